@@ -7,6 +7,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #define __STDC_WANT_IEC_60559_TYPES_EXT__
 #include <float.h>
@@ -55,6 +56,8 @@ extern "C"
 		ND_ERROR_INVALID_ARGUMENT,
 		ND_ERROR_INVALID_TYPE,     /* invalid node parent/child type */
 		ND_ERROR_INVALID_ELEMENTS, /* unexpected number of elements */
+		ND_ERROR_INVALID_DATA,     /* malformed binary data */
+		ND_ERROR_LIMIT_EXCEEDED,   /* binary data nested too deep, or too large */
 	} AcmErrorCode;
 
 	typedef enum AcmFileType
@@ -64,6 +67,19 @@ extern "C"
 		ACM_FILE_TYPE_UTF8,
 	} AcmFileType;
 
+	typedef enum AcmWriteFlags
+	{
+		ACM_WRITE_FLAG_NONE         = 0,
+		ACM_WRITE_FLAG_COMPACT      = 1 << 0, /* binary: varint lengths/counts and bit-packed integer arrays, utf8: all on one line, without indentation or comments */
+		ACM_WRITE_FLAG_COMPRESS     = 1 << 1, /* binary: compressed in independent blocks */
+		ACM_WRITE_FLAG_STRING_TABLE = 1 << 2, /* binary: names and repeated string values are shared via a table */
+		ACM_WRITE_FLAG_TABLES       = 1 << 3, /* binary: arrays of objects with the same fields written as a schema and rows */
+		ACM_WRITE_FLAG_CANONICAL    = 1 << 4, /* both: fields ordered by name and values normalised, so equal trees give identical output */
+		ACM_WRITE_FLAG_HALF_FLOAT   = 1 << 5, /* binary: float arrays stored as 16-bit floats (lossy) */
+		ACM_WRITE_FLAG_FIXED_16     = 1 << 6, /* binary: float arrays stored as 16-bit steps between their smallest and largest values (lossy) */
+		ACM_WRITE_FLAG_FIXED_8      = 1 << 7, /* binary: float arrays stored as 8-bit steps between their smallest and largest values (lossy) */
+	} AcmWriteFlags;
+
 	// Mind changing the order of the below,
 	// as you will break binary compatibility when doing so!!
 	typedef enum AcmPropertyType
@@ -95,10 +111,12 @@ extern "C"
 
 	const char  *acm_get_error_message( void );
 	AcmErrorCode acm_get_error( void );
+	uint64_t     acm_get_error_offset( void ); /* offset into the file of the last binary decoding error, if any */
 
 	unsigned int acm_get_num_of_children( const AcmBranch *self ); /* only valid for object/array */
 	AcmBranch   *acm_get_first_child( AcmBranch *self );
 	AcmBranch   *acm_get_child_by_name( AcmBranch *self, const char *name ); /* only valid for object */
+	AcmBranch   *acm_get_child_by_path( AcmBranch *self, const char *path ); /* e.g. "a.b.2.c", indices for arrays */
 	AcmBranch   *acm_get_parent( AcmBranch *self );
 	AcmBranch   *acm_get_next_child( AcmBranch *node );
 
@@ -142,19 +160,119 @@ extern "C"
 #define ACM_GET_INT( VAR, ROOT, NAME, FALLBACK )  ( typeof( ( VAR ) ) ) acm_get_int( ( ROOT ), ( NAME ), ( FALLBACK ) )
 #define ACM_GET_UINT( VAR, ROOT, NAME, FALLBACK ) ( typeof( ( VAR ) ) ) acm_get_uint( ( ROOT ), ( NAME ), ( FALLBACK ) )
 
+	typedef struct AcmFieldRequest
+	{
+		const char     *name;
+		AcmPropertyType type; /* type to convert into, see acm_get_many */
+		void           *dest;
+		bool           *found; /* optional */
+	} AcmFieldRequest;
+
+	/**
+	 * Fetches multiple children from an object in a single pass over its children.
+	 * The destination is left untouched for any field that's missing, so defaults
+	 * can be set beforehand. Destination types follow the requested type;
+	 * string fields give a const char * into the tree, float16 fields give the raw
+	 * binary16 value and object/array fields give the AcmBranch *. Passing
+	 * ACM_PROPERTY_TYPE_INVALID gives the AcmBranch * of whatever type was found.
+	 *
+	 * @param root		Object to fetch the fields from.
+	 * @param fields	List of fields to fetch.
+	 * @param numFields	Number of fields in the list.
+	 * @return			Number of fields that were found.
+	 */
+	unsigned int acm_get_many( AcmBranch *root, const AcmFieldRequest *fields, unsigned int numFields );
+
 	AcmErrorCode acm_branch_get_bool_array( AcmBranch *self, bool *buf, unsigned int numElements );
 	AcmErrorCode acm_branch_get_string_array( AcmBranch *self, char **buf, unsigned int numElements );
+	AcmErrorCode acm_branch_get_int8_array( AcmBranch *self, int8_t *buf, unsigned int numElements );
 	AcmErrorCode acm_branch_get_int16_array( AcmBranch *self, int16_t *buf, unsigned int numElements );
 	AcmErrorCode acm_branch_get_int32_array( AcmBranch *self, int32_t *buf, unsigned int numElements );
 	AcmErrorCode acm_branch_get_uint32_array( AcmBranch *self, uint32_t *buf, unsigned int numElements );
 	AcmErrorCode acm_branch_get_float32_array( AcmBranch *self, float *buf, unsigned int numElements );
 	AcmErrorCode acm_branch_get_float64_array( AcmBranch *self, double *buf, unsigned int numElements );
 
+	/**
+	 * Arrays of scalar types are stored in a single native buffer. These return
+	 * a pointer directly into that buffer, without copying or conversion.
+	 * The pointer remains valid until the array is modified or destroyed.
+	 * Float16 arrays are returned as raw binary16 values.
+	 *
+	 * @param self			Array branch.
+	 * @param numElements	Returns the number of elements.
+	 * @return				Pointer to the elements, null if empty or of the wrong type.
+	 */
+	const bool     *acm_branch_view_bool( const AcmBranch *self, unsigned int *numElements );
+	const uint16_t *acm_branch_view_f16( const AcmBranch *self, unsigned int *numElements );
+	const float    *acm_branch_view_f32( const AcmBranch *self, unsigned int *numElements );
+	const double   *acm_branch_view_f64( const AcmBranch *self, unsigned int *numElements );
+	const int8_t   *acm_branch_view_i8( const AcmBranch *self, unsigned int *numElements );
+	const int16_t  *acm_branch_view_i16( const AcmBranch *self, unsigned int *numElements );
+	const int32_t  *acm_branch_view_i32( const AcmBranch *self, unsigned int *numElements );
+	const int64_t  *acm_branch_view_i64( const AcmBranch *self, unsigned int *numElements );
+	const uint8_t  *acm_branch_view_ui8( const AcmBranch *self, unsigned int *numElements );
+	const uint16_t *acm_branch_view_ui16( const AcmBranch *self, unsigned int *numElements );
+	const uint32_t *acm_branch_view_ui32( const AcmBranch *self, unsigned int *numElements );
+	const uint64_t *acm_branch_view_ui64( const AcmBranch *self, unsigned int *numElements );
+
 	int16_t *acm_get_array_i16( AcmBranch *branch, const char *name, int16_t *destination, unsigned int numElements );
 	float   *acm_get_array_f32( AcmBranch *branch, const char *name, float *destination, uint32_t numElements );
 
 	AcmBranch *acm_linear_lookup( AcmBranch *root, const char *name );
 
+	typedef struct AcmArrayIndex AcmArrayIndex;
+
+	/**
+	 * Builds a hash index over an array of objects, keyed on the value of the
+	 * given field of each element. The index is kept up to date as elements or
+	 * their fields are pushed, set or destroyed. Values are compared by their
+	 * text, so for numeric fields pass the value as it would be written out.
+	 *
+	 * @param array		Array of objects to index.
+	 * @param fieldName	Name of the field to key on, i.e. "id".
+	 * @return			The new index, null on failure.
+	 */
+	AcmArrayIndex *acm_array_index_build( AcmBranch *array, const char *fieldName );
+	/**
+	 * Returns the element whose field matches the given value. If multiple
+	 * elements share the value, the earliest indexed is returned.
+	 * Returns null if there's no match, or the array has been destroyed, or
+	 * the index was dropped after failing to allocate room for a new entry.
+	 */
+	AcmBranch   *acm_array_index_find( const AcmArrayIndex *self, const char *value );
+	unsigned int acm_array_index_get_num_entries( const AcmArrayIndex *self );
+	void         acm_array_index_destroy( AcmArrayIndex *self );
+
+	typedef struct AcmColumn
+	{
+		const char     *name;
+		AcmPropertyType type;     /* type of the first occurrence of the field */
+		void           *data;     /* numRows native values; const char * views into the tree for strings */
+		uint8_t        *presence; /* bit per row, set if the row provided the field */
+	} AcmColumn;
+
+	typedef struct AcmColumnTable
+	{
+		unsigned int numRows;
+		unsigned int numColumns;
+		AcmColumn   *columns;
+	} AcmColumnTable;
+
+	/**
+	 * Converts an array of objects into a structure-of-arrays, with a contiguous
+	 * buffer per field, in a single pass over the array. Only scalar and string
+	 * fields are exported; nested objects and arrays are skipped. String columns
+	 * point into the tree, so are only valid for as long as the tree is.
+	 *
+	 * @param array	Array of objects to export.
+	 * @return		The new table, null on failure.
+	 */
+	AcmColumnTable  *acm_array_export_columns( AcmBranch *array );
+	const AcmColumn *acm_column_table_get( const AcmColumnTable *self, const char *name );
+	void             acm_column_table_destroy( AcmColumnTable *self );
+
+#define ACM_COLUMN_HAS_ROW( COLUMN, ROW ) ( ( ( COLUMN )->presence[ ( ROW ) / 8 ] >> ( ( ROW ) % 8 ) ) & 1 )
+
 	AcmBranch *acm_push_branch( AcmBranch *parent, AcmBranch *child );
 	AcmBranch *acm_push_object( AcmBranch *node, const char *name );
 	AcmBranch *acm_push_string( AcmBranch *parent, const char *name, const char *var, bool conditional );
@@ -181,6 +299,71 @@ extern "C"
 #endif
 	AcmBranch *acm_push_array_f32( AcmBranch *parent, const char *name, const float *array, unsigned int numElements );
 
+	typedef struct AcmStructDescriptor AcmStructDescriptor;
+
+	/**
+	 * Describes how a struct member maps onto a branch.
+	 *  - Scalar types are read/written directly; bool members are expected to be bool.
+	 *  - Strings are either a char buffer of arrayCount bytes, or if arrayCount is 0,
+	 *    a const char * which points into the tree on read.
+	 *  - Other scalar types with an arrayCount are fixed-size arrays.
+	 *  - Objects use the nested descriptor; with an arrayCount, an array of structs.
+	 *  - If provided, the hooks are used instead. Deserialize is passed the member and
+	 *    the matching branch, serialize the member and the object to push onto.
+	 */
+	typedef struct AcmFieldDescriptor
+	{
+		const char                *name;
+		AcmPropertyType            type;
+		size_t                     offset;
+		unsigned int               arrayCount;
+		const AcmStructDescriptor *nested;
+		AcmDeserializeFunction     deserialize;
+		AcmSerializeFunction       serialize;
+	} AcmFieldDescriptor;
+
+	struct AcmStructDescriptor
+	{
+		const AcmFieldDescriptor *fields;
+		unsigned int              numFields;
+		size_t                    size; /* required for arrays of structs */
+	};
+
+#define ACM_MEMBER_COUNT( STRUCT, MEMBER ) ( sizeof( ( ( STRUCT * ) 0 )->MEMBER ) / sizeof( ( ( STRUCT * ) 0 )->MEMBER[ 0 ] ) )
+
+#define ACM_FIELD( STRUCT, MEMBER, TYPE )            { #MEMBER, ( TYPE ), offsetof( STRUCT, MEMBER ), 0, NULL, NULL, NULL }
+#define ACM_FIELD_ARRAY( STRUCT, MEMBER, TYPE )      { #MEMBER, ( TYPE ), offsetof( STRUCT, MEMBER ), ACM_MEMBER_COUNT( STRUCT, MEMBER ), NULL, NULL, NULL }
+#define ACM_FIELD_STRING( STRUCT, MEMBER )           ACM_FIELD_ARRAY( STRUCT, MEMBER, ACM_PROPERTY_TYPE_STRING )
+#define ACM_FIELD_OBJECT( STRUCT, MEMBER, DESC )     { #MEMBER, ACM_PROPERTY_TYPE_OBJECT, offsetof( STRUCT, MEMBER ), 0, ( DESC ), NULL, NULL }
+#define ACM_FIELD_OBJECT_ARRAY( STRUCT, MEMBER, DESC ) \
+	{ #MEMBER, ACM_PROPERTY_TYPE_OBJECT, offsetof( STRUCT, MEMBER ), ACM_MEMBER_COUNT( STRUCT, MEMBER ), ( DESC ), NULL, NULL }
+#define ACM_FIELD_CUSTOM( STRUCT, MEMBER, READ, WRITE ) \
+	{ #MEMBER, ACM_PROPERTY_TYPE_INVALID, offsetof( STRUCT, MEMBER ), 0, NULL, ( READ ), ( WRITE ) }
+
+#define ACM_STRUCT_DESCRIPTOR( STRUCT, FIELDS ) { ( FIELDS ), sizeof( FIELDS ) / sizeof( *( FIELDS ) ), sizeof( STRUCT ) }
+
+	/**
+	 * Reads the given object into a struct, via its descriptor. All fields are
+	 * matched in a single pass over the object's children. Members are left
+	 * untouched if the field is missing.
+	 *
+	 * @param root			Object to read from.
+	 * @param descriptor	Descriptor for the struct.
+	 * @param dst			Struct to read into.
+	 * @return				Number of fields that were found.
+	 */
+	unsigned int acm_bind_read( AcmBranch *root, const AcmStructDescriptor *descriptor, void *dst );
+	/**
+	 * Writes the given struct out as a new object, via its descriptor.
+	 *
+	 * @param parent		Parent to push onto, can be null.
+	 * @param name			Name of the new object.
+	 * @param descriptor	Descriptor for the struct.
+	 * @param src			Struct to write out.
+	 * @return				The new object, null on failure.
+	 */
+	AcmBranch *acm_bind_write( AcmBranch *parent, const char *name, const AcmStructDescriptor *descriptor, const void *src );
+
 	bool acm_set_variable( AcmBranch *root, const char *name, const char *value, AcmPropertyType type, bool createOnFail );
 
 	/**
@@ -192,7 +375,9 @@ extern "C"
 	AcmBranch *acm_copy_branch( AcmBranch *node );
 
 	/**
-	 * Destroy the given branch and all its children.
+	 * Destroy the given branch and all its children. An element of a scalar
+	 * array that was loaded from a mapped file needs the array copied out
+	 * first, so if that fails it stays where it is and the error is set.
 	 *
 	 * @param node	Pointer to the branch you want to destroy.
 	 */
@@ -218,6 +403,112 @@ extern "C"
 	 */
 	AcmBranch *acm_load_file( const char *path, const char *objectType );
 
+	/**
+	 * Load a file via the given path, mapping it into memory rather than reading
+	 * it. For binary files, names and string values point straight into the
+	 * mapping, which is kept until the returned tree is destroyed.
+	 * Text files are loaded as normal.
+	 *
+	 * @param path 			Path to load from.
+	 * @param objectType 	Expected root object type, can be left null.
+	 * @return 				Pointer to the root branch. Null on failure.
+	 */
+	AcmBranch *acm_load_file_mapped( const char *path, const char *objectType );
+
+	/**
+	 * Load a single branch from a buffer, addressed by a path relative to
+	 * the root, e.g. "a.b.c" (array elements are addressed by their index).
+	 * For binary v3 onwards only the requested branch is decoded; older
+	 * formats fall back to loading the whole tree.
+	 *
+	 * @param buf 		Pointer to buffer.
+	 * @param bufSize
+	 * @param path 		Path to the branch, or null for the root.
+	 * @return 			Pointer to the branch, owned by the caller. Null on failure.
+	 */
+	AcmBranch *acm_load_branch_from_memory( const void *buf, size_t bufSize, const char *path );
+
+	/**
+	 * Load a single branch from the given file, see acm_load_branch_from_memory.
+	 * For binary v3 onwards, the file is only read where needed to reach the branch.
+	 *
+	 * @param path 			Path to load from.
+	 * @param branchPath 	Path to the branch, or null for the root.
+	 * @return 				Pointer to the branch, owned by the caller. Null on failure.
+	 */
+	AcmBranch *acm_load_file_branch( const char *path, const char *branchPath );
+
+	/**
+	 * Overwrites the value of a fixed-size scalar (integer, float or bool)
+	 * in a binary buffer, such as a file mapped for writing, without
+	 * decoding or rewriting anything else. The value is parsed as the type
+	 * the scalar already has. Only uncompressed files from v3 onwards can
+	 * be patched, and not elements of bit-packed arrays or tables.
+	 *
+	 * @param buf 		Pointer to buffer.
+	 * @param bufSize
+	 * @param path 		Path to the scalar, see acm_load_branch_from_memory.
+	 * @param value 	New value, as it would be written in text.
+	 * @return 			True on success, false on failure.
+	 */
+	bool acm_patch_memory( void *buf, size_t bufSize, const char *path, const char *value );
+
+	/**
+	 * Overwrites the value of a fixed-size scalar in the given file, see
+	 * acm_patch_memory. Only the bytes leading to the scalar are read,
+	 * and only the value itself is written.
+	 *
+	 * @param path 			Path of the file to patch.
+	 * @param branchPath 	Path to the scalar.
+	 * @param value 		New value, as it would be written in text.
+	 * @param sync 			Flush the change through to the disk before returning.
+	 * @return 				True on success, false on failure.
+	 */
+	bool acm_patch_file( const char *path, const char *branchPath, const char *value, bool sync );
+
+	typedef struct AcmBinReader AcmBinReader;
+
+	typedef enum AcmBinReaderEvent
+	{
+		ACM_BINREADER_EVENT_ERROR = -1,
+		ACM_BINREADER_EVENT_EOF,   /* the root has been read, there's nothing more to come */
+		ACM_BINREADER_EVENT_BEGIN, /* start of an object or array, its children follow */
+		ACM_BINREADER_EVENT_VALUE, /* a string or scalar, inc. the elements of scalar arrays */
+		ACM_BINREADER_EVENT_END,   /* end of the object or array that last began */
+	} AcmBinReaderEvent;
+
+	/**
+	 * Opens a pull reader over a binary file, which is read incrementally
+	 * through a small buffer, rather than being loaded in whole. Memory use
+	 * stays the same regardless of the size of the file, save for the string
+	 * table, if it has one. Compressed files need the source to be seekable.
+	 * The reader doesn't take ownership of the file.
+	 *
+	 * @param file 	File to read from, positioned at the start of the header.
+	 * @return 		The new reader, null on failure.
+	 */
+	AcmBinReader *acm_binreader_open_file( FILE *file );
+	AcmBinReader *acm_binreader_open_fd( int fd );
+	void          acm_binreader_close( AcmBinReader *self );
+
+	/**
+	 * Reads up to the next event. The name, type and value returned by the
+	 * getters belong to that event, and are only valid until the next call.
+	 * Failures leave the error set, inc. the offset, and all further calls
+	 * return ACM_BINREADER_EVENT_ERROR.
+	 *
+	 * @param self 	Reader instance.
+	 * @return 		Type of event.
+	 */
+	AcmBinReaderEvent acm_binreader_next( AcmBinReader *self );
+
+	const char     *acm_binreader_get_name( const AcmBinReader *self );         /* null if unnamed, or for END */
+	AcmPropertyType acm_binreader_get_type( const AcmBinReader *self );         /* type of the node */
+	AcmPropertyType acm_binreader_get_child_type( const AcmBinReader *self );   /* type of the elements, for arrays */
+	unsigned int    acm_binreader_get_num_children( const AcmBinReader *self ); /* for BEGIN */
+	unsigned int    acm_binreader_get_depth( const AcmBinReader *self );        /* number of objects/arrays currently open */
+	const char     *acm_binreader_get_value( const AcmBinReader *self, uint16_t *size ); /* for VALUE, same as acm_branch_get_value */
+
 	/**
 	 * Writes the given branch to the destination.
 	 *
@@ -228,6 +519,208 @@ extern "C"
 	 */
 	bool acm_write_file( const char *path, AcmBranch *root, AcmFileType fileType );
 
+	/**
+	 * Writes the given branch to the destination, see acm_write_file.
+	 * Binary files written with ACM_WRITE_FLAG_COMPACT can't be read by
+	 * versions that predate it, though compact utf8 files can.
+	 *
+	 * ACM_WRITE_FLAG_FIXED_8, ACM_WRITE_FLAG_FIXED_16 and
+	 * ACM_WRITE_FLAG_HALF_FLOAT trade precision for size on float32/float64
+	 * arrays, which are decoded back to their own type on load. If more than
+	 * one is given, each array takes the smallest whose worst case error is
+	 * within the tolerance (see acm_set_quantization_tolerance), fixed point
+	 * ahead of half floats. Fixed point needs every value to be finite, and
+	 * half floats need them within +/-65504, otherwise the array is written
+	 * at full precision, as are arrays of fewer than 8 elements.
+	 *
+	 * @param path		Output location.
+	 * @param root 		Branch to serialise.
+	 * @param fileType 	Type of file to write out (either binary / utf8).
+	 * @param flags 	Combination of AcmWriteFlags.
+	 * @return 			True on success, false on failure.
+	 */
+	bool acm_write_file_ex( const char *path, AcmBranch *root, AcmFileType fileType, unsigned int flags );
+
+	/**
+	 * Sets how far the values of a quantized float array may end up from
+	 * where they started, as a fraction of the largest magnitude in the
+	 * array; 0.001 by default. Applies to writes started after it's set.
+	 */
+	void acm_set_quantization_tolerance( double tolerance );
+
+	/* returns the number of bytes taken, anything less than size is treated as a failure */
+	typedef size_t ( *AcmWriteCallback )( const void *buf, size_t size, void *user );
+
+	/**
+	 * Writes the given branch through the callback, see acm_write_file_ex.
+	 * Output is gathered into large blocks first, so the callback is only
+	 * called a handful of times.
+	 *
+	 * @param root 		Branch to serialise.
+	 * @param fileType 	Type of file to write out (either binary / utf8).
+	 * @param flags 	Combination of AcmWriteFlags.
+	 * @param write 	Called with each block of output, in order.
+	 * @param user 		Passed through to the callback.
+	 * @return 			True on success, false on failure.
+	 */
+	bool acm_write_to_sink( AcmBranch *root, AcmFileType fileType, unsigned int flags, AcmWriteCallback write, void *user );
+
+	/**
+	 * Writes the given branch into a buffer, see acm_write_file_ex.
+	 * The buffer is null-terminated (not included in the size), and
+	 * should be freed with ACM_DELETE.
+	 *
+	 * @param root 		Branch to serialise.
+	 * @param fileType 	Type of file to write out (either binary / utf8).
+	 * @param flags 	Combination of AcmWriteFlags.
+	 * @param size 		Number of bytes written, can be left null.
+	 * @return 			Buffer on success, null on failure.
+	 */
+	void *acm_write_to_memory( AcmBranch *root, AcmFileType fileType, unsigned int flags, size_t *size );
+
+	/**
+	 * Writes the given branch into a buffer provided by the caller, such as
+	 * a file mapped for writing, see acm_write_file_ex. Fails if it doesn't
+	 * fit; use acm_get_binary_size to find out how big it needs to be.
+	 *
+	 * @param root 		Branch to serialise.
+	 * @param fileType 	Type of file to write out (either binary / utf8).
+	 * @param flags 	Combination of AcmWriteFlags.
+	 * @param buf 		Destination.
+	 * @param bufSize
+	 * @param size 		Number of bytes written, can be left null.
+	 * @return 			True on success, false on failure.
+	 */
+	bool acm_write_to_buffer( AcmBranch *root, AcmFileType fileType, unsigned int flags, void *buf, size_t bufSize, size_t *size );
+
+	/**
+	 * Works out exactly how many bytes the given branch takes up as a binary
+	 * file, without writing anything. Compressed sizes can't be known until
+	 * the output's been compressed, so ACM_WRITE_FLAG_COMPRESS isn't allowed.
+	 *
+	 * @param root 		Branch to measure.
+	 * @param flags 	Combination of AcmWriteFlags.
+	 * @param size 		Size of the output.
+	 * @return 			True on success, false on failure.
+	 */
+	bool acm_get_binary_size( AcmBranch *root, unsigned int flags, uint64_t *size );
+
+	/**
+	 * Hashes the canonical binary form of the given branch (see
+	 * ACM_WRITE_FLAG_CANONICAL), so trees that only differ in the order
+	 * of their fields, or in how their values were written, hash the same.
+	 * Nothing is kept in memory beyond a canonical copy of the tree.
+	 *
+	 * @param root 		Branch to hash.
+	 * @param hash 		64-bit FNV-1a of the canonical form.
+	 * @return 			True on success, false on failure.
+	 */
+	bool acm_hash_branch( AcmBranch *root, uint64_t *hash );
+
+	/**
+	 * Limits the number of threads used to write out large trees, 0 to use
+	 * one per core (the default) or 1 to only ever use the calling thread.
+	 * Output is the same either way. Errors are tracked per thread, so any
+	 * number of documents can be loaded or saved on different threads.
+	 */
+	void acm_set_max_threads( unsigned int numThreads );
+
+	/**
+	 * Push writer, for writing out a document as it's generated rather than
+	 * building a tree for it first. Output matches acm_write_file, and only
+	 * the objects/arrays currently open are kept track of. Binary output is
+	 * written uncompressed, and can only go to a file or memory, as the size
+	 * of each object/array is filled in once it ends.
+	 *
+	 * Starts with the root, which is usually an object; names are ignored for
+	 * elements of arrays, which have to match the element type. Once anything
+	 * fails, so does everything else, and the error is kept for the close.
+	 */
+	typedef struct AcmWriter AcmWriter;
+
+	AcmWriter *acm_writer_open_file( const char *path, AcmFileType fileType );
+	AcmWriter *acm_writer_open_sink( AcmFileType fileType, AcmWriteCallback write, void *user ); /* utf8 only */
+	AcmWriter *acm_writer_open_memory( AcmFileType fileType );
+	bool       acm_writer_close( AcmWriter *self );                      /* false if anything failed, or the document is incomplete */
+	void      *acm_writer_close_memory( AcmWriter *self, size_t *size ); /* see acm_write_to_memory */
+
+	bool acm_writer_begin_object( AcmWriter *self, const char *name );
+	bool acm_writer_begin_array( AcmWriter *self, const char *name, AcmPropertyType childType );
+	bool acm_writer_end( AcmWriter *self );
+
+	bool acm_writer_write_string( AcmWriter *self, const char *name, const char *value );
+	bool acm_writer_write_bool( AcmWriter *self, const char *name, bool var );
+	bool acm_writer_write_i8( AcmWriter *self, const char *name, int8_t var );
+	bool acm_writer_write_ui8( AcmWriter *self, const char *name, uint8_t var );
+	bool acm_writer_write_i16( AcmWriter *self, const char *name, int16_t var );
+	bool acm_writer_write_ui16( AcmWriter *self, const char *name, uint16_t var );
+	bool acm_writer_write_i32( AcmWriter *self, const char *name, int32_t var );
+	bool acm_writer_write_ui32( AcmWriter *self, const char *name, uint32_t var );
+#ifdef ACM_SUPPORT_FLT16
+	bool acm_writer_write_f16( AcmWriter *self, const char *name, _Float16 var );
+#endif
+	bool acm_writer_write_f32( AcmWriter *self, const char *name, float var );
+	bool acm_writer_write_f64( AcmWriter *self, const char *name, double var );
+
+	bool acm_writer_write_array_string( AcmWriter *self, const char *name, const char **array, unsigned int numElements );
+	bool acm_writer_write_array_i16( AcmWriter *self, const char *name, const int16_t *array, unsigned int numElements );
+	bool acm_writer_write_array_i32( AcmWriter *self, const char *name, const int32_t *array, unsigned int numElements );
+	bool acm_writer_write_array_ui32( AcmWriter *self, const char *name, const uint32_t *array, unsigned int numElements );
+#ifdef ACM_SUPPORT_FLT16
+	bool acm_writer_write_array_f16( AcmWriter *self, const char *name, const _Float16 *array, unsigned int numElements );
+#endif
+	bool acm_writer_write_array_f32( AcmWriter *self, const char *name, const float *array, unsigned int numElements );
+
+	/**
+	 * Converts a file from one format to another without loading it into a
+	 * tree, so memory use stays the same however large the file is. The source
+	 * can be either format, and is read as it's converted; text goes through
+	 * the same parser as acm_load_file, so anything it would skip with a
+	 * warning is skipped here too. Output goes through the push writer above,
+	 * so binary output is uncompressed.
+	 */
+	bool acm_transcode_file( const char *srcPath, const char *dstPath, AcmFileType dstType );
+
+	/**
+	 * Journaled documents, for saving a large tree that changes a little at
+	 * a time. The document is kept as a binary base file at the given path,
+	 * with a log beside it (path.log). Each commit only appends the branches
+	 * that have changed since the last; branches are saved whole, and
+	 * removing anything saves the whole of whatever it was removed from.
+	 *
+	 * Opening loads the base and replays the log on top. Once the log's grown
+	 * larger than the base, commits start folding it back into a new base on
+	 * another thread, which can also be started early via compact. A commit
+	 * cut short by a crash is simply ignored the next time it's opened.
+	 *
+	 * The journal doesn't own the tree, which has to outlive it, and closing
+	 * waits for any compaction but doesn't commit anything.
+	 */
+	typedef struct AcmJournal AcmJournal;
+
+	AcmJournal *acm_journal_create( const char *path, AcmBranch *root ); /* writes out root as the base, replacing anything that's there */
+	AcmJournal *acm_journal_open( const char *path, AcmBranch **root );  /* root is set to the loaded tree, which the caller then owns */
+	bool        acm_journal_commit( AcmJournal *self );
+	bool        acm_journal_compact( AcmJournal *self );
+	bool        acm_journal_close( AcmJournal *self );
+
+	/**
+	 * Produces a diff that turns one document into another, made up of
+	 * branches to remove, insert or replace. Each branch's hash is kept until
+	 * something under it changes, so matching subtrees are skipped straight
+	 * away and diffing again after a few changes only visits what's changed.
+	 * That does mean diffing modifies both trees, so neither can be in use on
+	 * another thread at the time. The diff should be freed with ACM_DELETE.
+	 *
+	 * Applying checks that the diff was made from an identical document
+	 * and reads it in whole before changing anything. The ops are applied in
+	 * place, so branches they don't touch stay as they are, and if one doesn't
+	 * fit or the result doesn't match, everything is undone; anything the
+	 * diff had removed or replaced by then comes back as a copy.
+	 */
+	void *acm_diff( AcmBranch *from, AcmBranch *to, size_t *size );
+	bool  acm_diff_apply( AcmBranch *root, const void *diff, size_t size );
+
 	/**
 	 * Parse a null-terminated buffer.
 	 *
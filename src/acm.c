@@ -8,15 +8,11 @@
 #include "acm_private.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <inttypes.h>
+#include <math.h>
 
-#define ACM_FORMAT_UTF8_HEADER "node.utf8"
-
-#define ACM_FORMAT_BINARY_HEADER   "node.bin\n" // original format w/ no versioning support (defaults to 1)
-#define ACM_FORMAT_BINARY_HEADER_2 "node.binx\n"// new format w/ versioning support
-#define ACM_FORMAT_BINARY_VERSION  2
-
-static const char *string_for_property_type( AcmPropertyType propertyType )
+const char *acm_string_for_property_type_( AcmPropertyType propertyType )
 {
 	const char *propToStr[ ACM_MAX_PROPERTY_TYPES ] = {
 	        // Special types
@@ -46,34 +42,68 @@ static const char *string_for_property_type( AcmPropertyType propertyType )
 	return propToStr[ propertyType ];
 }
 
-static char         nlErrorMsg[ 4096 ];
-static AcmErrorCode nlErrorType = ND_ERROR_SUCCESS;
+// errors are per thread, so documents can be loaded and saved on several at once
+#if defined( _MSC_VER ) && !defined( __clang__ )
+#	define ACM_THREAD_LOCAL __declspec( thread )
+#else
+#	define ACM_THREAD_LOCAL _Thread_local
+#endif
+
+static ACM_THREAD_LOCAL char         nlErrorMsg[ 4096 ];
+static ACM_THREAD_LOCAL AcmErrorCode nlErrorType   = ND_ERROR_SUCCESS;
+static ACM_THREAD_LOCAL uint64_t     nlErrorOffset = 0;
 static void         clear_error_message( void )
 {
-	*nlErrorMsg = '\0';
-	nlErrorType = ND_ERROR_SUCCESS;
+	*nlErrorMsg   = '\0';
+	nlErrorType   = ND_ERROR_SUCCESS;
+	nlErrorOffset = 0;
 }
 
-static void set_error_message( AcmErrorCode type, const char *msg, ... )
+static void set_error_message_v( AcmErrorCode type, const char *msg, va_list args )
 {
 	clear_error_message();
 
 	nlErrorType = type;
 
-	va_list args;
-	va_start( args, msg );
 	vsnprintf( nlErrorMsg, sizeof( nlErrorMsg ), msg, args );
 	Warning( "NLERR: %s\n", nlErrorMsg );
+}
 
+static void set_error_message( AcmErrorCode type, const char *msg, ... )
+{
+	va_list args;
+	va_start( args, msg );
+	set_error_message_v( type, msg, args );
+	va_end( args );
+}
+
+void acm_set_error_message_( AcmErrorCode type, const char *msg, ... )
+{
+	va_list args;
+	va_start( args, msg );
+	set_error_message_v( type, msg, args );
 	va_end( args );
 }
 
+void acm_set_error_offset_( uint64_t offset )
+{
+	nlErrorOffset = offset;
+}
+
 const char  *acm_get_error_message( void ) { return nlErrorMsg; }
 AcmErrorCode acm_get_error( void ) { return nlErrorType; }
+uint64_t     acm_get_error_offset( void ) { return nlErrorOffset; }
 
-static AcmString *alloc_var_string( const char *string, AcmString *dst )
+AcmString *acm_alloc_var_string_( const char *string, AcmString *dst )
 {
-	dst->bufSize = ( uint16_t ) strlen( string ) + 1;
+	size_t length = strlen( string ) + 1;
+	if ( length > UINT16_MAX )
+	{
+		set_error_message( ND_ERROR_LIMIT_EXCEEDED, "string is too long (%zu bytes)", length );
+		return NULL;
+	}
+
+	dst->bufSize = ( uint16_t ) length;
 
 	dst->buf = ACM_NEW_( char, dst->bufSize );
 	if ( dst->buf == NULL )
@@ -87,265 +117,892 @@ static AcmString *alloc_var_string( const char *string, AcmString *dst )
 	return dst;
 }
 
-unsigned int acm_get_num_of_children( const AcmBranch *self )
-{
-	return self->numChildren;
-}
+/******************************************/
+/** Packed Arrays **/
 
-AcmBranch *acm_get_first_child( AcmBranch *self )
+size_t acm_get_type_size_( AcmPropertyType type )
 {
-	return self->children.start;
+	switch ( type )
+	{
+		default:
+			return 0;
+		case ACM_PROPERTY_TYPE_BOOL:
+		case ND_PROPERTY_INT8:
+		case ND_PROPERTY_UI8:
+			return sizeof( uint8_t );
+		case ACM_PROPERTY_TYPE_FLOAT16:
+		case ND_PROPERTY_INT16:
+		case ND_PROPERTY_UI16:
+			return sizeof( uint16_t );
+		case ACM_PROPERTY_TYPE_FLOAT32:
+		case ND_PROPERTY_INT32:
+		case ND_PROPERTY_UI32:
+			return sizeof( uint32_t );
+		case ACM_PROPERTY_TYPE_FLOAT64:
+		case ND_PROPERTY_INT64:
+		case ND_PROPERTY_UI64:
+			return sizeof( uint64_t );
+	}
 }
 
-AcmBranch *acm_get_next_child( AcmBranch *node )
+bool acm_is_packed_array_( const AcmBranch *self )
 {
-	return node->next;
+	return self->type == ACM_PROPERTY_TYPE_ARRAY && acm_get_type_size_( self->childType ) > 0;
 }
 
-AcmBranch *acm_get_child_by_name( AcmBranch *self, const char *name )
+float acm_half_to_float_( uint16_t h )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_OBJECT )
+	uint32_t sign     = ( uint32_t ) ( h & 0x8000 ) << 16;
+	uint32_t exponent = ( h >> 10 ) & 0x1F;
+	uint32_t mantissa = h & 0x3FF;
+
+	uint32_t bits;
+	if ( exponent == 0x1F )
 	{
-		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to get child from an invalid node type!\n" );
-		return NULL;
+		bits = sign | 0x7F800000 | ( mantissa << 13 );
 	}
-
-	AcmBranch *child = acm_get_first_child( self );
-	while ( child != NULL )
+	else if ( exponent != 0 )
 	{
-		if ( strcmp( name, child->name.buf ) == 0 )
+		bits = sign | ( ( exponent + 112 ) << 23 ) | ( mantissa << 13 );
+	}
+	else if ( mantissa != 0 )
+	{
+		// subnormal, so normalise it
+		exponent = 113;
+		while ( ( mantissa & 0x400 ) == 0 )
 		{
-			return child;
+			mantissa <<= 1;
+			exponent--;
 		}
-
-		child = acm_get_next_child( child );
+		bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3FF ) << 13 );
 	}
-
-	return NULL;
-}
-
-static const AcmString *get_value_by_name( AcmBranch *root, const char *name )
-{
-	const AcmBranch *field = acm_get_child_by_name( root, name );
-	if ( field == NULL )
+	else
 	{
-		return NULL;
+		bits = sign;
 	}
 
-	return &field->data;
-}
-
-AcmBranch *acm_get_parent( AcmBranch *self )
-{
-	return self->parent;
+	float f;
+	memcpy( &f, &bits, sizeof( float ) );
+	return f;
 }
 
-const char *acm_branch_get_name( const AcmBranch *self )
+uint16_t acm_float_to_half_( float f )
 {
-	return self->name.buf;
-}
+	uint32_t bits;
+	memcpy( &bits, &f, sizeof( uint32_t ) );
 
-AcmPropertyType acm_branch_get_type( const AcmBranch *self )
-{
-	return self->type;
-}
+	uint16_t sign     = ( bits >> 16 ) & 0x8000;
+	int      exponent = ( int ) ( ( bits >> 23 ) & 0xFF ) - 112;
+	uint32_t mantissa = bits & 0x7FFFFF;
 
-const char *acm_branch_get_value( const AcmBranch *self, uint16_t *size )
-{
-	if ( size != NULL )
+	if ( ( ( bits >> 23 ) & 0xFF ) == 0xFF )
 	{
-		*size = self->data.bufSize;
+		// nans are quietened and keep the top of their payload, as F16C does
+		return sign | 0x7C00 | ( mantissa != 0 ? 0x200 | ( mantissa >> 13 ) : 0 );
+	}
+	if ( exponent >= 0x1F )
+	{
+		return sign | 0x7C00;
 	}
-	return self->data.buf;
-}
-
-AcmErrorCode acm_branch_get_string( const AcmBranch *self, char *dest, size_t length )
-{
-	//TODO: why isn't this just returning the buf!?
-	//		if we can resolve this, it'll negate the need for get_value
-	if ( self->type != ACM_PROPERTY_TYPE_STRING ) return ND_ERROR_INVALID_TYPE;
-	snprintf( dest, length, "%s", self->data.buf );
-	return ND_ERROR_SUCCESS;
-}
-
-AcmErrorCode acm_branch_get_bool( const AcmBranch *self, bool *dest )
-{
-	if ( self->type != ACM_PROPERTY_TYPE_BOOL ) return ND_ERROR_INVALID_TYPE;
 
-	if ( ( strcmp( self->data.buf, "true" ) == 0 ) || ( self->data.buf[ 0 ] == '1' && self->data.buf[ 1 ] == '\0' ) )
+	// round to nearest, ties to even
+	uint32_t half, remainder, midpoint;
+	if ( exponent <= 0 )
 	{
-		*dest = true;
-		return ND_ERROR_SUCCESS;
+		if ( exponent < -10 )
+		{
+			return sign;
+		}
+
+		mantissa |= 0x800000;
+		unsigned int shift = 14 - exponent;
+		half               = mantissa >> shift;
+		remainder          = mantissa & ( ( 1U << shift ) - 1 );
+		midpoint           = 1U << ( shift - 1 );
 	}
-	if ( ( strcmp( self->data.buf, "false" ) == 0 ) || ( self->data.buf[ 0 ] == '0' && self->data.buf[ 1 ] == '\0' ) )
+	else
 	{
-		*dest = false;
-		return ND_ERROR_SUCCESS;
+		half      = ( ( uint32_t ) exponent << 10 ) | ( mantissa >> 13 );
+		remainder = mantissa & 0x1FFF;
+		midpoint  = 0x1000;
 	}
 
-	set_error_message( ND_ERROR_INVALID_ARGUMENT, "invalid data passed from var" );
-	return ND_ERROR_INVALID_ARGUMENT;
-}
-
-#ifdef ACM_SUPPORT_FLT16
-AcmErrorCode acm_branch_get_float16( const AcmBranch *self, _Float16 *dest )
-{
-	if ( self->type != ACM_PROPERTY_TYPE_FLOAT16 ) return ND_ERROR_INVALID_TYPE;
-	*dest = strtof( self->data.buf, NULL );
-	return ND_ERROR_SUCCESS;
-}
-#endif
+	if ( remainder > midpoint || ( remainder == midpoint && ( half & 1 ) ) )
+	{
+		half++;
+	}
 
-AcmErrorCode acm_branch_get_float32( const AcmBranch *self, float *dest )
-{
-	if ( self->type != ACM_PROPERTY_TYPE_FLOAT32 ) return ND_ERROR_INVALID_TYPE;
-	*dest = strtof( self->data.buf, NULL );
-	return ND_ERROR_SUCCESS;
+	return sign | ( uint16_t ) half;
 }
 
-AcmErrorCode acm_branch_get_float64( const AcmBranch *self, double *dest )
+/**
+ * Writes out the shortest representation of the given float
+ * that still reads back to the same value.
+ */
+static void format_float( char *dst, size_t size, double v, AcmPropertyType type )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_FLOAT64 ) return ND_ERROR_INVALID_TYPE;
-	*dest = strtod( self->data.buf, NULL );
-	return ND_ERROR_SUCCESS;
-}
+	int minPrecision, maxPrecision;
+	switch ( type )
+	{
+		case ACM_PROPERTY_TYPE_FLOAT16:
+			minPrecision = 3, maxPrecision = 5;
+			break;
+		case ACM_PROPERTY_TYPE_FLOAT32:
+			minPrecision = 6, maxPrecision = 9;
+			break;
+		default:
+			minPrecision = 15, maxPrecision = 17;
+			break;
+	}
 
-AcmErrorCode acm_branch_get_int8( const AcmBranch *self, int8_t *dest )
-{
-	if ( self->type != ND_PROPERTY_INT8 ) return ND_ERROR_INVALID_TYPE;
-	*dest = ( int8_t ) strtol( self->data.buf, NULL, 10 );
-	return ND_ERROR_SUCCESS;
-}
+	for ( int precision = minPrecision; precision <= maxPrecision; ++precision )
+	{
+		snprintf( dst, size, "%.*g", precision, v );
 
-AcmErrorCode acm_branch_get_int16( const AcmBranch *self, int16_t *dest )
-{
-	if ( self->type != ND_PROPERTY_INT16 ) return ND_ERROR_INVALID_TYPE;
-	*dest = ( int16_t ) strtol( self->data.buf, NULL, 10 );
-	return ND_ERROR_SUCCESS;
-}
+		bool exact;
+		if ( type == ACM_PROPERTY_TYPE_FLOAT16 )
+		{
+			exact = acm_float_to_half_( strtof( dst, NULL ) ) == acm_float_to_half_( ( float ) v );
+		}
+		else if ( type == ACM_PROPERTY_TYPE_FLOAT32 )
+		{
+			exact = strtof( dst, NULL ) == ( float ) v;
+		}
+		else
+		{
+			exact = strtod( dst, NULL ) == v;
+		}
 
-AcmErrorCode acm_branch_get_int32( const AcmBranch *self, int32_t *dest )
-{
-	if ( self->type != ND_PROPERTY_INT32 ) return ND_ERROR_INVALID_TYPE;
-	*dest = ( int32_t ) strtol( self->data.buf, NULL, 10 );
-	return ND_ERROR_SUCCESS;
+		if ( exact )
+		{
+			break;
+		}
+	}
 }
 
-AcmErrorCode acm_branch_get_int64( const AcmBranch *self, int64_t *dest )
+void acm_format_value_( AcmPropertyType type, const void *src, char *dst, size_t size )
 {
-	if ( self->type != ND_PROPERTY_INT64 ) return ND_ERROR_INVALID_TYPE;
-	*dest = strtoll( self->data.buf, NULL, 10 );
-	return ND_ERROR_SUCCESS;
+	switch ( type )
+	{
+		default:
+			*dst = '\0';
+			break;
+		case ACM_PROPERTY_TYPE_BOOL:
+			snprintf( dst, size, "%s", *( const uint8_t * ) src ? "true" : "false" );
+			break;
+		case ACM_PROPERTY_TYPE_FLOAT16:
+			format_float( dst, size, acm_half_to_float_( *( const uint16_t * ) src ), type );
+			break;
+		case ACM_PROPERTY_TYPE_FLOAT32:
+			format_float( dst, size, *( const float * ) src, type );
+			break;
+		case ACM_PROPERTY_TYPE_FLOAT64:
+			format_float( dst, size, *( const double * ) src, type );
+			break;
+		case ND_PROPERTY_INT8:
+			snprintf( dst, size, "%" PRId8, *( const int8_t * ) src );
+			break;
+		case ND_PROPERTY_INT16:
+			snprintf( dst, size, "%" PRId16, *( const int16_t * ) src );
+			break;
+		case ND_PROPERTY_INT32:
+			snprintf( dst, size, "%" PRId32, *( const int32_t * ) src );
+			break;
+		case ND_PROPERTY_INT64:
+			snprintf( dst, size, "%" PRId64, *( const int64_t * ) src );
+			break;
+		case ND_PROPERTY_UI8:
+			snprintf( dst, size, "%" PRIu8, *( const uint8_t * ) src );
+			break;
+		case ND_PROPERTY_UI16:
+			snprintf( dst, size, "%" PRIu16, *( const uint16_t * ) src );
+			break;
+		case ND_PROPERTY_UI32:
+			snprintf( dst, size, "%" PRIu32, *( const uint32_t * ) src );
+			break;
+		case ND_PROPERTY_UI64:
+			snprintf( dst, size, "%" PRIu64, *( const uint64_t * ) src );
+			break;
+	}
 }
 
-AcmErrorCode acm_branch_get_uint8( const AcmBranch *self, uint8_t *dest )
+/**
+ * Integers have to be the whole string and fit the type, rather than
+ * being cut short or wrapped around.
+ */
+static bool parse_signed( const char *string, int64_t min, int64_t max, int64_t *value )
 {
-	if ( self->type != ND_PROPERTY_UI8 ) return ND_ERROR_INVALID_TYPE;
-	*dest = ( uint8_t ) strtoul( self->data.buf, NULL, 10 );
-	return ND_ERROR_SUCCESS;
+	char *end;
+	errno  = 0;
+	*value = strtoll( string, &end, 10 );
+	return end != string && *end == '\0' && errno == 0 && *value >= min && *value <= max;
 }
 
-AcmErrorCode acm_branch_get_uint16( const AcmBranch *self, uint16_t *dest )
+static bool parse_unsigned( const char *string, uint64_t max, uint64_t *value )
 {
-	if ( self->type != ND_PROPERTY_UI16 ) return ND_ERROR_INVALID_TYPE;
-	*dest = ( uint16_t ) strtoul( self->data.buf, NULL, 10 );
-	return ND_ERROR_SUCCESS;
-}
+	// strtoull would happily negate these
+	const char *c = string;
+	while ( isspace( ( unsigned char ) *c ) )
+	{
+		c++;
+	}
 
-AcmErrorCode acm_branch_get_uint32( const AcmBranch *self, uint32_t *dest )
-{
-	if ( self->type != ND_PROPERTY_UI32 ) return ND_ERROR_INVALID_TYPE;
-	*dest = strtoul( self->data.buf, NULL, 10 );
-	return ND_ERROR_SUCCESS;
+	char *end;
+	errno  = 0;
+	*value = strtoull( string, &end, 10 );
+	return *c != '-' && end != string && *end == '\0' && errno == 0 && *value <= max;
 }
 
-AcmErrorCode acm_branch_get_uint64( const AcmBranch *self, uint64_t *dest )
+/* values too small to represent are fine, they just lose precision */
+static bool parse_float( const char *string, float *value )
 {
-	if ( self->type != ND_PROPERTY_UI64 ) return ND_ERROR_INVALID_TYPE;
-	*dest = strtoull( self->data.buf, NULL, 10 );
-	return ND_ERROR_SUCCESS;
+	char *end;
+	errno  = 0;
+	*value = strtof( string, &end );
+	return end != string && *end == '\0' && !( errno == ERANGE && isinf( *value ) );
 }
 
-AcmErrorCode acm_branch_get_string_array( AcmBranch *self, char **buf, unsigned int numElements )
+bool acm_parse_value_( AcmPropertyType type, const char *string, void *dst )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ACM_PROPERTY_TYPE_STRING )
+	if ( string == NULL )
 	{
-		return ND_ERROR_INVALID_TYPE;
+		set_error_message( ND_ERROR_INVALID_ARGUMENT, "no value provided for array element" );
+		return false;
 	}
 
-	AcmBranch *child = acm_get_first_child( self );
-	for ( unsigned int i = 0; i < numElements; ++i )
+	bool isValid;
+	switch ( type )
 	{
-		if ( child == NULL )
+		default:
+			set_error_message( ND_ERROR_INVALID_TYPE, "attempted to parse invalid type (%s)", acm_string_for_property_type_( type ) );
+			return false;
+		case ACM_PROPERTY_TYPE_BOOL:
 		{
-			return ND_ERROR_INVALID_ELEMENTS;
+			uint8_t v;
+			if ( ( strcmp( string, "true" ) == 0 ) || ( strcmp( string, "1" ) == 0 ) )
+			{
+				v = 1;
+			}
+			else if ( ( strcmp( string, "false" ) == 0 ) || ( strcmp( string, "0" ) == 0 ) )
+			{
+				v = 0;
+			}
+			else
+			{
+				set_error_message( ND_ERROR_INVALID_ARGUMENT, "invalid data passed from var" );
+				return false;
+			}
+			*( uint8_t * ) dst = v;
+			return true;
+		}
+		case ACM_PROPERTY_TYPE_FLOAT16:
+		{
+			float f;
+			if ( ( isValid = parse_float( string, &f ) ) )
+			{
+				// anything finite that only fits as infinity is out of range
+				uint16_t v = acm_float_to_half_( f );
+				if ( ( isValid = !isfinite( f ) || ( v & 0x7FFF ) != 0x7C00 ) )
+				{
+					memcpy( dst, &v, sizeof( uint16_t ) );
+				}
+			}
+			break;
+		}
+		case ACM_PROPERTY_TYPE_FLOAT32:
+		{
+			float v;
+			if ( ( isValid = parse_float( string, &v ) ) )
+			{
+				memcpy( dst, &v, sizeof( float ) );
+			}
+			break;
+		}
+		case ACM_PROPERTY_TYPE_FLOAT64:
+		{
+			char *end;
+			errno    = 0;
+			double v = strtod( string, &end );
+			if ( ( isValid = end != string && *end == '\0' && !( errno == ERANGE && isinf( v ) ) ) )
+			{
+				memcpy( dst, &v, sizeof( double ) );
+			}
+			break;
+		}
+		case ND_PROPERTY_INT8:
+		{
+			int64_t v;
+			if ( ( isValid = parse_signed( string, INT8_MIN, INT8_MAX, &v ) ) )
+			{
+				*( int8_t * ) dst = ( int8_t ) v;
+			}
+			break;
+		}
+		case ND_PROPERTY_INT16:
+		{
+			int64_t v;
+			if ( ( isValid = parse_signed( string, INT16_MIN, INT16_MAX, &v ) ) )
+			{
+				int16_t w = ( int16_t ) v;
+				memcpy( dst, &w, sizeof( int16_t ) );
+			}
+			break;
+		}
+		case ND_PROPERTY_INT32:
+		{
+			int64_t v;
+			if ( ( isValid = parse_signed( string, INT32_MIN, INT32_MAX, &v ) ) )
+			{
+				int32_t w = ( int32_t ) v;
+				memcpy( dst, &w, sizeof( int32_t ) );
+			}
+			break;
+		}
+		case ND_PROPERTY_INT64:
+		{
+			int64_t v;
+			if ( ( isValid = parse_signed( string, INT64_MIN, INT64_MAX, &v ) ) )
+			{
+				memcpy( dst, &v, sizeof( int64_t ) );
+			}
+			break;
+		}
+		case ND_PROPERTY_UI8:
+		{
+			uint64_t v;
+			if ( ( isValid = parse_unsigned( string, UINT8_MAX, &v ) ) )
+			{
+				*( uint8_t * ) dst = ( uint8_t ) v;
+			}
+			break;
+		}
+		case ND_PROPERTY_UI16:
+		{
+			uint64_t v;
+			if ( ( isValid = parse_unsigned( string, UINT16_MAX, &v ) ) )
+			{
+				uint16_t w = ( uint16_t ) v;
+				memcpy( dst, &w, sizeof( uint16_t ) );
+			}
+			break;
+		}
+		case ND_PROPERTY_UI32:
+		{
+			uint64_t v;
+			if ( ( isValid = parse_unsigned( string, UINT32_MAX, &v ) ) )
+			{
+				uint32_t w = ( uint32_t ) v;
+				memcpy( dst, &w, sizeof( uint32_t ) );
+			}
+			break;
+		}
+		case ND_PROPERTY_UI64:
+		{
+			uint64_t v;
+			if ( ( isValid = parse_unsigned( string, UINT64_MAX, &v ) ) )
+			{
+				memcpy( dst, &v, sizeof( uint64_t ) );
+			}
+			break;
+		}
+	}
+
+	if ( !isValid )
+	{
+		set_error_message( ND_ERROR_INVALID_ARGUMENT, "invalid %s value (%s)", acm_string_for_property_type_( type ), string );
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Links the branch onto the end of the parent's list, without
+ * touching the child count.
+ */
+static void link_branch( AcmBranch *self, AcmBranch *parent )
+{
+	if ( parent->children.start == NULL )
+	{
+		parent->children.start = self;
+	}
+
+	self->prev = parent->children.end;
+	if ( parent->children.end != NULL )
+	{
+		parent->children.end->next = self;
+	}
+	parent->children.end = self;
+	self->next           = NULL;
+	self->parent         = parent;
+}
+
+/**
+ * Adds element branches from start onwards. If any of them can't be
+ * allocated, the ones already added here are removed again, so the
+ * mirror is either all there or not there at all.
+ */
+static bool link_packed_mirror( AcmBranch *self, unsigned int start )
+{
+	AcmBranch *last     = self->children.end;
+	size_t     typeSize = acm_get_type_size_( self->childType );
+	for ( unsigned int i = start; i < self->packed.numElements; ++i )
+	{
+		char str[ 64 ];
+		acm_format_value_( self->childType, ( uint8_t * ) self->packed.buf + i * typeSize, str, sizeof( str ) );
+
+		AcmBranch *element = ACM_NEW( AcmBranch );
+		if ( element == NULL || acm_alloc_var_string_( str, &element->data ) == NULL )
+		{
+			ACM_DELETE( element );
+
+			AcmBranch *child = last != NULL ? last->next : self->children.start;
+			while ( child != NULL )
+			{
+				AcmBranch *next = child->next;
+				ACM_DELETE( child->data.buf );
+				ACM_DELETE( child );
+				child = next;
+			}
+
+			self->children.end = last;
+			if ( last != NULL )
+			{
+				last->next = NULL;
+			}
+			else
+			{
+				self->children.start = NULL;
+			}
+
+			set_error_message( NL_ERROR_MEM_ALLOC, "failed to allocate element branch for array (%u)", i );
+			return false;
+		}
+
+		element->type      = self->childType;
+		element->childType = ACM_PROPERTY_TYPE_INVALID;
+		link_branch( element, self );
+	}
+
+	return true;
+}
+
+/**
+ * Packed arrays only create branches for their elements once someone
+ * asks to iterate over them. After that point, the element branches are
+ * kept in sync with the native buffer, which remains the actual storage.
+ */
+static bool materialize_packed_array( AcmBranch *self )
+{
+	if ( self->packed.hasMirror )
+	{
+		return true;
+	}
+
+	self->packed.hasMirror = link_packed_mirror( self, 0 );
+	return self->packed.hasMirror;
+}
+
+bool acm_reserve_packed_values_( AcmBranch *self, unsigned int numValues )
+{
+	if ( numValues <= self->packed.maxElements )
+	{
+		return true;
+	}
+
+	size_t typeSize = acm_get_type_size_( self->childType );
+	void  *p;
+	if ( self->packed.isBorrowed )
+	{
+		// mapped data is read-only, so move it into our own buffer
+		p = ACM_NEW_( uint8_t, numValues * typeSize );
+		if ( p != NULL )
+		{
+			memcpy( p, self->packed.buf, self->packed.numElements * typeSize );
+		}
+	}
+	else
+	{
+		p = ACM_REALLOC( self->packed.buf, uint8_t, numValues * typeSize );
+	}
+
+	if ( p == NULL )
+	{
+		set_error_message( NL_ERROR_MEM_ALLOC, "failed to allocate memory for array (%u elements)", numValues );
+		return false;
+	}
+
+	self->packed.buf         = p;
+	self->packed.maxElements = numValues;
+	self->packed.isBorrowed  = false;
+	return true;
+}
+
+bool acm_push_packed_values_( AcmBranch *self, const void *values, unsigned int numValues )
+{
+	if ( numValues == 0 )
+	{
+		return true;
+	}
+
+	acm_mark_branch_dirty_( self );
+
+	unsigned int numElements = self->packed.numElements + numValues;
+	if ( numElements > self->packed.maxElements )
+	{
+		unsigned int maxElements = self->packed.maxElements > 0 ? self->packed.maxElements : 16;
+		while ( maxElements < numElements )
+		{
+			maxElements *= 2;
+		}
+
+		if ( !acm_reserve_packed_values_( self, maxElements ) )
+		{
+			return false;
+		}
+	}
+
+	size_t typeSize = acm_get_type_size_( self->childType );
+	memcpy( ( uint8_t * ) self->packed.buf + self->packed.numElements * typeSize, values, numValues * typeSize );
+
+	unsigned int start       = self->packed.numElements;
+	self->packed.numElements = numElements;
+	self->numChildren        = numElements;
+
+	if ( self->packed.hasMirror && !link_packed_mirror( self, start ) )
+	{
+		self->packed.numElements = start;
+		self->numChildren        = start;
+		return false;
+	}
+
+	return true;
+}
+
+bool acm_push_packed_value_( AcmBranch *self, const char *value )
+{
+	uint64_t v;
+	if ( !acm_parse_value_( self->childType, value, &v ) )
+	{
+		return false;
+	}
+
+	return acm_push_packed_values_( self, &v, 1 );
+}
+
+static bool remove_packed_value( AcmBranch *self, unsigned int index )
+{
+	// mapped data is read-only, so the rest can't be moved down until it's copied out
+	if ( self->packed.isBorrowed && !acm_reserve_packed_values_( self, self->packed.numElements ) )
+	{
+		set_error_message( NL_ERROR_MEM_ALLOC, "failed to remove element from array (%u)", index );
+		return false;
+	}
+
+	size_t   typeSize = acm_get_type_size_( self->childType );
+	uint8_t *p        = ( uint8_t * ) self->packed.buf + index * typeSize;
+	memmove( p, p + typeSize, ( self->packed.numElements - index - 1 ) * typeSize );
+	self->packed.numElements--;
+	return true;
+}
+
+static AcmBranch *push_packed_variable( AcmBranch *parent, const char *value, AcmPropertyType type )
+{
+	if ( type != parent->childType )
+	{
+		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to add invalid type (%s)", acm_string_for_property_type_( type ) );
+		return NULL;
+	}
+
+	// the caller expects a branch back, so we'll need the mirror
+	if ( !materialize_packed_array( parent ) || !acm_push_packed_value_( parent, value ) )
+	{
+		return NULL;
+	}
+
+	return parent->children.end;
+}
+
+static const void *view_packed_array( const AcmBranch *self, AcmPropertyType childType, unsigned int *numElements )
+{
+	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != childType )
+	{
+		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to view array of invalid type (%s)", acm_string_for_property_type_( childType ) );
+		*numElements = 0;
+		return NULL;
+	}
+
+	*numElements = self->packed.numElements;
+	return self->packed.buf;
+}
+
+const bool *acm_branch_view_bool( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ACM_PROPERTY_TYPE_BOOL, numElements ); }
+const uint16_t *acm_branch_view_f16( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ACM_PROPERTY_TYPE_FLOAT16, numElements ); }
+const float *acm_branch_view_f32( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ACM_PROPERTY_TYPE_FLOAT32, numElements ); }
+const double *acm_branch_view_f64( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ACM_PROPERTY_TYPE_FLOAT64, numElements ); }
+const int8_t *acm_branch_view_i8( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ND_PROPERTY_INT8, numElements ); }
+const int16_t *acm_branch_view_i16( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ND_PROPERTY_INT16, numElements ); }
+const int32_t *acm_branch_view_i32( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ND_PROPERTY_INT32, numElements ); }
+const int64_t *acm_branch_view_i64( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ND_PROPERTY_INT64, numElements ); }
+const uint8_t *acm_branch_view_ui8( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ND_PROPERTY_UI8, numElements ); }
+const uint16_t *acm_branch_view_ui16( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ND_PROPERTY_UI16, numElements ); }
+const uint32_t *acm_branch_view_ui32( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ND_PROPERTY_UI32, numElements ); }
+const uint64_t *acm_branch_view_ui64( const AcmBranch *self, unsigned int *numElements ) { return view_packed_array( self, ND_PROPERTY_UI64, numElements ); }
+
+/******************************************/
+
+unsigned int acm_get_num_of_children( const AcmBranch *self )
+{
+	return self->numChildren;
+}
+
+AcmBranch *acm_get_first_child( AcmBranch *self )
+{
+	if ( acm_is_packed_array_( self ) && !materialize_packed_array( self ) )
+	{
+		return NULL;
+	}
+
+	return self->children.start;
+}
+
+AcmBranch *acm_get_next_child( AcmBranch *node )
+{
+	return node->next;
+}
+
+AcmBranch *acm_get_child_by_name( AcmBranch *self, const char *name )
+{
+	if ( self->type != ACM_PROPERTY_TYPE_OBJECT )
+	{
+		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to get child from an invalid node type!\n" );
+		return NULL;
+	}
+
+	AcmBranch *child = acm_get_first_child( self );
+	while ( child != NULL )
+	{
+		if ( strcmp( name, child->name.buf ) == 0 )
+		{
+			return child;
 		}
 
-		buf[ i ] = ACM_NEW_( char, strlen( child->data.buf ) + 1 );
-		strcpy( buf[ i ], child->data.buf );
-
 		child = acm_get_next_child( child );
 	}
 
+	return NULL;
+}
+
+AcmBranch *acm_get_child_by_path( AcmBranch *self, const char *path )
+{
+	AcmBranch *branch = self;
+	for ( const char *segment = path; branch != NULL && segment != NULL && *segment != '\0'; )
+	{
+		const char *end    = strchr( segment, '.' );
+		size_t      length = ( end != NULL ) ? ( size_t ) ( end - segment ) : strlen( segment );
+		if ( branch->type == ACM_PROPERTY_TYPE_ARRAY )
+		{
+			unsigned int index = 0;
+			for ( size_t i = 0; i < length; ++i )
+			{
+				if ( !isdigit( ( unsigned char ) segment[ i ] ) )
+				{
+					set_error_message( ND_ERROR_INVALID_ELEMENTS, "invalid array index in path (%s)", path );
+					return NULL;
+				}
+				index = index * 10 + ( unsigned int ) ( segment[ i ] - '0' );
+			}
+
+			AcmBranch *child = ( length > 0 ) ? acm_get_first_child( branch ) : NULL;
+			for ( ; child != NULL && index > 0; --index )
+			{
+				child = acm_get_next_child( child );
+			}
+			branch = child;
+		}
+		else if ( branch->type == ACM_PROPERTY_TYPE_OBJECT )
+		{
+			AcmBranch *child = acm_get_first_child( branch );
+			for ( ; child != NULL; child = acm_get_next_child( child ) )
+			{
+				if ( child->name.buf != NULL && strncmp( child->name.buf, segment, length ) == 0 && child->name.buf[ length ] == '\0' )
+				{
+					break;
+				}
+			}
+			branch = child;
+		}
+		else
+		{
+			set_error_message( ND_ERROR_INVALID_TYPE, "attempted to get child from an invalid node type (%s)", path );
+			return NULL;
+		}
+
+		segment = ( end != NULL ) ? end + 1 : NULL;
+	}
+
+	return branch;
+}
+
+static const AcmString *get_value_by_name( AcmBranch *root, const char *name )
+{
+	const AcmBranch *field = acm_get_child_by_name( root, name );
+	if ( field == NULL )
+	{
+		return NULL;
+	}
+
+	return &field->data;
+}
+
+AcmBranch *acm_get_parent( AcmBranch *self )
+{
+	return self->parent;
+}
+
+const char *acm_branch_get_name( const AcmBranch *self )
+{
+	return self->name.buf;
+}
+
+AcmPropertyType acm_branch_get_type( const AcmBranch *self )
+{
+	return self->type;
+}
+
+const char *acm_branch_get_value( const AcmBranch *self, uint16_t *size )
+{
+	if ( size != NULL )
+	{
+		*size = self->data.bufSize;
+	}
+	return self->data.buf;
+}
+
+AcmErrorCode acm_branch_get_string( const AcmBranch *self, char *dest, size_t length )
+{
+	//TODO: why isn't this just returning the buf!?
+	//		if we can resolve this, it'll negate the need for get_value
+	if ( self->type != ACM_PROPERTY_TYPE_STRING ) return ND_ERROR_INVALID_TYPE;
+	snprintf( dest, length, "%s", self->data.buf );
+	return ND_ERROR_SUCCESS;
+}
+
+AcmErrorCode acm_branch_get_bool( const AcmBranch *self, bool *dest )
+{
+	if ( self->type != ACM_PROPERTY_TYPE_BOOL ) return ND_ERROR_INVALID_TYPE;
+
+	if ( ( strcmp( self->data.buf, "true" ) == 0 ) || ( self->data.buf[ 0 ] == '1' && self->data.buf[ 1 ] == '\0' ) )
+	{
+		*dest = true;
+		return ND_ERROR_SUCCESS;
+	}
+	if ( ( strcmp( self->data.buf, "false" ) == 0 ) || ( self->data.buf[ 0 ] == '0' && self->data.buf[ 1 ] == '\0' ) )
+	{
+		*dest = false;
+		return ND_ERROR_SUCCESS;
+	}
+
+	set_error_message( ND_ERROR_INVALID_ARGUMENT, "invalid data passed from var" );
+	return ND_ERROR_INVALID_ARGUMENT;
+}
+
+#ifdef ACM_SUPPORT_FLT16
+AcmErrorCode acm_branch_get_float16( const AcmBranch *self, _Float16 *dest )
+{
+	if ( self->type != ACM_PROPERTY_TYPE_FLOAT16 ) return ND_ERROR_INVALID_TYPE;
+	*dest = strtof( self->data.buf, NULL );
 	return ND_ERROR_SUCCESS;
 }
+#endif
 
-AcmErrorCode acm_branch_get_bool_array( AcmBranch *self, bool *buf, unsigned int numElements )
+AcmErrorCode acm_branch_get_float32( const AcmBranch *self, float *dest )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ACM_PROPERTY_TYPE_FLOAT64 )
-		return ND_ERROR_INVALID_TYPE;
+	if ( self->type != ACM_PROPERTY_TYPE_FLOAT32 ) return ND_ERROR_INVALID_TYPE;
+	*dest = strtof( self->data.buf, NULL );
+	return ND_ERROR_SUCCESS;
+}
 
-	AcmBranch *child = acm_get_first_child( self );
-	for ( unsigned int i = 0; i < numElements; ++i )
-	{
-		if ( child == NULL )
-			return ND_ERROR_INVALID_ELEMENTS;
+AcmErrorCode acm_branch_get_float64( const AcmBranch *self, double *dest )
+{
+	if ( self->type != ACM_PROPERTY_TYPE_FLOAT64 ) return ND_ERROR_INVALID_TYPE;
+	*dest = strtod( self->data.buf, NULL );
+	return ND_ERROR_SUCCESS;
+}
 
-		AcmErrorCode errorCode = acm_branch_get_bool( child, &buf[ i ] );
-		if ( errorCode != ND_ERROR_SUCCESS )
-			return errorCode;
+AcmErrorCode acm_branch_get_int8( const AcmBranch *self, int8_t *dest )
+{
+	if ( self->type != ND_PROPERTY_INT8 ) return ND_ERROR_INVALID_TYPE;
+	*dest = ( int8_t ) strtol( self->data.buf, NULL, 10 );
+	return ND_ERROR_SUCCESS;
+}
 
-		child = acm_get_next_child( child );
-	}
+AcmErrorCode acm_branch_get_int16( const AcmBranch *self, int16_t *dest )
+{
+	if ( self->type != ND_PROPERTY_INT16 ) return ND_ERROR_INVALID_TYPE;
+	*dest = ( int16_t ) strtol( self->data.buf, NULL, 10 );
+	return ND_ERROR_SUCCESS;
+}
 
+AcmErrorCode acm_branch_get_int32( const AcmBranch *self, int32_t *dest )
+{
+	if ( self->type != ND_PROPERTY_INT32 ) return ND_ERROR_INVALID_TYPE;
+	*dest = ( int32_t ) strtol( self->data.buf, NULL, 10 );
 	return ND_ERROR_SUCCESS;
 }
 
-AcmErrorCode acm_branch_get_int8_array( AcmBranch *self, int8_t *buf, unsigned int numElements )
+AcmErrorCode acm_branch_get_int64( const AcmBranch *self, int64_t *dest )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ND_PROPERTY_INT8 )
-		return ND_ERROR_INVALID_TYPE;
+	if ( self->type != ND_PROPERTY_INT64 ) return ND_ERROR_INVALID_TYPE;
+	*dest = strtoll( self->data.buf, NULL, 10 );
+	return ND_ERROR_SUCCESS;
+}
 
-	AcmBranch *child = acm_get_first_child( self );
-	for ( unsigned int i = 0; i < numElements; ++i )
-	{
-		if ( child == NULL )
-			return ND_ERROR_INVALID_ELEMENTS;
+AcmErrorCode acm_branch_get_uint8( const AcmBranch *self, uint8_t *dest )
+{
+	if ( self->type != ND_PROPERTY_UI8 ) return ND_ERROR_INVALID_TYPE;
+	*dest = ( uint8_t ) strtoul( self->data.buf, NULL, 10 );
+	return ND_ERROR_SUCCESS;
+}
 
-		AcmErrorCode errorCode = acm_branch_get_int8( child, &buf[ i ] );
-		if ( errorCode != ND_ERROR_SUCCESS )
-			return errorCode;
+AcmErrorCode acm_branch_get_uint16( const AcmBranch *self, uint16_t *dest )
+{
+	if ( self->type != ND_PROPERTY_UI16 ) return ND_ERROR_INVALID_TYPE;
+	*dest = ( uint16_t ) strtoul( self->data.buf, NULL, 10 );
+	return ND_ERROR_SUCCESS;
+}
 
-		child = acm_get_next_child( child );
-	}
+AcmErrorCode acm_branch_get_uint32( const AcmBranch *self, uint32_t *dest )
+{
+	if ( self->type != ND_PROPERTY_UI32 ) return ND_ERROR_INVALID_TYPE;
+	*dest = strtoul( self->data.buf, NULL, 10 );
+	return ND_ERROR_SUCCESS;
+}
 
+AcmErrorCode acm_branch_get_uint64( const AcmBranch *self, uint64_t *dest )
+{
+	if ( self->type != ND_PROPERTY_UI64 ) return ND_ERROR_INVALID_TYPE;
+	*dest = strtoull( self->data.buf, NULL, 10 );
 	return ND_ERROR_SUCCESS;
 }
 
-AcmErrorCode acm_branch_get_int16_array( AcmBranch *self, int16_t *buf, unsigned int numElements )
+AcmErrorCode acm_branch_get_string_array( AcmBranch *self, char **buf, unsigned int numElements )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ND_PROPERTY_INT16 )
+	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ACM_PROPERTY_TYPE_STRING )
+	{
 		return ND_ERROR_INVALID_TYPE;
+	}
 
 	AcmBranch *child = acm_get_first_child( self );
 	for ( unsigned int i = 0; i < numElements; ++i )
 	{
 		if ( child == NULL )
+		{
 			return ND_ERROR_INVALID_ELEMENTS;
+		}
 
-		AcmErrorCode errorCode = acm_branch_get_int16( child, &buf[ i ] );
-		if ( errorCode != ND_ERROR_SUCCESS )
-			return errorCode;
+		buf[ i ] = ACM_NEW_( char, strlen( child->data.buf ) + 1 );
+		strcpy( buf[ i ], child->data.buf );
 
 		child = acm_get_next_child( child );
 	}
@@ -353,94 +1010,67 @@ AcmErrorCode acm_branch_get_int16_array( AcmBranch *self, int16_t *buf, unsigned
 	return ND_ERROR_SUCCESS;
 }
 
-AcmErrorCode acm_branch_get_int32_array( AcmBranch *self, int32_t *buf, unsigned int numElements )
+static AcmErrorCode copy_packed_array( const AcmBranch *self, AcmPropertyType childType, void *buf, unsigned int numElements )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ND_PROPERTY_INT32 )
+	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != childType )
+	{
 		return ND_ERROR_INVALID_TYPE;
+	}
 
-	AcmBranch *child = acm_get_first_child( self );
-	for ( unsigned int i = 0; i < numElements; ++i )
+	if ( numElements > self->packed.numElements )
 	{
-		if ( child == NULL )
-			return ND_ERROR_INVALID_ELEMENTS;
-
-		AcmErrorCode errorCode = acm_branch_get_int32( child, &buf[ i ] );
-		if ( errorCode != ND_ERROR_SUCCESS )
-			return errorCode;
-
-		child = acm_get_next_child( child );
+		return ND_ERROR_INVALID_ELEMENTS;
 	}
 
+	memcpy( buf, self->packed.buf, numElements * acm_get_type_size_( childType ) );
 	return ND_ERROR_SUCCESS;
 }
 
-AcmErrorCode acm_branch_get_uint32_array( AcmBranch *self, uint32_t *buf, unsigned int numElements )
+AcmErrorCode acm_branch_get_bool_array( AcmBranch *self, bool *buf, unsigned int numElements )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ND_PROPERTY_UI32 )
+	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ACM_PROPERTY_TYPE_BOOL )
 		return ND_ERROR_INVALID_TYPE;
 
-	AcmBranch *child = acm_get_first_child( self );
+	if ( numElements > self->packed.numElements )
+		return ND_ERROR_INVALID_ELEMENTS;
+
+	const uint8_t *src = self->packed.buf;
 	for ( unsigned int i = 0; i < numElements; ++i )
 	{
-		if ( child == NULL )
-			return ND_ERROR_INVALID_ELEMENTS;
-
-		AcmErrorCode errorCode = acm_branch_get_uint32( child, &buf[ i ] );
-		if ( errorCode != ND_ERROR_SUCCESS )
-			return errorCode;
-
-		child = acm_get_next_child( child );
+		buf[ i ] = src[ i ] != 0;
 	}
 
 	return ND_ERROR_SUCCESS;
 }
 
-AcmErrorCode acm_branch_get_float32_array( AcmBranch *self, float *buf, unsigned int numElements )
+AcmErrorCode acm_branch_get_int8_array( AcmBranch *self, int8_t *buf, unsigned int numElements )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ACM_PROPERTY_TYPE_FLOAT32 )
-		return ND_ERROR_INVALID_TYPE;
+	return copy_packed_array( self, ND_PROPERTY_INT8, buf, numElements );
+}
 
-	AcmBranch *child = acm_get_first_child( self );
-	for ( unsigned int i = 0; i < numElements; ++i )
-	{
-		if ( child == NULL )
-			return ND_ERROR_INVALID_ELEMENTS;
+AcmErrorCode acm_branch_get_int16_array( AcmBranch *self, int16_t *buf, unsigned int numElements )
+{
+	return copy_packed_array( self, ND_PROPERTY_INT16, buf, numElements );
+}
 
-		AcmErrorCode errorCode = acm_branch_get_float32( child, &buf[ i ] );
-		if ( errorCode != ND_ERROR_SUCCESS )
-		{
-			return errorCode;
-		}
+AcmErrorCode acm_branch_get_int32_array( AcmBranch *self, int32_t *buf, unsigned int numElements )
+{
+	return copy_packed_array( self, ND_PROPERTY_INT32, buf, numElements );
+}
 
-		child = acm_get_next_child( child );
-	}
+AcmErrorCode acm_branch_get_uint32_array( AcmBranch *self, uint32_t *buf, unsigned int numElements )
+{
+	return copy_packed_array( self, ND_PROPERTY_UI32, buf, numElements );
+}
 
-	return ND_ERROR_SUCCESS;
+AcmErrorCode acm_branch_get_float32_array( AcmBranch *self, float *buf, unsigned int numElements )
+{
+	return copy_packed_array( self, ACM_PROPERTY_TYPE_FLOAT32, buf, numElements );
 }
 
 AcmErrorCode acm_branch_get_float64_array( AcmBranch *self, double *buf, unsigned int numElements )
 {
-	if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ACM_PROPERTY_TYPE_FLOAT64 )
-	{
-		return ND_ERROR_INVALID_TYPE;
-	}
-
-	AcmBranch *child = acm_get_first_child( self );
-	for ( unsigned int i = 0; i < numElements; ++i )
-	{
-		if ( child == NULL )
-		{
-			return ND_ERROR_INVALID_ELEMENTS;
-		}
-
-		AcmErrorCode errorCode = acm_branch_get_float64( child, &buf[ i ] );
-		if ( errorCode != ND_ERROR_SUCCESS )
-			return errorCode;
-
-		child = acm_get_next_child( child );
-	}
-
-	return ND_ERROR_SUCCESS;
+	return copy_packed_array( self, ACM_PROPERTY_TYPE_FLOAT64, buf, numElements );
 }
 
 /******************************************/
@@ -510,20 +1140,220 @@ uintmax_t acm_get_uint( AcmBranch *root, const char *name, uintmax_t fallback )
 	return ( var != NULL ) ? strtoull( var->buf, NULL, 10 ) : fallback;
 }
 
-int16_t *acm_get_array_i16( AcmBranch *branch, const char *name, int16_t *destination, unsigned int numElements )
-{
-	AcmBranch *child = acm_get_child_by_name( branch, name );
-	if ( child == NULL )
-	{
-		return NULL;
+int16_t *acm_get_array_i16( AcmBranch *branch, const char *name, int16_t *destination, unsigned int numElements )
+{
+	AcmBranch *child = acm_get_child_by_name( branch, name );
+	if ( child == NULL )
+	{
+		return NULL;
+	}
+
+	if ( acm_branch_get_int16_array( child, destination, numElements ) != ND_ERROR_SUCCESS )
+	{
+		return NULL;
+	}
+
+	return destination;
+}
+
+uint32_t acm_hash_string_( const char *string )
+{
+	uint32_t hash = 2166136261U;
+	for ( const unsigned char *c = ( const unsigned char * ) string; *c != '\0'; ++c )
+	{
+		hash ^= *c;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+uint64_t acm_hash_bytes_( uint64_t hash, const void *buf, size_t size )
+{
+	const uint8_t *p = buf;
+	for ( size_t i = 0; i < size; ++i )
+	{
+		hash ^= p[ i ];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static bool get_field_value( AcmBranch *child, AcmPropertyType type, void *dest )
+{
+	switch ( type )
+	{
+		default:
+			set_error_message( ND_ERROR_INVALID_TYPE, "attempted to fetch invalid type (%s)", acm_string_for_property_type_( type ) );
+			return false;
+		case ACM_PROPERTY_TYPE_INVALID:
+			*( AcmBranch ** ) dest = child;
+			return true;
+		case ACM_PROPERTY_TYPE_OBJECT:
+		case ACM_PROPERTY_TYPE_ARRAY:
+			if ( child->type != type )
+			{
+				return false;
+			}
+			*( AcmBranch ** ) dest = child;
+			return true;
+		case ACM_PROPERTY_TYPE_STRING:
+			if ( child->data.buf == NULL )
+			{
+				return false;
+			}
+			*( const char ** ) dest = child->data.buf;
+			return true;
+		case ACM_PROPERTY_TYPE_BOOL:
+		{
+			uint8_t v;
+			if ( child->data.buf == NULL || !acm_parse_value_( type, child->data.buf, &v ) )
+			{
+				return false;
+			}
+			*( bool * ) dest = v != 0;
+			return true;
+		}
+		case ACM_PROPERTY_TYPE_FLOAT16:
+		case ACM_PROPERTY_TYPE_FLOAT32:
+		case ACM_PROPERTY_TYPE_FLOAT64:
+		case ND_PROPERTY_INT8:
+		case ND_PROPERTY_INT16:
+		case ND_PROPERTY_INT32:
+		case ND_PROPERTY_INT64:
+		case ND_PROPERTY_UI8:
+		case ND_PROPERTY_UI16:
+		case ND_PROPERTY_UI32:
+		case ND_PROPERTY_UI64:
+			if ( child->data.buf == NULL )
+			{
+				return false;
+			}
+			return acm_parse_value_( type, child->data.buf, dest );
+	}
+}
+
+unsigned int acm_get_many( AcmBranch *root, const AcmFieldRequest *fields, unsigned int numFields )
+{
+	if ( root->type != ACM_PROPERTY_TYPE_OBJECT )
+	{
+		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to get children from an invalid node type!\n" );
+		return 0;
+	}
+
+	// hash the requested names, so each child only costs a single probe
+	unsigned int numSlots = 16;
+	while ( numSlots < numFields * 2 )
+	{
+		numSlots *= 2;
+	}
+
+	unsigned int  localSlots[ 64 ], localChain[ 32 ];
+	unsigned int *slots = localSlots, *chain = localChain;
+	if ( numSlots > 64 || numFields > 32 )
+	{
+		slots = ACM_NEW_( unsigned int, numSlots + numFields );
+		if ( slots == NULL )
+		{
+			set_error_message( NL_ERROR_MEM_ALLOC, "failed to allocate field table" );
+			return 0;
+		}
+		chain = slots + numSlots;
+	}
+	else
+	{
+		memset( localSlots, 0, sizeof( localSlots ) );
+	}
+
+	for ( unsigned int i = 0; i < numFields; ++i )
+	{
+		if ( fields[ i ].found != NULL )
+		{
+			*fields[ i ].found = false;
+		}
+
+		// slots store the index + 1, with duplicate names chained behind the first
+		chain[ i ]         = 0;
+		unsigned int index = acm_hash_string_( fields[ i ].name ) & ( numSlots - 1 );
+		while ( slots[ index ] != 0 && strcmp( fields[ slots[ index ] - 1 ].name, fields[ i ].name ) != 0 )
+		{
+			index = ( index + 1 ) & ( numSlots - 1 );
+		}
+
+		if ( slots[ index ] == 0 )
+		{
+			slots[ index ] = i + 1;
+			continue;
+		}
+
+		unsigned int j = slots[ index ] - 1;
+		while ( chain[ j ] != 0 )
+		{
+			j = chain[ j ] - 1;
+		}
+		chain[ j ] = i + 1;
+	}
+
+	unsigned int numFound   = 0;
+	unsigned int numMatched = 0;
+	for ( AcmBranch *child = root->children.start; child != NULL && numMatched < numFields; child = child->next )
+	{
+		if ( child->name.buf == NULL )
+		{
+			continue;
+		}
+
+		unsigned int index = acm_hash_string_( child->name.buf ) & ( numSlots - 1 );
+		while ( slots[ index ] != 0 && strcmp( fields[ slots[ index ] - 1 ].name, child->name.buf ) != 0 )
+		{
+			index = ( index + 1 ) & ( numSlots - 1 );
+		}
+
+		if ( slots[ index ] == 0 )
+		{
+			continue;
+		}
+
+		// first match wins, same as acm_get_child_by_name
+		for ( unsigned int i = slots[ index ]; i != 0; i = chain[ i - 1 ] )
+		{
+			const AcmFieldRequest *field = &fields[ i - 1 ];
+			numMatched++;
+			if ( !get_field_value( child, field->type, field->dest ) )
+			{
+				continue;
+			}
+
+			if ( field->found != NULL )
+			{
+				*field->found = true;
+			}
+			numFound++;
+		}
+		slots[ index ] = 0;
+
+		// keep the probe sequence intact for anything that collided with this slot
+		for ( unsigned int next = ( index + 1 ) & ( numSlots - 1 ); slots[ next ] != 0; next = ( next + 1 ) & ( numSlots - 1 ) )
+		{
+			unsigned int field = slots[ next ];
+			slots[ next ]      = 0;
+
+			unsigned int home = acm_hash_string_( fields[ field - 1 ].name ) & ( numSlots - 1 );
+			while ( slots[ home ] != 0 )
+			{
+				home = ( home + 1 ) & ( numSlots - 1 );
+			}
+			slots[ home ] = field;
+		}
 	}
 
-	if ( acm_branch_get_int16_array( child, destination, numElements ) != ND_ERROR_SUCCESS )
+	if ( slots != localSlots )
 	{
-		return NULL;
+		ACM_DELETE( slots );
 	}
 
-	return destination;
+	return numFound;
 }
 
 static int acm_strcasecmp( const char *s1, const char *s2 )
@@ -568,21 +1398,57 @@ AcmBranch *acm_linear_lookup( AcmBranch *root, const char *name )
 
 static void attach_branch( AcmBranch *self, AcmBranch *parent )
 {
-	if ( parent->children.start == NULL )
+	link_branch( self, parent );
+	parent->numChildren++;
+}
+
+/**
+ * Flags the branch as changed, so a journal knows to save it. Everything
+ * above counts it as having something changed further down, stopping as
+ * soon as we reach something that was already flagged.
+ */
+void acm_mark_branch_dirty_( AcmBranch *self )
+{
+	// hashes no longer hold for anything above either
+	for ( AcmBranch *branch = self; branch != NULL && ( branch->hasHash || branch == self ); branch = branch->parent )
 	{
-		parent->children.start = self;
+		branch->hasHash = false;
 	}
 
-	self->prev = parent->children.end;
-	if ( parent->children.end != NULL )
+	// elements of packed arrays are only ever saved along with the array
+	if ( self->parent != NULL && acm_is_packed_array_( self->parent ) )
 	{
-		parent->children.end->next = self;
+		self = self->parent;
 	}
-	parent->children.end = self;
-	self->next           = NULL;
-	self->parent         = parent;
 
-	parent->numChildren++;
+	if ( self->isDirty )
+	{
+		return;
+	}
+
+	bool wasFlagged = self->numDirtyChildren > 0;
+	self->isDirty   = true;
+	for ( AcmBranch *parent = self->parent; parent != NULL && !wasFlagged; parent = parent->parent )
+	{
+		wasFlagged = parent->isDirty || parent->numDirtyChildren > 0;
+		parent->numDirtyChildren++;
+	}
+}
+
+/**
+ * Branches built up on their own (loaded, copied) are flagged as dirty
+ * throughout, but none of that was ever counted by anything they're now
+ * going into, so it's cleared before they're attached and marked again.
+ */
+static void clear_branch_flags( AcmBranch *self )
+{
+	self->isDirty          = false;
+	self->isInserted       = false;
+	self->numDirtyChildren = 0;
+	for ( AcmBranch *child = self->children.start; child != NULL; child = child->next )
+	{
+		clear_branch_flags( child );
+	}
 }
 
 AcmBranch *acm_push_new_branch( AcmBranch *parent, const char *name, AcmPropertyType propertyType, AcmPropertyType childType )
@@ -590,16 +1456,17 @@ AcmBranch *acm_push_new_branch( AcmBranch *parent, const char *name, AcmProperty
 	/* arrays are special cases */
 	if ( parent != NULL && parent->type == ACM_PROPERTY_TYPE_ARRAY && propertyType != parent->childType )
 	{
-		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to add invalid type (%s)", string_for_property_type( propertyType ) );
+		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to add invalid type (%s)", acm_string_for_property_type_( propertyType ) );
 		return NULL;
 	}
 
 	AcmBranch *node = ACM_NEW( AcmBranch );
 
 	/* assign the node name, if provided */
-	if ( ( parent == NULL || parent->type != ACM_PROPERTY_TYPE_ARRAY ) && name != NULL )
+	if ( ( parent == NULL || parent->type != ACM_PROPERTY_TYPE_ARRAY ) && name != NULL && acm_alloc_var_string_( name, &node->name ) == NULL )
 	{
-		alloc_var_string( name, &node->name );
+		ACM_DELETE( node );
+		return NULL;
 	}
 
 	node->type      = propertyType;
@@ -611,25 +1478,69 @@ AcmBranch *acm_push_new_branch( AcmBranch *parent, const char *name, AcmProperty
 		attach_branch( node, parent );
 	}
 
+	acm_mark_branch_dirty_( node );
+
 	return node;
 }
 
+/**
+ * Values are kept as text, so anything that won't convert to the type is
+ * turned away here, rather than the text and binary output disagreeing on it.
+ */
+bool acm_is_valid_value_( AcmPropertyType type, const char *value )
+{
+	if ( type == ACM_PROPERTY_TYPE_STRING )
+	{
+		// the length is stored in 16 bits, terminator included
+		size_t length = strlen( value ) + 1;
+		if ( length > UINT16_MAX )
+		{
+			set_error_message( ND_ERROR_LIMIT_EXCEEDED, "string is too long (%zu bytes)", length );
+			return false;
+		}
+
+		return true;
+	}
+
+	uint64_t v;
+	return acm_parse_value_( type, value, &v );
+}
+
 AcmBranch *acm_push_variable_( AcmBranch *parent, const char *name, const char *value, AcmPropertyType type )
 {
+	if ( parent != NULL && acm_is_packed_array_( parent ) )
+	{
+		return push_packed_variable( parent, value, type );
+	}
+
+	if ( !acm_is_valid_value_( type, value ) )
+	{
+		return NULL;
+	}
+
 	AcmBranch *branch = acm_push_new_branch( parent, name, type, ACM_PROPERTY_TYPE_INVALID );
 	if ( branch == NULL )
 	{
 		return NULL;
 	}
 
-	alloc_var_string( value, &branch->data );
+	acm_alloc_var_string_( value, &branch->data );
+	acm_index_branch_added_( branch );
 	return branch;
 }
 
 AcmBranch *acm_push_branch( AcmBranch *parent, AcmBranch *child )
 {
+	if ( acm_is_packed_array_( parent ) )
+	{
+		return push_packed_variable( parent, child->data.buf, child->type );
+	}
+
 	AcmBranch *branch = acm_copy_branch( child );
+	clear_branch_flags( branch );
 	attach_branch( branch, parent );
+	acm_index_branch_added_( branch );
+	acm_mark_branch_dirty_( branch );
 	return branch;
 }
 
@@ -712,7 +1623,9 @@ AcmBranch *acm_push_ui32( AcmBranch *parent, const char *name, uint32_t var )
 AcmBranch *acm_push_f16( AcmBranch *parent, const char *name, _Float16 var )
 {
 	char buf[ 32 ];
-	snprintf( buf, sizeof( buf ), "%f", ( double ) var );
+	uint16_t v;
+	memcpy( &v, &var, sizeof( uint16_t ) );
+	acm_format_value_( ACM_PROPERTY_TYPE_FLOAT16, &v, buf, sizeof( buf ) );
 	return acm_push_variable_( parent, name, buf, ACM_PROPERTY_TYPE_FLOAT16 );
 }
 #endif
@@ -720,14 +1633,14 @@ AcmBranch *acm_push_f16( AcmBranch *parent, const char *name, _Float16 var )
 AcmBranch *acm_push_f32( AcmBranch *parent, const char *name, float var )
 {
 	char buf[ 32 ];
-	snprintf( buf, sizeof( buf ), "%f", var );
+	acm_format_value_( ACM_PROPERTY_TYPE_FLOAT32, &var, buf, sizeof( buf ) );
 	return acm_push_variable_( parent, name, buf, ACM_PROPERTY_TYPE_FLOAT32 );
 }
 
 AcmBranch *acm_push_f64( AcmBranch *parent, const char *name, double var )
 {
 	char buf[ 32 ];
-	snprintf( buf, sizeof( buf ), "%lf", var );
+	acm_format_value_( ACM_PROPERTY_TYPE_FLOAT64, &var, buf, sizeof( buf ) );
 	return acm_push_variable_( parent, name, buf, ACM_PROPERTY_TYPE_FLOAT64 );
 }
 
@@ -736,10 +1649,7 @@ AcmBranch *acm_push_array_i16( AcmBranch *root, const char *name, const int16_t
 	AcmBranch *node = acm_push_new_branch( root, name, ACM_PROPERTY_TYPE_ARRAY, ND_PROPERTY_INT16 );
 	if ( node != NULL )
 	{
-		for ( unsigned int i = 0; i < numElements; ++i )
-		{
-			acm_push_i16( node, NULL, array[ i ] );
-		}
+		acm_push_packed_values_( node, array, numElements );
 	}
 	return node;
 }
@@ -749,10 +1659,7 @@ AcmBranch *acm_push_array_i32( AcmBranch *parent, const char *name, const int32_
 	AcmBranch *node = acm_push_new_branch( parent, name, ACM_PROPERTY_TYPE_ARRAY, ND_PROPERTY_INT32 );
 	if ( node != NULL )
 	{
-		for ( unsigned int i = 0; i < numElements; ++i )
-		{
-			acm_push_i32( node, NULL, array[ i ] );
-		}
+		acm_push_packed_values_( node, array, numElements );
 	}
 	return node;
 }
@@ -762,10 +1669,7 @@ AcmBranch *acm_push_array_ui32( AcmBranch *parent, const char *name, const uint3
 	AcmBranch *node = acm_push_new_branch( parent, name, ACM_PROPERTY_TYPE_ARRAY, ND_PROPERTY_UI32 );
 	if ( node != NULL )
 	{
-		for ( unsigned int i = 0; i < numElements; ++i )
-		{
-			acm_push_ui32( node, NULL, array[ i ] );
-		}
+		acm_push_packed_values_( node, array, numElements );
 	}
 	return node;
 }
@@ -776,10 +1680,8 @@ AcmBranch *acm_push_array_f16( AcmBranch *parent, const char *name, const _Float
 	AcmBranch *node = acm_push_new_branch( parent, name, ACM_PROPERTY_TYPE_ARRAY, ACM_PROPERTY_TYPE_FLOAT16 );
 	if ( node != NULL )
 	{
-		for ( unsigned int i = 0; i < numElements; ++i )
-		{
-			acm_push_f16( node, NULL, array[ i ] );
-		}
+		/* binary16 is stored as-is */
+		acm_push_packed_values_( node, array, numElements );
 	}
 	return node;
 }
@@ -790,10 +1692,7 @@ AcmBranch *acm_push_array_f32( AcmBranch *parent, const char *name, const float
 	AcmBranch *node = acm_push_new_branch( parent, name, ACM_PROPERTY_TYPE_ARRAY, ACM_PROPERTY_TYPE_FLOAT32 );
 	if ( node != NULL )
 	{
-		for ( unsigned int i = 0; i < numElements; ++i )
-		{
-			acm_push_f32( node, NULL, array[ i ] );
-		}
+		acm_push_packed_values_( node, array, numElements );
 	}
 	return node;
 }
@@ -813,12 +1712,33 @@ bool acm_set_variable( AcmBranch *root, const char *name, const char *value, Acm
 
 	if ( child->type != type )
 	{
-		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to set variable (%s) to invalid type (%s)", name, string_for_property_type( type ) );
+		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to set variable (%s) to invalid type (%s)", name, acm_string_for_property_type_( type ) );
+		return false;
+	}
+
+	if ( !acm_is_valid_value_( type, value ) )
+	{
 		return false;
 	}
 
 	size_t length = strlen( value ) + 1;
-	if ( length > child->data.bufSize )
+	if ( child->data.isBorrowed )
+	{
+		// can't write into a mapped file, so take our own copy first
+		size_t bufSize = length > child->data.bufSize ? length : child->data.bufSize;
+		char  *p       = ACM_NEW_( char, bufSize );
+		if ( p == NULL )
+		{
+			set_error_message( NL_ERROR_MEM_ALLOC, "failed to allocate memory for variable (%s)", name );
+			return false;
+		}
+
+		strcpy( p, child->data.buf );
+		child->data.buf        = p;
+		child->data.bufSize    = bufSize;
+		child->data.isBorrowed = false;
+	}
+	else if ( length > child->data.bufSize )
 	{
 		void *p = ACM_REALLOC( child->data.buf, char, length );
 		if ( p == NULL )
@@ -831,7 +1751,10 @@ bool acm_set_variable( AcmBranch *root, const char *name, const char *value, Acm
 		child->data.bufSize = length;
 	}
 
+	acm_index_value_changing_( child );
 	snprintf( child->data.buf, child->data.bufSize, "%s", value );
+	acm_index_branch_added_( child );
+	acm_mark_branch_dirty_( child );
 
 	return true;
 }
@@ -843,6 +1766,11 @@ AcmBranch *acm_push_array_object( AcmBranch *parent, const char *name )
 
 static AcmString *copy_var_string( const AcmString *src, AcmString *dst )
 {
+	if ( src->buf == NULL )
+	{
+		return dst;
+	}
+
 	dst->bufSize = src->bufSize;
 
 	dst->buf = ACM_NEW_( char, src->bufSize );
@@ -869,6 +1797,12 @@ AcmBranch *acm_copy_branch( AcmBranch *node )
 	copy_var_string( &node->name, &newNode->name );
 	// Not setting the parent is intentional here, since we likely don't want that link
 
+	if ( acm_is_packed_array_( node ) )
+	{
+		acm_push_packed_values_( newNode, node->packed.buf, node->packed.numElements );
+		return newNode;
+	}
+
 	AcmBranch *child = acm_get_first_child( node );
 	while ( child != NULL )
 	{
@@ -887,333 +1821,229 @@ void acm_branch_destroy( AcmBranch *node )
 		return;
 	}
 
-	ACM_DELETE( node->name.buf );
-	ACM_DELETE( node->data.buf );
-
-	/* if it's an object/array, we'll need to clean up all it's children */
-	if ( node->type == ACM_PROPERTY_TYPE_OBJECT || node->type == ACM_PROPERTY_TYPE_ARRAY )
-	{
-		AcmBranch *child = acm_get_first_child( node );
-		while ( child != NULL )
-		{
-			AcmBranch *nextChild = acm_get_next_child( child );
-			acm_branch_destroy( child );
-			child = nextChild;
-		}
-	}
-
-	if ( node->parent != NULL )
+	// done first, as it's the only part that can fail
+	if ( node->parent != NULL && acm_is_packed_array_( node->parent ) )
 	{
-		if ( node->prev != NULL )
-		{
-			node->prev->next = node->next;
-		}
-		if ( node->next != NULL )
-		{
-			node->next->prev = node->prev;
-		}
-
-		if ( node == node->parent->children.start )
+		unsigned int index = 0;
+		for ( const AcmBranch *prev = node->prev; prev != NULL; prev = prev->prev )
 		{
-			node->parent->children.start = node->next;
+			index++;
 		}
-		if ( node == node->parent->children.end )
+		if ( !remove_packed_value( node->parent, index ) )
 		{
-			node->parent->children.end = node->prev;
+			return;
 		}
-
-		node->parent->numChildren--;
-	}
-
-	ACM_DELETE( node );
-}
-
-/******************************************/
-/** Deserialisation **/
-
-static const void *read_buf( const void **buf, size_t *bufSize, size_t elementSize )
-{
-	if ( elementSize == 0 || *bufSize < elementSize )
-	{
-		return NULL;
-	}
-
-	const void *p = *buf;
-	*buf          = ( const char * ) ( *buf ) + elementSize;
-	*bufSize -= elementSize;
-	return p;
-}
-
-static char *read_string( const void **buf, size_t *bufSize, uint16_t size )
-{
-	const char *src = read_buf( buf, bufSize, size );
-	if ( src == NULL )
-	{
-		return NULL;
 	}
 
-	char *string = ACM_NEW_( char, size + 1 );
-	strcpy( string, src );
-	return string;
-}
-
-static char *deserialize_string_var( const void **buf, size_t *bufSize, uint16_t *length )
-{
-	const uint16_t *l = read_buf( buf, bufSize, sizeof( uint16_t ) );
-	if ( l == NULL )
+	if ( node->parent != NULL )
 	{
-		return NULL;
+		acm_index_branch_removed_( node );
 	}
-
-	*length = *l;
-	if ( *length == 0 )
+	if ( node->indexes != NULL )
 	{
-		return NULL;
+		acm_index_detach_( node );
 	}
 
-	return read_string( buf, bufSize, *length );
-}
-
-static AcmBranch *deserialize_binary_node( const void **buf, size_t *bufSize, AcmBranch *parent, unsigned int version )
-{
-	// attempt to fetch the name, keeping in mind that not
-	// all nodes necessarily have a name
-	AcmString name;
-	name.buf = deserialize_string_var( buf, bufSize, &name.bufSize );
-
-	const int8_t *type = read_buf( buf, bufSize, sizeof( int8_t ) );
-	if ( type == NULL )
+	if ( !node->name.isBorrowed )
 	{
-		Warning( "Failed to read property type for node (%s)!\n", name.buf ? name.buf : "unnamed" );
-		ACM_DELETE( name.buf );
-		return NULL;
+		ACM_DELETE( node->name.buf );
 	}
-
-	if ( *type == ACM_PROPERTY_TYPE_INVALID || *type >= ACM_MAX_PROPERTY_TYPES )
+	if ( !node->data.isBorrowed )
 	{
-		Warning( "Invalid property type (%u) for node (%s)!\n", *type, name.buf ? name.buf : "unnamed" );
-		ACM_DELETE( name.buf );
-		return NULL;
+		ACM_DELETE( node->data.buf );
 	}
-
-	AcmBranch *node = acm_push_new_branch( parent, NULL, *type, ACM_PROPERTY_TYPE_INVALID );
-	if ( node == NULL )
+	if ( !node->packed.isBorrowed )
 	{
-		ACM_DELETE( name.buf );
-		return NULL;
+		ACM_DELETE( node->packed.buf );
 	}
 
-	// node now takes ownership of name
-	node->name = name;
-
-	if ( node->type == ACM_PROPERTY_TYPE_ARRAY )
+	/* if it's an object/array, we'll need to clean up all it's children */
+	if ( node->type == ACM_PROPERTY_TYPE_OBJECT || node->type == ACM_PROPERTY_TYPE_ARRAY )
 	{
-		const int8_t *childType = read_buf( buf, bufSize, sizeof( int8_t ) );
-		if ( childType == NULL )
-		{
-			Warning( "Failed to fetch child type for node!\n" );
-			acm_branch_destroy( node );
-			return NULL;
-		}
-
-		if ( *childType == ACM_PROPERTY_TYPE_INVALID || *childType >= ACM_MAX_PROPERTY_TYPES )
+		bool       isPacked = acm_is_packed_array_( node );
+		AcmBranch *child    = node->children.start;
+		while ( child != NULL )
 		{
-			Warning( "Invalid child property type (%u) for node (%s)!\n", *childType, name.buf ? name.buf : "unnamed" );
-			acm_branch_destroy( node );
-			return NULL;
+			AcmBranch *nextChild = acm_get_next_child( child );
+			if ( isPacked )
+			{
+				/* buffer is already gone, so don't let the mirror touch it */
+				child->parent = NULL;
+			}
+			acm_branch_destroy( child );
+			child = nextChild;
 		}
-
-		node->childType = ( AcmPropertyType ) *childType;
-	}
-
-	// get the expected size depending on the type
-	unsigned int typeSize;
-	switch ( node->type )
-	{
-		default:
-			typeSize = 0;
-			break;
-		case ACM_PROPERTY_TYPE_FLOAT32:
-			typeSize = sizeof( float );
-			break;
-		case ACM_PROPERTY_TYPE_FLOAT64:
-			typeSize = sizeof( double );
-			break;
-		case ACM_PROPERTY_TYPE_BOOL:
-		case ND_PROPERTY_INT8:
-		case ND_PROPERTY_UI8:
-			typeSize = sizeof( uint8_t );
-			break;
-		case ACM_PROPERTY_TYPE_FLOAT16:
-		case ACM_PROPERTY_TYPE_STRING:
-		case ND_PROPERTY_INT16:
-		case ND_PROPERTY_UI16:
-			typeSize = sizeof( uint16_t );
-			break;
-		case ACM_PROPERTY_TYPE_ARRAY:
-		case ACM_PROPERTY_TYPE_OBJECT:
-		case ND_PROPERTY_INT32:
-		case ND_PROPERTY_UI32:
-			typeSize = sizeof( uint32_t );
-			break;
-		case ND_PROPERTY_INT64:
-		case ND_PROPERTY_UI64:
-			typeSize = sizeof( uint64_t );
-			break;
-	}
-
-	if ( typeSize == 0 )
-	{
-		Warning( "Unexpected type size for node; likely an unhandled type (%u)!\n", node->type );
-		acm_branch_destroy( node );
-		return NULL;
 	}
 
-	const void *data = read_buf( buf, bufSize, typeSize );
-	if ( data == NULL )
+	if ( node->parent != NULL )
 	{
-		Warning( "Failed to fetch initial data value for type (%u)!\n", node->type );
-		acm_branch_destroy( node );
-		return NULL;
-	}
+		acm_mark_branch_dirty_( node->parent );
 
-	switch ( node->type )
-	{
-		default:
-			Warning( "Encountered unhandled node type: %d!\n", node->type );
-			acm_branch_destroy( node );
-			return NULL;
-		case ACM_PROPERTY_TYPE_ARRAY:
-		case ACM_PROPERTY_TYPE_OBJECT:
-		{
-			unsigned int numChildren = *( ( uint32_t * ) data );
-			for ( unsigned int i = 0; i < numChildren; ++i )
-			{
-				if ( deserialize_binary_node( buf, bufSize, node, version ) == NULL )
-				{
-					break;
-				}
-			}
-			break;
-		}
-		case ACM_PROPERTY_TYPE_STRING:
-		{
-			node->data.bufSize = *( ( uint16_t * ) data );
-			node->data.buf     = read_string( buf, bufSize, node->data.bufSize );
-			break;
-		}
-		case ACM_PROPERTY_TYPE_BOOL:
-		{
-			alloc_var_string( *( ( bool * ) data ) ? "true" : "false", &node->data );
-			break;
-		}
-#ifdef ACM_SUPPORT_FLT16
-		case ACM_PROPERTY_TYPE_FLOAT16:
-		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%f", ( double ) *( _Float16 * ) data );
-			alloc_var_string( str, &node->data );
-			break;
-		}
-#endif
-		case ACM_PROPERTY_TYPE_FLOAT32:
-		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%f", *( float * ) data );
-			alloc_var_string( str, &node->data );
-			break;
-		}
-		case ACM_PROPERTY_TYPE_FLOAT64:
-		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%lf", *( double * ) data );
-			alloc_var_string( str, &node->data );
-			break;
-		}
-		case ND_PROPERTY_UI8:
+		if ( node->prev != NULL )
 		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%" PRIu8, *( uint8_t * ) data );
-			alloc_var_string( str, &node->data );
-			break;
+			node->prev->next = node->next;
 		}
-		case ND_PROPERTY_INT8:
+		if ( node->next != NULL )
 		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%" PRId8, *( int8_t * ) data );
-			alloc_var_string( str, &node->data );
-			break;
+			node->next->prev = node->prev;
 		}
-		case ND_PROPERTY_UI16:
+
+		if ( node == node->parent->children.start )
 		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%" PRIu16, *( uint16_t * ) data );
-			alloc_var_string( str, &node->data );
-			// slapped on fix for a bug with serialisation in older versions
-			if ( version < 2 )
-			{
-				read_buf( buf, bufSize, sizeof( uint32_t ) );
-			}
-			break;
+			node->parent->children.start = node->next;
 		}
-		case ND_PROPERTY_INT16:
+		if ( node == node->parent->children.end )
 		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%" PRId16, *( int16_t * ) data );
-			alloc_var_string( str, &node->data );
-			// slapped on fix for a bug with serialisation in older versions
-			if ( version < 2 )
-			{
-				read_buf( buf, bufSize, sizeof( uint32_t ) );
-			}
-			break;
+			node->parent->children.end = node->prev;
 		}
-		case ND_PROPERTY_UI32:
+
+		node->parent->numChildren--;
+	}
+
+	/* everything borrowing from the mapping is gone now */
+	if ( node->mapping != NULL )
+	{
+		acm_release_mapping_( node->mapping );
+	}
+
+	ACM_DELETE( node );
+}
+
+bool acm_insert_branch_( AcmBranch *parent, AcmBranch *before, AcmBranch *self )
+{
+	if ( acm_is_packed_array_( parent ) || ( parent->type == ACM_PROPERTY_TYPE_ARRAY && self->type != parent->childType ) )
+	{
+		set_error_message( ND_ERROR_INVALID_TYPE, "attempted to insert invalid type (%s)", acm_string_for_property_type_( self->type ) );
+		return false;
+	}
+
+	clear_branch_flags( self );
+	if ( before == NULL )
+	{
+		attach_branch( self, parent );
+	}
+	else
+	{
+		self->parent = parent;
+		self->next   = before;
+		self->prev   = before->prev;
+		if ( before->prev != NULL )
 		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%" PRIu32, *( uint32_t * ) data );
-			alloc_var_string( str, &node->data );
-			break;
+			before->prev->next = self;
 		}
-		case ND_PROPERTY_INT32:
+		else
 		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%" PRId32, *( int32_t * ) data );
-			alloc_var_string( str, &node->data );
-			break;
+			parent->children.start = self;
 		}
-		case ND_PROPERTY_UI64:
+		before->prev = self;
+		parent->numChildren++;
+	}
+
+	acm_index_branch_added_( self );
+	acm_mark_branch_dirty_( self );
+	self->isInserted = true;
+	return true;
+}
+
+AcmBranch *acm_get_child_at_( AcmBranch *self, unsigned int index )
+{
+	if ( index >= self->numChildren || acm_is_packed_array_( self ) )
+	{
+		return NULL;
+	}
+
+	// start from whichever end is closer
+	AcmBranch *child;
+	if ( index < self->numChildren / 2 )
+	{
+		child = self->children.start;
+		for ( unsigned int i = 0; i < index; ++i )
 		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%" PRIu64, *( uint64_t * ) data );
-			alloc_var_string( str, &node->data );
-			break;
+			child = child->next;
 		}
-		case ND_PROPERTY_INT64:
+	}
+	else
+	{
+		child = self->children.end;
+		for ( unsigned int i = self->numChildren - 1; i > index; --i )
 		{
-			char str[ 32 ];
-			snprintf( str, sizeof( str ), "%" PRId64, *( int64_t * ) data );
-			alloc_var_string( str, &node->data );
-			break;
+			child = child->prev;
 		}
 	}
 
-	return node;
+	return child;
+}
+
+static void adopt_children( AcmBranch *self )
+{
+	for ( AcmBranch *child = self->children.start; child != NULL; child = child->next )
+	{
+		child->parent = self;
+	}
+}
+
+void acm_replace_branch_( AcmBranch *self, AcmBranch *src )
+{
+	if ( self->parent != NULL )
+	{
+		acm_index_branch_removed_( self );
+	}
+	if ( self->indexes != NULL )
+	{
+		acm_index_detach_( self );
+	}
+
+	// swap them over, so src can be destroyed along with what was here
+	clear_branch_flags( src );
+	AcmBranch old          = *self;
+	*self                  = *src;
+	self->parent           = old.parent;
+	self->prev             = old.prev;
+	self->next             = old.next;
+	self->mapping          = old.mapping;
+	self->isDirty          = old.isDirty;
+	self->isInserted       = old.isInserted;
+	self->numDirtyChildren = old.numDirtyChildren; /* still counted above, though none of src's children are */
+	self->hasHash          = false;
+	adopt_children( self );
+
+	*src         = old;
+	src->parent  = NULL;
+	src->prev    = NULL;
+	src->next    = NULL;
+	src->mapping = NULL;
+	src->indexes = NULL;
+	adopt_children( src );
+	acm_branch_destroy( src );
+
+	acm_index_branch_added_( self );
+	acm_mark_branch_dirty_( self );
 }
 
-static AcmFileType parse_node_file_type( const void *buf, uint32_t *version, unsigned int *headerSize )
+/******************************************/
+/** Deserialisation **/
+
+AcmFileType acm_parse_file_type_( const void *buf, size_t bufSize, uint32_t *version, uint32_t *flags, unsigned int *headerSize )
 {
+	*flags = 0;
+
 	*headerSize = strlen( ACM_FORMAT_UTF8_HEADER );
-	if ( strncmp( buf, ACM_FORMAT_UTF8_HEADER, *headerSize ) == 0 )
+	if ( bufSize >= *headerSize && strncmp( buf, ACM_FORMAT_UTF8_HEADER, *headerSize ) == 0 )
 	{
 		*version = 1;
 		return ACM_FILE_TYPE_UTF8;
 	}
 
 	*headerSize = strlen( ACM_FORMAT_BINARY_HEADER_2 );
-	if ( strncmp( buf, ACM_FORMAT_BINARY_HEADER_2, *headerSize ) == 0 )
+	if ( bufSize >= *headerSize && strncmp( buf, ACM_FORMAT_BINARY_HEADER_2, *headerSize ) == 0 )
 	{
-		*version = *( uint32_t * ) ( buf + *headerSize );// inc + 1, because there's a new line after identifier
+		if ( bufSize < *headerSize + sizeof( uint32_t ) )
+		{
+			set_error_message( ND_ERROR_IO_READ, "unexpected end of binary node header" );
+			return ACM_FILE_TYPE_INVALID;
+		}
+
+		memcpy( version, ( const uint8_t * ) buf + *headerSize, sizeof( uint32_t ) );// inc + 1, because there's a new line after identifier
 		if ( *version == 0 || *version > ACM_FORMAT_BINARY_VERSION )
 		{
 			set_error_message( ND_ERROR_IO_READ, "invalid binary node format (%u == 0 || %u > %u)", *version, *version, ACM_FORMAT_BINARY_VERSION );
@@ -1221,11 +2051,31 @@ static AcmFileType parse_node_file_type( const void *buf, uint32_t *version, uns
 		}
 
 		*headerSize = *headerSize + sizeof( uint32_t );
+
+		// v3 onwards carries a set of flags for optional features
+		if ( *version >= 3 )
+		{
+			if ( bufSize < *headerSize + sizeof( uint32_t ) )
+			{
+				set_error_message( ND_ERROR_IO_READ, "unexpected end of binary node header" );
+				return ACM_FILE_TYPE_INVALID;
+			}
+
+			memcpy( flags, ( const uint8_t * ) buf + *headerSize, sizeof( uint32_t ) );
+			if ( ( *flags & ~ACM_BINARY_FLAGS_SUPPORTED ) != 0 )
+			{
+				set_error_message( ND_ERROR_IO_READ, "unsupported binary node features (%X)", *flags & ~ACM_BINARY_FLAGS_SUPPORTED );
+				return ACM_FILE_TYPE_INVALID;
+			}
+
+			*headerSize = *headerSize + sizeof( uint32_t );
+		}
+
 		return ACM_FILE_TYPE_BINARY;
 	}
 
 	*headerSize = strlen( ACM_FORMAT_BINARY_HEADER );
-	if ( strncmp( buf, ACM_FORMAT_BINARY_HEADER, *headerSize ) == 0 )
+	if ( bufSize >= *headerSize && strncmp( buf, ACM_FORMAT_BINARY_HEADER, *headerSize ) == 0 )
 	{
 		*version = 1;
 		return ACM_FILE_TYPE_BINARY;
@@ -1240,17 +2090,41 @@ AcmBranch *acm_load_from_memory( const void *buf, size_t bufSize, const char *ob
 	AcmBranch *root = NULL;
 
 	unsigned int headerSize;
-	unsigned int version;
-	AcmFileType  fileType = parse_node_file_type( buf, &version, &headerSize );
-	if ( fileType == ACM_FILE_TYPE_BINARY )
+	uint32_t     version;
+	uint32_t     flags;
+	AcmFileType  fileType = acm_parse_file_type_( buf, bufSize, &version, &flags, &headerSize );
+	if ( fileType == ACM_FILE_TYPE_BINARY && ( flags & ACM_BINARY_FLAG_COMPRESSED ) )
+	{
+		// decompresses to the file as it would otherwise be, so just start over with that
+		size_t rawSize;
+		void  *raw = acm_decompress_binary_( buf, bufSize, headerSize, &rawSize );
+		if ( raw == NULL )
+		{
+			return NULL;
+		}
+
+		uint32_t     rawVersion;
+		uint32_t     rawFlags;
+		unsigned int rawHeaderSize;
+		if ( acm_parse_file_type_( raw, rawSize, &rawVersion, &rawFlags, &rawHeaderSize ) == ACM_FILE_TYPE_BINARY && !( rawFlags & ACM_BINARY_FLAG_COMPRESSED ) )
+		{
+			root = acm_load_from_memory( raw, rawSize, objectType, source );
+		}
+		else
+		{
+			set_error_message( ND_ERROR_IO_READ, "invalid compressed binary node data" );
+		}
+
+		ACM_DELETE( raw );
+		return root;
+	}
+	else if ( fileType == ACM_FILE_TYPE_BINARY )
 	{
-		const void *p = buf;
-		read_buf( &p, &bufSize, headerSize );
-		root = deserialize_binary_node( &p, &bufSize, NULL, version );
+		root = acm_deserialize_binary_( buf, bufSize, headerSize, version, flags );
 	}
 	else if ( fileType == ACM_FILE_TYPE_UTF8 )
 	{
-		root = acm_parse_buffer( ( const char * ) buf + headerSize, source );
+		root = acm_parse_buffer_( ( const char * ) buf + headerSize, bufSize - headerSize, source );
 	}
 	else
 	{
@@ -1292,265 +2166,690 @@ AcmBranch *acm_load_file( const char *path, const char *objectType )
 
 	AcmBranch *root = NULL;
 
-	// now read it into memory
-	uint8_t *buf = ACM_NEW_( uint8_t, size + 1 );
-	if ( buf != NULL )
+	// now read it into memory
+	uint8_t *buf = ACM_NEW_( uint8_t, size + 1 );
+	if ( buf != NULL )
+	{
+		fread( buf, sizeof( uint8_t ), size, file );
+
+		// finally hand it over to our parser
+		root = acm_load_from_memory( buf, size, objectType, path );
+
+		ACM_DELETE( buf );
+	}
+
+	fclose( file );
+
+	return root;
+}
+
+/******************************************/
+/** Serialisation **/
+
+/* state for writing out a tree, so any number can be written at once */
+typedef struct AcmSerializer
+{
+	AcmOutput   *output;
+	unsigned int depth;
+	bool         compact; /* everything on the one line, separated by single spaces */
+} AcmSerializer;
+
+static void write_line( AcmSerializer *self, const char *string, bool tabify )
+{
+	if ( tabify && !self->compact )
+	{
+		acm_output_tabs_( self->output, self->depth );
+	}
+
+	if ( string == NULL )
+	{
+		return;
+	}
+
+	acm_output_string_( self->output, string );
+}
+
+/* values are already followed by a space, which is all a compact line needs */
+static void end_line( AcmSerializer *self )
+{
+	if ( !self->compact )
+	{
+		acm_output_char_( self->output, '\n' );
+	}
+}
+
+static void write_open_bracket( AcmSerializer *self, bool tabify )
+{
+	write_line( self, self->compact ? "{ " : "{\n", tabify );
+}
+
+static void write_close_bracket( AcmSerializer *self )
+{
+	write_line( self, self->compact ? "} " : "}\n", true );
+}
+
+void acm_serialize_string_var_( const char *string, AcmOutput *output )
+{
+	/* allow nameless nodes, used for arrays */
+	if ( string == NULL )
+	{
+		return;
+	}
+
+	bool        encloseString = false;
+	const char *c             = string;
+	if ( *c == '\0' )
+	{
+		/* enclose an empty string!!! */
+		encloseString = true;
+	}
+	else
+	{
+		/* otherwise, check if there are any spaces */
+		while ( *c != '\0' )
+		{
+			if ( *c == ' ' )
+			{
+				encloseString = true;
+				break;
+			}
+
+			c++;
+		}
+	}
+
+	if ( encloseString )
+	{
+		acm_output_char_( output, '"' );
+		acm_output_string_( output, string );
+		acm_output_char_( output, '"' );
+	}
+	else
+	{
+		acm_output_string_( output, string );
+	}
+
+	acm_output_char_( output, ' ' );
+}
+
+static void serialize_packed_elements( AcmSerializer *self, const AcmBranch *node )
+{
+	size_t         typeSize = acm_get_type_size_( node->childType );
+	const uint8_t *p        = node->packed.buf;
+	for ( unsigned int i = 0; i < node->packed.numElements; ++i, p += typeSize )
+	{
+		char str[ 64 ];
+		acm_format_value_( node->childType, p, str, sizeof( str ) );
+		write_line( self, NULL, true );
+		acm_output_string_( self->output, str );
+		acm_output_char_( self->output, ' ' );
+		end_line( self );
+	}
+}
+
+/**
+ * Writes out the line identifying this node, and its value if it has one.
+ * Returns true if it has children, which go on the lines that follow.
+ */
+static bool serialize_node_head( AcmSerializer *self, const AcmBranch *node )
+{
+	write_line( self, NULL, true );
+	AcmBranch *parent = node->parent;
+	if ( parent == NULL || parent->type != ACM_PROPERTY_TYPE_ARRAY )
+	{
+		acm_output_string_( self->output, acm_string_for_property_type_( node->type ) );
+		acm_output_char_( self->output, ' ' );
+		if ( node->type == ACM_PROPERTY_TYPE_ARRAY )
+		{
+			acm_output_string_( self->output, acm_string_for_property_type_( node->childType ) );
+			acm_output_char_( self->output, ' ' );
+		}
+
+		acm_serialize_string_var_( node->name.buf, self->output );
+	}
+
+	if ( node->type == ACM_PROPERTY_TYPE_OBJECT || node->type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		write_open_bracket( self, ( parent != NULL && parent->type == ACM_PROPERTY_TYPE_ARRAY ) );
+		return true;
+	}
+
+	acm_serialize_string_var_( node->data.buf, self->output );
+	end_line( self );
+	return false;
+}
+
+static void serialize_node_tree( AcmSerializer *self, const AcmBranch *root );
+static void serialize_node( AcmSerializer *self, const AcmBranch *node )
+{
+	if ( !serialize_node_head( self, node ) )
+	{
+		return;
+	}
+
+	/* if this node has children, serialize all those */
+	self->depth++;
+	if ( acm_is_packed_array_( node ) )
+	{
+		serialize_packed_elements( self, node );
+	}
+	else
+	{
+		serialize_node_tree( self, node );
+	}
+	self->depth--;
+	write_close_bracket( self );
+}
+
+static void serialize_node_tree( AcmSerializer *self, const AcmBranch *root )
+{
+	const AcmBranch *child = root->children.start;
+	while ( child != NULL )
+	{
+		serialize_node( self, child );
+		child = child->next;
+	}
+}
+
+/******************************************/
+/** Parallel Serialisation **/
+
+/* Large trees are split into runs of neighbouring subtrees, each written
+ * into a buffer of its own by a pool of threads, and then written out in
+ * order with the lines opening and closing the objects/arrays around them.
+ * Nothing written for a node depends on anything but the node, its parent
+ * and its depth, so the result is the same as writing it all in one go.
+ */
+
+#define PARALLEL_MIN_NODES 65536 /* smaller trees are just written on this thread */
+#define PARALLEL_RUN_NODES 8192  /* rough size of each run */
+
+typedef enum AcmSerializePieceType
+{
+	ACM_SERIALIZE_PIECE_HEAD, /* line opening an object/array */
+	ACM_SERIALIZE_PIECE_TAIL, /* line closing an object/array */
+	ACM_SERIALIZE_PIECE_RUN,  /* neighbouring nodes, written by a worker */
+} AcmSerializePieceType;
+
+typedef struct AcmSerializePiece
+{
+	AcmSerializePieceType type;
+	const AcmBranch      *node; /* object/array for heads, first node for runs */
+	unsigned int          numNodes;
+	unsigned int          depth;
+	AcmOutput             output; /* written by a worker, for runs */
+} AcmSerializePiece;
+
+typedef struct AcmSerializePlan
+{
+	AcmSerializePiece *pieces;
+	unsigned int       numPieces;
+	unsigned int       maxPieces;
+	unsigned int      *runs; /* index of the piece for each run */
+	unsigned int       numRuns;
+	unsigned int       nextPiece; /* next piece to write out */
+	AcmOutput         *output;
+	bool               compact;
+	bool               failed;
+} AcmSerializePlan;
+
+/* counts the nodes (and packed elements) of a subtree, giving up at the limit */
+static unsigned int count_nodes( const AcmBranch *node, unsigned int limit )
+{
+	if ( acm_is_packed_array_( node ) )
+	{
+		return 1 + node->packed.numElements;
+	}
+
+	unsigned int numNodes = 1;
+	for ( const AcmBranch *child = node->children.start; child != NULL && numNodes < limit; child = child->next )
+	{
+		numNodes += count_nodes( child, limit - numNodes );
+	}
+
+	return numNodes;
+}
+
+static void add_piece( AcmSerializePlan *self, AcmSerializePieceType type, const AcmBranch *node, unsigned int numNodes, unsigned int depth )
+{
+	if ( self->failed )
+	{
+		return;
+	}
+
+	if ( self->numPieces == self->maxPieces )
+	{
+		unsigned int       maxPieces = self->maxPieces > 0 ? self->maxPieces * 2 : 64;
+		AcmSerializePiece *pieces    = ACM_REALLOC( self->pieces, AcmSerializePiece, maxPieces );
+		if ( pieces == NULL )
+		{
+			set_error_message( NL_ERROR_MEM_ALLOC, "failed to allocate serialisation plan (%u pieces)", maxPieces );
+			self->failed = true;
+			return;
+		}
+
+		self->pieces    = pieces;
+		self->maxPieces = maxPieces;
+	}
+
+	AcmSerializePiece *piece = &self->pieces[ self->numPieces++ ];
+	memset( piece, 0, sizeof( AcmSerializePiece ) );
+	piece->type     = type;
+	piece->node     = node;
+	piece->numNodes = numNodes;
+	piece->depth    = depth;
+}
+
+/**
+ * Splits the children of the given object/array into runs, going
+ * further down into any that are too big to be a run by themselves.
+ */
+static void plan_node( AcmSerializePlan *self, const AcmBranch *node, unsigned int depth )
+{
+	add_piece( self, ACM_SERIALIZE_PIECE_HEAD, node, 0, depth );
+
+	const AcmBranch *first    = NULL;
+	unsigned int     runNodes = 0;
+	unsigned int     numNodes = 0;
+	for ( const AcmBranch *child = node->children.start; child != NULL; child = child->next )
 	{
-		fread( buf, sizeof( uint8_t ), size, file );
+		unsigned int size = count_nodes( child, PARALLEL_RUN_NODES );
+		if ( size >= PARALLEL_RUN_NODES && !acm_is_packed_array_( child ) && child->numChildren > 1 )
+		{
+			if ( first != NULL )
+			{
+				add_piece( self, ACM_SERIALIZE_PIECE_RUN, first, numNodes, depth + 1 );
+				first = NULL;
+			}
 
-		// finally hand it over to our parser
-		root = acm_load_from_memory( buf, size, objectType, path );
+			plan_node( self, child, depth + 1 );
+			continue;
+		}
 
-		ACM_DELETE( buf );
+		if ( first == NULL )
+		{
+			first    = child;
+			runNodes = 0;
+			numNodes = 0;
+		}
+
+		runNodes += size;
+		numNodes++;
+		if ( runNodes >= PARALLEL_RUN_NODES )
+		{
+			add_piece( self, ACM_SERIALIZE_PIECE_RUN, first, numNodes, depth + 1 );
+			first = NULL;
+		}
 	}
 
-	fclose( file );
+	if ( first != NULL )
+	{
+		add_piece( self, ACM_SERIALIZE_PIECE_RUN, first, numNodes, depth + 1 );
+	}
 
-	return root;
+	add_piece( self, ACM_SERIALIZE_PIECE_TAIL, node, 0, depth );
 }
 
-/******************************************/
-/** Serialisation **/
-
-static unsigned int sDepth; /* serialisation depth */
-
-static void write_line( FILE *file, const char *string, bool tabify )
+static bool run_piece( void *user, unsigned int index )
 {
-	if ( tabify )
+	AcmSerializePlan  *self  = user;
+	AcmSerializePiece *piece = &self->pieces[ self->runs[ index ] ];
+	if ( !acm_output_open_( &piece->output, NULL, NULL ) )
 	{
-		for ( unsigned int i = 0; i < sDepth; ++i )
-		{
-			fputc( '\t', file );
-		}
+		return false;
 	}
 
-	if ( string == NULL )
+	AcmSerializer serializer = { &piece->output, piece->depth, self->compact };
+	const AcmBranch *node = piece->node;
+	for ( unsigned int i = 0; i < piece->numNodes; ++i, node = node->next )
 	{
-		return;
+		serialize_node( &serializer, node );
 	}
 
-	fprintf( file, "%s", string );
+	return !piece->output.failed;
 }
 
-static void serialize_string_var( const AcmString *string, AcmFileType fileType, FILE *file )
+/* writes out everything up to and including the given run, in order */
+static bool consume_piece( void *user, unsigned int index )
 {
-	size_t length = string->buf == NULL ? 0 : strlen( string->buf );
-	if ( fileType == ACM_FILE_TYPE_BINARY )
+	AcmSerializePlan *self = user;
+	unsigned int      last = index < self->numRuns ? self->runs[ index ] : self->numPieces - 1;
+	for ( ; self->nextPiece <= last; self->nextPiece++ )
 	{
-		if ( length > 0 )
+		AcmSerializePiece *piece      = &self->pieces[ self->nextPiece ];
+		AcmSerializer      serializer = { self->output, piece->depth, self->compact };
+		switch ( piece->type )
 		{
-			length++;// null terminator
+			case ACM_SERIALIZE_PIECE_HEAD:
+				serialize_node_head( &serializer, piece->node );
+				break;
+			case ACM_SERIALIZE_PIECE_TAIL:
+				write_close_bracket( &serializer );
+				break;
+			case ACM_SERIALIZE_PIECE_RUN:
+				acm_output_write_( self->output, piece->output.buf, piece->output.length );
+				acm_output_close_( &piece->output );
+				break;
 		}
-
-		fwrite( &length, sizeof( uint16_t ), 1, file );
-		fwrite( string->buf, sizeof( char ), length, file );
-		return;
 	}
 
-	/* allow nameless nodes, used for arrays */
-	if ( length == 0 )
-	{
-		return;
-	}
+	return !self->output->failed;
+}
 
-	bool        encloseString = false;
-	const char *c             = string->buf;
-	if ( *c == '\0' )
+static bool serialize_parallel( AcmOutput *output, const AcmBranch *root, bool compact )
+{
+	AcmSerializePlan plan;
+	memset( &plan, 0, sizeof( AcmSerializePlan ) );
+	plan.output  = output;
+	plan.compact = compact;
+
+	plan_node( &plan, root, 0 );
+	if ( !plan.failed )
 	{
-		/* enclose an empty string!!! */
-		encloseString = true;
+		plan.runs = ACM_NEW_( unsigned int, plan.numPieces );
+		if ( plan.runs == NULL )
+		{
+			set_error_message( NL_ERROR_MEM_ALLOC, "failed to allocate serialisation plan (%u pieces)", plan.numPieces );
+			plan.failed = true;
+		}
 	}
-	else
+
+	if ( !plan.failed )
 	{
-		/* otherwise, check if there are any spaces */
-		while ( *c != '\0' )
+		for ( unsigned int i = 0; i < plan.numPieces; ++i )
 		{
-			if ( *c == ' ' )
+			if ( plan.pieces[ i ].type == ACM_SERIALIZE_PIECE_RUN )
 			{
-				encloseString = true;
-				break;
+				plan.runs[ plan.numRuns++ ] = i;
 			}
+		}
 
-			c++;
+		// anything after the last run gets written once it's done
+		if ( !acm_run_jobs_( plan.numRuns, run_piece, consume_piece, &plan ) || !consume_piece( &plan, plan.numRuns ) )
+		{
+			// workers can only fail to allocate, and errors on other threads aren't ours
+			if ( !output->failed )
+			{
+				set_error_message( NL_ERROR_MEM_ALLOC, "failed to allocate output for subtree" );
+			}
+			plan.failed = true;
 		}
 	}
 
-	if ( encloseString )
-	{
-		fprintf( file, "\"%s\" ", string->buf );
-	}
-	else
+	// runs that were written but never consumed
+	for ( unsigned int i = 0; i < plan.numPieces; ++i )
 	{
-		fprintf( file, "%s ", string->buf );
+		acm_output_close_( &plan.pieces[ i ].output );
 	}
+
+	ACM_DELETE( plan.runs );
+	ACM_DELETE( plan.pieces );
+
+	return !plan.failed;
+}
+
+/******************************************/
+/** Canonical Form **/
+
+/* Equal trees can still be written out differently, depending on the order
+ * fields were added in and how their values were set (e.g. "1" or "1.000000"
+ * for a float). The canonical form is a copy with the fields of each object
+ * sorted by name, and every value written the one way it parses back to.
+ */
+
+static int compare_branch_names( const AcmBranch *a, const AcmBranch *b )
+{
+	return strcmp( a->name.buf != NULL ? a->name.buf : "", b->name.buf != NULL ? b->name.buf : "" );
 }
 
-static void serialize_node_tree( FILE *file, AcmBranch *root, AcmFileType fileType );
-static void serialize_node( FILE *file, AcmBranch *node, AcmFileType fileType )
+/* stable, so fields sharing a name keep their order, and the first still wins */
+static AcmBranch *sort_branch_list( AcmBranch *start, unsigned int numBranches )
 {
-	if ( fileType == ACM_FILE_TYPE_UTF8 )
+	if ( numBranches < 2 )
 	{
-		/* write out the line identifying this node */
-		write_line( file, NULL, true );
-		AcmBranch *parent = acm_get_parent( node );
-		if ( parent == NULL || parent->type != ACM_PROPERTY_TYPE_ARRAY )
-		{
-			fprintf( file, "%s ", string_for_property_type( node->type ) );
-			if ( node->type == ACM_PROPERTY_TYPE_ARRAY )
-			{
-				fprintf( file, "%s ", string_for_property_type( node->childType ) );
-			}
+		start->next = NULL;
+		return start;
+	}
 
-			serialize_string_var( &node->name, fileType, file );
-		}
+	unsigned int half   = numBranches / 2;
+	AcmBranch   *middle = start;
+	for ( unsigned int i = 0; i < half; ++i )
+	{
+		middle = middle->next;
+	}
+
+	AcmBranch *a = sort_branch_list( start, half );
+	AcmBranch *b = sort_branch_list( middle, numBranches - half );
 
-		/* if this node has children, serialize all those */
-		if ( node->type == ACM_PROPERTY_TYPE_OBJECT || node->type == ACM_PROPERTY_TYPE_ARRAY )
+	AcmBranch  *sorted = NULL;
+	AcmBranch **tail   = &sorted;
+	while ( a != NULL && b != NULL )
+	{
+		if ( compare_branch_names( b, a ) < 0 )
 		{
-			write_line( file, "{\n", ( parent != NULL && parent->type == ACM_PROPERTY_TYPE_ARRAY ) );
-			sDepth++;
-			serialize_node_tree( file, node, fileType );
-			sDepth--;
-			write_line( file, "}\n", true );
+			*tail = b;
+			b     = b->next;
 		}
 		else
 		{
-			serialize_string_var( &node->data, fileType, file );
-			fprintf( file, "\n" );
+			*tail = a;
+			a     = a->next;
 		}
+		tail = &( *tail )->next;
+	}
+	*tail = a != NULL ? a : b;
 
+	return sorted;
+}
+
+static void sort_children( AcmBranch *node )
+{
+	if ( node->numChildren < 2 )
+	{
 		return;
 	}
 
-	serialize_string_var( &node->name, fileType, file );
-	fwrite( &node->type, sizeof( int8_t ), 1, file );
-	switch ( node->type )
+	AcmBranch *prev = NULL;
+	node->children.start = sort_branch_list( node->children.start, node->numChildren );
+	for ( AcmBranch *child = node->children.start; child != NULL; child = child->next )
 	{
-		default:
-		{
-			Warning( "Invalid node type: %u/n", node->type );
-			//TODO: don't do this!!!
-			abort();
-		}
-#ifdef ACM_SUPPORT_FLT16
-		case ACM_PROPERTY_TYPE_FLOAT16:
-		{
-			_Float16 v;
-			acm_branch_get_float16( node, &v );
-			fwrite( &v, sizeof( _Float16 ), 1, file );
-			break;
-		}
-#endif
-		case ACM_PROPERTY_TYPE_FLOAT32:
-		{
-			float v;
-			acm_branch_get_float32( node, &v );
-			fwrite( &v, sizeof( float ), 1, file );
-			break;
-		}
-		case ACM_PROPERTY_TYPE_FLOAT64:
-		{
-			double v;
-			acm_branch_get_float64( node, &v );
-			fwrite( &v, sizeof( double ), 1, file );
-			break;
-		}
-		case ND_PROPERTY_INT8:
-		{
-			int8_t v;
-			acm_branch_get_int8( node, &v );
-			fwrite( &v, sizeof( int8_t ), 1, file );
-			break;
-		}
-		case ND_PROPERTY_INT16:
-		{
-			int16_t v;
-			acm_branch_get_int16( node, &v );
-			fwrite( &v, sizeof( int16_t ), 1, file );
-			break;
-		}
-		case ND_PROPERTY_INT32:
-		{
-			int32_t v;
-			acm_branch_get_int32( node, &v );
-			fwrite( &v, sizeof( int32_t ), 1, file );
-			break;
-		}
-		case ND_PROPERTY_INT64:
-		{
-			int64_t v;
-			acm_branch_get_int64( node, &v );
-			fwrite( &v, sizeof( int64_t ), 1, file );
-			break;
-		}
-		case ND_PROPERTY_UI8:
+		child->prev = prev;
+		prev        = child;
+	}
+	node->children.end = prev;
+}
+
+/* folds negative zero into zero, and every NaN into the one quiet NaN */
+static void normalise_float( AcmPropertyType type, void *value )
+{
+	if ( type == ACM_PROPERTY_TYPE_FLOAT16 )
+	{
+		uint16_t v;
+		memcpy( &v, value, sizeof( uint16_t ) );
+		if ( ( v & 0x7FFF ) == 0 )
 		{
-			uint8_t v;
-			acm_branch_get_uint8( node, &v );
-			fwrite( &v, sizeof( uint8_t ), 1, file );
-			break;
+			v = 0;
 		}
-		case ND_PROPERTY_UI16:
+		else if ( ( v & 0x7C00 ) == 0x7C00 && ( v & 0x03FF ) != 0 )
 		{
-			uint16_t v;
-			acm_branch_get_uint16( node, &v );
-			fwrite( &v, sizeof( uint16_t ), 1, file );
-			break;
+			v = 0x7E00;
 		}
-		case ND_PROPERTY_UI32:
+		memcpy( value, &v, sizeof( uint16_t ) );
+	}
+	else if ( type == ACM_PROPERTY_TYPE_FLOAT32 )
+	{
+		uint32_t v;
+		memcpy( &v, value, sizeof( uint32_t ) );
+		if ( ( v & 0x7FFFFFFF ) == 0 )
 		{
-			uint32_t v;
-			acm_branch_get_uint32( node, &v );
-			fwrite( &v, sizeof( uint32_t ), 1, file );
-			break;
+			v = 0;
 		}
-		case ND_PROPERTY_UI64:
+		else if ( ( v & 0x7F800000 ) == 0x7F800000 && ( v & 0x007FFFFF ) != 0 )
 		{
-			uint64_t v;
-			acm_branch_get_uint64( node, &v );
-			fwrite( &v, sizeof( uint64_t ), 1, file );
-			break;
+			v = 0x7FC00000;
 		}
-		case ACM_PROPERTY_TYPE_STRING:
+		memcpy( value, &v, sizeof( uint32_t ) );
+	}
+	else if ( type == ACM_PROPERTY_TYPE_FLOAT64 )
+	{
+		uint64_t v;
+		memcpy( &v, value, sizeof( uint64_t ) );
+		if ( ( v & 0x7FFFFFFFFFFFFFFF ) == 0 )
 		{
-			serialize_string_var( &node->data, fileType, file );
-			break;
+			v = 0;
 		}
-		case ACM_PROPERTY_TYPE_BOOL:
+		else if ( ( v & 0x7FF0000000000000 ) == 0x7FF0000000000000 && ( v & 0x000FFFFFFFFFFFFF ) != 0 )
 		{
-			bool v;
-			acm_branch_get_bool( node, &v );
-			fwrite( &v, sizeof( uint8_t ), 1, file );
-			break;
+			v = 0x7FF8000000000000;
 		}
-		case ACM_PROPERTY_TYPE_ARRAY:
+		memcpy( value, &v, sizeof( uint64_t ) );
+	}
+}
+
+/**
+ * Binary output only cares about the value, so the text is only
+ * rewritten for utf8 output, or if the value itself has changed.
+ */
+static bool canonicalise_value( AcmBranch *node, bool isText )
+{
+	bool isFloat = node->type == ACM_PROPERTY_TYPE_FLOAT16 || node->type == ACM_PROPERTY_TYPE_FLOAT32 || node->type == ACM_PROPERTY_TYPE_FLOAT64;
+	if ( !isText && !isFloat )
+	{
+		return true;
+	}
+
+	// anything that doesn't parse is left as it is, as it would be otherwise
+	uint64_t value = 0;
+	if ( !acm_parse_value_( node->type, node->data.buf, &value ) )
+	{
+		return true;
+	}
+
+	uint64_t original = value;
+	normalise_float( node->type, &value );
+	if ( !isText && value == original )
+	{
+		return true;
+	}
+
+	char str[ 64 ];
+	acm_format_value_( node->type, &value, str, sizeof( str ) );
+
+	ACM_DELETE( node->data.buf );
+	return acm_alloc_var_string_( str, &node->data ) != NULL;
+}
+
+static bool canonicalise_branch( AcmBranch *node, bool isText )
+{
+	if ( acm_is_packed_array_( node ) )
+	{
+		size_t   typeSize = acm_get_type_size_( node->childType );
+		uint8_t *p        = node->packed.buf;
+		for ( unsigned int i = 0; i < node->packed.numElements; ++i, p += typeSize )
 		{
-			/* only extra component here is the child type */
-			fwrite( &node->childType, sizeof( uint8_t ), 1, file );
+			normalise_float( node->childType, p );
 		}
-		case ACM_PROPERTY_TYPE_OBJECT:
+		return true;
+	}
+	else if ( node->type == ACM_PROPERTY_TYPE_OBJECT )
+	{
+		sort_children( node );
+	}
+	else if ( node->type != ACM_PROPERTY_TYPE_ARRAY )
+	{
+		return node->type == ACM_PROPERTY_TYPE_STRING || canonicalise_value( node, isText );
+	}
+
+	for ( AcmBranch *child = node->children.start; child != NULL; child = child->next )
+	{
+		if ( !canonicalise_branch( child, isText ) )
 		{
-			fwrite( &node->numChildren, sizeof( uint32_t ), 1, file );
-			serialize_node_tree( file, node, fileType );
-			break;
+			return false;
 		}
 	}
+
+	return true;
 }
 
-static void serialize_node_tree( FILE *file, AcmBranch *root, AcmFileType fileType )
+static AcmBranch *copy_canonical_branch( AcmBranch *root, AcmFileType fileType )
 {
-	AcmBranch *child = root->children.start;
-	while ( child != NULL )
+	AcmBranch *copy = acm_copy_branch( root );
+	if ( copy == NULL || !canonicalise_branch( copy, fileType == ACM_FILE_TYPE_UTF8 ) )
 	{
-		serialize_node( file, child, fileType );
-		child = child->next;
+		acm_branch_destroy( copy );
+		return NULL;
 	}
+
+	return copy;
 }
 
 /**
  * Serialize the given node set.
  */
 bool acm_write_file( const char *path, AcmBranch *root, AcmFileType fileType )
+{
+	return acm_write_file_ex( path, root, fileType, ACM_WRITE_FLAG_NONE );
+}
+
+static bool serialize_tree( AcmOutput *output, AcmBranch *root, AcmFileType fileType, unsigned int flags )
+{
+	if ( flags & ACM_WRITE_FLAG_CANONICAL )
+	{
+		AcmBranch *copy = copy_canonical_branch( root, fileType );
+		if ( copy == NULL )
+		{
+			return false;
+		}
+
+		bool status = serialize_tree( output, copy, fileType, flags & ~ACM_WRITE_FLAG_CANONICAL );
+		acm_branch_destroy( copy );
+		return status;
+	}
+
+	if ( fileType == ACM_FILE_TYPE_BINARY )
+	{
+		return acm_serialize_binary_( output, root, flags );
+	}
+
+	bool compact = ( flags & ACM_WRITE_FLAG_COMPACT ) != 0;
+	if ( compact )
+	{
+		acm_output_string_( output, ACM_FORMAT_UTF8_HEADER "\n" );
+	}
+	else
+	{
+		acm_output_string_( output, ACM_FORMAT_UTF8_HEADER "\n; this node file has been auto-generated!\n" );
+	}
+
+	bool isContainer = root->type == ACM_PROPERTY_TYPE_OBJECT || root->type == ACM_PROPERTY_TYPE_ARRAY;
+	if ( isContainer && !acm_is_packed_array_( root ) && acm_get_num_threads_() > 1 &&
+	     count_nodes( root, PARALLEL_MIN_NODES ) >= PARALLEL_MIN_NODES )
+	{
+		if ( !serialize_parallel( output, root, compact ) )
+		{
+			return false;
+		}
+	}
+	else
+	{
+		AcmSerializer serializer = { output, 0, compact };
+		serialize_node( &serializer, root );
+	}
+
+	if ( compact )
+	{
+		acm_output_char_( output, '\n' );
+	}
+
+	return !output->failed;
+}
+
+static size_t write_to_file( const void *buf, size_t size, void *user )
+{
+	return fwrite( buf, sizeof( uint8_t ), size, ( FILE * ) user );
+}
+
+bool acm_write_file_ex( const char *path, AcmBranch *root, AcmFileType fileType, unsigned int flags )
 {
 	FILE *file = fopen( path, "wb" );
 	if ( file == NULL )
@@ -1559,23 +2858,67 @@ bool acm_write_file( const char *path, AcmBranch *root, AcmFileType fileType )
 		return false;
 	}
 
-	if ( fileType == ACM_FILE_TYPE_BINARY )
+	bool status = acm_write_to_sink( root, fileType, flags, write_to_file, file );
+	if ( fclose( file ) != 0 && status )
 	{
-		fprintf( file, ACM_FORMAT_BINARY_HEADER_2 );
-		static const unsigned int version = ACM_FORMAT_BINARY_VERSION;
-		fwrite( &version, sizeof( uint32_t ), 1, file );
+		set_error_message( ND_ERROR_IO_WRITE, "failed to close path \"%s\"", path );
+		status = false;
 	}
-	else
+
+	return status;
+}
+
+bool acm_write_to_sink( AcmBranch *root, AcmFileType fileType, unsigned int flags, AcmWriteCallback write, void *user )
+{
+	AcmOutput output;
+	if ( !acm_output_open_( &output, write, user ) )
 	{
-		sDepth = 0;
-		fprintf( file, ACM_FORMAT_UTF8_HEADER "\n; this node file has been auto-generated!\n" );
+		return false;
 	}
 
-	serialize_node( file, root, fileType );
+	bool status = serialize_tree( &output, root, fileType, flags );
+	return acm_output_close_( &output ) && status;
+}
 
-	fclose( file );
+void *acm_write_to_memory( AcmBranch *root, AcmFileType fileType, unsigned int flags, size_t *size )
+{
+	AcmOutput output;
+	if ( !acm_output_open_( &output, NULL, NULL ) )
+	{
+		return NULL;
+	}
 
-	return true;
+	void *buf = serialize_tree( &output, root, fileType, flags ) ? acm_output_release_( &output, size ) : NULL;
+	acm_output_close_( &output );
+
+	return buf;
+}
+
+static size_t hash_output( const void *buf, size_t size, void *user )
+{
+	uint64_t *hash = user;
+	*hash          = acm_hash_bytes_( *hash, buf, size );
+	return size;
+}
+
+bool acm_hash_branch( AcmBranch *root, uint64_t *hash )
+{
+	*hash = ACM_HASH_BASIS;
+	return acm_write_to_sink( root, ACM_FILE_TYPE_BINARY, ACM_WRITE_FLAG_CANONICAL, hash_output, hash );
+}
+
+bool acm_write_to_buffer( AcmBranch *root, AcmFileType fileType, unsigned int flags, void *buf, size_t bufSize, size_t *size )
+{
+	AcmOutput output;
+	acm_output_open_fixed_( &output, buf, bufSize );
+
+	bool status = serialize_tree( &output, root, fileType, flags );
+	if ( status && size != NULL )
+	{
+		*size = output.length;
+	}
+
+	return acm_output_close_( &output ) && status;
 }
 
 /******************************************/
@@ -1591,11 +2934,25 @@ void acm_print_tree( AcmBranch *self, int index )
 		const char *name = ( self->name.buf != NULL ) ? self->name.buf : "";
 		if ( self->type == ACM_PROPERTY_TYPE_OBJECT )
 		{
-			Message( "%s (%s)\n", name, string_for_property_type( self->type ) );
+			Message( "%s (%s)\n", name, acm_string_for_property_type_( self->type ) );
 		}
 		else
 		{
-			Message( "%s (%s %s)\n", name, string_for_property_type( self->type ), string_for_property_type( self->childType ) );
+			Message( "%s (%s %s)\n", name, acm_string_for_property_type_( self->type ), acm_string_for_property_type_( self->childType ) );
+		}
+
+		if ( acm_is_packed_array_( self ) )
+		{
+			size_t         typeSize = acm_get_type_size_( self->childType );
+			const uint8_t *p        = self->packed.buf;
+			for ( unsigned int i = 0; i < self->packed.numElements; ++i, p += typeSize )
+			{
+				char str[ 64 ];
+				acm_format_value_( self->childType, p, str, sizeof( str ) );
+				for ( int j = 0; j < index; ++j ) printf( "\t" );
+				Message( "%s %s\n", acm_string_for_property_type_( self->childType ), str );
+			}
+			return;
 		}
 
 		AcmBranch *child = acm_get_first_child( self );
@@ -1610,11 +2967,11 @@ void acm_print_tree( AcmBranch *self, int index )
 		AcmBranch *parent = acm_get_parent( self );
 		if ( parent != NULL && parent->type == ACM_PROPERTY_TYPE_ARRAY )
 		{
-			Message( "%s %s\n", string_for_property_type( self->type ), self->data.buf );
+			Message( "%s %s\n", acm_string_for_property_type_( self->type ), self->data.buf );
 		}
 		else
 		{
-			Message( "%s %s %s\n", string_for_property_type( self->type ), self->name.buf, self->data.buf );
+			Message( "%s %s %s\n", acm_string_for_property_type_( self->type ), self->name.buf, self->data.buf );
 		}
 	}
 }
@@ -0,0 +1,3769 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+
+#if defined( _WIN32 )
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#	include <io.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+// MSVC has no macro for F16C, but every CPU with AVX2 has it
+#if defined( __F16C__ ) || ( defined( _MSC_VER ) && defined( __AVX2__ ) )
+#	define ACM_HAS_F16C
+#	include <immintrin.h>
+#endif
+
+/******************************************/
+/** Deserialisation **/
+
+typedef struct AcmBinaryReader
+{
+	uint32_t version;
+	uint32_t flags;
+	bool     borrow; /* point into the buffer rather than copying, for mapped files */
+
+	const AcmString *strings; /* shared strings, as views into the table */
+	uint32_t         numStrings;
+
+	const uint8_t *base;       /* start of the buffer being decoded */
+	uint64_t       baseOffset; /* where that sits in the file, for reporting errors */
+} AcmBinaryReader;
+
+/* container that's still having its children read */
+typedef struct AcmBinaryFrame
+{
+	AcmBranch  *node;
+	uint32_t    numPending; /* child nodes still to come */
+	const void *end;        /* end of the payload, NULL prior to v3 */
+	size_t      endSize;    /* what's left of the buffer from there */
+} AcmBinaryFrame;
+
+/**
+ * Flags up malformed data, along with where in the file it was found,
+ * which is also available afterwards via acm_get_error_offset.
+ */
+static void set_decode_error( const AcmBinaryReader *reader, const void *at, AcmErrorCode type, const char *msg, ... )
+{
+	char    str[ 256 ];
+	va_list args;
+	va_start( args, msg );
+	vsnprintf( str, sizeof( str ), msg, args );
+	va_end( args );
+
+	uint64_t offset = reader->baseOffset + ( uint64_t ) ( ( const uint8_t * ) at - reader->base );
+	acm_set_error_message_( type, "%s (offset %" PRIu64 ")", str, offset );
+	acm_set_error_offset_( offset );
+}
+
+static const char *get_node_name( const AcmBranch *node )
+{
+	return node->name.buf != NULL ? node->name.buf : "unnamed";
+}
+
+static const void *read_buf( const void **buf, size_t *bufSize, size_t elementSize )
+{
+	if ( elementSize == 0 || *bufSize < elementSize )
+	{
+		return NULL;
+	}
+
+	const void *p = *buf;
+	*buf          = ( const char * ) ( *buf ) + elementSize;
+	*bufSize -= elementSize;
+	return p;
+}
+
+static bool read_varint( const void **buf, size_t *bufSize, uint64_t *value )
+{
+	*value = 0;
+	for ( unsigned int shift = 0; shift < 64; shift += 7 )
+	{
+		const uint8_t *byte = read_buf( buf, bufSize, sizeof( uint8_t ) );
+		if ( byte == NULL )
+		{
+			return false;
+		}
+
+		*value |= ( uint64_t ) ( *byte & 0x7F ) << shift;
+		if ( !( *byte & 0x80 ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Lengths and counts are fixed width, unless the file was written
+ * compact, in which case they're varints.
+ */
+static bool read_count( const void **buf, size_t *bufSize, size_t fixedSize, const AcmBinaryReader *reader, uint64_t *value )
+{
+	if ( reader->flags & ACM_BINARY_FLAG_VARINTS )
+	{
+		return read_varint( buf, bufSize, value );
+	}
+
+	const void *p = read_buf( buf, bufSize, fixedSize );
+	if ( p == NULL )
+	{
+		return false;
+	}
+
+	*value = 0;
+	memcpy( value, p, fixedSize );
+	return true;
+}
+
+/* dst->bufSize is the length, including the terminator, which has to be there */
+static bool read_string( const void **buf, size_t *bufSize, AcmString *dst, const AcmBinaryReader *reader )
+{
+	if ( dst->bufSize == 0 )
+	{
+		dst->buf = NULL;
+		return true;
+	}
+
+	const char *src = read_buf( buf, bufSize, dst->bufSize );
+	if ( src == NULL )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading string (%u bytes)", dst->bufSize );
+		return false;
+	}
+	else if ( src[ dst->bufSize - 1 ] != '\0' )
+	{
+		set_decode_error( reader, src, ND_ERROR_INVALID_DATA, "unterminated string (%u bytes)", dst->bufSize );
+		return false;
+	}
+
+	// strings are stored with their terminator, so can be used in place
+	if ( reader->borrow )
+	{
+		dst->buf        = ( char * ) src;
+		dst->isBorrowed = true;
+		return true;
+	}
+
+	dst->buf = ACM_NEW_( char, dst->bufSize );
+	if ( dst->buf == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate string (%u bytes)", dst->bufSize );
+		return false;
+	}
+
+	memcpy( dst->buf, src, dst->bufSize );
+	return true;
+}
+
+/**
+ * Reads the shared string table. Entries are kept as views into the
+ * buffer, so it needs to stick around for as long as the reader does.
+ */
+static bool parse_string_table( const void *table, size_t tableSize, uint64_t numStrings, AcmBinaryReader *reader )
+{
+	if ( numStrings > tableSize )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "invalid string table (%" PRIu64 " strings in %zu bytes)", numStrings, tableSize );
+		return false;
+	}
+
+	AcmString *strings = ACM_NEW_( AcmString, numStrings + 1 );
+	if ( strings == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate string table (%" PRIu64 " strings)", numStrings );
+		return false;
+	}
+
+	for ( uint64_t i = 0; i < numStrings; ++i )
+	{
+		uint64_t    length;
+		const char *src = NULL;
+		if ( read_count( &table, &tableSize, sizeof( uint16_t ), reader, &length ) && length > 0 && length <= UINT16_MAX )
+		{
+			src = read_buf( &table, &tableSize, length );
+		}
+
+		if ( src == NULL || src[ length - 1 ] != '\0' )
+		{
+			acm_set_error_message_( ND_ERROR_INVALID_DATA, "invalid string table entry (%" PRIu64 ")", i );
+			ACM_DELETE( strings );
+			return false;
+		}
+
+		strings[ i ].buf        = ( char * ) src;
+		strings[ i ].bufSize    = ( uint16_t ) length;
+		strings[ i ].isBorrowed = true;
+	}
+
+	reader->strings    = strings;
+	reader->numStrings = ( uint32_t ) numStrings;
+	return true;
+}
+
+static bool read_string_table( const void **buf, size_t *bufSize, AcmBinaryReader *reader )
+{
+	uint64_t numStrings, tableSize;
+	if ( !read_count( buf, bufSize, sizeof( uint32_t ), reader, &numStrings ) ||
+	     !read_count( buf, bufSize, sizeof( uint64_t ), reader, &tableSize ) ||
+	     numStrings > UINT32_MAX || tableSize > *bufSize )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "invalid string table header" );
+		return false;
+	}
+
+	const void *table = *buf;
+	*buf              = ( const uint8_t * ) *buf + tableSize;
+	*bufSize -= ( size_t ) tableSize;
+
+	return parse_string_table( table, ( size_t ) tableSize, numStrings, reader );
+}
+
+/* references are the index of the entry plus one, leaving 0 for none */
+static bool get_shared_string( const AcmBinaryReader *reader, const void *at, uint64_t ref, AcmString *dst )
+{
+	if ( ref == 0 || ref > reader->numStrings )
+	{
+		set_decode_error( reader, at, ND_ERROR_INVALID_DATA, "invalid string reference (%" PRIu64 " of %u)", ref, reader->numStrings );
+		return false;
+	}
+
+	const AcmString *src = &reader->strings[ ref - 1 ];
+	dst->bufSize         = src->bufSize;
+	if ( reader->borrow )
+	{
+		dst->buf        = src->buf;
+		dst->isBorrowed = true;
+		return true;
+	}
+
+	dst->buf = ACM_NEW_( char, src->bufSize );
+	if ( dst->buf == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate string (%u bytes)", src->bufSize );
+		return false;
+	}
+
+	memcpy( dst->buf, src->buf, src->bufSize );
+	return true;
+}
+
+static bool deserialize_string_var( const void **buf, size_t *bufSize, AcmString *dst, const AcmBinaryReader *reader )
+{
+	memset( dst, 0, sizeof( AcmString ) );
+
+	const void *at = *buf;
+	uint64_t    length;
+	if ( reader->flags & ACM_BINARY_FLAG_STRING_TABLE )
+	{
+		// names always come from the table
+		if ( !read_count( buf, bufSize, sizeof( uint32_t ), reader, &length ) )
+		{
+			set_decode_error( reader, at, ND_ERROR_IO_READ, "unexpected end of data reading name" );
+			return false;
+		}
+
+		return length == 0 || get_shared_string( reader, at, length, dst );
+	}
+
+	if ( !read_count( buf, bufSize, sizeof( uint16_t ), reader, &length ) )
+	{
+		set_decode_error( reader, at, ND_ERROR_IO_READ, "unexpected end of data reading name" );
+		return false;
+	}
+	else if ( length > UINT16_MAX )
+	{
+		set_decode_error( reader, at, ND_ERROR_INVALID_DATA, "invalid name length (%" PRIu64 ")", length );
+		return false;
+	}
+
+	dst->bufSize = ( uint16_t ) length;
+	return read_string( buf, bufSize, dst, reader );
+}
+
+static bool deserialize_string_value( const void **buf, size_t *bufSize, AcmString *dst, const AcmBinaryReader *reader )
+{
+	memset( dst, 0, sizeof( AcmString ) );
+
+	// with a string table, the value is either shared or follows inline
+	const void *at = *buf;
+	uint64_t    length;
+	if ( reader->flags & ACM_BINARY_FLAG_STRING_TABLE )
+	{
+		if ( !read_count( buf, bufSize, sizeof( uint32_t ), reader, &length ) )
+		{
+			set_decode_error( reader, at, ND_ERROR_IO_READ, "unexpected end of data reading string" );
+			return false;
+		}
+		else if ( length > 0 )
+		{
+			return get_shared_string( reader, at, length, dst );
+		}
+
+		at = *buf;
+	}
+
+	if ( !read_count( buf, bufSize, sizeof( uint16_t ), reader, &length ) )
+	{
+		set_decode_error( reader, at, ND_ERROR_IO_READ, "unexpected end of data reading string" );
+		return false;
+	}
+	else if ( length > UINT16_MAX )
+	{
+		set_decode_error( reader, at, ND_ERROR_INVALID_DATA, "invalid string length (%" PRIu64 ")", length );
+		return false;
+	}
+
+	dst->bufSize = ( uint16_t ) length;
+	return read_string( buf, bufSize, dst, reader );
+}
+
+static void free_string( AcmString *string )
+{
+	if ( !string->isBorrowed )
+	{
+		ACM_DELETE( string->buf );
+	}
+}
+
+/**
+ * Elements of scalar arrays are read straight into the native buffer,
+ * rather than creating a branch for each.
+ */
+static bool deserialize_packed_elements( const void **buf, size_t *bufSize, AcmBranch *node, unsigned int numElements, const AcmBinaryReader *reader )
+{
+	if ( !acm_reserve_packed_values_( node, numElements ) )
+	{
+		return false;
+	}
+
+	size_t typeSize = acm_get_type_size_( node->childType );
+	for ( unsigned int i = 0; i < numElements; ++i )
+	{
+		AcmString name;
+		if ( !deserialize_string_var( buf, bufSize, &name, reader ) )
+		{
+			return false;
+		}
+		free_string( &name );
+
+		const int8_t *type = read_buf( buf, bufSize, sizeof( int8_t ) );
+		const void   *data = ( type != NULL ) ? read_buf( buf, bufSize, typeSize ) : NULL;
+		if ( data == NULL )
+		{
+			set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading element (%u) of array (%s)", i, get_node_name( node ) );
+			return false;
+		}
+		else if ( *type != node->childType )
+		{
+			set_decode_error( reader, type, ND_ERROR_INVALID_TYPE, "unexpected element type (%d) in array (%s)", *type, get_node_name( node ) );
+			return false;
+		}
+
+		if ( node->childType == ACM_PROPERTY_TYPE_BOOL )
+		{
+			uint8_t v = *( const uint8_t * ) data != 0;
+			acm_push_packed_values_( node, &v, 1 );
+		}
+		else
+		{
+			acm_push_packed_values_( node, data, 1 );
+		}
+
+		// slapped on fix for a bug with serialisation in older versions
+		if ( reader->version < 2 && ( node->childType == ND_PROPERTY_INT16 || node->childType == ND_PROPERTY_UI16 ) &&
+		     read_buf( buf, bufSize, sizeof( uint32_t ) ) == NULL )
+		{
+			set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading element (%u) of array (%s)", i, get_node_name( node ) );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Scalar arrays written as a single block, which is either copied in one
+ * go or, for mapped files, used in place.
+ */
+static bool deserialize_packed_block( const void **buf, size_t *bufSize, AcmBranch *node, unsigned int numElements, const AcmBinaryReader *reader )
+{
+	const uint8_t *padding = read_buf( buf, bufSize, sizeof( uint8_t ) );
+	if ( padding == NULL || ( *padding > 0 && read_buf( buf, bufSize, *padding ) == NULL ) )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading block padding for array (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	if ( numElements == 0 )
+	{
+		return true;
+	}
+
+	size_t      typeSize = acm_get_type_size_( node->childType );
+	const void *data     = ( numElements <= SIZE_MAX / typeSize ) ? read_buf( buf, bufSize, numElements * typeSize ) : NULL;
+	if ( data == NULL )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading element block for array (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	// bools get normalised on the way in, so always take a copy of those
+	if ( reader->borrow && node->childType != ACM_PROPERTY_TYPE_BOOL && ( ( uintptr_t ) data % typeSize ) == 0 )
+	{
+		node->packed.buf         = ( void * ) data;
+		node->packed.numElements = numElements;
+		node->packed.isBorrowed  = true;
+		node->numChildren        = numElements;
+		return true;
+	}
+
+	if ( !acm_push_packed_values_( node, data, numElements ) )
+	{
+		return false;
+	}
+
+	if ( node->childType == ACM_PROPERTY_TYPE_BOOL )
+	{
+		uint8_t *p = node->packed.buf;
+		for ( unsigned int i = 0; i < numElements; ++i )
+		{
+			p[ i ] = p[ i ] != 0;
+		}
+	}
+
+	return true;
+}
+
+static bool is_signed_integer( AcmPropertyType type )
+{
+	return type == ND_PROPERTY_INT8 || type == ND_PROPERTY_INT16 || type == ND_PROPERTY_INT32 || type == ND_PROPERTY_INT64;
+}
+
+static bool is_integer( AcmPropertyType type )
+{
+	return is_signed_integer( type ) || type == ND_PROPERTY_UI8 || type == ND_PROPERTY_UI16 || type == ND_PROPERTY_UI32 || type == ND_PROPERTY_UI64;
+}
+
+/* widens an integer element to 64 bits, sign extending where needed */
+static uint64_t load_integer( const uint8_t *p, AcmPropertyType type, size_t typeSize )
+{
+	switch ( type )
+	{
+		default:
+		{
+			uint64_t v = 0;
+			memcpy( &v, p, typeSize );
+			return v;
+		}
+		case ND_PROPERTY_INT8:
+		{
+			int8_t v;
+			memcpy( &v, p, sizeof( int8_t ) );
+			return ( uint64_t ) ( int64_t ) v;
+		}
+		case ND_PROPERTY_INT16:
+		{
+			int16_t v;
+			memcpy( &v, p, sizeof( int16_t ) );
+			return ( uint64_t ) ( int64_t ) v;
+		}
+		case ND_PROPERTY_INT32:
+		{
+			int32_t v;
+			memcpy( &v, p, sizeof( int32_t ) );
+			return ( uint64_t ) ( int64_t ) v;
+		}
+	}
+}
+
+/**
+ * Each value is read from the 8 bytes it starts in, plus the byte after
+ * for the bits of wide values that spill over, so the same few loads,
+ * shifts and masks work for every width, with nothing to branch on.
+ * Every value has to start at least 9 bytes before the end of src.
+ */
+static void unpack_words( const uint8_t *src, uint64_t bit, unsigned int bitWidth, uint64_t *dst, unsigned int count )
+{
+	uint64_t mask = UINT64_MAX >> ( 64 - bitWidth );
+	for ( unsigned int i = 0; i < count; ++i, bit += bitWidth )
+	{
+		size_t       byte  = ( size_t ) ( bit >> 3 );
+		unsigned int shift = ( unsigned int ) ( bit & 7 );
+
+		uint64_t word;
+		memcpy( &word, src + byte, sizeof( uint64_t ) );
+
+		// shifted in two steps, as the spill has nowhere to go when shift is 0
+		uint64_t spill = ( ( uint64_t ) src[ byte + sizeof( uint64_t ) ] << 1 ) << ( 63 - shift );
+		dst[ i ]       = ( ( word >> shift ) | spill ) & mask;
+	}
+}
+
+/**
+ * Unpacks a run of values of the given bit width. Those that end too
+ * close to the end of src for a whole word are read from a zero padded
+ * copy of the last few bytes instead.
+ */
+static void unpack_bits( const uint8_t *src, size_t srcSize, uint64_t bit, unsigned int bitWidth, uint64_t *dst, unsigned int count )
+{
+	if ( bitWidth == 0 )
+	{
+		memset( dst, 0, sizeof( uint64_t ) * count );
+		return;
+	}
+
+	// values starting before this bit can be read straight from src
+	uint64_t     endBit    = srcSize > sizeof( uint64_t ) ? ( uint64_t ) ( srcSize - sizeof( uint64_t ) ) * 8 : 0;
+	uint64_t     numDirect = endBit > bit ? ( endBit - bit + bitWidth - 1 ) / bitWidth : 0;
+	unsigned int numWords  = numDirect < count ? ( unsigned int ) numDirect : count;
+	unpack_words( src, bit, bitWidth, dst, numWords );
+	if ( numWords == count )
+	{
+		return;
+	}
+
+	// the rest start in the last 8 bytes
+	uint8_t  tail[ sizeof( uint64_t ) * 2 + 1 ] = { 0 };
+	uint64_t tailBit                             = bit + ( uint64_t ) numWords * bitWidth;
+	size_t   tailStart                           = ( size_t ) ( tailBit >> 3 );
+	memcpy( tail, src + tailStart, srcSize - tailStart );
+	unpack_words( tail, tailBit - ( uint64_t ) tailStart * 8, bitWidth, dst + numWords, count - numWords );
+}
+
+/**
+ * Integer arrays stored as frame-of-reference (optionally on the deltas
+ * between elements), bit-packed to the width of the largest offset.
+ */
+static bool deserialize_bitpacked_block( const void **buf, size_t *bufSize, AcmBranch *node, unsigned int numElements, const AcmBinaryReader *reader )
+{
+	const uint8_t *header = read_buf( buf, bufSize, ACM_BINARY_BITPACK_HEADER );
+	if ( header == NULL )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading bit-packed header for array (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	uint8_t  mode     = header[ 0 ];
+	uint8_t  bitWidth = header[ 1 ];
+	uint64_t first, reference;
+	memcpy( &first, header + 2, sizeof( uint64_t ) );
+	memcpy( &reference, header + 2 + sizeof( uint64_t ), sizeof( uint64_t ) );
+	if ( mode > ACM_BINARY_BITPACK_DELTA || bitWidth > 64 )
+	{
+		set_decode_error( reader, header, ND_ERROR_INVALID_DATA, "invalid bit-packing (mode %u, %u bits) for array (%s)", mode, bitWidth, get_node_name( node ) );
+		return false;
+	}
+
+	// everything else takes up space in the file, but a run of the
+	// same value (or step) takes none, so has a limit of its own
+	if ( bitWidth == 0 && numElements > ACM_BINARY_MAX_ELEMENTS )
+	{
+		set_decode_error( reader, header, ND_ERROR_LIMIT_EXCEEDED, "too many elements (%u) in bit-packed array (%s)", numElements, get_node_name( node ) );
+		return false;
+	}
+
+	unsigned int   count    = ( mode == ACM_BINARY_BITPACK_DELTA && numElements > 0 ) ? numElements - 1 : numElements;
+	uint64_t       dataSize = ( ( uint64_t ) count * bitWidth + 7 ) / 8;
+	const uint8_t *data     = NULL;
+	if ( dataSize > 0 && ( dataSize > *bufSize || ( data = read_buf( buf, bufSize, ( size_t ) dataSize ) ) == NULL ) )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading bit-packed array (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	if ( !acm_reserve_packed_values_( node, numElements ) )
+	{
+		return false;
+	}
+
+	size_t typeSize = acm_get_type_size_( node->childType );
+	if ( mode == ACM_BINARY_BITPACK_DELTA && numElements > 0 )
+	{
+		acm_push_packed_values_( node, &first, 1 );
+	}
+
+	// decoded in batches, to keep everything on the stack
+	uint64_t values[ 256 ];
+	uint8_t  elements[ 256 * sizeof( uint64_t ) ];
+	uint64_t previous = first;
+	for ( unsigned int start = 0; start < count; start += 256 )
+	{
+		unsigned int n = ( count - start ) < 256 ? ( count - start ) : 256;
+		unpack_bits( data, ( size_t ) dataSize, ( uint64_t ) start * bitWidth, bitWidth, values, n );
+
+		for ( unsigned int i = 0; i < n; ++i )
+		{
+			values[ i ] += reference;
+		}
+
+		if ( mode == ACM_BINARY_BITPACK_DELTA )
+		{
+			for ( unsigned int i = 0; i < n; ++i )
+			{
+				previous += values[ i ];
+				values[ i ] = previous;
+			}
+		}
+
+		for ( unsigned int i = 0; i < n; ++i )
+		{
+			memcpy( elements + i * typeSize, &values[ i ], typeSize );
+		}
+
+		if ( !acm_push_packed_values_( node, elements, n ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+size_t acm_get_quantized_size_( uint8_t encoding )
+{
+	return encoding == ACM_BINARY_QUANTIZE_FIXED_8 ? sizeof( uint8_t ) : sizeof( uint16_t );
+}
+
+/**
+ * Same as acm_half_to_float_, but without any branches, so the loop
+ * can be vectorised where there's no F16C to do it for us.
+ */
+static void decode_half_floats( const uint8_t *src, float *dst, unsigned int count )
+{
+	unsigned int i = 0;
+#if defined( ACM_HAS_F16C )
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		__m128i h = _mm_loadu_si128( ( const __m128i * ) ( src + i * sizeof( uint16_t ) ) );
+		_mm256_storeu_ps( dst + i, _mm256_cvtph_ps( h ) );
+	}
+#endif
+
+	// exponent is rebiased by scaling, which also takes care of infinities and nans,
+	// while subnormals are pulled out by subtracting the implicit bit
+	static const float expScale = 0x1.0p-112f;
+	for ( ; i < count; ++i )
+	{
+		uint16_t h;
+		memcpy( &h, src + i * sizeof( uint16_t ), sizeof( uint16_t ) );
+
+		uint32_t w    = ( uint32_t ) h << 17;
+		uint32_t sign = ( uint32_t ) ( h & 0x8000 ) << 16;
+
+		uint32_t normalBits    = ( w >> 4 ) + ( 0xE0U << 23 );
+		uint32_t subnormalBits = ( w >> 17 ) | ( 126U << 23 );
+		float    normal, subnormal;
+		memcpy( &normal, &normalBits, sizeof( float ) );
+		memcpy( &subnormal, &subnormalBits, sizeof( float ) );
+		normal *= expScale;
+		subnormal -= 0.5f;
+		memcpy( &normalBits, &normal, sizeof( uint32_t ) );
+		memcpy( &subnormalBits, &subnormal, sizeof( uint32_t ) );
+
+		uint32_t mask = 0U - ( uint32_t ) ( w < ( 1U << 27 ) );
+		uint32_t bits = sign | ( subnormalBits & mask ) | ( normalBits & ~mask );
+		memcpy( &dst[ i ], &bits, sizeof( float ) );
+	}
+}
+
+/**
+ * Expands quantized elements back out to the array's own type. Plain
+ * loads, multiplies and adds, so these loops get vectorised too.
+ */
+void acm_dequantize_( const AcmQuantization *quantization, AcmPropertyType type, const uint8_t *src, void *dst, unsigned int count )
+{
+	if ( quantization->encoding == ACM_BINARY_QUANTIZE_HALF )
+	{
+		if ( type == ACM_PROPERTY_TYPE_FLOAT32 )
+		{
+			decode_half_floats( src, dst, count );
+			return;
+		}
+
+		// doubles are decoded to floats first, and then widened
+		double *values = dst;
+		float   floats[ 64 ];
+		for ( unsigned int start = 0; start < count; start += 64 )
+		{
+			unsigned int n = ( count - start ) < 64 ? ( count - start ) : 64;
+			decode_half_floats( src + start * sizeof( uint16_t ), floats, n );
+			for ( unsigned int i = 0; i < n; ++i )
+			{
+				values[ start + i ] = floats[ i ];
+			}
+		}
+		return;
+	}
+
+	unsigned int levels = quantization->encoding == ACM_BINARY_QUANTIZE_FIXED_8 ? UINT8_MAX : UINT16_MAX;
+	double       step   = ( quantization->maxValue - quantization->minValue ) / levels;
+	if ( type == ACM_PROPERTY_TYPE_FLOAT32 )
+	{
+		float  minValue = ( float ) quantization->minValue;
+		float  stepF    = ( float ) step;
+		float *values   = dst;
+		if ( quantization->encoding == ACM_BINARY_QUANTIZE_FIXED_8 )
+		{
+			for ( unsigned int i = 0; i < count; ++i )
+			{
+				values[ i ] = minValue + ( float ) src[ i ] * stepF;
+			}
+			return;
+		}
+
+		for ( unsigned int i = 0; i < count; ++i )
+		{
+			uint16_t q;
+			memcpy( &q, src + i * sizeof( uint16_t ), sizeof( uint16_t ) );
+			values[ i ] = minValue + ( float ) q * stepF;
+		}
+		return;
+	}
+
+	double *values = dst;
+	for ( unsigned int i = 0; i < count; ++i )
+	{
+		uint16_t q = src[ i ];
+		if ( quantization->encoding == ACM_BINARY_QUANTIZE_FIXED_16 )
+		{
+			memcpy( &q, src + i * sizeof( uint16_t ), sizeof( uint16_t ) );
+		}
+		values[ i ] = quantization->minValue + ( double ) q * step;
+	}
+}
+
+/**
+ * Float arrays stored at reduced precision, either as half floats or
+ * as fixed point steps between the smallest and largest values.
+ */
+static bool deserialize_quantized_block( const void **buf, size_t *bufSize, AcmBranch *node, unsigned int numElements, const AcmBinaryReader *reader )
+{
+	const uint8_t *header = read_buf( buf, bufSize, ACM_BINARY_QUANTIZE_HEADER );
+	if ( header == NULL )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading quantization header for array (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	AcmQuantization quantization;
+	quantization.encoding = header[ 0 ];
+	memcpy( &quantization.minValue, header + 1, sizeof( double ) );
+	memcpy( &quantization.maxValue, header + 1 + sizeof( double ), sizeof( double ) );
+	if ( quantization.encoding > ACM_BINARY_QUANTIZE_FIXED_16 ||
+	     ( quantization.encoding != ACM_BINARY_QUANTIZE_HALF && !( quantization.minValue <= quantization.maxValue ) ) )
+	{
+		set_decode_error( reader, header, ND_ERROR_INVALID_DATA, "invalid quantization (%u) for array (%s)", quantization.encoding, get_node_name( node ) );
+		return false;
+	}
+
+	size_t         elementSize = acm_get_quantized_size_( quantization.encoding );
+	const uint8_t *data        = NULL;
+	if ( numElements > 0 && ( data = read_buf( buf, bufSize, numElements * elementSize ) ) == NULL )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading quantized array (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	if ( !acm_reserve_packed_values_( node, numElements ) )
+	{
+		return false;
+	}
+
+	// decoded in batches, to keep everything on the stack
+	union
+	{
+		float  f32[ 256 ];
+		double f64[ 256 ];
+	} elements;
+	for ( unsigned int start = 0; start < numElements; start += 256 )
+	{
+		unsigned int n = ( numElements - start ) < 256 ? ( numElements - start ) : 256;
+		acm_dequantize_( &quantization, node->childType, data + start * elementSize, &elements, n );
+		if ( !acm_push_packed_values_( node, &elements, n ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool deserialize_table_field( const void **buf, size_t *bufSize, AcmBranch *row, const AcmString *name, AcmPropertyType type, const AcmBinaryReader *reader )
+{
+	// borrowed names can be shared by every row, otherwise each gets a copy
+	AcmBranch *field = acm_push_new_branch( row, name->isBorrowed ? NULL : name->buf, type, ACM_PROPERTY_TYPE_INVALID );
+	if ( field == NULL )
+	{
+		return false;
+	}
+	else if ( name->isBorrowed )
+	{
+		field->name = *name;
+	}
+
+	if ( type == ACM_PROPERTY_TYPE_STRING )
+	{
+		return deserialize_string_value( buf, bufSize, &field->data, reader );
+	}
+
+	size_t      typeSize = acm_get_type_size_( type );
+	const void *data     = read_buf( buf, bufSize, typeSize );
+	if ( data == NULL )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading field (%s)", get_node_name( field ) );
+		return false;
+	}
+
+	uint64_t value = 0;
+	memcpy( &value, data, typeSize );
+
+	char str[ 64 ];
+	acm_format_value_( type, &value, str, sizeof( str ) );
+	return acm_alloc_var_string_( str, &field->data ) != NULL;
+}
+
+/**
+ * Rows of a table are rebuilt as regular objects, with each
+ * field taking its name and type from the schema.
+ */
+static bool deserialize_table( const void **buf, size_t *bufSize, AcmBranch *node, unsigned int numRows, const AcmBinaryReader *reader )
+{
+	const void *at = *buf;
+	uint64_t    numFields;
+	if ( node->childType != ACM_PROPERTY_TYPE_OBJECT || !read_count( buf, bufSize, sizeof( uint32_t ), reader, &numFields ) ||
+	     numFields == 0 || numFields > *bufSize )
+	{
+		set_decode_error( reader, at, ND_ERROR_INVALID_DATA, "invalid table schema for array (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	AcmString       *names = ACM_NEW_( AcmString, numFields );
+	AcmPropertyType *types = ACM_NEW_( AcmPropertyType, numFields );
+	if ( names == NULL || types == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate table schema (%" PRIu64 " fields)", numFields );
+		ACM_DELETE( names );
+		ACM_DELETE( types );
+		return false;
+	}
+
+	bool     status = true;
+	uint64_t i;
+	for ( i = 0; i < numFields; ++i )
+	{
+		if ( !deserialize_string_var( buf, bufSize, &names[ i ], reader ) )
+		{
+			status = false;
+			break;
+		}
+
+		at                 = *buf;
+		const int8_t *type = read_buf( buf, bufSize, sizeof( int8_t ) );
+		if ( names[ i ].buf == NULL || type == NULL || *type <= ACM_PROPERTY_TYPE_INVALID || *type >= ACM_MAX_PROPERTY_TYPES ||
+		     ( *type != ACM_PROPERTY_TYPE_STRING && acm_get_type_size_( ( AcmPropertyType ) *type ) == 0 ) )
+		{
+			set_decode_error( reader, at, ND_ERROR_INVALID_DATA, "invalid table field (%" PRIu64 ") for array (%s)", i, get_node_name( node ) );
+			status = false;
+			i++;
+			break;
+		}
+
+		types[ i ] = ( AcmPropertyType ) *type;
+	}
+
+	// every field takes at least a byte
+	if ( status && numRows > *bufSize / numFields )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_INVALID_DATA, "too many rows (%u) for table array (%s)", numRows, get_node_name( node ) );
+		status = false;
+	}
+
+	for ( unsigned int row = 0; row < numRows && status; ++row )
+	{
+		AcmBranch *object = acm_push_new_branch( node, NULL, ACM_PROPERTY_TYPE_OBJECT, ACM_PROPERTY_TYPE_INVALID );
+		if ( object == NULL )
+		{
+			status = false;
+			break;
+		}
+
+		for ( uint64_t field = 0; field < numFields; ++field )
+		{
+			if ( !deserialize_table_field( buf, bufSize, object, &names[ field ], types[ field ], reader ) )
+			{
+				status = false;
+				break;
+			}
+		}
+	}
+
+	while ( i-- > 0 )
+	{
+		free_string( &names[ i ] );
+	}
+	ACM_DELETE( names );
+	ACM_DELETE( types );
+
+	return status;
+}
+
+static bool is_valid_type( int8_t type )
+{
+	return type > ACM_PROPERTY_TYPE_INVALID && type < ACM_MAX_PROPERTY_TYPES;
+}
+
+/**
+ * Decodes the value of a scalar or string node.
+ */
+static bool deserialize_value( const void **buf, size_t *bufSize, AcmBranch *node, const AcmBinaryReader *reader )
+{
+	if ( node->type == ACM_PROPERTY_TYPE_STRING )
+	{
+		return deserialize_string_value( buf, bufSize, &node->data, reader );
+	}
+
+	size_t typeSize = acm_get_type_size_( node->type );
+	if ( typeSize == 0 )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_INVALID_TYPE, "unhandled type (%u) for node (%s)", node->type, get_node_name( node ) );
+		return false;
+	}
+
+	// data isn't necessarily aligned, so take a copy
+	const void *data = read_buf( buf, bufSize, typeSize );
+	if ( data == NULL )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading value of node (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	uint64_t value = 0;
+	memcpy( &value, data, typeSize );
+
+	char str[ 64 ];
+	acm_format_value_( node->type, &value, str, sizeof( str ) );
+	if ( acm_alloc_var_string_( str, &node->data ) == NULL )
+	{
+		return false;
+	}
+
+	// slapped on fix for a bug with serialisation in older versions
+	if ( reader->version < 2 && ( node->type == ND_PROPERTY_INT16 || node->type == ND_PROPERTY_UI16 ) &&
+	     read_buf( buf, bufSize, sizeof( uint32_t ) ) == NULL )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_IO_READ, "unexpected end of data reading value of node (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Reads the count and, from v3 on, the flags and payload size of a
+ * container. Elements stored as a block are decoded there and then,
+ * otherwise the frame is left with the number of child nodes to come,
+ * and the buffer is cut down to the payload so they can't overrun it.
+ */
+static bool deserialize_container( const void **buf, size_t *bufSize, AcmBranch *node, const AcmBinaryReader *reader, AcmBinaryFrame *frame )
+{
+	const void *at = *buf;
+	uint64_t    numChildren;
+	if ( !read_count( buf, bufSize, sizeof( uint32_t ), reader, &numChildren ) )
+	{
+		set_decode_error( reader, at, ND_ERROR_IO_READ, "unexpected end of data reading child count of node (%s)", get_node_name( node ) );
+		return false;
+	}
+	else if ( numChildren > UINT32_MAX )
+	{
+		set_decode_error( reader, at, ND_ERROR_INVALID_DATA, "invalid child count (%" PRIu64 ") for node (%s)", numChildren, get_node_name( node ) );
+		return false;
+	}
+
+	// v3 onwards stores the size of everything under the container,
+	// so we can carry on from the end of it regardless of what's inside
+	uint8_t containerFlags = 0;
+	if ( reader->version >= 3 )
+	{
+		at                   = *buf;
+		const uint8_t *flags = read_buf( buf, bufSize, sizeof( uint8_t ) );
+		uint64_t       payloadSize;
+		if ( flags == NULL || !read_count( buf, bufSize, sizeof( uint64_t ), reader, &payloadSize ) || payloadSize > *bufSize )
+		{
+			set_decode_error( reader, at, ND_ERROR_INVALID_DATA, "invalid payload size for node (%s)", get_node_name( node ) );
+			return false;
+		}
+
+		containerFlags = *flags;
+		frame->end     = ( const uint8_t * ) *buf + payloadSize;
+		frame->endSize = *bufSize - ( size_t ) payloadSize;
+		*bufSize       = ( size_t ) payloadSize;
+	}
+
+	// bit-packed elements can take less than a byte each, so are checked
+	// as they're read, but everything else takes up at least one
+	if ( !( containerFlags & ACM_BINARY_CONTAINER_BITPACKED ) && numChildren > *bufSize )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_INVALID_DATA, "too many children (%" PRIu64 ") for node (%s)", numChildren, get_node_name( node ) );
+		return false;
+	}
+
+	bool isPacked = acm_is_packed_array_( node );
+	if ( ( containerFlags & ( ACM_BINARY_CONTAINER_BITPACKED | ACM_BINARY_CONTAINER_PACKED | ACM_BINARY_CONTAINER_QUANTIZED ) ) && !isPacked )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_INVALID_TYPE, "unexpected element block for node (%s)", get_node_name( node ) );
+		return false;
+	}
+	else if ( ( containerFlags & ACM_BINARY_CONTAINER_BITPACKED ) && !is_integer( node->childType ) )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_INVALID_TYPE, "unexpected bit-packed elements for node (%s)", get_node_name( node ) );
+		return false;
+	}
+	else if ( ( containerFlags & ACM_BINARY_CONTAINER_QUANTIZED ) && node->childType != ACM_PROPERTY_TYPE_FLOAT32 && node->childType != ACM_PROPERTY_TYPE_FLOAT64 )
+	{
+		set_decode_error( reader, *buf, ND_ERROR_INVALID_TYPE, "unexpected quantized elements for node (%s)", get_node_name( node ) );
+		return false;
+	}
+
+	if ( containerFlags & ACM_BINARY_CONTAINER_BITPACKED )
+	{
+		return deserialize_bitpacked_block( buf, bufSize, node, ( unsigned int ) numChildren, reader );
+	}
+	else if ( containerFlags & ACM_BINARY_CONTAINER_QUANTIZED )
+	{
+		return deserialize_quantized_block( buf, bufSize, node, ( unsigned int ) numChildren, reader );
+	}
+	else if ( containerFlags & ACM_BINARY_CONTAINER_TABLE )
+	{
+		return deserialize_table( buf, bufSize, node, ( unsigned int ) numChildren, reader );
+	}
+	else if ( containerFlags & ACM_BINARY_CONTAINER_PACKED )
+	{
+		return deserialize_packed_block( buf, bufSize, node, ( unsigned int ) numChildren, reader );
+	}
+	else if ( isPacked )
+	{
+		return deserialize_packed_elements( buf, bufSize, node, ( unsigned int ) numChildren, reader );
+	}
+
+	frame->numPending = ( uint32_t ) numChildren;
+	return true;
+}
+
+/**
+ * Reads a single node and attaches it to the parent. For containers,
+ * the frame is filled in with whatever's left to read.
+ */
+static AcmBranch *deserialize_node( const void **buf, size_t *bufSize, AcmBranch *parent, const AcmBinaryReader *reader, AcmBinaryFrame *frame )
+{
+	memset( frame, 0, sizeof( AcmBinaryFrame ) );
+
+	// attempt to fetch the name, keeping in mind that not
+	// all nodes necessarily have a name
+	AcmString name;
+	if ( !deserialize_string_var( buf, bufSize, &name, reader ) )
+	{
+		return NULL;
+	}
+
+	const void   *at        = *buf;
+	const int8_t *type      = read_buf( buf, bufSize, sizeof( int8_t ) );
+	const int8_t *childType = ( type != NULL && *type == ACM_PROPERTY_TYPE_ARRAY ) ? read_buf( buf, bufSize, sizeof( int8_t ) ) : NULL;
+	if ( type == NULL || ( *type == ACM_PROPERTY_TYPE_ARRAY && childType == NULL ) )
+	{
+		set_decode_error( reader, at, ND_ERROR_IO_READ, "unexpected end of data reading type of node (%s)", name.buf ? name.buf : "unnamed" );
+		free_string( &name );
+		return NULL;
+	}
+	else if ( !is_valid_type( *type ) || ( childType != NULL && !is_valid_type( *childType ) ) )
+	{
+		set_decode_error( reader, at, ND_ERROR_INVALID_TYPE, "invalid property type (%d/%d) for node (%s)", *type, childType ? *childType : -1, name.buf ? name.buf : "unnamed" );
+		free_string( &name );
+		return NULL;
+	}
+
+	AcmBranch *node = acm_push_new_branch( parent, NULL, *type, childType ? *childType : ACM_PROPERTY_TYPE_INVALID );
+	if ( node == NULL )
+	{
+		free_string( &name );
+		return NULL;
+	}
+
+	// node now takes ownership of name
+	node->name  = name;
+	frame->node = node;
+
+	bool status;
+	if ( node->type == ACM_PROPERTY_TYPE_OBJECT || node->type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		status = deserialize_container( buf, bufSize, node, reader, frame );
+	}
+	else
+	{
+		status = deserialize_value( buf, bufSize, node, reader );
+	}
+
+	if ( !status )
+	{
+		acm_branch_destroy( node );
+		return NULL;
+	}
+
+	return node;
+}
+
+/* skips anything left in the payload, such as the child table */
+static void end_container( const void **buf, size_t *bufSize, const AcmBinaryFrame *frame )
+{
+	if ( frame->end != NULL )
+	{
+		*buf     = frame->end;
+		*bufSize = frame->endSize;
+	}
+}
+
+/**
+ * Decodes a node and everything under it. Rather than recursing, the
+ * containers still being read are kept on a stack of their own, so
+ * deeply nested data can't run us out of stack, only up to the limit.
+ * Anything malformed fails the lot, with the error set to say where.
+ */
+static AcmBranch *deserialize_binary_node( const void *buf, size_t bufSize, uint64_t offset, const AcmBinaryReader *reader )
+{
+	AcmBinaryReader view = *reader;
+	view.base            = buf;
+	view.baseOffset      = offset;
+
+	AcmBinaryFrame stack[ ACM_BINARY_MAX_DEPTH ];
+	unsigned int   depth = 0;
+	AcmBranch     *root  = NULL;
+	do
+	{
+		if ( depth == ACM_BINARY_MAX_DEPTH )
+		{
+			set_decode_error( &view, buf, ND_ERROR_LIMIT_EXCEEDED, "nesting is too deep (%u levels)", depth );
+			acm_branch_destroy( root );
+			return NULL;
+		}
+
+		AcmBinaryFrame *frame = &stack[ depth ];
+		AcmBranch      *node  = deserialize_node( &buf, &bufSize, depth > 0 ? stack[ depth - 1 ].node : NULL, &view, frame );
+		if ( node == NULL )
+		{
+			acm_branch_destroy( root );
+			return NULL;
+		}
+		else if ( root == NULL )
+		{
+			root = node;
+		}
+
+		if ( frame->numPending > 0 )
+		{
+			depth++;
+			continue;
+		}
+
+		end_container( &buf, &bufSize, frame );
+
+		// work back up through any containers that are now done with
+		while ( depth > 0 && --stack[ depth - 1 ].numPending == 0 )
+		{
+			end_container( &buf, &bufSize, &stack[ --depth ] );
+		}
+	} while ( depth > 0 );
+
+	return root;
+}
+
+AcmBranch *acm_deserialize_binary_( const void *buf, size_t bufSize, unsigned int headerSize, uint32_t version, uint32_t flags )
+{
+	AcmBinaryReader reader;
+	memset( &reader, 0, sizeof( AcmBinaryReader ) );
+	reader.version = version;
+	reader.flags   = flags;
+
+	const void *p    = ( const uint8_t * ) buf + headerSize;
+	size_t      size = bufSize - headerSize;
+	if ( ( flags & ACM_BINARY_FLAG_STRING_TABLE ) && !read_string_table( &p, &size, &reader ) )
+	{
+		return NULL;
+	}
+
+	AcmBranch *root = deserialize_binary_node( p, size, ( uint64_t ) ( ( const uint8_t * ) p - ( const uint8_t * ) buf ), &reader );
+
+	ACM_DELETE( ( AcmString * ) reader.strings );
+
+	return root;
+}
+
+/******************************************/
+/** Serialisation **/
+
+typedef struct AcmBinaryStringEntry
+{
+	const char *string;
+	uint32_t    hash;
+	uint32_t    numUses;
+	uint32_t    ref; /* index + 1 in the table, 0 if it isn't shared */
+	bool        isName;
+} AcmBinaryStringEntry;
+
+typedef struct AcmBinaryStringTable
+{
+	AcmBinaryStringEntry *entries; /* open addressed, by hash */
+	uint32_t              numEntries;
+	uint32_t              maxEntries;
+	const char          **shared; /* in the order they're referenced */
+	uint32_t              numShared;
+} AcmBinaryStringTable;
+
+typedef struct AcmBinaryWriter
+{
+	AcmOutput           *output;
+	uint8_t             *dst;         /* uncompressed output kept in memory goes straight into place */
+	uint64_t             dstSize;
+	uint8_t             *block;       /* otherwise it's gathered here, rather than lots of small writes */
+	size_t               blockLength;
+	uint8_t             *compressed; /* scratch to compress each block into, if compressing */
+	size_t               maxCompressed;
+	AcmBinaryBlockEntry *blockIndex;
+	uint32_t             numBlocks;
+	uint32_t             maxBlocks;
+	uint64_t             offset;       /* number of bytes written so far, before compression */
+	uint64_t            *payloadSizes; /* size of each container payload, in the order they're written */
+	unsigned int         numPayloadSizes;
+	unsigned int         maxPayloadSizes;
+	unsigned int         cursor;
+	bool                 compact; /* varint lengths/counts, and bit-packed integer arrays */
+	bool                 tables;   /* arrays of objects with the same fields written as tables */
+	unsigned int         quantize;  /* ACM_WRITE_FLAG_HALF_FLOAT/FIXED_16/FIXED_8, lossy encodings allowed for float arrays */
+	double               tolerance; /* largest error allowed in a quantized array, relative to its largest magnitude */
+	bool                 failed;
+
+	AcmBinaryStringTable *strings; /* shared names and values, if writing a table */
+} AcmBinaryWriter;
+
+typedef struct AcmBitPacking
+{
+	uint8_t  mode;
+	uint8_t  bitWidth;
+	uint64_t first;     /* first element, for deltas */
+	uint64_t reference; /* smallest of the values (or deltas) */
+	uint64_t dataSize;
+} AcmBitPacking;
+
+typedef struct AcmBinaryChildEntry
+{
+	uint32_t hash;
+	uint64_t offset;
+} AcmBinaryChildEntry;
+
+/**
+ * Arrays of unnamed objects that all have the same fields (names, types
+ * and order), and nothing nested, can have the schema written just once.
+ */
+static bool is_table_array( const AcmBinaryWriter *self, const AcmBranch *node )
+{
+	if ( !self->tables || node->type != ACM_PROPERTY_TYPE_ARRAY || node->childType != ACM_PROPERTY_TYPE_OBJECT ||
+	     node->numChildren < ACM_BINARY_TABLE_MIN )
+	{
+		return false;
+	}
+
+	const AcmBranch *schema = node->children.start;
+	if ( schema->numChildren == 0 )
+	{
+		return false;
+	}
+
+	for ( const AcmBranch *field = schema->children.start; field != NULL; field = field->next )
+	{
+		if ( field->name.buf == NULL || ( field->type != ACM_PROPERTY_TYPE_STRING && acm_get_type_size_( field->type ) == 0 ) )
+		{
+			return false;
+		}
+	}
+
+	for ( const AcmBranch *row = schema->next; row != NULL; row = row->next )
+	{
+		if ( row->type != ACM_PROPERTY_TYPE_OBJECT || row->name.buf != NULL || row->numChildren != schema->numChildren )
+		{
+			return false;
+		}
+
+		const AcmBranch *expected = schema->children.start;
+		for ( const AcmBranch *field = row->children.start; field != NULL; field = field->next, expected = expected->next )
+		{
+			if ( field->type != expected->type || field->name.buf == NULL || strcmp( field->name.buf, expected->name.buf ) != 0 )
+			{
+				return false;
+			}
+		}
+	}
+
+	return schema->type == ACM_PROPERTY_TYPE_OBJECT && schema->name.buf == NULL;
+}
+
+static bool has_child_table( const AcmBranch *node, bool isTable )
+{
+	// elements of scalar arrays are all the same size, so can be located without one
+	return node->numChildren >= ACM_BINARY_CHILD_TABLE_MIN && !acm_is_packed_array_( node ) && !isTable;
+}
+
+static unsigned int get_varint_size( uint64_t value )
+{
+	unsigned int size = 1;
+	while ( value >= 0x80 )
+	{
+		value >>= 7;
+		size++;
+	}
+
+	return size;
+}
+
+static uint64_t measure_count( const AcmBinaryWriter *self, uint64_t value, size_t fixedSize )
+{
+	return self->compact ? get_varint_size( value ) : fixedSize;
+}
+
+static uint64_t measure_string( const AcmBinaryWriter *self, const AcmString *string )
+{
+	uint64_t length = string->buf != NULL ? strlen( string->buf ) + 1 : 0;
+	return measure_count( self, length, sizeof( uint16_t ) ) + length;
+}
+
+static AcmBinaryStringEntry *find_string_entry( AcmBinaryStringTable *self, const char *string, uint32_t hash )
+{
+	uint32_t mask = self->maxEntries - 1;
+	for ( uint32_t i = hash & mask;; i = ( i + 1 ) & mask )
+	{
+		AcmBinaryStringEntry *entry = &self->entries[ i ];
+		if ( entry->string == NULL || ( entry->hash == hash && strcmp( entry->string, string ) == 0 ) )
+		{
+			return entry;
+		}
+	}
+}
+
+static bool add_string_use( AcmBinaryStringTable *self, const char *string, bool isName )
+{
+	// kept under half full, so probes stay short
+	if ( ( self->numEntries + 1 ) * 2 > self->maxEntries )
+	{
+		uint32_t              maxEntries = self->maxEntries > 0 ? self->maxEntries * 2 : 256;
+		AcmBinaryStringEntry *entries    = ACM_NEW_( AcmBinaryStringEntry, maxEntries );
+		if ( entries == NULL )
+		{
+			acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate string table (%u entries)", maxEntries );
+			return false;
+		}
+
+		AcmBinaryStringEntry *oldEntries    = self->entries;
+		uint32_t              oldMaxEntries = self->maxEntries;
+		self->entries                       = entries;
+		self->maxEntries                    = maxEntries;
+		for ( uint32_t i = 0; i < oldMaxEntries; ++i )
+		{
+			if ( oldEntries[ i ].string != NULL )
+			{
+				*find_string_entry( self, oldEntries[ i ].string, oldEntries[ i ].hash ) = oldEntries[ i ];
+			}
+		}
+		ACM_DELETE( oldEntries );
+	}
+
+	uint32_t              hash  = acm_hash_string_( string );
+	AcmBinaryStringEntry *entry = find_string_entry( self, string, hash );
+	if ( entry->string == NULL )
+	{
+		entry->string = string;
+		entry->hash   = hash;
+		self->numEntries++;
+	}
+
+	entry->numUses++;
+	entry->isName |= isName;
+	return true;
+}
+
+static bool collect_strings( AcmBinaryStringTable *self, const AcmBranch *node )
+{
+	if ( node->name.buf != NULL && !add_string_use( self, node->name.buf, true ) )
+	{
+		return false;
+	}
+
+	if ( node->type == ACM_PROPERTY_TYPE_STRING )
+	{
+		return node->data.buf == NULL || add_string_use( self, node->data.buf, false );
+	}
+	else if ( acm_is_packed_array_( node ) )
+	{
+		return true;
+	}
+
+	for ( const AcmBranch *child = node->children.start; child != NULL; child = child->next )
+	{
+		if ( !collect_strings( self, child ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Names are always shared, but values are only worth it if they
+ * turn up more than once. Otherwise they're kept inline.
+ */
+static void assign_string_ref( AcmBinaryStringTable *self, const char *string, bool isName )
+{
+	AcmBinaryStringEntry *entry = find_string_entry( self, string, acm_hash_string_( string ) );
+	if ( entry->ref == 0 && ( isName || entry->isName || entry->numUses > 1 ) )
+	{
+		self->shared[ self->numShared++ ] = entry->string;
+		entry->ref                         = self->numShared;
+	}
+}
+
+static void assign_string_refs( AcmBinaryStringTable *self, const AcmBranch *node )
+{
+	if ( node->name.buf != NULL )
+	{
+		assign_string_ref( self, node->name.buf, true );
+	}
+
+	if ( node->type == ACM_PROPERTY_TYPE_STRING )
+	{
+		if ( node->data.buf != NULL )
+		{
+			assign_string_ref( self, node->data.buf, false );
+		}
+		return;
+	}
+	else if ( acm_is_packed_array_( node ) )
+	{
+		return;
+	}
+
+	for ( const AcmBranch *child = node->children.start; child != NULL; child = child->next )
+	{
+		assign_string_refs( self, child );
+	}
+}
+
+static bool build_string_table( AcmBinaryStringTable *self, const AcmBranch *root )
+{
+	memset( self, 0, sizeof( AcmBinaryStringTable ) );
+	if ( !collect_strings( self, root ) )
+	{
+		return false;
+	}
+
+	self->shared = ACM_NEW_( const char *, self->numEntries + 1 );
+	if ( self->shared == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate string table (%u strings)", self->numEntries );
+		return false;
+	}
+
+	assign_string_refs( self, root );
+	return true;
+}
+
+static void free_string_table( AcmBinaryStringTable *self )
+{
+	ACM_DELETE( self->entries );
+	ACM_DELETE( ( void * ) self->shared );
+}
+
+static uint32_t get_string_ref( AcmBinaryStringTable *self, const AcmString *string )
+{
+	if ( string->buf == NULL || self->maxEntries == 0 )
+	{
+		return 0;
+	}
+
+	return find_string_entry( self, string->buf, acm_hash_string_( string->buf ) )->ref;
+}
+
+static uint64_t measure_name( AcmBinaryWriter *self, const AcmString *name )
+{
+	if ( self->strings == NULL )
+	{
+		return measure_string( self, name );
+	}
+
+	return measure_count( self, get_string_ref( self->strings, name ), sizeof( uint32_t ) );
+}
+
+static uint64_t measure_string_value( AcmBinaryWriter *self, const AcmString *value )
+{
+	if ( self->strings == NULL )
+	{
+		return measure_string( self, value );
+	}
+
+	uint32_t ref = get_string_ref( self->strings, value );
+	return measure_count( self, ref, sizeof( uint32_t ) ) + ( ref == 0 ? measure_string( self, value ) : 0 );
+}
+
+static uint64_t measure_string_table( AcmBinaryWriter *self, uint64_t *tableSize )
+{
+	*tableSize = 0;
+	for ( uint32_t i = 0; i < self->strings->numShared; ++i )
+	{
+		AcmString string = { ( char * ) self->strings->shared[ i ], 0, false };
+		*tableSize += measure_string( self, &string );
+	}
+
+	return measure_count( self, self->strings->numShared, sizeof( uint32_t ) ) + measure_count( self, *tableSize, sizeof( uint64_t ) ) + *tableSize;
+}
+
+static unsigned int get_bit_width( uint64_t range )
+{
+	unsigned int numBits = 0;
+	while ( range != 0 )
+	{
+		numBits++;
+		range >>= 1;
+	}
+
+	return numBits;
+}
+
+/**
+ * Works out whether an integer array is worth bit-packing, and if so,
+ * whether it packs smaller as is or as the differences between elements.
+ */
+static bool plan_bit_packing( const AcmBinaryWriter *self, const AcmBranch *node, AcmBitPacking *plan )
+{
+	unsigned int numElements = node->packed.numElements;
+	if ( !self->compact || !is_integer( node->childType ) || numElements < ACM_BINARY_BITPACK_MIN )
+	{
+		return false;
+	}
+
+	size_t         typeSize = acm_get_type_size_( node->childType );
+	bool           isSigned = is_signed_integer( node->childType );
+	const uint8_t *p        = node->packed.buf;
+
+	uint64_t first    = load_integer( p, node->childType, typeSize );
+	uint64_t minValue = first, maxValue = first, previous = first;
+	uint64_t minDelta = 0, maxDelta = 0;
+	for ( unsigned int i = 1; i < numElements; ++i )
+	{
+		uint64_t v = load_integer( p + i * typeSize, node->childType, typeSize );
+		if ( isSigned ? ( int64_t ) v < ( int64_t ) minValue : v < minValue )
+		{
+			minValue = v;
+		}
+		if ( isSigned ? ( int64_t ) v > ( int64_t ) maxValue : v > maxValue )
+		{
+			maxValue = v;
+		}
+
+		// deltas wrap at 64 bits, which the decoder reverses
+		uint64_t delta = v - previous;
+		if ( i == 1 || ( int64_t ) delta < ( int64_t ) minDelta )
+		{
+			minDelta = delta;
+		}
+		if ( i == 1 || ( int64_t ) delta > ( int64_t ) maxDelta )
+		{
+			maxDelta = delta;
+		}
+		previous = v;
+	}
+
+	unsigned int forWidth   = get_bit_width( maxValue - minValue );
+	unsigned int deltaWidth = get_bit_width( maxDelta - minDelta );
+	uint64_t     forSize    = ( ( uint64_t ) numElements * forWidth + 7 ) / 8;
+	uint64_t     deltaSize  = ( ( uint64_t ) ( numElements - 1 ) * deltaWidth + 7 ) / 8;
+
+	memset( plan, 0, sizeof( AcmBitPacking ) );
+	if ( deltaSize < forSize )
+	{
+		plan->mode      = ACM_BINARY_BITPACK_DELTA;
+		plan->bitWidth  = ( uint8_t ) deltaWidth;
+		plan->first     = first;
+		plan->reference = minDelta;
+		plan->dataSize  = deltaSize;
+	}
+	else
+	{
+		plan->mode      = ACM_BINARY_BITPACK_FOR;
+		plan->bitWidth  = ( uint8_t ) forWidth;
+		plan->reference = minValue;
+		plan->dataSize  = forSize;
+	}
+
+	return ACM_BINARY_BITPACK_HEADER + plan->dataSize < ( uint64_t ) numElements * typeSize;
+}
+
+static double quantizationTolerance = 0.001;
+
+void acm_set_quantization_tolerance( double tolerance )
+{
+	quantizationTolerance = tolerance;
+}
+
+/**
+ * Picks the smallest of the encodings asked for whose worst case error,
+ * over the values of a float array, is within the tolerance. Fixed point
+ * can't hold infinities or nans, and half floats would turn anything
+ * beyond their range into infinity.
+ */
+static bool plan_quantization( const AcmBinaryWriter *self, const AcmBranch *node, AcmQuantization *plan )
+{
+	unsigned int numElements = node->packed.numElements;
+	if ( self->quantize == 0 || ( node->childType != ACM_PROPERTY_TYPE_FLOAT32 && node->childType != ACM_PROPERTY_TYPE_FLOAT64 ) ||
+	     numElements < ACM_BINARY_QUANTIZE_MIN )
+	{
+		return false;
+	}
+
+	double minValue = 0.0, maxValue = 0.0, maxMagnitude = 0.0;
+	bool   isFinite = true;
+	for ( unsigned int i = 0; i < numElements; ++i )
+	{
+		double v;
+		if ( node->childType == ACM_PROPERTY_TYPE_FLOAT32 )
+		{
+			float f;
+			memcpy( &f, ( const uint8_t * ) node->packed.buf + i * sizeof( float ), sizeof( float ) );
+			v = f;
+		}
+		else
+		{
+			memcpy( &v, ( const uint8_t * ) node->packed.buf + i * sizeof( double ), sizeof( double ) );
+		}
+
+		if ( !isfinite( v ) )
+		{
+			isFinite = false;
+			continue;
+		}
+
+		minValue     = ( i == 0 || v < minValue ) ? v : minValue;
+		maxValue     = ( i == 0 || v > maxValue ) ? v : maxValue;
+		maxMagnitude = ( v < -maxMagnitude || v > maxMagnitude ) ? ( v < 0.0 ? -v : v ) : maxMagnitude;
+	}
+
+	// fixed point is out by at most half a step, and half floats by half of
+	// their 11 bits of precision, or half the smallest subnormal
+	double range    = maxValue - minValue;
+	bool   isFixed  = isFinite && isfinite( range );
+	double maxError = self->tolerance * maxMagnitude;
+
+	memset( plan, 0, sizeof( AcmQuantization ) );
+	plan->minValue = minValue;
+	plan->maxValue = maxValue;
+	if ( isFixed && ( self->quantize & ACM_WRITE_FLAG_FIXED_8 ) && range / ( 2.0 * UINT8_MAX ) <= maxError )
+	{
+		plan->encoding = ACM_BINARY_QUANTIZE_FIXED_8;
+		return true;
+	}
+	else if ( isFixed && ( self->quantize & ACM_WRITE_FLAG_FIXED_16 ) && range / ( 2.0 * UINT16_MAX ) <= maxError )
+	{
+		plan->encoding = ACM_BINARY_QUANTIZE_FIXED_16;
+		return true;
+	}
+	else if ( ( self->quantize & ACM_WRITE_FLAG_HALF_FLOAT ) && maxMagnitude <= 65504.0 &&
+	          maxMagnitude * 0x1.0p-11 + 0x1.0p-25 <= maxError )
+	{
+		// the range isn't needed to decode these
+		memset( plan, 0, sizeof( AcmQuantization ) );
+		plan->encoding = ACM_BINARY_QUANTIZE_HALF;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Padding needed ahead of an element block, so the values are naturally
+ * aligned relative to the start of the file (and so in a mapping of it).
+ */
+static uint8_t get_block_padding( const AcmBinaryWriter *self, uint64_t offset, size_t typeSize )
+{
+	if ( self->compact )
+	{
+		return 0;
+	}
+
+	return ( uint8_t ) ( ( typeSize - offset % typeSize ) % typeSize );
+}
+
+/**
+ * Walks the tree in the same order it's written, advancing the offset
+ * as it goes, so payload sizes (and block padding) are known up front.
+ */
+static void measure_table( AcmBinaryWriter *self, const AcmBranch *node )
+{
+	const AcmBranch *schema = node->children.start;
+	self->offset += measure_count( self, schema->numChildren, sizeof( uint32_t ) );
+	for ( const AcmBranch *field = schema->children.start; field != NULL; field = field->next )
+	{
+		self->offset += measure_name( self, &field->name ) + sizeof( int8_t );
+	}
+
+	for ( const AcmBranch *row = schema; row != NULL; row = row->next )
+	{
+		for ( const AcmBranch *field = row->children.start; field != NULL; field = field->next )
+		{
+			self->offset += field->type == ACM_PROPERTY_TYPE_STRING ? measure_string_value( self, &field->data ) : acm_get_type_size_( field->type );
+		}
+	}
+}
+
+static void measure_node( AcmBinaryWriter *self, const AcmBranch *node )
+{
+	self->offset += measure_name( self, &node->name ) + sizeof( int8_t );
+	if ( node->type == ACM_PROPERTY_TYPE_STRING )
+	{
+		self->offset += measure_string_value( self, &node->data );
+		return;
+	}
+	else if ( node->type != ACM_PROPERTY_TYPE_OBJECT && node->type != ACM_PROPERTY_TYPE_ARRAY )
+	{
+		self->offset += acm_get_type_size_( node->type );
+		return;
+	}
+
+	if ( node->type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		self->offset += sizeof( int8_t );
+	}
+
+	// compact headers depend on the size of what follows, so are added once that's known;
+	// nothing in a compact file is aligned, so the order doesn't matter
+	if ( !self->compact )
+	{
+		self->offset += sizeof( uint32_t ) + sizeof( uint8_t ) + sizeof( uint64_t );
+	}
+
+	// slot is taken before the children, so the sizes end up in the same order they're written
+	if ( self->numPayloadSizes == self->maxPayloadSizes )
+	{
+		unsigned int maxPayloadSizes = self->maxPayloadSizes > 0 ? self->maxPayloadSizes * 2 : 64;
+		uint64_t    *payloadSizes    = ACM_REALLOC( self->payloadSizes, uint64_t, maxPayloadSizes );
+		if ( payloadSizes == NULL )
+		{
+			acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate payload sizes (%u)", maxPayloadSizes );
+			self->failed = true;
+			return;
+		}
+
+		self->payloadSizes    = payloadSizes;
+		self->maxPayloadSizes = maxPayloadSizes;
+	}
+	unsigned int slot = self->numPayloadSizes++;
+
+	uint64_t        payloadStart = self->offset;
+	bool            isTable      = is_table_array( self, node );
+	AcmBitPacking   plan;
+	AcmQuantization quantization;
+	if ( isTable )
+	{
+		measure_table( self, node );
+	}
+	else if ( acm_is_packed_array_( node ) && plan_bit_packing( self, node, &plan ) )
+	{
+		self->offset += ACM_BINARY_BITPACK_HEADER + plan.dataSize;
+	}
+	else if ( acm_is_packed_array_( node ) && plan_quantization( self, node, &quantization ) )
+	{
+		self->offset += ACM_BINARY_QUANTIZE_HEADER + ( uint64_t ) node->packed.numElements * acm_get_quantized_size_( quantization.encoding );
+	}
+	else if ( acm_is_packed_array_( node ) )
+	{
+		size_t typeSize = acm_get_type_size_( node->childType );
+		self->offset += sizeof( uint8_t );
+		self->offset += get_block_padding( self, self->offset, typeSize ) + ( uint64_t ) node->packed.numElements * typeSize;
+	}
+	else
+	{
+		for ( const AcmBranch *child = node->children.start; child != NULL; child = child->next )
+		{
+			measure_node( self, child );
+		}
+	}
+
+	if ( has_child_table( node, isTable ) )
+	{
+		self->offset += ( uint64_t ) node->numChildren * ACM_BINARY_CHILD_TABLE_ENTRY;
+	}
+
+	self->payloadSizes[ slot ] = self->offset - payloadStart;
+	if ( self->compact )
+	{
+		self->offset += get_varint_size( node->numChildren ) + sizeof( uint8_t ) + get_varint_size( self->payloadSizes[ slot ] );
+	}
+}
+
+static void emit_bytes( AcmBinaryWriter *self, const void *buf, size_t size )
+{
+	if ( size == 0 || self->failed )
+	{
+		return;
+	}
+
+	acm_output_write_( self->output, buf, size );
+	self->failed = self->output->failed;
+}
+
+static void flush_block( AcmBinaryWriter *self )
+{
+	if ( self->blockLength == 0 || self->failed )
+	{
+		return;
+	}
+
+	if ( self->compressed == NULL )
+	{
+		emit_bytes( self, self->block, self->blockLength );
+		self->blockLength = 0;
+		return;
+	}
+
+	if ( self->numBlocks == self->maxBlocks )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "unexpected number of blocks (%u)", self->numBlocks + 1 );
+		self->failed = true;
+		return;
+	}
+
+	// anything that doesn't shrink is stored as is
+	const uint8_t *data = self->block;
+	size_t         size = acm_compress_block_( self->block, self->blockLength, self->compressed, self->maxCompressed );
+	if ( size > 0 && size < self->blockLength )
+	{
+		data = self->compressed;
+	}
+	else
+	{
+		size = self->blockLength;
+	}
+
+	self->blockIndex[ self->numBlocks ].offset = self->output->total;
+	self->blockIndex[ self->numBlocks ].size   = ( uint32_t ) size;
+	self->numBlocks++;
+
+	emit_bytes( self, data, size );
+	self->blockLength = 0;
+}
+
+static void write_bytes( AcmBinaryWriter *self, const void *buf, size_t size )
+{
+	if ( self->failed )
+	{
+		return;
+	}
+
+	if ( self->dst != NULL && size > 0 )
+	{
+		if ( size > self->dstSize - self->offset )
+		{
+			acm_set_error_message_( ND_ERROR_IO_WRITE, "output is larger than measured (%" PRIu64 " bytes)", self->dstSize );
+			self->failed = true;
+			return;
+		}
+
+		memcpy( self->dst + self->offset, buf, size );
+		self->offset += size;
+		return;
+	}
+
+	self->offset += size;
+
+	const uint8_t *src = buf;
+	while ( size > 0 )
+	{
+		size_t n = ACM_BINARY_BLOCK_SIZE - self->blockLength;
+		if ( n > size )
+		{
+			n = size;
+		}
+
+		memcpy( self->block + self->blockLength, src, n );
+		self->blockLength += n;
+		src += n;
+		size -= n;
+
+		if ( self->blockLength == ACM_BINARY_BLOCK_SIZE )
+		{
+			flush_block( self );
+		}
+	}
+}
+
+/**
+ * Lengths and counts are written at a fixed size, or as
+ * unsigned LEB128 for compact output.
+ */
+static void write_count( AcmBinaryWriter *self, uint64_t value, size_t fixedSize )
+{
+	if ( !self->compact )
+	{
+		write_bytes( self, &value, fixedSize );
+		return;
+	}
+
+	uint8_t      varint[ 10 ];
+	unsigned int size = 0;
+	do
+	{
+		uint8_t byte = value & 0x7F;
+		value >>= 7;
+		varint[ size++ ] = byte | ( value != 0 ? 0x80 : 0 );
+	} while ( value != 0 );
+
+	write_bytes( self, varint, size );
+}
+
+static void write_string( AcmBinaryWriter *self, const AcmString *string )
+{
+	// empty strings keep their terminator, so they aren't confused with no string at all
+	size_t length = string->buf != NULL ? strlen( string->buf ) + 1 : 0;
+
+	write_count( self, ( uint16_t ) length, sizeof( uint16_t ) );
+	write_bytes( self, string->buf, length );
+}
+
+static void write_name( AcmBinaryWriter *self, const AcmString *name )
+{
+	if ( self->strings == NULL )
+	{
+		write_string( self, name );
+		return;
+	}
+
+	write_count( self, get_string_ref( self->strings, name ), sizeof( uint32_t ) );
+}
+
+static void write_string_value( AcmBinaryWriter *self, const AcmString *value )
+{
+	if ( self->strings == NULL )
+	{
+		write_string( self, value );
+		return;
+	}
+
+	uint32_t ref = get_string_ref( self->strings, value );
+	write_count( self, ref, sizeof( uint32_t ) );
+	if ( ref == 0 )
+	{
+		write_string( self, value );
+	}
+}
+
+static void write_bit_packed( AcmBinaryWriter *self, const AcmBranch *node, const AcmBitPacking *plan )
+{
+	uint8_t header[ ACM_BINARY_BITPACK_HEADER ];
+	header[ 0 ] = plan->mode;
+	header[ 1 ] = plan->bitWidth;
+	memcpy( header + 2, &plan->first, sizeof( uint64_t ) );
+	memcpy( header + 2 + sizeof( uint64_t ), &plan->reference, sizeof( uint64_t ) );
+	write_bytes( self, header, sizeof( header ) );
+
+	size_t         typeSize = acm_get_type_size_( node->childType );
+	const uint8_t *p        = node->packed.buf;
+
+	// bits are gathered into a word at a time, then flushed through a small buffer
+	uint8_t      out[ 256 ];
+	unsigned int outSize     = 0;
+	uint64_t     accumulator = 0;
+	unsigned int numBits     = 0;
+	uint64_t     previous    = plan->first;
+	for ( unsigned int i = ( plan->mode == ACM_BINARY_BITPACK_DELTA ) ? 1 : 0; i < node->packed.numElements; ++i )
+	{
+		uint64_t v = load_integer( p + i * typeSize, node->childType, typeSize );
+		uint64_t x;
+		if ( plan->mode == ACM_BINARY_BITPACK_DELTA )
+		{
+			x        = ( v - previous ) - plan->reference;
+			previous = v;
+		}
+		else
+		{
+			x = v - plan->reference;
+		}
+
+		unsigned int remaining = plan->bitWidth;
+		while ( remaining > 0 )
+		{
+			unsigned int n = ( 64 - numBits ) < remaining ? ( 64 - numBits ) : remaining;
+			uint64_t     bits = n < 64 ? ( x & ( ( ( uint64_t ) 1 << n ) - 1 ) ) : x;
+			accumulator |= bits << numBits;
+			numBits += n;
+			x         = n < 64 ? x >> n : 0;
+			remaining -= n;
+
+			while ( numBits >= 8 )
+			{
+				out[ outSize++ ] = ( uint8_t ) accumulator;
+				accumulator      = numBits > 8 ? accumulator >> 8 : 0;
+				numBits -= 8;
+				if ( outSize == sizeof( out ) )
+				{
+					write_bytes( self, out, outSize );
+					outSize = 0;
+				}
+			}
+		}
+	}
+
+	if ( numBits > 0 )
+	{
+		out[ outSize++ ] = ( uint8_t ) accumulator;
+	}
+	write_bytes( self, out, outSize );
+}
+
+/**
+ * Half floats always go through acm_float_to_half_, rather than F16C
+ * where it's available, so the output doesn't depend on the build.
+ */
+/**
+ * Same as acm_float_to_half_, eight at a time where there's F16C.
+ */
+static void encode_half_floats( const float *src, uint8_t *dst, unsigned int count )
+{
+	unsigned int i = 0;
+#if defined( ACM_HAS_F16C )
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		__m128i h = _mm256_cvtps_ph( _mm256_loadu_ps( src + i ), _MM_FROUND_TO_NEAREST_INT );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i * sizeof( uint16_t ) ), h );
+	}
+#endif
+
+	for ( ; i < count; ++i )
+	{
+		uint16_t h = acm_float_to_half_( src[ i ] );
+		memcpy( dst + i * sizeof( uint16_t ), &h, sizeof( uint16_t ) );
+	}
+}
+
+static void write_quantized( AcmBinaryWriter *self, const AcmBranch *node, const AcmQuantization *plan )
+{
+	uint8_t header[ ACM_BINARY_QUANTIZE_HEADER ];
+	header[ 0 ] = plan->encoding;
+	memcpy( header + 1, &plan->minValue, sizeof( double ) );
+	memcpy( header + 1 + sizeof( double ), &plan->maxValue, sizeof( double ) );
+	write_bytes( self, header, sizeof( header ) );
+
+	unsigned int numElements = node->packed.numElements;
+	if ( plan->encoding == ACM_BINARY_QUANTIZE_HALF )
+	{
+		// floats are converted straight from the array, doubles narrowed a block at a time first
+		uint8_t out[ 256 * sizeof( uint16_t ) ];
+		float   floats[ 256 ];
+		for ( unsigned int start = 0; start < numElements; start += 256 )
+		{
+			unsigned int n   = ( numElements - start ) < 256 ? ( numElements - start ) : 256;
+			const float *src = ( const float * ) node->packed.buf + start;
+			if ( node->childType == ACM_PROPERTY_TYPE_FLOAT64 )
+			{
+				for ( unsigned int i = 0; i < n; ++i )
+				{
+					double v;
+					memcpy( &v, ( const uint8_t * ) node->packed.buf + ( start + i ) * sizeof( double ), sizeof( double ) );
+					floats[ i ] = ( float ) v;
+				}
+				src = floats;
+			}
+
+			encode_half_floats( src, out, n );
+			write_bytes( self, out, n * sizeof( uint16_t ) );
+		}
+		return;
+	}
+
+	unsigned int levels = plan->encoding == ACM_BINARY_QUANTIZE_FIXED_8 ? UINT8_MAX : UINT16_MAX;
+	double       range  = plan->maxValue - plan->minValue;
+	double       scale  = range > 0.0 ? levels / range : 0.0;
+
+	// gathered through a small buffer, rather than a write per element
+	uint8_t      out[ 512 ];
+	unsigned int outSize = 0;
+	for ( unsigned int i = 0; i < numElements; ++i )
+	{
+		double v;
+		if ( node->childType == ACM_PROPERTY_TYPE_FLOAT32 )
+		{
+			float f;
+			memcpy( &f, ( const uint8_t * ) node->packed.buf + i * sizeof( float ), sizeof( float ) );
+			v = f;
+		}
+		else
+		{
+			memcpy( &v, ( const uint8_t * ) node->packed.buf + i * sizeof( double ), sizeof( double ) );
+		}
+
+		double q = ( v - plan->minValue ) * scale + 0.5;
+		if ( plan->encoding == ACM_BINARY_QUANTIZE_FIXED_8 )
+		{
+			out[ outSize++ ] = ( uint8_t ) ( q < levels ? q : levels );
+		}
+		else
+		{
+			uint16_t q16 = ( uint16_t ) ( q < levels ? q : levels );
+			memcpy( out + outSize, &q16, sizeof( uint16_t ) );
+			outSize += sizeof( uint16_t );
+		}
+
+		if ( outSize == sizeof( out ) )
+		{
+			write_bytes( self, out, outSize );
+			outSize = 0;
+		}
+	}
+	write_bytes( self, out, outSize );
+}
+
+static int compare_child_entries( const void *a, const void *b )
+{
+	const AcmBinaryChildEntry *entryA = a;
+	const AcmBinaryChildEntry *entryB = b;
+	if ( entryA->hash != entryB->hash )
+	{
+		return entryA->hash < entryB->hash ? -1 : 1;
+	}
+
+	// keep the original order for duplicate names, so the first still wins
+	return entryA->offset < entryB->offset ? -1 : ( entryA->offset > entryB->offset );
+}
+
+static void write_scalar( AcmBinaryWriter *self, const AcmBranch *node )
+{
+	size_t typeSize = acm_get_type_size_( node->type );
+	if ( typeSize == 0 )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_TYPE, "invalid node type (%u)", node->type );
+		self->failed = true;
+		return;
+	}
+
+	uint64_t value = 0;
+	if ( !acm_parse_value_( node->type, node->data.buf, &value ) )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "failed to convert value for node (%s)", node->name.buf != NULL ? node->name.buf : "unnamed" );
+		self->failed = true;
+		return;
+	}
+
+	write_bytes( self, &value, typeSize );
+}
+
+/* schema from the first row, then each row as a fixed layout record */
+static void write_table( AcmBinaryWriter *self, const AcmBranch *node )
+{
+	const AcmBranch *schema = node->children.start;
+	write_count( self, schema->numChildren, sizeof( uint32_t ) );
+	for ( const AcmBranch *field = schema->children.start; field != NULL; field = field->next )
+	{
+		int8_t type = ( int8_t ) field->type;
+		write_name( self, &field->name );
+		write_bytes( self, &type, sizeof( int8_t ) );
+	}
+
+	for ( const AcmBranch *row = schema; row != NULL; row = row->next )
+	{
+		for ( const AcmBranch *field = row->children.start; field != NULL; field = field->next )
+		{
+			if ( field->type == ACM_PROPERTY_TYPE_STRING )
+			{
+				write_string_value( self, &field->data );
+				continue;
+			}
+
+			write_scalar( self, field );
+		}
+	}
+}
+
+static void write_node( AcmBinaryWriter *self, const AcmBranch *node );
+static void write_container( AcmBinaryWriter *self, const AcmBranch *node )
+{
+	bool     isPacked    = acm_is_packed_array_( node );
+	bool     isTable     = is_table_array( self, node );
+	uint32_t numChildren = node->numChildren;
+	uint8_t  flags       = has_child_table( node, isTable ) ? ACM_BINARY_CONTAINER_CHILD_TABLE : 0;
+	uint64_t payloadSize = self->payloadSizes[ self->cursor++ ];
+
+	AcmBitPacking   plan;
+	AcmQuantization quantization;
+	bool            isBitPacked = isPacked && plan_bit_packing( self, node, &plan );
+	bool            isQuantized = isPacked && !isBitPacked && plan_quantization( self, node, &quantization );
+	if ( isTable )
+	{
+		flags |= ACM_BINARY_CONTAINER_TABLE;
+	}
+	else if ( isBitPacked )
+	{
+		flags |= ACM_BINARY_CONTAINER_BITPACKED;
+	}
+	else if ( isQuantized )
+	{
+		flags |= ACM_BINARY_CONTAINER_QUANTIZED;
+	}
+	else if ( isPacked )
+	{
+		flags |= ACM_BINARY_CONTAINER_PACKED;
+	}
+	write_count( self, numChildren, sizeof( uint32_t ) );
+	write_bytes( self, &flags, sizeof( uint8_t ) );
+	write_count( self, payloadSize, sizeof( uint64_t ) );
+
+	if ( isTable )
+	{
+		write_table( self, node );
+		return;
+	}
+	else if ( isBitPacked )
+	{
+		write_bit_packed( self, node, &plan );
+		return;
+	}
+	else if ( isQuantized )
+	{
+		write_quantized( self, node, &quantization );
+		return;
+	}
+	else if ( isPacked )
+	{
+		static const uint8_t zeroes[ sizeof( uint64_t ) ] = { 0 };
+
+		size_t  typeSize = acm_get_type_size_( node->childType );
+		uint8_t padding  = get_block_padding( self, self->offset + sizeof( uint8_t ), typeSize );
+		write_bytes( self, &padding, sizeof( uint8_t ) );
+		write_bytes( self, zeroes, padding );
+		write_bytes( self, node->packed.buf, node->packed.numElements * typeSize );
+		return;
+	}
+
+	AcmBinaryChildEntry *entries = NULL;
+	if ( flags & ACM_BINARY_CONTAINER_CHILD_TABLE )
+	{
+		entries = ACM_NEW_( AcmBinaryChildEntry, numChildren );
+		if ( entries == NULL )
+		{
+			acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate child table (%u entries)", numChildren );
+			self->failed = true;
+			return;
+		}
+	}
+
+	uint64_t     payloadStart = self->offset;
+	unsigned int i            = 0;
+	for ( const AcmBranch *child = node->children.start; child != NULL; child = child->next, ++i )
+	{
+		if ( entries != NULL )
+		{
+			entries[ i ].hash   = node->type == ACM_PROPERTY_TYPE_OBJECT ? acm_hash_string_( child->name.buf != NULL ? child->name.buf : "" ) : 0;
+			entries[ i ].offset = self->offset - payloadStart;
+		}
+
+		write_node( self, child );
+	}
+
+	if ( entries == NULL )
+	{
+		return;
+	}
+
+	// objects are looked up by name, while arrays are looked up by index
+	if ( node->type == ACM_PROPERTY_TYPE_OBJECT )
+	{
+		qsort( entries, numChildren, sizeof( AcmBinaryChildEntry ), compare_child_entries );
+	}
+
+	for ( i = 0; i < numChildren; ++i )
+	{
+		write_bytes( self, &entries[ i ].hash, sizeof( uint32_t ) );
+		write_bytes( self, &entries[ i ].offset, sizeof( uint64_t ) );
+	}
+
+	ACM_DELETE( entries );
+}
+
+static void write_node( AcmBinaryWriter *self, const AcmBranch *node )
+{
+	write_name( self, &node->name );
+
+	int8_t type = ( int8_t ) node->type;
+	write_bytes( self, &type, sizeof( int8_t ) );
+
+	switch ( node->type )
+	{
+		default:
+			write_scalar( self, node );
+			break;
+		case ACM_PROPERTY_TYPE_STRING:
+		{
+			write_string_value( self, &node->data );
+			break;
+		}
+		case ACM_PROPERTY_TYPE_ARRAY:
+		{
+			/* only extra component here is the child type */
+			int8_t childType = ( int8_t ) node->childType;
+			write_bytes( self, &childType, sizeof( int8_t ) );
+		}
+		case ACM_PROPERTY_TYPE_OBJECT:
+		{
+			write_container( self, node );
+			break;
+		}
+	}
+}
+
+/**
+ * Container sizes are needed before their children are written, so
+ * everything is measured up front, which gives the size of the file
+ * (before any compression) along the way.
+ */
+static uint64_t open_writer( AcmBinaryWriter *self, AcmBinaryStringTable *strings, const AcmBranch *root, unsigned int flags, uint64_t *tableSize )
+{
+	memset( self, 0, sizeof( AcmBinaryWriter ) );
+	self->compact   = ( flags & ACM_WRITE_FLAG_COMPACT ) != 0;
+	self->tables    = ( flags & ACM_WRITE_FLAG_TABLES ) != 0;
+	self->quantize  = flags & ( ACM_WRITE_FLAG_HALF_FLOAT | ACM_WRITE_FLAG_FIXED_16 | ACM_WRITE_FLAG_FIXED_8 );
+	self->tolerance = quantizationTolerance;
+
+	*tableSize = 0;
+	if ( flags & ACM_WRITE_FLAG_STRING_TABLE )
+	{
+		self->strings = strings;
+		self->failed  = !build_string_table( strings, root );
+	}
+
+	self->offset = strlen( ACM_FORMAT_BINARY_HEADER_2 ) + sizeof( uint32_t ) * 2;
+	if ( self->strings != NULL )
+	{
+		self->offset += measure_string_table( self, tableSize );
+	}
+	measure_node( self, root );
+
+	uint64_t rawSize = self->offset;
+	self->offset     = 0;
+	return rawSize;
+}
+
+static void close_writer( AcmBinaryWriter *self )
+{
+	ACM_DELETE( self->block );
+	ACM_DELETE( self->compressed );
+	ACM_DELETE( self->blockIndex );
+	ACM_DELETE( self->payloadSizes );
+
+	if ( self->strings != NULL )
+	{
+		free_string_table( self->strings );
+	}
+}
+
+bool acm_get_binary_size( AcmBranch *root, unsigned int flags, uint64_t *size )
+{
+	if ( flags & ACM_WRITE_FLAG_COMPRESS )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "size of compressed output isn't known until it's written" );
+		return false;
+	}
+
+	AcmBinaryWriter      writer;
+	AcmBinaryStringTable strings;
+	uint64_t             tableSize;
+	*size = open_writer( &writer, &strings, root, flags, &tableSize );
+
+	bool status = !writer.failed;
+	close_writer( &writer );
+
+	return status;
+}
+
+bool acm_serialize_binary_( AcmOutput *output, AcmBranch *root, unsigned int flags )
+{
+	AcmBinaryWriter      writer;
+	AcmBinaryStringTable strings;
+	uint64_t             tableSize;
+	uint64_t             rawSize = open_writer( &writer, &strings, root, flags, &tableSize );
+	writer.output                = output;
+
+	// uncompressed output is exactly the size measured, so it can all be allocated up front
+	if ( !( flags & ACM_WRITE_FLAG_COMPRESS ) && output->write == NULL && !writer.failed )
+	{
+		writer.dst     = acm_output_claim_( output, rawSize );
+		writer.dstSize = rawSize;
+		writer.failed  = writer.dst == NULL;
+	}
+	else if ( !writer.failed )
+	{
+		writer.block = ACM_NEW_( uint8_t, ACM_BINARY_BLOCK_SIZE );
+		if ( writer.block == NULL )
+		{
+			acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate output block" );
+			writer.failed = true;
+		}
+	}
+
+	static const uint32_t version     = ACM_FORMAT_BINARY_VERSION;
+	uint32_t              headerFlags = writer.compact ? ACM_BINARY_FLAG_VARINTS : 0;
+	if ( writer.strings != NULL )
+	{
+		headerFlags |= ACM_BINARY_FLAG_STRING_TABLE;
+	}
+	if ( writer.tables )
+	{
+		headerFlags |= ACM_BINARY_FLAG_TABLES;
+	}
+	if ( writer.quantize != 0 )
+	{
+		headerFlags |= ACM_BINARY_FLAG_QUANTIZED;
+	}
+
+	if ( ( flags & ACM_WRITE_FLAG_COMPRESS ) && !writer.failed )
+	{
+		// compressed blocks hold the file as it would otherwise be written, wrapped in a header of its own
+		writer.maxCompressed = acm_compress_bound_( ACM_BINARY_BLOCK_SIZE );
+		writer.compressed    = ACM_NEW_( uint8_t, writer.maxCompressed );
+		writer.maxBlocks     = ( uint32_t ) ( ( rawSize + ACM_BINARY_BLOCK_SIZE - 1 ) / ACM_BINARY_BLOCK_SIZE );
+		writer.blockIndex    = ACM_NEW_( AcmBinaryBlockEntry, writer.maxBlocks );
+		if ( writer.compressed == NULL || writer.blockIndex == NULL )
+		{
+			acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate compression buffers (%u blocks)", writer.maxBlocks );
+			writer.failed = true;
+		}
+
+		uint32_t outerFlags = headerFlags | ACM_BINARY_FLAG_COMPRESSED;
+		uint32_t blockSize  = ACM_BINARY_BLOCK_SIZE;
+		emit_bytes( &writer, ACM_FORMAT_BINARY_HEADER_2, strlen( ACM_FORMAT_BINARY_HEADER_2 ) );
+		emit_bytes( &writer, &version, sizeof( uint32_t ) );
+		emit_bytes( &writer, &outerFlags, sizeof( uint32_t ) );
+		emit_bytes( &writer, &blockSize, sizeof( uint32_t ) );
+		emit_bytes( &writer, &writer.maxBlocks, sizeof( uint32_t ) );
+		emit_bytes( &writer, &rawSize, sizeof( uint64_t ) );
+	}
+
+	write_bytes( &writer, ACM_FORMAT_BINARY_HEADER_2, strlen( ACM_FORMAT_BINARY_HEADER_2 ) );
+	write_bytes( &writer, &version, sizeof( uint32_t ) );
+	write_bytes( &writer, &headerFlags, sizeof( uint32_t ) );
+	if ( writer.strings != NULL )
+	{
+		write_count( &writer, strings.numShared, sizeof( uint32_t ) );
+		write_count( &writer, tableSize, sizeof( uint64_t ) );
+		for ( uint32_t i = 0; i < strings.numShared; ++i )
+		{
+			AcmString string = { ( char * ) strings.shared[ i ], 0, false };
+			write_string( &writer, &string );
+		}
+	}
+	write_node( &writer, root );
+	flush_block( &writer );
+
+	if ( writer.dst != NULL && writer.offset != writer.dstSize && !writer.failed )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "output is smaller than measured (%" PRIu64 " != %" PRIu64 " bytes)", writer.offset, writer.dstSize );
+		writer.failed = true;
+	}
+
+	if ( writer.compressed != NULL && !writer.failed )
+	{
+		if ( writer.numBlocks != writer.maxBlocks )
+		{
+			acm_set_error_message_( ND_ERROR_IO_WRITE, "unexpected number of blocks (%u != %u)", writer.numBlocks, writer.maxBlocks );
+			writer.failed = true;
+		}
+
+		for ( uint32_t i = 0; i < writer.numBlocks; ++i )
+		{
+			emit_bytes( &writer, &writer.blockIndex[ i ].offset, sizeof( uint64_t ) );
+			emit_bytes( &writer, &writer.blockIndex[ i ].size, sizeof( uint32_t ) );
+		}
+	}
+
+	close_writer( &writer );
+
+	return !writer.failed;
+}
+
+/******************************************/
+/** Random Access **/
+
+typedef struct AcmBinarySource
+{
+	const uint8_t *buf;  /* either a buffer in memory... */
+	FILE          *file; /* ...or a file on disk */
+	uint64_t       size;
+	uint64_t       filePos;
+	uint32_t       flags; /* from the header */
+
+	const AcmString *strings; /* shared strings, if there's a table */
+	uint32_t         numStrings;
+
+	struct AcmBinaryBlocks *blocks; /* compressed files are read through these instead */
+} AcmBinarySource;
+
+typedef struct AcmBinaryBlocks
+{
+	AcmBinarySource      container; /* the compressed file itself */
+	uint32_t             blockSize;
+	uint32_t             numBlocks;
+	uint64_t             rawSize;
+	AcmBinaryBlockEntry *entries;
+	uint8_t             *cache; /* most recently used block, decompressed */
+	uint8_t             *scratch;
+	uint32_t             cachedBlock;
+} AcmBinaryBlocks;
+
+typedef struct AcmBinaryNodeInfo
+{
+	uint64_t        offset; /* start of the node */
+	uint64_t        end;    /* first byte after the node */
+	uint64_t        nameOffset;
+	uint16_t        nameLength; /* including null terminator */
+	const char     *name;       /* shared name from the string table, rather than at nameOffset */
+	AcmPropertyType type;
+	AcmPropertyType childType;
+	uint32_t        numChildren;
+	uint8_t         flags;
+	uint64_t        payload;        /* offset of the first child */
+	bool            isBlockElement; /* value within an element block, with no node around it */
+	bool            isDecodedElement; /* element only reachable by decoding the array, which offset/end cover */
+	uint32_t        elementIndex;
+} AcmBinaryNodeInfo;
+
+static bool read_blocks( AcmBinaryBlocks *self, uint64_t offset, void *dst, size_t size );
+static bool source_read( AcmBinarySource *self, uint64_t offset, void *dst, size_t size )
+{
+	if ( self->blocks != NULL )
+	{
+		return read_blocks( self->blocks, offset, dst, size );
+	}
+
+	if ( offset > self->size || size > self->size - offset )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "unexpected end of binary node data (%" PRIu64 ")", offset );
+		return false;
+	}
+
+	if ( self->buf != NULL )
+	{
+		memcpy( dst, self->buf + offset, size );
+		return true;
+	}
+
+	if ( self->filePos != offset && acm_fseek64( self->file, offset, SEEK_SET ) != 0 )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "failed to seek to %" PRIu64, offset );
+		return false;
+	}
+
+	if ( fread( dst, sizeof( uint8_t ), size, self->file ) != size )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "failed to read %zu bytes at %" PRIu64, size, offset );
+		self->filePos = UINT64_MAX;
+		return false;
+	}
+
+	self->filePos = offset + size;
+	return true;
+}
+
+/******************************************/
+/** Compressed Files **/
+
+static void close_blocks( AcmBinaryBlocks *self )
+{
+	ACM_DELETE( self->entries );
+	ACM_DELETE( self->cache );
+	ACM_DELETE( self->scratch );
+}
+
+/**
+ * Reads the block index from a compressed file, after which the source
+ * reads from the uncompressed file held in the blocks instead.
+ */
+static bool open_blocks( AcmBinarySource *source, unsigned int headerSize, AcmBinaryBlocks *self )
+{
+	memset( self, 0, sizeof( AcmBinaryBlocks ) );
+	self->container   = *source;
+	self->cachedBlock = UINT32_MAX;
+
+	uint64_t indexSize;
+	if ( !source_read( &self->container, headerSize, &self->blockSize, sizeof( uint32_t ) ) ||
+	     !source_read( &self->container, headerSize + sizeof( uint32_t ), &self->numBlocks, sizeof( uint32_t ) ) ||
+	     !source_read( &self->container, headerSize + sizeof( uint32_t ) * 2, &self->rawSize, sizeof( uint64_t ) ) )
+	{
+		return false;
+	}
+
+	indexSize = ( uint64_t ) self->numBlocks * ACM_BINARY_BLOCK_ENTRY;
+	if ( self->blockSize == 0 || self->blockSize > ACM_BINARY_BLOCK_SIZE * 256 ||
+	     self->numBlocks != ( self->rawSize + self->blockSize - 1 ) / self->blockSize ||
+	     indexSize > self->container.size - headerSize - sizeof( uint32_t ) * 2 - sizeof( uint64_t ) )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "invalid compressed binary node header (%u blocks of %u)", self->numBlocks, self->blockSize );
+		return false;
+	}
+
+	self->entries = ACM_NEW_( AcmBinaryBlockEntry, self->numBlocks + 1 );
+	self->cache   = ACM_NEW_( uint8_t, self->blockSize );
+	self->scratch = ACM_NEW_( uint8_t, self->blockSize );
+	if ( self->entries == NULL || self->cache == NULL || self->scratch == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate block index (%u blocks)", self->numBlocks );
+		close_blocks( self );
+		return false;
+	}
+
+	// index sits at the very end of the file
+	uint64_t index = self->container.size - indexSize;
+	for ( uint32_t i = 0; i < self->numBlocks; ++i, index += ACM_BINARY_BLOCK_ENTRY )
+	{
+		AcmBinaryBlockEntry *entry = &self->entries[ i ];
+		if ( !source_read( &self->container, index, &entry->offset, sizeof( uint64_t ) ) ||
+		     !source_read( &self->container, index + sizeof( uint64_t ), &entry->size, sizeof( uint32_t ) ) )
+		{
+			close_blocks( self );
+			return false;
+		}
+
+		if ( entry->size > self->blockSize || entry->size > self->container.size - indexSize ||
+		     entry->offset > self->container.size - indexSize - entry->size )
+		{
+			acm_set_error_message_( ND_ERROR_IO_READ, "invalid compressed block (%u)", i );
+			close_blocks( self );
+			return false;
+		}
+	}
+
+	source->buf     = NULL;
+	source->file    = NULL;
+	source->size    = self->rawSize;
+	source->filePos = 0;
+	source->blocks  = self;
+	return true;
+}
+
+static size_t get_block_length( const AcmBinaryBlocks *self, uint32_t index )
+{
+	uint64_t start = ( uint64_t ) index * self->blockSize;
+	return ( size_t ) ( ( self->rawSize - start ) < self->blockSize ? ( self->rawSize - start ) : self->blockSize );
+}
+
+static bool decompress_block( AcmBinaryBlocks *self, uint32_t index, uint8_t *dst )
+{
+	const AcmBinaryBlockEntry *entry  = &self->entries[ index ];
+	size_t                     length = get_block_length( self, index );
+
+	// stored blocks can go straight to the destination
+	if ( entry->size == length )
+	{
+		return source_read( &self->container, entry->offset, dst, length );
+	}
+
+	const uint8_t *src = self->scratch;
+	if ( self->container.buf != NULL )
+	{
+		src = self->container.buf + entry->offset;
+	}
+	else if ( !source_read( &self->container, entry->offset, self->scratch, entry->size ) )
+	{
+		return false;
+	}
+
+	return acm_decompress_block_( src, entry->size, dst, length );
+}
+
+static bool read_blocks( AcmBinaryBlocks *self, uint64_t offset, void *dst, size_t size )
+{
+	if ( offset > self->rawSize || size > self->rawSize - offset )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "unexpected end of binary node data (%" PRIu64 ")", offset );
+		return false;
+	}
+
+	// only the blocks covering the range are touched
+	uint8_t *p = dst;
+	while ( size > 0 )
+	{
+		uint32_t index = ( uint32_t ) ( offset / self->blockSize );
+		if ( index != self->cachedBlock )
+		{
+			self->cachedBlock = UINT32_MAX;
+			if ( !decompress_block( self, index, self->cache ) )
+			{
+				return false;
+			}
+			self->cachedBlock = index;
+		}
+
+		size_t start = ( size_t ) ( offset - ( uint64_t ) index * self->blockSize );
+		size_t n     = get_block_length( self, index ) - start;
+		if ( n > size )
+		{
+			n = size;
+		}
+
+		memcpy( p, self->cache + start, n );
+		p += n;
+		offset += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+/**
+ * Decompresses an entire file in one go, resulting in the
+ * file as it would be without compression.
+ */
+void *acm_decompress_binary_( const void *buf, size_t bufSize, unsigned int headerSize, size_t *rawSize )
+{
+	AcmBinarySource source;
+	memset( &source, 0, sizeof( AcmBinarySource ) );
+	source.buf  = buf;
+	source.size = bufSize;
+
+	AcmBinaryBlocks blocks;
+	if ( !open_blocks( &source, headerSize, &blocks ) )
+	{
+		return NULL;
+	}
+
+	uint8_t *raw = ( blocks.rawSize <= SIZE_MAX ) ? ACM_NEW_( uint8_t, ( size_t ) blocks.rawSize + 1 ) : NULL;
+	if ( raw == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate decompressed file (%" PRIu64 " bytes)", blocks.rawSize );
+		close_blocks( &blocks );
+		return NULL;
+	}
+
+	for ( uint32_t i = 0; i < blocks.numBlocks; ++i )
+	{
+		if ( !decompress_block( &blocks, i, raw + ( size_t ) i * blocks.blockSize ) )
+		{
+			ACM_DELETE( raw );
+			raw = NULL;
+			break;
+		}
+	}
+
+	close_blocks( &blocks );
+
+	*rawSize = ( size_t ) blocks.rawSize;
+	return raw;
+}
+
+/* see read_count */
+static bool source_read_count( AcmBinarySource *self, uint64_t *offset, size_t fixedSize, uint64_t *value )
+{
+	*value = 0;
+	if ( !( self->flags & ACM_BINARY_FLAG_VARINTS ) )
+	{
+		if ( !source_read( self, *offset, value, fixedSize ) )
+		{
+			return false;
+		}
+
+		*offset += fixedSize;
+		return true;
+	}
+
+	for ( unsigned int shift = 0; shift < 64; shift += 7 )
+	{
+		uint8_t byte;
+		if ( !source_read( self, ( *offset )++, &byte, sizeof( uint8_t ) ) )
+		{
+			return false;
+		}
+
+		*value |= ( uint64_t ) ( byte & 0x7F ) << shift;
+		if ( !( byte & 0x80 ) )
+		{
+			return true;
+		}
+	}
+
+	acm_set_error_message_( ND_ERROR_IO_READ, "invalid varint at %" PRIu64, *offset );
+	return false;
+}
+
+/**
+ * Sets where the node's data ends, provided it fits before limit (the
+ * end of whatever the node sits in).
+ */
+static bool set_node_end( AcmBinaryNodeInfo *info, uint64_t offset, uint64_t size, uint64_t limit )
+{
+	if ( offset > limit || size > limit - offset )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "node at %" PRIu64 " overruns its parent (%" PRIu64 ")", info->offset, limit );
+		return false;
+	}
+
+	info->end = offset + size;
+	return true;
+}
+
+/* where the children of the node end, which is before its child table if it has one */
+static uint64_t get_payload_end( const AcmBinaryNodeInfo *info )
+{
+	if ( info->flags & ACM_BINARY_CONTAINER_CHILD_TABLE )
+	{
+		return info->end - ( uint64_t ) info->numChildren * ACM_BINARY_CHILD_TABLE_ENTRY;
+	}
+
+	return info->end;
+}
+
+static bool read_node_info( AcmBinarySource *source, uint64_t offset, uint64_t limit, AcmBinaryNodeInfo *info )
+{
+	memset( info, 0, sizeof( AcmBinaryNodeInfo ) );
+	info->offset = offset;
+	if ( limit > source->size )
+	{
+		limit = source->size;
+	}
+
+	uint64_t length;
+	bool     hasTable = ( source->flags & ACM_BINARY_FLAG_STRING_TABLE ) != 0;
+	if ( !source_read_count( source, &offset, hasTable ? sizeof( uint32_t ) : sizeof( uint16_t ), &length ) )
+	{
+		return false;
+	}
+
+	if ( hasTable )
+	{
+		if ( length > source->numStrings )
+		{
+			acm_set_error_message_( ND_ERROR_IO_READ, "invalid string reference (%" PRIu64 ") at %" PRIu64, length, info->offset );
+			return false;
+		}
+		else if ( length > 0 )
+		{
+			info->name       = source->strings[ length - 1 ].buf;
+			info->nameLength = source->strings[ length - 1 ].bufSize;
+		}
+	}
+	else if ( length > UINT16_MAX )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "invalid name length (%" PRIu64 ") at %" PRIu64, length, info->offset );
+		return false;
+	}
+	else
+	{
+		info->nameLength = ( uint16_t ) length;
+		info->nameOffset = offset;
+		offset += info->nameLength;
+	}
+
+	int8_t type;
+	if ( !source_read( source, offset++, &type, sizeof( int8_t ) ) )
+	{
+		return false;
+	}
+	else if ( type <= ACM_PROPERTY_TYPE_INVALID || type >= ACM_MAX_PROPERTY_TYPES )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_TYPE, "invalid property type (%d) at %" PRIu64, type, info->offset );
+		return false;
+	}
+	info->type = ( AcmPropertyType ) type;
+
+	if ( info->type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		if ( !source_read( source, offset++, &type, sizeof( int8_t ) ) )
+		{
+			return false;
+		}
+		else if ( type <= ACM_PROPERTY_TYPE_INVALID || type >= ACM_MAX_PROPERTY_TYPES )
+		{
+			acm_set_error_message_( ND_ERROR_INVALID_TYPE, "invalid child property type (%d) at %" PRIu64, type, info->offset );
+			return false;
+		}
+		info->childType = ( AcmPropertyType ) type;
+	}
+
+	if ( info->type == ACM_PROPERTY_TYPE_STRING )
+	{
+		if ( hasTable )
+		{
+			if ( !source_read_count( source, &offset, sizeof( uint32_t ), &length ) )
+			{
+				return false;
+			}
+
+			// shared values are just the reference
+			if ( length > 0 )
+			{
+				return set_node_end( info, offset, 0, limit );
+			}
+		}
+
+		if ( !source_read_count( source, &offset, sizeof( uint16_t ), &length ) )
+		{
+			return false;
+		}
+
+		return set_node_end( info, offset, length, limit );
+	}
+	else if ( info->type != ACM_PROPERTY_TYPE_OBJECT && info->type != ACM_PROPERTY_TYPE_ARRAY )
+	{
+		return set_node_end( info, offset, acm_get_type_size_( info->type ), limit );
+	}
+
+	uint64_t numChildren, payloadSize;
+	if ( !source_read_count( source, &offset, sizeof( uint32_t ), &numChildren ) ||
+	     !source_read( source, offset++, &info->flags, sizeof( uint8_t ) ) ||
+	     !source_read_count( source, &offset, sizeof( uint64_t ), &payloadSize ) )
+	{
+		return false;
+	}
+
+	info->numChildren = ( uint32_t ) numChildren;
+	info->payload     = offset;
+	if ( numChildren > UINT32_MAX ||
+	     ( ( info->flags & ACM_BINARY_CONTAINER_CHILD_TABLE ) && ( uint64_t ) info->numChildren * ACM_BINARY_CHILD_TABLE_ENTRY > payloadSize ) )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "invalid payload size (%" PRIu64 ") at %" PRIu64, payloadSize, info->offset );
+		return false;
+	}
+
+	return set_node_end( info, info->payload, payloadSize, limit );
+}
+
+static bool read_child_entry( AcmBinarySource *source, const AcmBinaryNodeInfo *parent, uint32_t index, uint32_t *hash, uint64_t *offset )
+{
+	uint64_t entry = parent->end - ( uint64_t ) ( parent->numChildren - index ) * ACM_BINARY_CHILD_TABLE_ENTRY;
+	return source_read( source, entry, hash, sizeof( uint32_t ) ) &&
+	       source_read( source, entry + sizeof( uint32_t ), offset, sizeof( uint64_t ) );
+}
+
+static bool node_name_matches( AcmBinarySource *source, const AcmBinaryNodeInfo *info, const char *name, size_t length )
+{
+	if ( info->nameLength != length + 1 )
+	{
+		return false;
+	}
+	else if ( info->name != NULL )
+	{
+		return memcmp( info->name, name, length ) == 0;
+	}
+
+	char buf[ 64 ];
+	for ( size_t i = 0; i < length; i += sizeof( buf ) )
+	{
+		size_t n = ( length - i ) < sizeof( buf ) ? ( length - i ) : sizeof( buf );
+		if ( !source_read( source, info->nameOffset + i, buf, n ) || memcmp( buf, name + i, n ) != 0 )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool find_element( AcmBinarySource *source, const AcmBinaryNodeInfo *parent, const char *segment, AcmBinaryNodeInfo *child )
+{
+	char         *end;
+	unsigned long index = strtoul( segment, &end, 10 );
+	if ( *segment < '0' || *segment > '9' || *end != '\0' || index >= parent->numChildren )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ELEMENTS, "invalid array index (%s)", segment );
+		return false;
+	}
+
+	if ( parent->flags & ACM_BINARY_CONTAINER_CHILD_TABLE )
+	{
+		uint32_t hash;
+		uint64_t offset;
+		return read_child_entry( source, parent, ( uint32_t ) index, &hash, &offset ) &&
+		       read_node_info( source, parent->payload + offset, get_payload_end( parent ), child );
+	}
+
+	size_t typeSize = acm_get_type_size_( parent->childType );
+	if ( parent->flags & ( ACM_BINARY_CONTAINER_BITPACKED | ACM_BINARY_CONTAINER_QUANTIZED | ACM_BINARY_CONTAINER_TABLE ) )
+	{
+		// no way to get at a single element without decoding the array, so that happens on load
+		*child                  = *parent;
+		child->type             = parent->childType;
+		child->isDecodedElement = true;
+		child->elementIndex     = ( uint32_t ) index;
+		return true;
+	}
+	else if ( parent->flags & ACM_BINARY_CONTAINER_PACKED )
+	{
+		uint8_t padding;
+		if ( typeSize == 0 || !source_read( source, parent->payload, &padding, sizeof( uint8_t ) ) )
+		{
+			return false;
+		}
+
+		// the block has to fit the payload, as the element can end up being written to
+		uint64_t available = get_payload_end( parent ) - parent->payload;
+		if ( sizeof( uint8_t ) + padding > available ||
+		     ( uint64_t ) parent->numChildren * typeSize > available - sizeof( uint8_t ) - padding )
+		{
+			acm_set_error_message_( ND_ERROR_INVALID_DATA, "invalid element block at %" PRIu64, parent->offset );
+			return false;
+		}
+
+		memset( child, 0, sizeof( AcmBinaryNodeInfo ) );
+		child->offset         = parent->payload + sizeof( uint8_t ) + padding + index * typeSize;
+		child->end            = child->offset + typeSize;
+		child->type           = parent->childType;
+		child->isBlockElement = true;
+		return true;
+	}
+	else if ( typeSize > 0 )
+	{
+		// elements are written unnamed, as a zero length (or string reference),
+		// which takes a single byte as a varint, then the type and the value
+		size_t nameSize = ( source->flags & ACM_BINARY_FLAG_STRING_TABLE ) ? sizeof( uint32_t ) : sizeof( uint16_t );
+		if ( source->flags & ACM_BINARY_FLAG_VARINTS )
+		{
+			nameSize = sizeof( uint8_t );
+		}
+
+		// none can be any smaller, so if that's all there's room for, every
+		// element is at a fixed stride; otherwise some are named, and are walked
+		uint64_t elementSize = nameSize + sizeof( int8_t ) + typeSize;
+		if ( get_payload_end( parent ) - parent->payload == ( uint64_t ) parent->numChildren * elementSize )
+		{
+			return read_node_info( source, parent->payload + index * elementSize, get_payload_end( parent ), child );
+		}
+	}
+
+	uint64_t offset = parent->payload;
+	for ( unsigned long i = 0; i <= index; ++i )
+	{
+		if ( !read_node_info( source, offset, get_payload_end( parent ), child ) )
+		{
+			return false;
+		}
+		offset = child->end;
+	}
+
+	return true;
+}
+
+static bool find_child( AcmBinarySource *source, const AcmBinaryNodeInfo *parent, const char *segment, AcmBinaryNodeInfo *child )
+{
+	if ( parent->type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		return find_element( source, parent, segment, child );
+	}
+	else if ( parent->type != ACM_PROPERTY_TYPE_OBJECT )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_TYPE, "attempted to get child (%s) from an invalid node type", segment );
+		return false;
+	}
+
+	size_t length = strlen( segment );
+	if ( parent->flags & ACM_BINARY_CONTAINER_CHILD_TABLE )
+	{
+		uint32_t hash = acm_hash_string_( segment );
+		uint32_t entryHash;
+		uint64_t entryOffset;
+
+		uint32_t lo = 0, hi = parent->numChildren;
+		while ( lo < hi )
+		{
+			uint32_t mid = lo + ( hi - lo ) / 2;
+			if ( !read_child_entry( source, parent, mid, &entryHash, &entryOffset ) )
+			{
+				return false;
+			}
+
+			if ( entryHash < hash )
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+
+		for ( ; lo < parent->numChildren; ++lo )
+		{
+			if ( !read_child_entry( source, parent, lo, &entryHash, &entryOffset ) )
+			{
+				return false;
+			}
+			else if ( entryHash != hash )
+			{
+				break;
+			}
+
+			if ( !read_node_info( source, parent->payload + entryOffset, get_payload_end( parent ), child ) )
+			{
+				return false;
+			}
+			else if ( node_name_matches( source, child, segment, length ) )
+			{
+				return true;
+			}
+		}
+	}
+	else
+	{
+		uint64_t offset = parent->payload;
+		for ( uint32_t i = 0; i < parent->numChildren; ++i )
+		{
+			if ( !read_node_info( source, offset, get_payload_end( parent ), child ) )
+			{
+				return false;
+			}
+			else if ( node_name_matches( source, child, segment, length ) )
+			{
+				return true;
+			}
+			offset = child->end;
+		}
+	}
+
+	acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "failed to find child (%s)", segment );
+	return false;
+}
+
+static AcmBranch *create_scalar_branch( AcmPropertyType type, const void *value )
+{
+	AcmBranch *branch = acm_push_new_branch( NULL, NULL, type, ACM_PROPERTY_TYPE_INVALID );
+	if ( branch != NULL )
+	{
+		char str[ 64 ];
+		acm_format_value_( type, value, str, sizeof( str ) );
+		acm_alloc_var_string_( str, &branch->data );
+	}
+
+	return branch;
+}
+
+/**
+ * Pulls a single element (or something under it) out of a decoded
+ * array, which is then thrown away.
+ */
+static AcmBranch *extract_element( AcmBranch *array, uint32_t index, const char *path )
+{
+	if ( array == NULL )
+	{
+		return NULL;
+	}
+
+	AcmBranch *branch = NULL;
+	if ( acm_is_packed_array_( array ) && index < array->packed.numElements && path == NULL )
+	{
+		size_t   typeSize = acm_get_type_size_( array->childType );
+		uint64_t value    = 0;
+		memcpy( &value, ( const uint8_t * ) array->packed.buf + index * typeSize, typeSize );
+		branch = create_scalar_branch( array->childType, &value );
+	}
+	else if ( !acm_is_packed_array_( array ) && index < array->numChildren )
+	{
+		AcmBranch *element = array->children.start;
+		for ( uint32_t i = 0; i < index; ++i )
+		{
+			element = element->next;
+		}
+
+		AcmBranch *target = path != NULL ? acm_get_child_by_path( element, path ) : element;
+		if ( target != NULL )
+		{
+			branch = acm_copy_branch( target );
+		}
+		else
+		{
+			acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "failed to find branch (%s)", path );
+		}
+	}
+	else
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ELEMENTS, "invalid array index (%u)", index );
+	}
+
+	acm_branch_destroy( array );
+
+	return branch;
+}
+
+/**
+ * Follows the path down from the node at the given offset. Anything past
+ * an element that needs its array decoded is left in rest, to be looked
+ * up once it has been.
+ */
+static bool find_branch( AcmBinarySource *source, uint64_t offset, const char *path, AcmBinaryNodeInfo *info, const char **rest )
+{
+	*rest = NULL;
+	if ( !read_node_info( source, offset, source->size, info ) )
+	{
+		return false;
+	}
+	else if ( path == NULL || *path == '\0' )
+	{
+		return true;
+	}
+
+	size_t length   = strlen( path );
+	char  *segments = ACM_NEW_( char, length + 1 );
+	if ( segments == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate path (%s)", path );
+		return false;
+	}
+	memcpy( segments, path, length );
+
+	char *segment = segments;
+	while ( segment != NULL )
+	{
+		char *next = strchr( segment, '.' );
+		if ( next != NULL )
+		{
+			*next++ = '\0';
+		}
+
+		AcmBinaryNodeInfo child;
+		if ( !find_child( source, info, segment, &child ) )
+		{
+			ACM_DELETE( segments );
+			return false;
+		}
+
+		*info   = child;
+		segment = next;
+		if ( info->isDecodedElement )
+		{
+			*rest = next != NULL ? path + ( next - segments ) : NULL;
+			break;
+		}
+	}
+
+	ACM_DELETE( segments );
+	return true;
+}
+
+static AcmBranch *load_branch( AcmBinarySource *source, uint64_t offset, const AcmBinaryReader *reader, const char *path )
+{
+	AcmBinaryNodeInfo info;
+	const char       *rest;
+	if ( !find_branch( source, offset, path, &info, &rest ) )
+	{
+		return NULL;
+	}
+
+	if ( info.isBlockElement )
+	{
+		uint64_t value = 0;
+		if ( !source_read( source, info.offset, &value, ( size_t ) ( info.end - info.offset ) ) )
+		{
+			return NULL;
+		}
+
+		return create_scalar_branch( info.type, &value );
+	}
+
+	// now only the bytes making up the branch need to be decoded
+	size_t size = ( size_t ) ( info.end - info.offset );
+	if ( source->buf != NULL )
+	{
+		AcmBranch *branch = deserialize_binary_node( source->buf + info.offset, size, info.offset, reader );
+		return info.isDecodedElement ? extract_element( branch, info.elementIndex, rest ) : branch;
+	}
+
+	uint8_t *buf = ACM_NEW_( uint8_t, size );
+	if ( buf == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate branch buffer (%zu bytes)", size );
+		return NULL;
+	}
+
+	AcmBranch *branch = NULL;
+	if ( source_read( source, info.offset, buf, size ) )
+	{
+		branch = deserialize_binary_node( buf, size, info.offset, reader );
+		if ( info.isDecodedElement )
+		{
+			branch = extract_element( branch, info.elementIndex, rest );
+		}
+	}
+
+	ACM_DELETE( buf );
+
+	return branch;
+}
+
+/**
+ * Formats prior to v3 have no sizes we can skip with, so it all
+ * needs to be loaded before we can pull out the branch.
+ */
+static AcmBranch *extract_branch( AcmBranch *root, const char *path )
+{
+	if ( root == NULL )
+	{
+		return NULL;
+	}
+
+	AcmBranch *branch = acm_get_child_by_path( root, path );
+	if ( branch == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "failed to find branch (%s)", path );
+	}
+
+	if ( branch != root )
+	{
+		branch = branch != NULL ? acm_copy_branch( branch ) : NULL;
+		acm_branch_destroy( root );
+	}
+
+	return branch;
+}
+
+/**
+ * Reads the string table in one go, so names can be compared without
+ * going back to the source. Files get a copy of the table, which the
+ * caller is responsible for.
+ */
+static bool load_string_table( AcmBinarySource *source, uint64_t *offset, AcmBinaryReader *reader, uint8_t **copy )
+{
+	uint64_t numStrings, tableSize;
+	if ( !source_read_count( source, offset, sizeof( uint32_t ), &numStrings ) ||
+	     !source_read_count( source, offset, sizeof( uint64_t ), &tableSize ) )
+	{
+		return false;
+	}
+	else if ( numStrings > UINT32_MAX || tableSize > source->size - *offset )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "invalid string table header" );
+		return false;
+	}
+
+	const uint8_t *table = source->buf != NULL ? source->buf + *offset : NULL;
+	if ( table == NULL )
+	{
+		*copy = ACM_NEW_( uint8_t, ( size_t ) tableSize + 1 );
+		if ( *copy == NULL )
+		{
+			acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate string table (%" PRIu64 " bytes)", tableSize );
+			return false;
+		}
+		else if ( !source_read( source, *offset, *copy, ( size_t ) tableSize ) )
+		{
+			return false;
+		}
+		table = *copy;
+	}
+
+	if ( !parse_string_table( table, ( size_t ) tableSize, numStrings, reader ) )
+	{
+		return false;
+	}
+
+	source->strings    = reader->strings;
+	source->numStrings = reader->numStrings;
+	*offset += tableSize;
+	return true;
+}
+
+/**
+ * Loads a branch from a v3 file or buffer, where anything
+ * compressed is decompressed a block at a time as needed.
+ */
+static AcmBranch *load_source_branch( AcmBinarySource *source, uint32_t version, uint32_t flags, unsigned int headerSize, const char *path )
+{
+	AcmBinaryBlocks blocks;
+	bool            isCompressed = ( flags & ACM_BINARY_FLAG_COMPRESSED ) != 0;
+	if ( isCompressed )
+	{
+		if ( !open_blocks( source, headerSize, &blocks ) )
+		{
+			return NULL;
+		}
+
+		// blocks contain the uncompressed file, with a header of its own
+		uint8_t header[ 32 ];
+		size_t  headerLength = source->size < sizeof( header ) ? ( size_t ) source->size : sizeof( header );
+		if ( !source_read( source, 0, header, headerLength ) ||
+		     acm_parse_file_type_( header, headerLength, &version, &flags, &headerSize ) != ACM_FILE_TYPE_BINARY ||
+		     version < 3 || ( flags & ACM_BINARY_FLAG_COMPRESSED ) )
+		{
+			acm_set_error_message_( ND_ERROR_IO_READ, "invalid compressed binary node data" );
+			close_blocks( &blocks );
+			return NULL;
+		}
+	}
+
+	source->flags = flags;
+
+	AcmBinaryReader reader;
+	memset( &reader, 0, sizeof( AcmBinaryReader ) );
+	reader.version = version;
+	reader.flags   = flags;
+
+	AcmBranch *branch = NULL;
+	uint64_t   offset = headerSize;
+	uint8_t   *table  = NULL;
+	if ( !( flags & ACM_BINARY_FLAG_STRING_TABLE ) || load_string_table( source, &offset, &reader, &table ) )
+	{
+		branch = load_branch( source, offset, &reader, path );
+	}
+
+	ACM_DELETE( ( AcmString * ) reader.strings );
+	ACM_DELETE( table );
+
+	if ( isCompressed )
+	{
+		close_blocks( &blocks );
+	}
+
+	return branch;
+}
+
+AcmBranch *acm_load_branch_from_memory( const void *buf, size_t bufSize, const char *path )
+{
+	unsigned int headerSize;
+	uint32_t     version;
+	uint32_t     flags;
+	AcmFileType  fileType = acm_parse_file_type_( buf, bufSize, &version, &flags, &headerSize );
+	if ( fileType == ACM_FILE_TYPE_BINARY && version >= 3 )
+	{
+		AcmBinarySource source;
+		memset( &source, 0, sizeof( AcmBinarySource ) );
+		source.buf  = buf;
+		source.size = bufSize;
+
+		return load_source_branch( &source, version, flags, headerSize, path );
+	}
+
+	return extract_branch( acm_load_from_memory( buf, bufSize, NULL, NULL ), path );
+}
+
+AcmBranch *acm_load_file_branch( const char *path, const char *branchPath )
+{
+	FILE *file = fopen( path, "rb" );
+	if ( file == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "failed to open file (%s)", path );
+		return NULL;
+	}
+
+	uint8_t      header[ 32 ];
+	size_t       headerLength = fread( header, sizeof( uint8_t ), sizeof( header ), file );
+	unsigned int headerSize;
+	uint32_t     version;
+	uint32_t     flags;
+	AcmFileType  fileType = acm_parse_file_type_( header, headerLength, &version, &flags, &headerSize );
+	if ( fileType == ACM_FILE_TYPE_BINARY && version >= 3 )
+	{
+		AcmBinarySource source;
+		memset( &source, 0, sizeof( AcmBinarySource ) );
+		source.file    = file;
+		source.filePos = UINT64_MAX;
+
+		AcmBranch *branch = NULL;
+		if ( acm_fseek64( file, 0, SEEK_END ) == 0 )
+		{
+			source.size = ( uint64_t ) acm_ftell64( file );
+			branch      = load_source_branch( &source, version, flags, headerSize, branchPath );
+		}
+
+		fclose( file );
+		return branch;
+	}
+
+	fclose( file );
+
+	return extract_branch( acm_load_file( path, NULL ), branchPath );
+}
+
+/******************************************/
+/** Patching **/
+
+/**
+ * Finds where the value of the scalar at the given path sits in the
+ * file, and encodes the new value to go there.
+ */
+static bool locate_scalar( AcmBinarySource *source, unsigned int headerSize, const char *path, const char *value, uint64_t *valueOffset, uint8_t *dst, size_t *size )
+{
+	// names can't be compared without the table
+	AcmBinaryReader reader;
+	memset( &reader, 0, sizeof( AcmBinaryReader ) );
+	reader.version = ACM_FORMAT_BINARY_VERSION;
+	reader.flags   = source->flags;
+
+	AcmBinaryNodeInfo info;
+	const char       *rest;
+	uint64_t          offset = headerSize;
+	uint8_t          *table  = NULL;
+	bool              status = ( !( source->flags & ACM_BINARY_FLAG_STRING_TABLE ) || load_string_table( source, &offset, &reader, &table ) ) &&
+	                           find_branch( source, offset, path, &info, &rest );
+
+	ACM_DELETE( ( AcmString * ) reader.strings );
+	ACM_DELETE( table );
+
+	if ( !status )
+	{
+		return false;
+	}
+	else if ( info.isDecodedElement )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_TYPE, "elements of bit-packed arrays, quantized arrays and tables can't be patched in place (%s)", path );
+		return false;
+	}
+
+	*size = acm_get_type_size_( info.type );
+	if ( *size == 0 )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_TYPE, "only fixed-size scalars can be patched in place (%s)", path );
+		return false;
+	}
+
+	// values of scalar nodes are the last thing in them
+	*valueOffset = info.isBlockElement ? info.offset : info.end - *size;
+	if ( info.end > source->size || *valueOffset < info.offset || *valueOffset + *size != info.end )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "invalid scalar at %" PRIu64 " (%s)", info.offset, path );
+		return false;
+	}
+
+	return acm_parse_value_( info.type, value, dst );
+}
+
+/* only uncompressed v3 files have the sizes needed to find a branch without loading it all */
+static bool is_patchable( AcmFileType fileType, uint32_t version, uint32_t flags )
+{
+	if ( fileType != ACM_FILE_TYPE_BINARY || version < 3 || ( flags & ACM_BINARY_FLAG_COMPRESSED ) )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "only uncompressed binary files from v3 onwards can be patched in place" );
+		return false;
+	}
+
+	return true;
+}
+
+bool acm_patch_memory( void *buf, size_t bufSize, const char *path, const char *value )
+{
+	unsigned int headerSize;
+	uint32_t     version;
+	uint32_t     flags;
+	AcmFileType  fileType = acm_parse_file_type_( buf, bufSize, &version, &flags, &headerSize );
+	if ( !is_patchable( fileType, version, flags ) )
+	{
+		return false;
+	}
+
+	AcmBinarySource source;
+	memset( &source, 0, sizeof( AcmBinarySource ) );
+	source.buf   = buf;
+	source.size  = bufSize;
+	source.flags = flags;
+
+	uint8_t  data[ sizeof( uint64_t ) ];
+	size_t   size;
+	uint64_t offset;
+	if ( !locate_scalar( &source, headerSize, path, value, &offset, data, &size ) )
+	{
+		return false;
+	}
+
+	memcpy( ( uint8_t * ) buf + offset, data, size );
+	return true;
+}
+
+bool acm_patch_file( const char *path, const char *branchPath, const char *value, bool sync )
+{
+	FILE *file = fopen( path, "r+b" );
+	if ( file == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to open file (%s)", path );
+		return false;
+	}
+
+	uint8_t      header[ 32 ];
+	size_t       headerLength = fread( header, sizeof( uint8_t ), sizeof( header ), file );
+	unsigned int headerSize;
+	uint32_t     version;
+	uint32_t     flags;
+	AcmFileType  fileType = acm_parse_file_type_( header, headerLength, &version, &flags, &headerSize );
+	if ( !is_patchable( fileType, version, flags ) || acm_fseek64( file, 0, SEEK_END ) != 0 )
+	{
+		fclose( file );
+		return false;
+	}
+
+	AcmBinarySource source;
+	memset( &source, 0, sizeof( AcmBinarySource ) );
+	source.file    = file;
+	source.filePos = UINT64_MAX;
+	source.size    = ( uint64_t ) acm_ftell64( file );
+	source.flags   = flags;
+
+	uint8_t  data[ sizeof( uint64_t ) ];
+	size_t   size;
+	uint64_t offset;
+	bool     status = locate_scalar( &source, headerSize, branchPath, value, &offset, data, &size );
+	if ( status )
+	{
+		// switching from reading to writing needs a seek in between regardless
+		status = acm_fseek64( file, offset, SEEK_SET ) == 0 && fwrite( data, sizeof( uint8_t ), size, file ) == size && fflush( file ) == 0;
+#if defined( _WIN32 )
+		status = status && ( !sync || _commit( _fileno( file ) ) == 0 );
+#else
+		status = status && ( !sync || fsync( fileno( file ) ) == 0 );
+#endif
+		if ( !status )
+		{
+			acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to write %zu bytes at %" PRIu64 " (%s)", size, offset, path );
+		}
+	}
+
+	if ( fclose( file ) != 0 && status )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to close file (%s)", path );
+		status = false;
+	}
+
+	return status;
+}
+
+/******************************************/
+/** Mapped Files **/
+
+static AcmMapping *map_file( const char *path )
+{
+	AcmMapping *mapping = ACM_NEW( AcmMapping );
+	if ( mapping == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate mapping" );
+		return NULL;
+	}
+
+#if defined( _WIN32 )
+	HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( file != INVALID_HANDLE_VALUE )
+	{
+		LARGE_INTEGER size;
+		if ( GetFileSizeEx( file, &size ) && size.QuadPart > 0 )
+		{
+			// the view keeps hold of the file, so the handles can go straight away
+			HANDLE view = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+			if ( view != NULL )
+			{
+				mapping->base = MapViewOfFile( view, FILE_MAP_READ, 0, 0, 0 );
+				mapping->size = ( size_t ) size.QuadPart;
+				CloseHandle( view );
+			}
+		}
+		CloseHandle( file );
+	}
+#else
+	int file = open( path, O_RDONLY );
+	if ( file >= 0 )
+	{
+		struct stat st;
+		if ( fstat( file, &st ) == 0 && st.st_size > 0 )
+		{
+			void *base = mmap( NULL, ( size_t ) st.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+			if ( base != MAP_FAILED )
+			{
+				mapping->base = base;
+				mapping->size = ( size_t ) st.st_size;
+			}
+		}
+		close( file );
+	}
+#endif
+
+	if ( mapping->base == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "failed to map file (%s)", path );
+		ACM_DELETE( mapping );
+		return NULL;
+	}
+
+	return mapping;
+}
+
+void acm_release_mapping_( AcmMapping *mapping )
+{
+#if defined( _WIN32 )
+	UnmapViewOfFile( mapping->base );
+#else
+	munmap( mapping->base, mapping->size );
+#endif
+
+	ACM_DELETE( mapping );
+}
+
+AcmBranch *acm_load_file_mapped( const char *path, const char *objectType )
+{
+	AcmMapping *mapping = map_file( path );
+	if ( mapping == NULL )
+	{
+		return NULL;
+	}
+
+	unsigned int headerSize;
+	uint32_t     version;
+	uint32_t     flags;
+	AcmFileType  fileType = acm_parse_file_type_( mapping->base, mapping->size, &version, &flags, &headerSize );
+	if ( fileType != ACM_FILE_TYPE_BINARY || ( flags & ACM_BINARY_FLAG_COMPRESSED ) )
+	{
+		acm_release_mapping_( mapping );
+
+		// text gets tokenised regardless, and compressed files have to be
+		// decompressed, so there's nothing to gain from the mapping
+		return ( fileType != ACM_FILE_TYPE_INVALID ) ? acm_load_file( path, objectType ) : NULL;
+	}
+
+	AcmBinaryReader reader;
+	memset( &reader, 0, sizeof( AcmBinaryReader ) );
+	reader.version       = version;
+	reader.flags         = flags;
+	reader.borrow        = true;
+
+	// names end up pointing straight into the table in the mapping
+	const void *p    = ( const uint8_t * ) mapping->base + headerSize;
+	size_t      size = mapping->size - headerSize;
+	AcmBranch  *root = NULL;
+	if ( !( flags & ACM_BINARY_FLAG_STRING_TABLE ) || read_string_table( &p, &size, &reader ) )
+	{
+		root = deserialize_binary_node( p, size, ( uint64_t ) ( ( const uint8_t * ) p - ( const uint8_t * ) mapping->base ), &reader );
+	}
+
+	ACM_DELETE( ( AcmString * ) reader.strings );
+
+	if ( root == NULL )
+	{
+		acm_release_mapping_( mapping );
+		return NULL;
+	}
+
+	// root now takes ownership of the mapping
+	root->mapping = mapping;
+
+	if ( objectType != NULL && ( root->name.buf == NULL || strcmp( root->name.buf, objectType ) != 0 ) )
+	{
+		Warning( "Invalid \"%s\" file, expected \"%s\" but got \"%s\"!\n", objectType, objectType, root->name.buf ? root->name.buf : "" );
+		acm_branch_destroy( root );
+		return NULL;
+	}
+
+	return root;
+}
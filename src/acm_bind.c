@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+#define MAX_LOCAL_FIELDS 32
+
+static AcmPropertyType get_request_type( const AcmFieldDescriptor *field )
+{
+	if ( field->deserialize != NULL )
+	{
+		return ACM_PROPERTY_TYPE_INVALID;
+	}
+
+	if ( field->type == ACM_PROPERTY_TYPE_OBJECT )
+	{
+		return field->arrayCount > 0 ? ACM_PROPERTY_TYPE_ARRAY : ACM_PROPERTY_TYPE_OBJECT;
+	}
+
+	if ( field->type == ACM_PROPERTY_TYPE_STRING || field->arrayCount == 0 )
+	{
+		return field->type;
+	}
+
+	return ACM_PROPERTY_TYPE_ARRAY;
+}
+
+static void bind_read_array( const AcmBranch *array, const AcmFieldDescriptor *field, uint8_t *dst )
+{
+	if ( !acm_is_packed_array_( array ) || array->childType != field->type )
+	{
+		Warning( "Unexpected array type for field (%s)!\n", field->name );
+		return;
+	}
+
+	unsigned int numElements = array->packed.numElements;
+	if ( numElements > field->arrayCount )
+	{
+		numElements = field->arrayCount;
+	}
+
+	if ( field->type == ACM_PROPERTY_TYPE_BOOL )
+	{
+		const uint8_t *src = array->packed.buf;
+		for ( unsigned int i = 0; i < numElements; ++i )
+		{
+			( ( bool * ) dst )[ i ] = src[ i ] != 0;
+		}
+		return;
+	}
+
+	memcpy( dst, array->packed.buf, numElements * acm_get_type_size_( field->type ) );
+}
+
+static void bind_read_object_array( AcmBranch *array, const AcmFieldDescriptor *field, uint8_t *dst )
+{
+	if ( array->childType != ACM_PROPERTY_TYPE_OBJECT )
+	{
+		Warning( "Unexpected array type for field (%s)!\n", field->name );
+		return;
+	}
+
+	unsigned int i = 0;
+	for ( AcmBranch *element = array->children.start; element != NULL && i < field->arrayCount; element = element->next, ++i )
+	{
+		acm_bind_read( element, field->nested, dst + i * field->nested->size );
+	}
+}
+
+unsigned int acm_bind_read( AcmBranch *root, const AcmStructDescriptor *descriptor, void *dst )
+{
+	// everything is resolved up front through a single pass over the children,
+	// with scalars written straight into the struct and the rest dealt with after
+	AcmFieldRequest  localRequests[ MAX_LOCAL_FIELDS ];
+	AcmBranch       *localBranches[ MAX_LOCAL_FIELDS ];
+	AcmFieldRequest *requests = localRequests;
+	AcmBranch      **branches = localBranches;
+	if ( descriptor->numFields > MAX_LOCAL_FIELDS )
+	{
+		requests = ACM_NEW_( AcmFieldRequest, descriptor->numFields );
+		branches = ACM_NEW_( AcmBranch *, descriptor->numFields );
+		if ( requests == NULL || branches == NULL )
+		{
+			acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate field requests" );
+			ACM_DELETE( requests );
+			ACM_DELETE( branches );
+			return 0;
+		}
+	}
+
+	for ( unsigned int i = 0; i < descriptor->numFields; ++i )
+	{
+		const AcmFieldDescriptor *field = &descriptor->fields[ i ];
+
+		branches[ i ]       = NULL;
+		requests[ i ].name  = field->name;
+		requests[ i ].type  = get_request_type( field );
+		requests[ i ].found = NULL;
+		requests[ i ].dest  = &branches[ i ];
+
+		bool isScalar = field->deserialize == NULL && field->arrayCount == 0 &&
+		                field->type != ACM_PROPERTY_TYPE_OBJECT && field->type != ACM_PROPERTY_TYPE_ARRAY;
+		if ( isScalar )
+		{
+			// includes const char * strings, which point into the tree
+			requests[ i ].dest = ( uint8_t * ) dst + field->offset;
+		}
+		else if ( field->type == ACM_PROPERTY_TYPE_STRING && field->deserialize == NULL )
+		{
+			// fetch the branch, and copy into the buffer after
+			requests[ i ].type = ACM_PROPERTY_TYPE_INVALID;
+		}
+	}
+
+	unsigned int numFound = acm_get_many( root, requests, descriptor->numFields );
+
+	for ( unsigned int i = 0; i < descriptor->numFields; ++i )
+	{
+		const AcmFieldDescriptor *field  = &descriptor->fields[ i ];
+		AcmBranch                *branch = branches[ i ];
+		if ( branch == NULL )
+		{
+			continue;
+		}
+
+		uint8_t *p = ( uint8_t * ) dst + field->offset;
+		if ( field->deserialize != NULL )
+		{
+			field->deserialize( p, branch );
+		}
+		else if ( field->type == ACM_PROPERTY_TYPE_STRING )
+		{
+			if ( branch->data.buf != NULL )
+			{
+				snprintf( ( char * ) p, field->arrayCount, "%s", branch->data.buf );
+			}
+		}
+		else if ( field->type == ACM_PROPERTY_TYPE_OBJECT )
+		{
+			if ( field->arrayCount > 0 )
+			{
+				bind_read_object_array( branch, field, p );
+			}
+			else
+			{
+				acm_bind_read( branch, field->nested, p );
+			}
+		}
+		else
+		{
+			bind_read_array( branch, field, p );
+		}
+	}
+
+	if ( requests != localRequests )
+	{
+		ACM_DELETE( requests );
+		ACM_DELETE( branches );
+	}
+
+	return numFound;
+}
+
+static void bind_write_field( AcmBranch *object, const AcmFieldDescriptor *field, const uint8_t *src )
+{
+	if ( field->serialize != NULL )
+	{
+		field->serialize( ( void * ) src, object );
+		return;
+	}
+
+	switch ( field->type )
+	{
+		default:
+		{
+			if ( acm_get_type_size_( field->type ) == 0 )
+			{
+				Warning( "Unsupported type for field (%s)!\n", field->name );
+				break;
+			}
+
+			if ( field->arrayCount > 0 )
+			{
+				AcmBranch *array = acm_push_new_branch( object, field->name, ACM_PROPERTY_TYPE_ARRAY, field->type );
+				if ( array == NULL )
+				{
+					break;
+				}
+
+				if ( field->type == ACM_PROPERTY_TYPE_BOOL )
+				{
+					for ( unsigned int i = 0; i < field->arrayCount; ++i )
+					{
+						uint8_t v = ( ( const bool * ) src )[ i ];
+						acm_push_packed_values_( array, &v, 1 );
+					}
+					break;
+				}
+
+				acm_push_packed_values_( array, src, field->arrayCount );
+				break;
+			}
+
+			char str[ 64 ];
+			if ( field->type == ACM_PROPERTY_TYPE_BOOL )
+			{
+				uint8_t v = *( const bool * ) src;
+				acm_format_value_( field->type, &v, str, sizeof( str ) );
+			}
+			else
+			{
+				acm_format_value_( field->type, src, str, sizeof( str ) );
+			}
+			acm_push_variable_( object, field->name, str, field->type );
+			break;
+		}
+		case ACM_PROPERTY_TYPE_STRING:
+		{
+			const char *string = field->arrayCount > 0 ? ( const char * ) src : *( const char ** ) src;
+			if ( string != NULL )
+			{
+				acm_push_string( object, field->name, string, false );
+			}
+			break;
+		}
+		case ACM_PROPERTY_TYPE_OBJECT:
+		{
+			if ( field->arrayCount == 0 )
+			{
+				acm_bind_write( object, field->name, field->nested, src );
+				break;
+			}
+
+			AcmBranch *array = acm_push_array_object( object, field->name );
+			if ( array == NULL )
+			{
+				break;
+			}
+
+			for ( unsigned int i = 0; i < field->arrayCount; ++i )
+			{
+				acm_bind_write( array, NULL, field->nested, src + i * field->nested->size );
+			}
+			break;
+		}
+	}
+}
+
+AcmBranch *acm_bind_write( AcmBranch *parent, const char *name, const AcmStructDescriptor *descriptor, const void *src )
+{
+	AcmBranch *object = acm_push_object( parent, name );
+	if ( object == NULL )
+	{
+		return NULL;
+	}
+
+	for ( unsigned int i = 0; i < descriptor->numFields; ++i )
+	{
+		const AcmFieldDescriptor *field = &descriptor->fields[ i ];
+		bind_write_field( object, field, ( const uint8_t * ) src + field->offset );
+	}
+
+	return object;
+}
@@ -0,0 +1,237 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+typedef struct AcmColumnBuilder
+{
+	AcmColumnTable *table;
+	unsigned int    maxColumns;
+	unsigned int   *slots; /* column index + 1, hashed by name */
+	unsigned int    numSlots;
+} AcmColumnBuilder;
+
+static size_t get_column_element_size( AcmPropertyType type )
+{
+	if ( type == ACM_PROPERTY_TYPE_STRING )
+	{
+		return sizeof( const char * );
+	}
+
+	return acm_get_type_size_( type );
+}
+
+static AcmColumn *find_column( const AcmColumnBuilder *builder, const char *name, uint32_t hash )
+{
+	unsigned int i = hash & ( builder->numSlots - 1 );
+	while ( builder->slots[ i ] != 0 )
+	{
+		AcmColumn *column = &builder->table->columns[ builder->slots[ i ] - 1 ];
+		if ( strcmp( column->name, name ) == 0 )
+		{
+			return column;
+		}
+		i = ( i + 1 ) & ( builder->numSlots - 1 );
+	}
+
+	return NULL;
+}
+
+static bool hash_columns( AcmColumnBuilder *builder, unsigned int numSlots )
+{
+	unsigned int *slots = ACM_NEW_( unsigned int, numSlots );
+	if ( slots == NULL )
+	{
+		return false;
+	}
+
+	for ( unsigned int c = 0; c < builder->table->numColumns; ++c )
+	{
+		unsigned int i = acm_hash_string_( builder->table->columns[ c ].name ) & ( numSlots - 1 );
+		while ( slots[ i ] != 0 )
+		{
+			i = ( i + 1 ) & ( numSlots - 1 );
+		}
+		slots[ i ] = c + 1;
+	}
+
+	ACM_DELETE( builder->slots );
+	builder->slots    = slots;
+	builder->numSlots = numSlots;
+	return true;
+}
+
+static AcmColumn *add_column( AcmColumnBuilder *builder, const AcmBranch *field )
+{
+	AcmColumnTable *table = builder->table;
+	if ( table->numColumns == builder->maxColumns )
+	{
+		unsigned int maxColumns = builder->maxColumns > 0 ? builder->maxColumns * 2 : 8;
+		AcmColumn   *columns    = ACM_REALLOC( table->columns, AcmColumn, maxColumns );
+		if ( columns == NULL )
+		{
+			return NULL;
+		}
+
+		table->columns      = columns;
+		builder->maxColumns = maxColumns;
+	}
+
+	AcmColumn *column = &table->columns[ table->numColumns ];
+	memset( column, 0, sizeof( AcmColumn ) );
+	column->type = field->type;
+
+	size_t nameLength = strlen( field->name.buf ) + 1;
+	char  *name       = ACM_NEW_( char, nameLength );
+	column->data      = ACM_NEW_( uint8_t, table->numRows * get_column_element_size( field->type ) + 1 );
+	column->presence  = ACM_NEW_( uint8_t, ( table->numRows + 7 ) / 8 + 1 );
+	if ( name == NULL || column->data == NULL || column->presence == NULL )
+	{
+		ACM_DELETE( name );
+		ACM_DELETE( column->data );
+		ACM_DELETE( column->presence );
+		return NULL;
+	}
+	memcpy( name, field->name.buf, nameLength );
+	column->name = name;
+
+	table->numColumns++;
+	if ( table->numColumns * 2 > builder->numSlots && !hash_columns( builder, builder->numSlots * 2 ) )
+	{
+		return NULL;
+	}
+
+	unsigned int i = acm_hash_string_( name ) & ( builder->numSlots - 1 );
+	while ( builder->slots[ i ] != 0 )
+	{
+		i = ( i + 1 ) & ( builder->numSlots - 1 );
+	}
+	builder->slots[ i ] = table->numColumns;
+
+	return column;
+}
+
+static bool store_field( AcmColumn *column, const AcmBranch *field, unsigned int row )
+{
+	if ( field->data.buf == NULL )
+	{
+		return false;
+	}
+
+	if ( column->type == ACM_PROPERTY_TYPE_STRING )
+	{
+		( ( const char ** ) column->data )[ row ] = field->data.buf;
+	}
+	else if ( !acm_parse_value_( column->type, field->data.buf, ( uint8_t * ) column->data + row * acm_get_type_size_( column->type ) ) )
+	{
+		return false;
+	}
+
+	column->presence[ row / 8 ] |= ( uint8_t ) ( 1U << ( row % 8 ) );
+	return true;
+}
+
+AcmColumnTable *acm_array_export_columns( AcmBranch *array )
+{
+	if ( array->type != ACM_PROPERTY_TYPE_ARRAY || array->childType != ACM_PROPERTY_TYPE_OBJECT )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_TYPE, "attempted to export columns from an array that isn't of objects" );
+		return NULL;
+	}
+
+	AcmColumnBuilder builder;
+	memset( &builder, 0, sizeof( AcmColumnBuilder ) );
+
+	builder.table = ACM_NEW( AcmColumnTable );
+	if ( builder.table == NULL || !hash_columns( &builder, 16 ) )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate column table" );
+		ACM_DELETE( builder.table );
+		return NULL;
+	}
+	builder.table->numRows = array->numChildren;
+
+	unsigned int row = 0;
+	for ( const AcmBranch *element = array->children.start; element != NULL; element = element->next, ++row )
+	{
+		// rows typically share the same layout, so try the column following the last one first
+		unsigned int nextColumn = 0;
+		for ( const AcmBranch *field = element->children.start; field != NULL; field = field->next )
+		{
+			if ( field->name.buf == NULL || get_column_element_size( field->type ) == 0 )
+			{
+				continue;
+			}
+
+			AcmColumn *column = NULL;
+			if ( nextColumn < builder.table->numColumns && strcmp( builder.table->columns[ nextColumn ].name, field->name.buf ) == 0 )
+			{
+				column = &builder.table->columns[ nextColumn ];
+			}
+			else
+			{
+				column = find_column( &builder, field->name.buf, acm_hash_string_( field->name.buf ) );
+				if ( column == NULL )
+				{
+					column = add_column( &builder, field );
+					if ( column == NULL )
+					{
+						acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate column (%s)", field->name.buf );
+						ACM_DELETE( builder.slots );
+						acm_column_table_destroy( builder.table );
+						return NULL;
+					}
+				}
+			}
+
+			nextColumn = ( unsigned int ) ( column - builder.table->columns ) + 1;
+
+			// only the first occurrence of a field within a row counts
+			if ( column->presence[ row / 8 ] & ( 1U << ( row % 8 ) ) )
+			{
+				continue;
+			}
+
+			if ( !store_field( column, field, row ) )
+			{
+				Warning( "Failed to convert field (%s) in row %u to %s!\n", field->name.buf, row, column->type == ACM_PROPERTY_TYPE_STRING ? "string" : "column type" );
+			}
+		}
+	}
+
+	ACM_DELETE( builder.slots );
+
+	return builder.table;
+}
+
+const AcmColumn *acm_column_table_get( const AcmColumnTable *self, const char *name )
+{
+	for ( unsigned int i = 0; i < self->numColumns; ++i )
+	{
+		if ( strcmp( self->columns[ i ].name, name ) == 0 )
+		{
+			return &self->columns[ i ];
+		}
+	}
+
+	return NULL;
+}
+
+void acm_column_table_destroy( AcmColumnTable *self )
+{
+	if ( self == NULL )
+	{
+		return;
+	}
+
+	for ( unsigned int i = 0; i < self->numColumns; ++i )
+	{
+		ACM_DELETE( ( char * ) self->columns[ i ].name );
+		ACM_DELETE( self->columns[ i ].data );
+		ACM_DELETE( self->columns[ i ].presence );
+	}
+
+	ACM_DELETE( self->columns );
+	ACM_DELETE( self );
+}
@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+/* LZ77 block codec, laid out along the same lines as LZ4:
+ *  sequence
+ *      uint8_t token (literal length << 4 | (match length - 4))
+ *      if literal length == 15: uint8_t extra[] (255 until the last)
+ *      uint8_t literals[ literal length ]
+ *      uint16_t offset (back from the current position, not present for the last sequence)
+ *      if match length == 15: uint8_t extra[] (255 until the last)
+ *
+ * Blocks are independent of one another, so can be decoded in any order.
+ */
+
+#define HASH_BITS     12
+#define MIN_MATCH     4
+#define MAX_OFFSET    UINT16_MAX
+#define LAST_LITERALS 5  /* the end of a block is always literals */
+#define MATCH_LIMIT   12 /* no match may start this close to the end */
+
+static uint32_t read32( const uint8_t *p )
+{
+	uint32_t v;
+	memcpy( &v, p, sizeof( uint32_t ) );
+	return v;
+}
+
+static unsigned int hash_sequence( uint32_t sequence )
+{
+	return ( sequence * 2654435761U ) >> ( 32 - HASH_BITS );
+}
+
+static uint8_t *write_length( uint8_t *op, size_t length )
+{
+	for ( ; length >= 255; length -= 255 )
+	{
+		*op++ = 255;
+	}
+	*op++ = ( uint8_t ) length;
+	return op;
+}
+
+/* match length of 0 marks the final run of literals */
+static uint8_t *write_sequence( uint8_t *op, const uint8_t *opEnd, const uint8_t *literals, size_t numLiterals, size_t matchLength, size_t offset )
+{
+	size_t worstCase = 1 + ( numLiterals / 255 + 1 ) + numLiterals + sizeof( uint16_t ) + ( matchLength / 255 + 1 );
+	if ( worstCase > ( size_t ) ( opEnd - op ) )
+	{
+		return NULL;
+	}
+
+	uint8_t *token = op++;
+	*token         = ( uint8_t ) ( ( numLiterals < 15 ? numLiterals : 15 ) << 4 );
+	if ( numLiterals >= 15 )
+	{
+		op = write_length( op, numLiterals - 15 );
+	}
+
+	memcpy( op, literals, numLiterals );
+	op += numLiterals;
+
+	if ( matchLength == 0 )
+	{
+		return op;
+	}
+
+	*op++ = ( uint8_t ) ( offset & 0xFF );
+	*op++ = ( uint8_t ) ( offset >> 8 );
+
+	matchLength -= MIN_MATCH;
+	*token |= ( uint8_t ) ( matchLength < 15 ? matchLength : 15 );
+	if ( matchLength >= 15 )
+	{
+		op = write_length( op, matchLength - 15 );
+	}
+
+	return op;
+}
+
+size_t acm_compress_bound_( size_t srcSize )
+{
+	return srcSize + srcSize / 255 + 16;
+}
+
+size_t acm_compress_block_( const void *src, size_t srcSize, void *dst, size_t dstCapacity )
+{
+	const uint8_t *in     = src;
+	const uint8_t *inEnd  = in + srcSize;
+	const uint8_t *ip     = in;
+	const uint8_t *anchor = in;
+	uint8_t       *op     = dst;
+	uint8_t       *opEnd  = op + dstCapacity;
+
+	if ( srcSize > MATCH_LIMIT )
+	{
+		// positions of the last sequence seen for each hash; stale entries
+		// are caught by comparing the bytes
+		uint32_t table[ 1 << HASH_BITS ];
+		memset( table, 0, sizeof( table ) );
+
+		const uint8_t *matchEnd   = inEnd - LAST_LITERALS;
+		const uint8_t *matchStart = inEnd - MATCH_LIMIT;
+		unsigned int   misses     = 0;
+		while ( ip < matchStart )
+		{
+			uint32_t       sequence = read32( ip );
+			unsigned int   h        = hash_sequence( sequence );
+			const uint8_t *ref      = in + table[ h ];
+			table[ h ]              = ( uint32_t ) ( ip - in );
+
+			if ( ref >= ip || ip - ref > MAX_OFFSET || read32( ref ) != sequence )
+			{
+				// skip ahead faster through data that isn't compressing
+				ip += 1 + ( misses++ >> 6 );
+				continue;
+			}
+
+			const uint8_t *mp = ip + MIN_MATCH;
+			const uint8_t *rp = ref + MIN_MATCH;
+			while ( mp < matchEnd && *mp == *rp )
+			{
+				mp++;
+				rp++;
+			}
+
+			op = write_sequence( op, opEnd, anchor, ( size_t ) ( ip - anchor ), ( size_t ) ( mp - ip ), ( size_t ) ( ip - ref ) );
+			if ( op == NULL )
+			{
+				return 0;
+			}
+
+			ip     = mp;
+			anchor = ip;
+			misses = 0;
+		}
+	}
+
+	op = write_sequence( op, opEnd, anchor, ( size_t ) ( inEnd - anchor ), 0, 0 );
+	if ( op == NULL )
+	{
+		return 0;
+	}
+
+	return ( size_t ) ( op - ( uint8_t * ) dst );
+}
+
+static bool read_length( const uint8_t **ip, const uint8_t *ipEnd, size_t *length )
+{
+	uint8_t byte;
+	do
+	{
+		if ( *ip >= ipEnd )
+		{
+			return false;
+		}
+
+		byte = *( *ip )++;
+		*length += byte;
+	} while ( byte == 255 );
+
+	return true;
+}
+
+bool acm_decompress_block_( const void *src, size_t srcSize, void *dst, size_t dstSize )
+{
+	const uint8_t *ip    = src;
+	const uint8_t *ipEnd = ip + srcSize;
+	uint8_t       *op    = dst;
+	uint8_t       *opEnd = op + dstSize;
+
+	while ( ip < ipEnd )
+	{
+		uint8_t token = *ip++;
+
+		size_t numLiterals = token >> 4;
+		if ( numLiterals == 15 && !read_length( &ip, ipEnd, &numLiterals ) )
+		{
+			break;
+		}
+
+		if ( numLiterals > ( size_t ) ( ipEnd - ip ) || numLiterals > ( size_t ) ( opEnd - op ) )
+		{
+			break;
+		}
+
+		memcpy( op, ip, numLiterals );
+		ip += numLiterals;
+		op += numLiterals;
+
+		// last sequence has no match
+		if ( ip == ipEnd )
+		{
+			return op == opEnd;
+		}
+
+		if ( ipEnd - ip < 2 )
+		{
+			break;
+		}
+
+		size_t offset = ip[ 0 ] | ( ( size_t ) ip[ 1 ] << 8 );
+		ip += 2;
+		if ( offset == 0 || offset > ( size_t ) ( op - ( uint8_t * ) dst ) )
+		{
+			break;
+		}
+
+		size_t matchLength = token & 15;
+		if ( matchLength == 15 && !read_length( &ip, ipEnd, &matchLength ) )
+		{
+			break;
+		}
+
+		matchLength += MIN_MATCH;
+		if ( matchLength > ( size_t ) ( opEnd - op ) )
+		{
+			break;
+		}
+
+		const uint8_t *ref = op - offset;
+		if ( offset >= matchLength )
+		{
+			memcpy( op, ref, matchLength );
+			op += matchLength;
+		}
+		else
+		{
+			// overlapping, so repeats what's just been written
+			for ( size_t i = 0; i < matchLength; ++i )
+			{
+				*op++ = *ref++;
+			}
+		}
+	}
+
+	acm_set_error_message_( ND_ERROR_IO_READ, "invalid compressed block data" );
+	return false;
+}
@@ -0,0 +1,620 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+#include <inttypes.h>
+
+/* Diffs between two documents. Each branch's hash covers everything
+ * further down, and is kept on the branch until something under it changes,
+ * so matching subtrees are skipped with a single comparison and diffing a
+ * document again after a few changes only visits what's changed.
+ *
+ *  char[10] header (DIFF_HEADER)
+ *  uint32_t version
+ *  uint64_t fromHash (of the document it applies to)
+ *  uint64_t toHash (of the document once applied)
+ *  uint32_t numOps
+ *  for each op
+ *      uint8_t op (DIFF_OP_*)
+ *      uint32_t depth
+ *      uint32_t path[depth] (index of the child at each level down from the root)
+ *      if inserting/replacing
+ *          uint32_t size
+ *          binary document, for the branch
+ *
+ * Ops are applied in order, so each path is into the document as it is by
+ * then. Inserts go before whatever's at the index, or on the end if it's one
+ * past the last child.
+ */
+
+#define DIFF_HEADER       "node.binp\n"
+#define DIFF_VERSION      1
+#define DIFF_HEADER_SIZE  34
+#define DIFF_RECORD_FLAGS ACM_WRITE_FLAG_COMPACT
+
+typedef enum AcmDiffOp
+{
+	DIFF_OP_REMOVE,
+	DIFF_OP_INSERT,
+	DIFF_OP_REPLACE,
+} AcmDiffOp;
+
+/******************************************/
+/** Hashing **/
+
+static uint64_t hash_string( uint64_t hash, const AcmString *string )
+{
+	// the terminator too, so a name running into the value hashes differently
+	return string->buf != NULL ? acm_hash_bytes_( hash, string->buf, strlen( string->buf ) + 1 ) : acm_hash_bytes_( hash, "", 1 );
+}
+
+static uint64_t get_branch_hash( AcmBranch *self )
+{
+	if ( self->hasHash )
+	{
+		return self->hash;
+	}
+
+	int32_t  types[ 2 ] = { self->type, self->childType };
+	uint64_t hash       = acm_hash_bytes_( ACM_HASH_BASIS, types, sizeof( types ) );
+	hash                = hash_string( hash, &self->name );
+	if ( acm_is_packed_array_( self ) )
+	{
+		hash = acm_hash_bytes_( hash, &self->packed.numElements, sizeof( unsigned int ) );
+		hash = acm_hash_bytes_( hash, self->packed.buf, self->packed.numElements * acm_get_type_size_( self->childType ) );
+	}
+	else if ( self->type == ACM_PROPERTY_TYPE_OBJECT || self->type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		hash = acm_hash_bytes_( hash, &self->numChildren, sizeof( unsigned int ) );
+		for ( AcmBranch *child = self->children.start; child != NULL; child = child->next )
+		{
+			uint64_t childHash = get_branch_hash( child );
+			hash               = acm_hash_bytes_( hash, &childHash, sizeof( uint64_t ) );
+		}
+	}
+	else
+	{
+		// by value rather than text, so "1.5" and "1.500000" are the same
+		uint64_t value    = 0;
+		size_t   typeSize = acm_get_type_size_( self->type );
+		if ( typeSize > 0 && self->data.buf != NULL && acm_parse_value_( self->type, self->data.buf, &value ) )
+		{
+			hash = acm_hash_bytes_( hash, &value, typeSize );
+		}
+		else
+		{
+			hash = hash_string( hash, &self->data );
+		}
+	}
+
+	self->hash    = hash;
+	self->hasHash = true;
+	return hash;
+}
+
+/* counts of each hash, to tell whether a child turns up again further along */
+typedef struct AcmHashCount
+{
+	uint64_t     hash;
+	unsigned int count;
+} AcmHashCount;
+
+typedef struct AcmHashCounts
+{
+	AcmHashCount *slots;
+	size_t        mask;
+} AcmHashCounts;
+
+static bool init_hash_counts( AcmHashCounts *self, AcmBranch **branches, unsigned int numBranches )
+{
+	size_t numSlots = 16;
+	while ( numSlots < ( size_t ) numBranches * 2 )
+	{
+		numSlots *= 2;
+	}
+
+	self->mask  = numSlots - 1;
+	self->slots = ACM_NEW_( AcmHashCount, numSlots );
+	if ( self->slots == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate hash table (%zu slots)", numSlots );
+		return false;
+	}
+
+	for ( unsigned int i = 0; i < numBranches; ++i )
+	{
+		uint64_t hash = get_branch_hash( branches[ i ] );
+		size_t   slot = hash & self->mask;
+		while ( self->slots[ slot ].count > 0 && self->slots[ slot ].hash != hash )
+		{
+			slot = ( slot + 1 ) & self->mask;
+		}
+
+		self->slots[ slot ].hash = hash;
+		self->slots[ slot ].count++;
+	}
+
+	return true;
+}
+
+/* returns the count for the given hash, after taking off the given amount */
+static unsigned int take_hash_count( AcmHashCounts *self, uint64_t hash, unsigned int amount )
+{
+	for ( size_t slot = hash & self->mask; self->slots[ slot ].count > 0 || self->slots[ slot ].hash != 0; slot = ( slot + 1 ) & self->mask )
+	{
+		if ( self->slots[ slot ].hash == hash )
+		{
+			self->slots[ slot ].count -= amount;
+			return self->slots[ slot ].count;
+		}
+	}
+
+	return 0;
+}
+
+/******************************************/
+/** Diff **/
+
+typedef struct AcmDiff
+{
+	AcmOutput    output;
+	uint32_t     path[ ACM_BINARY_MAX_DEPTH ];
+	unsigned int numOps;
+} AcmDiff;
+
+static bool write_op( AcmDiff *self, AcmDiffOp op, uint32_t depth, AcmBranch *branch )
+{
+	uint8_t opByte = ( uint8_t ) op;
+	acm_output_write_( &self->output, &opByte, sizeof( uint8_t ) );
+	acm_output_write_( &self->output, &depth, sizeof( uint32_t ) );
+	acm_output_write_( &self->output, self->path, depth * sizeof( uint32_t ) );
+	self->numOps++;
+
+	if ( branch == NULL )
+	{
+		return true;
+	}
+
+	uint64_t sizeOffset = self->output.total;
+	uint32_t size       = 0;
+	acm_output_write_( &self->output, &size, sizeof( uint32_t ) );
+	if ( !acm_serialize_binary_( &self->output, branch, DIFF_RECORD_FLAGS ) )
+	{
+		return false;
+	}
+
+	uint64_t branchSize = self->output.total - sizeOffset - sizeof( uint32_t );
+	if ( branchSize > UINT32_MAX )
+	{
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "diff op is too large (%" PRIu64 " bytes)", branchSize );
+		return false;
+	}
+
+	size = ( uint32_t ) branchSize;
+	return acm_output_patch_( &self->output, sizeOffset, &size, sizeof( uint32_t ) );
+}
+
+static bool is_same_kind( const AcmBranch *a, const AcmBranch *b )
+{
+	if ( a->type != b->type || a->childType != b->childType )
+	{
+		return false;
+	}
+	else if ( a->name.buf == NULL || b->name.buf == NULL )
+	{
+		return a->name.buf == b->name.buf;
+	}
+
+	return strcmp( a->name.buf, b->name.buf ) == 0;
+}
+
+static bool diff_branch( AcmDiff *self, AcmBranch *from, AcmBranch *to, uint32_t depth );
+
+/**
+ * Lines up the children that differ, once anything the same at either end
+ * has been skipped. A child that turns up later on the other side is kept
+ * for then, otherwise it's been removed, added, or changed if neither side's
+ * does.
+ */
+static bool diff_children( AcmDiff *self, AcmBranch **from, unsigned int numFrom, AcmBranch **to, unsigned int numTo, uint32_t index, uint32_t depth )
+{
+	AcmHashCounts fromCounts, toCounts;
+	if ( !init_hash_counts( &fromCounts, from, numFrom ) )
+	{
+		return false;
+	}
+	else if ( !init_hash_counts( &toCounts, to, numTo ) )
+	{
+		ACM_DELETE( fromCounts.slots );
+		return false;
+	}
+
+	bool         status = true;
+	unsigned int i = 0, j = 0;
+	while ( status && ( i < numFrom || j < numTo ) )
+	{
+		uint64_t fromHash = i < numFrom ? get_branch_hash( from[ i ] ) : 0;
+		uint64_t toHash   = j < numTo ? get_branch_hash( to[ j ] ) : 0;
+		if ( i < numFrom && j < numTo && fromHash == toHash )
+		{
+			take_hash_count( &fromCounts, fromHash, 1 );
+			take_hash_count( &toCounts, toHash, 1 );
+			i++, j++, index++;
+			continue;
+		}
+
+		bool isFromLater = i < numFrom && take_hash_count( &toCounts, fromHash, 0 ) > 0;
+		bool isToLater   = j < numTo && take_hash_count( &fromCounts, toHash, 0 ) > 0;
+
+		self->path[ depth ] = index;
+		if ( i < numFrom && j < numTo && !isFromLater && !isToLater )
+		{
+			status = diff_branch( self, from[ i ], to[ j ], depth + 1 );
+			take_hash_count( &fromCounts, fromHash, 1 );
+			take_hash_count( &toCounts, toHash, 1 );
+			i++, j++, index++;
+		}
+		else if ( i < numFrom && !isFromLater )
+		{
+			status = write_op( self, DIFF_OP_REMOVE, depth + 1, NULL );
+			take_hash_count( &fromCounts, fromHash, 1 );
+			i++;
+		}
+		else
+		{
+			// either it's new, or what's here turns up later on
+			status = write_op( self, DIFF_OP_INSERT, depth + 1, to[ j ] );
+			take_hash_count( &toCounts, toHash, 1 );
+			j++, index++;
+		}
+	}
+
+	ACM_DELETE( fromCounts.slots );
+	ACM_DELETE( toCounts.slots );
+
+	return status;
+}
+
+static AcmBranch **list_children( AcmBranch *start, unsigned int numChildren )
+{
+	AcmBranch **children = ACM_NEW_( AcmBranch *, numChildren + 1 );
+	if ( children == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate child list (%u)", numChildren );
+		return NULL;
+	}
+
+	for ( unsigned int i = 0; i < numChildren; ++i, start = start->next )
+	{
+		children[ i ] = start;
+	}
+
+	return children;
+}
+
+static bool diff_branch( AcmDiff *self, AcmBranch *from, AcmBranch *to, uint32_t depth )
+{
+	if ( get_branch_hash( from ) == get_branch_hash( to ) )
+	{
+		return true;
+	}
+
+	// anything but an object/array that's otherwise the same is just replaced
+	bool isContainer = from->type == ACM_PROPERTY_TYPE_OBJECT || from->type == ACM_PROPERTY_TYPE_ARRAY;
+	if ( !isContainer || !is_same_kind( from, to ) || acm_is_packed_array_( from ) )
+	{
+		return write_op( self, DIFF_OP_REPLACE, depth, to );
+	}
+	else if ( depth == ACM_BINARY_MAX_DEPTH )
+	{
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "nested too deeply to diff" );
+		return false;
+	}
+
+	// skip over anything that's the same at the start and end
+	AcmBranch   *fromStart = from->children.start, *toStart = to->children.start;
+	unsigned int numFrom = from->numChildren, numTo = to->numChildren, index = 0;
+	while ( numFrom > 0 && numTo > 0 && get_branch_hash( fromStart ) == get_branch_hash( toStart ) )
+	{
+		fromStart = fromStart->next;
+		toStart   = toStart->next;
+		numFrom--, numTo--, index++;
+	}
+
+	for ( AcmBranch *fromEnd = from->children.end, *toEnd = to->children.end;
+	      numFrom > 0 && numTo > 0 && get_branch_hash( fromEnd ) == get_branch_hash( toEnd );
+	      fromEnd = fromEnd->prev, toEnd = toEnd->prev )
+	{
+		numFrom--, numTo--;
+	}
+
+	AcmBranch **fromChildren = list_children( fromStart, numFrom );
+	AcmBranch **toChildren   = fromChildren != NULL ? list_children( toStart, numTo ) : NULL;
+	bool        status       = toChildren != NULL && diff_children( self, fromChildren, numFrom, toChildren, numTo, index, depth );
+
+	ACM_DELETE( fromChildren );
+	ACM_DELETE( toChildren );
+
+	return status;
+}
+
+void *acm_diff( AcmBranch *from, AcmBranch *to, size_t *size )
+{
+	AcmDiff *self = ACM_NEW( AcmDiff );
+	if ( self == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate diff" );
+		return NULL;
+	}
+	else if ( !acm_output_open_( &self->output, NULL, NULL ) )
+	{
+		ACM_DELETE( self );
+		return NULL;
+	}
+
+	uint8_t  header[ DIFF_HEADER_SIZE ];
+	uint32_t version  = DIFF_VERSION;
+	uint64_t fromHash = get_branch_hash( from );
+	uint64_t toHash   = get_branch_hash( to );
+	memcpy( header, DIFF_HEADER, 10 );
+	memcpy( header + 10, &version, sizeof( uint32_t ) );
+	memcpy( header + 14, &fromHash, sizeof( uint64_t ) );
+	memcpy( header + 22, &toHash, sizeof( uint64_t ) );
+	memset( header + 30, 0, sizeof( uint32_t ) );
+	acm_output_write_( &self->output, header, sizeof( header ) );
+
+	// the root can't be removed or have anything inserted beside it, so it's diffed or replaced
+	void *buf = NULL;
+	if ( diff_branch( self, from, to, 0 ) )
+	{
+		uint32_t numOps = self->numOps;
+		acm_output_patch_( &self->output, 30, &numOps, sizeof( uint32_t ) );
+		buf = acm_output_release_( &self->output, size );
+	}
+	acm_output_close_( &self->output );
+
+	ACM_DELETE( self );
+
+	return buf;
+}
+
+/******************************************/
+/** Apply **/
+
+static bool read_bytes( const uint8_t **p, const uint8_t *end, void *dst, size_t size )
+{
+	if ( ( size_t ) ( end - *p ) < size )
+	{
+		return false;
+	}
+
+	memcpy( dst, *p, size );
+	*p += size;
+	return true;
+}
+
+/**
+ * An op once it's been read in, with any branch it brings along loaded.
+ * Once applied, it keeps a copy of whatever it removed or replaced, so
+ * that it can be undone.
+ */
+typedef struct AcmDiffStep
+{
+	uint8_t        op;
+	uint32_t       depth;
+	const uint8_t *path;
+	AcmBranch     *branch;
+	AcmBranch     *original;
+} AcmDiffStep;
+
+static bool read_step( AcmDiffStep *step, const uint8_t **p, const uint8_t *end )
+{
+	if ( !read_bytes( p, end, &step->op, sizeof( uint8_t ) ) || step->op > DIFF_OP_REPLACE ||
+	     !read_bytes( p, end, &step->depth, sizeof( uint32_t ) ) || step->depth > ACM_BINARY_MAX_DEPTH ||
+	     ( step->depth == 0 && step->op != DIFF_OP_REPLACE ) ||
+	     ( size_t ) ( end - *p ) / sizeof( uint32_t ) < step->depth )
+	{
+		return false;
+	}
+
+	step->path = *p;
+	*p += step->depth * sizeof( uint32_t );
+	if ( step->op == DIFF_OP_REMOVE )
+	{
+		return true;
+	}
+
+	uint32_t size;
+	if ( !read_bytes( p, end, &size, sizeof( uint32_t ) ) || ( size_t ) ( end - *p ) < size )
+	{
+		return false;
+	}
+
+	step->branch = acm_load_from_memory( *p, size, NULL, NULL );
+	*p += size;
+	return step->branch != NULL;
+}
+
+/**
+ * Follows the path of the op down from the root, to the parent and where
+ * in it the op goes. Returns false if there's nothing there, unless it's
+ * one past the end and that's allowed.
+ */
+static bool find_step_target( AcmBranch *root, const AcmDiffStep *step, bool canAppend, AcmBranch **parent, uint32_t *index, AcmBranch **node )
+{
+	*parent = NULL;
+	*index  = 0;
+	*node   = root;
+	for ( uint32_t i = 0; i < step->depth; ++i )
+	{
+		if ( *node == NULL )
+		{
+			return false;
+		}
+
+		memcpy( index, step->path + i * sizeof( uint32_t ), sizeof( uint32_t ) );
+		*parent = *node;
+		*node   = acm_get_child_at_( *parent, *index );
+	}
+
+	return *node != NULL || ( canAppend && *index == ( *parent )->numChildren );
+}
+
+static bool apply_step( AcmBranch *root, AcmDiffStep *step )
+{
+	AcmBranch *parent, *node;
+	uint32_t   index;
+	if ( !find_step_target( root, step, step->op == DIFF_OP_INSERT, &parent, &index, &node ) )
+	{
+		return false;
+	}
+	else if ( step->op == DIFF_OP_INSERT )
+	{
+		if ( !acm_insert_branch_( parent, node, step->branch ) )
+		{
+			return false;
+		}
+
+		step->branch = NULL;
+		return true;
+	}
+	else if ( ( step->original = acm_copy_branch( node ) ) == NULL )
+	{
+		return false;
+	}
+
+	if ( step->op == DIFF_OP_REMOVE )
+	{
+		acm_branch_destroy( node );
+		return true;
+	}
+
+	acm_replace_branch_( node, step->branch );
+	step->branch = NULL;
+	return true;
+}
+
+/**
+ * Undoing goes newest first, so the tree is back as it was when the op was
+ * applied, and its path leads to the same place. Branches themselves may
+ * have been swapped for copies by undoing later ops, so they aren't kept.
+ */
+static void undo_step( AcmBranch *root, AcmDiffStep *step )
+{
+	AcmBranch *parent, *node;
+	uint32_t   index;
+	if ( !find_step_target( root, step, step->op == DIFF_OP_REMOVE, &parent, &index, &node ) )
+	{
+		return;
+	}
+	else if ( step->op == DIFF_OP_REMOVE )
+	{
+		if ( acm_insert_branch_( parent, node, step->original ) )
+		{
+			step->original = NULL;
+		}
+	}
+	else if ( step->op == DIFF_OP_INSERT )
+	{
+		acm_branch_destroy( node );
+	}
+	else
+	{
+		acm_replace_branch_( node, step->original );
+		step->original = NULL;
+	}
+}
+
+bool acm_diff_apply( AcmBranch *root, const void *diff, size_t size )
+{
+	const uint8_t *p   = diff;
+	const uint8_t *end = p + size;
+
+	uint32_t version, numOps;
+	uint64_t fromHash, toHash;
+	if ( size < DIFF_HEADER_SIZE || memcmp( p, DIFF_HEADER, 10 ) != 0 )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "invalid diff header" );
+		return false;
+	}
+
+	p += 10;
+	if ( !read_bytes( &p, end, &version, sizeof( uint32_t ) ) ||
+	     !read_bytes( &p, end, &fromHash, sizeof( uint64_t ) ) ||
+	     !read_bytes( &p, end, &toHash, sizeof( uint64_t ) ) ||
+	     !read_bytes( &p, end, &numOps, sizeof( uint32_t ) ) )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "truncated diff header" );
+		return false;
+	}
+	else if ( version != DIFF_VERSION )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "unsupported diff version (%u)", version );
+		return false;
+	}
+	else if ( get_branch_hash( root ) != fromHash )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "diff doesn't apply to this document" );
+		return false;
+	}
+
+	// every op is at least its type and depth, which bounds how many there can be
+	if ( numOps > ( size_t ) ( end - p ) / ( sizeof( uint8_t ) + sizeof( uint32_t ) ) )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "invalid diff op count (%u)", numOps );
+		return false;
+	}
+
+	AcmDiffStep *steps = ACM_NEW_( AcmDiffStep, numOps + 1 );
+	if ( steps == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate diff ops (%u)", numOps );
+		return false;
+	}
+
+	// everything's read in before the tree is touched, so most bad diffs never get that far
+	bool status = true;
+	for ( uint32_t i = 0; i < numOps && status; ++i )
+	{
+		if ( !( status = read_step( &steps[ i ], &p, end ) ) )
+		{
+			acm_set_error_message_( ND_ERROR_INVALID_DATA, "invalid diff op (%u of %u)", i + 1, numOps );
+		}
+	}
+
+	uint32_t numApplied = 0;
+	for ( ; numApplied < numOps && status; ++numApplied )
+	{
+		if ( !( status = apply_step( root, &steps[ numApplied ] ) ) )
+		{
+			acm_set_error_message_( ND_ERROR_INVALID_DATA, "diff op doesn't fit the document (%u of %u)", numApplied + 1, numOps );
+			break;
+		}
+	}
+
+	if ( status && get_branch_hash( root ) != toHash )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "document doesn't match once the diff is applied" );
+		status = false;
+	}
+
+	// anything that went wrong part way through is undone, newest first
+	if ( !status )
+	{
+		for ( uint32_t i = numApplied; i-- > 0; )
+		{
+			undo_step( root, &steps[ i ] );
+		}
+	}
+
+	for ( uint32_t i = 0; i < numOps; ++i )
+	{
+		acm_branch_destroy( steps[ i ].branch );
+		acm_branch_destroy( steps[ i ].original );
+	}
+	ACM_DELETE( steps );
+
+	return status;
+}
@@ -0,0 +1,383 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+/* each slot points at the field branch, with the element being its parent */
+typedef struct AcmArrayIndexSlot
+{
+	uint32_t   hash;
+	uint32_t   sequence; /* order it was indexed in, so the earliest of any duplicates wins */
+	AcmBranch *field;
+} AcmArrayIndexSlot;
+
+typedef struct AcmArrayIndex
+{
+	AcmBranch         *array;
+	char              *fieldName;
+	AcmArrayIndexSlot *slots;
+	unsigned int       numSlots;
+	unsigned int       numEntries;
+	uint32_t           nextSequence;
+
+	struct AcmArrayIndex *next;
+} AcmArrayIndex;
+
+static AcmBranch *get_element_field( AcmBranch *element, const char *fieldName )
+{
+	for ( AcmBranch *child = element->children.start; child != NULL; child = child->next )
+	{
+		if ( child->name.buf != NULL && strcmp( child->name.buf, fieldName ) == 0 )
+		{
+			return child;
+		}
+	}
+
+	return NULL;
+}
+
+static bool resize_index( AcmArrayIndex *self, unsigned int numSlots )
+{
+	AcmArrayIndexSlot *slots = ACM_NEW_( AcmArrayIndexSlot, numSlots );
+	if ( slots == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate array index (%u slots)", numSlots );
+		return false;
+	}
+
+	// duplicates are told apart by their sequence, so the order they go back in doesn't matter
+	for ( unsigned int i = 0; i < self->numSlots; ++i )
+	{
+		if ( self->slots[ i ].field == NULL )
+		{
+			continue;
+		}
+
+		unsigned int j = self->slots[ i ].hash & ( numSlots - 1 );
+		while ( slots[ j ].field != NULL )
+		{
+			j = ( j + 1 ) & ( numSlots - 1 );
+		}
+		slots[ j ] = self->slots[ i ];
+	}
+
+	ACM_DELETE( self->slots );
+	self->slots    = slots;
+	self->numSlots = numSlots;
+	return true;
+}
+
+static bool insert_field( AcmArrayIndex *self, AcmBranch *field )
+{
+	if ( field->data.buf == NULL )
+	{
+		return true;
+	}
+
+	if ( ( self->numEntries + 1 ) * 4 > self->numSlots * 3 && !resize_index( self, self->numSlots * 2 ) )
+	{
+		return false;
+	}
+
+	uint32_t     hash = acm_hash_string_( field->data.buf );
+	unsigned int i    = hash & ( self->numSlots - 1 );
+	while ( self->slots[ i ].field != NULL )
+	{
+		if ( self->slots[ i ].field == field )
+		{
+			return true;
+		}
+		i = ( i + 1 ) & ( self->numSlots - 1 );
+	}
+
+	self->slots[ i ].hash     = hash;
+	self->slots[ i ].sequence = self->nextSequence++;
+	self->slots[ i ].field    = field;
+	self->numEntries++;
+	return true;
+}
+
+/**
+ * An index that couldn't take a new entry would give the wrong answers
+ * from then on, so it's detached from the array, same as if the array
+ * had been destroyed.
+ */
+static void drop_index( AcmArrayIndex *self )
+{
+	AcmArrayIndex **link = &self->array->indexes;
+	while ( *link != self )
+	{
+		link = &( *link )->next;
+	}
+	*link = self->next;
+
+	self->array      = NULL;
+	self->next       = NULL;
+	self->numEntries = 0;
+	memset( self->slots, 0, sizeof( AcmArrayIndexSlot ) * self->numSlots );
+}
+
+static void insert_field_or_drop( AcmArrayIndex *self, AcmBranch *field )
+{
+	if ( !insert_field( self, field ) )
+	{
+		drop_index( self );
+	}
+}
+
+static void remove_field( AcmArrayIndex *self, const AcmBranch *field )
+{
+	if ( field->data.buf == NULL )
+	{
+		return;
+	}
+
+	unsigned int i = acm_hash_string_( field->data.buf ) & ( self->numSlots - 1 );
+	while ( self->slots[ i ].field != field )
+	{
+		if ( self->slots[ i ].field == NULL )
+		{
+			return;
+		}
+		i = ( i + 1 ) & ( self->numSlots - 1 );
+	}
+
+	// shift back anything that was displaced past this slot
+	unsigned int j = i;
+	while ( true )
+	{
+		self->slots[ i ].field = NULL;
+
+		unsigned int home;
+		do
+		{
+			j = ( j + 1 ) & ( self->numSlots - 1 );
+			if ( self->slots[ j ].field == NULL )
+			{
+				self->numEntries--;
+				return;
+			}
+			home = self->slots[ j ].hash & ( self->numSlots - 1 );
+		} while ( i <= j ? ( i < home && home <= j ) : ( i < home || home <= j ) );
+
+		self->slots[ i ] = self->slots[ j ];
+		i                = j;
+	}
+}
+
+AcmArrayIndex *acm_array_index_build( AcmBranch *array, const char *fieldName )
+{
+	if ( array->type != ACM_PROPERTY_TYPE_ARRAY || array->childType != ACM_PROPERTY_TYPE_OBJECT )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_TYPE, "attempted to index an array that isn't of objects" );
+		return NULL;
+	}
+
+	AcmArrayIndex *self = ACM_NEW( AcmArrayIndex );
+	if ( self == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate array index" );
+		return NULL;
+	}
+
+	self->fieldName = ACM_NEW_( char, strlen( fieldName ) + 1 );
+	if ( self->fieldName == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate array index" );
+		ACM_DELETE( self );
+		return NULL;
+	}
+	strcpy( self->fieldName, fieldName );
+
+	unsigned int numSlots = 16;
+	while ( numSlots * 3 < array->numChildren * 4 )
+	{
+		numSlots *= 2;
+	}
+
+	if ( !resize_index( self, numSlots ) )
+	{
+		ACM_DELETE( self->fieldName );
+		ACM_DELETE( self );
+		return NULL;
+	}
+
+	for ( AcmBranch *element = array->children.start; element != NULL; element = element->next )
+	{
+		AcmBranch *field = get_element_field( element, fieldName );
+		if ( field != NULL && !insert_field( self, field ) )
+		{
+			ACM_DELETE( self->slots );
+			ACM_DELETE( self->fieldName );
+			ACM_DELETE( self );
+			return NULL;
+		}
+	}
+
+	self->array    = array;
+	self->next     = array->indexes;
+	array->indexes = self;
+
+	return self;
+}
+
+AcmBranch *acm_array_index_find( const AcmArrayIndex *self, const char *value )
+{
+	if ( self->array == NULL )
+	{
+		return NULL;
+	}
+
+	// duplicates aren't necessarily in order along the probe, so it's followed to the end
+	const AcmArrayIndexSlot *match = NULL;
+	uint32_t                 hash  = acm_hash_string_( value );
+	unsigned int             i     = hash & ( self->numSlots - 1 );
+	while ( self->slots[ i ].field != NULL )
+	{
+		if ( self->slots[ i ].hash == hash && ( match == NULL || self->slots[ i ].sequence < match->sequence ) &&
+		     strcmp( self->slots[ i ].field->data.buf, value ) == 0 )
+		{
+			match = &self->slots[ i ];
+		}
+		i = ( i + 1 ) & ( self->numSlots - 1 );
+	}
+
+	return match != NULL ? match->field->parent : NULL;
+}
+
+unsigned int acm_array_index_get_num_entries( const AcmArrayIndex *self )
+{
+	return self->numEntries;
+}
+
+void acm_array_index_destroy( AcmArrayIndex *self )
+{
+	if ( self == NULL )
+	{
+		return;
+	}
+
+	if ( self->array != NULL )
+	{
+		AcmArrayIndex **link = &self->array->indexes;
+		while ( *link != self )
+		{
+			link = &( *link )->next;
+		}
+		*link = self->next;
+	}
+
+	ACM_DELETE( self->slots );
+	ACM_DELETE( self->fieldName );
+	ACM_DELETE( self );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Tree hooks, so indexes follow along with any changes
+
+void acm_index_detach_( AcmBranch *array )
+{
+	for ( AcmArrayIndex *index = array->indexes; index != NULL; index = index->next )
+	{
+		index->array      = NULL;
+		index->numEntries = 0;
+		memset( index->slots, 0, sizeof( AcmArrayIndexSlot ) * index->numSlots );
+	}
+
+	array->indexes = NULL;
+}
+
+void acm_index_branch_added_( AcmBranch *self )
+{
+	AcmBranch *parent = self->parent;
+	if ( parent == NULL )
+	{
+		return;
+	}
+
+	// new element for the array
+	for ( AcmArrayIndex *index = parent->indexes, *next; index != NULL; index = next )
+	{
+		next             = index->next;
+		AcmBranch *field = get_element_field( self, index->fieldName );
+		if ( field != NULL )
+		{
+			insert_field_or_drop( index, field );
+		}
+	}
+
+	// new field on an existing element
+	if ( parent->parent == NULL || self->name.buf == NULL )
+	{
+		return;
+	}
+
+	for ( AcmArrayIndex *index = parent->parent->indexes, *next; index != NULL; index = next )
+	{
+		next = index->next;
+		if ( strcmp( self->name.buf, index->fieldName ) == 0 && get_element_field( parent, index->fieldName ) == self )
+		{
+			insert_field_or_drop( index, self );
+		}
+	}
+}
+
+static void remove_element_field( AcmBranch *self, bool fallback )
+{
+	AcmBranch *parent = self->parent;
+	if ( parent == NULL || parent->parent == NULL || self->name.buf == NULL )
+	{
+		return;
+	}
+
+	for ( AcmArrayIndex *index = parent->parent->indexes, *next; index != NULL; index = next )
+	{
+		next = index->next;
+		if ( strcmp( self->name.buf, index->fieldName ) != 0 || get_element_field( parent, index->fieldName ) != self )
+		{
+			continue;
+		}
+
+		remove_field( index, self );
+		if ( !fallback )
+		{
+			continue;
+		}
+
+		// fall back to the next field of the same name, if there is one
+		for ( AcmBranch *sibling = self->next; sibling != NULL; sibling = sibling->next )
+		{
+			if ( sibling->name.buf != NULL && strcmp( sibling->name.buf, index->fieldName ) == 0 )
+			{
+				insert_field_or_drop( index, sibling );
+				break;
+			}
+		}
+	}
+}
+
+void acm_index_value_changing_( AcmBranch *self )
+{
+	remove_element_field( self, false );
+}
+
+void acm_index_branch_removed_( AcmBranch *self )
+{
+	AcmBranch *parent = self->parent;
+	if ( parent == NULL )
+	{
+		return;
+	}
+
+	for ( AcmArrayIndex *index = parent->indexes; index != NULL; index = index->next )
+	{
+		AcmBranch *field = get_element_field( self, index->fieldName );
+		if ( field != NULL )
+		{
+			remove_field( index, field );
+		}
+	}
+
+	remove_element_field( self, true );
+}
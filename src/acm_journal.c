@@ -0,0 +1,840 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+#include <inttypes.h>
+
+#if defined( _WIN32 )
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#endif
+
+/* Journaled documents: rather than writing the whole document out whenever
+ * something changes, only the branches that have changed since the last
+ * commit are appended to a log alongside it. Opening replays the log on top
+ * of the base, and compaction folds the log back into a new base on another
+ * thread, while commits carry on as usual.
+ *
+ *  base (path)
+ *      binary document
+ *
+ *  log (path.log)
+ *      char[10] header (JOURNAL_HEADER)
+ *      uint32_t version
+ *      uint64_t baseHash (FNV-1a of the base this applies on top of)
+ *      then for each commit
+ *          uint32_t size (of the records)
+ *          uint32_t numRecords
+ *          for each record
+ *              uint32_t depth (JOURNAL_RECORD_INSERT set for inserts)
+ *              uint32_t path[depth] (index of the child at each level down from the root)
+ *              uint32_t size
+ *              binary document, for the branch at the path
+ *          uint64_t hash (FNV-1a of everything since the size)
+ *
+ * Each record replaces the branch at its path, or adds it on the end if the
+ * index is one past the last child. Inserts go before whatever's at the
+ * index instead; records are in order, so every index is into the branch as
+ * it is by then. Changed branches are saved whole, and removing anything
+ * saves the whole of whatever it was removed from. A commit
+ * that was cut short is ignored, along with anything after it.
+ *
+ * Compaction writes out a new base, and a new log with whatever's been
+ * committed since it started, and then swaps each into place. If it's stopped
+ * in between, the new log is left beside the old one and gets picked up on
+ * the next open, as it's the one that matches the base.
+ */
+
+#define JOURNAL_HEADER         "node.binj\n"
+#define JOURNAL_VERSION        1
+#define JOURNAL_HEADER_SIZE    22
+#define JOURNAL_COMMIT_HEADER  8 /* size + numRecords */
+#define JOURNAL_COMMIT_HASH    8
+#define JOURNAL_RECORD_FLAGS   ACM_WRITE_FLAG_COMPACT
+#define JOURNAL_RECORD_INSERT  0x80000000U /* on the depth, as it's never anywhere near that */
+#define JOURNAL_COMPACT_MIN    65536 /* smaller logs aren't worth folding in automatically */
+
+struct AcmJournal
+{
+	AcmBranch *root;
+
+	char *path;
+	char *logPath;
+	char *newPath;    /* base being written by compaction */
+	char *newLogPath; /* log to go with it */
+
+	FILE    *log;
+	uint64_t logSize; /* up to the end of the last commit */
+	uint64_t baseSize;
+
+	AcmTask *compaction;
+	uint64_t foldSize; /* how much of the log it's folding in */
+	uint64_t newHash;
+	uint64_t newSize;
+	char     error[ 256 ]; /* errors on the compaction's own thread would otherwise be lost */
+};
+
+/******************************************/
+/** Files **/
+
+static char *make_path( const char *path, const char *suffix )
+{
+	size_t length = strlen( path ) + strlen( suffix ) + 1;
+	char  *p      = ACM_NEW_( char, length );
+	if ( p == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate path (%s%s)", path, suffix );
+		return NULL;
+	}
+
+	snprintf( p, length, "%s%s", path, suffix );
+	return p;
+}
+
+/**
+ * Reads in the whole file. If it doesn't exist and isOptional is set,
+ * returns null without setting an error.
+ */
+static uint8_t *read_file( const char *path, size_t *size, bool isOptional )
+{
+	FILE *file = fopen( path, "rb" );
+	if ( file == NULL )
+	{
+		if ( !isOptional )
+		{
+			acm_set_error_message_( ND_ERROR_IO_READ, "failed to open file (%s)", path );
+		}
+		return NULL;
+	}
+
+	int64_t length = acm_fseek64( file, 0, SEEK_END ) == 0 ? ( int64_t ) acm_ftell64( file ) : -1;
+	rewind( file );
+
+	uint8_t *buf = length >= 0 && ( uint64_t ) length < SIZE_MAX ? ACM_NEW_( uint8_t, ( size_t ) length + 1 ) : NULL;
+	if ( buf == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate buffer for file (%s)", path );
+	}
+	else if ( fread( buf, sizeof( uint8_t ), ( size_t ) length, file ) != ( size_t ) length )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "failed to read file (%s)", path );
+		ACM_DELETE( buf );
+		buf = NULL;
+	}
+
+	fclose( file );
+
+	*size = ( size_t ) length;
+	return buf;
+}
+
+static bool write_file( const char *path, const void *header, size_t headerSize, const void *buf, size_t size )
+{
+	FILE *file = fopen( path, "wb" );
+	if ( file == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to open file for writing (%s)", path );
+		return false;
+	}
+
+	bool status = fwrite( header, sizeof( uint8_t ), headerSize, file ) == headerSize &&
+	              ( size == 0 || fwrite( buf, sizeof( uint8_t ), size, file ) == size );
+	status = ( fclose( file ) == 0 ) && status;
+	if ( !status )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to write file (%s)", path );
+	}
+
+	return status;
+}
+
+static bool replace_file( const char *src, const char *dst )
+{
+#if defined( _WIN32 )
+	bool status = MoveFileExA( src, dst, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH );
+#else
+	bool status = rename( src, dst ) == 0;
+#endif
+	if ( !status )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to replace file (%s)", dst );
+	}
+
+	return status;
+}
+
+static void make_log_header( uint8_t *header, uint64_t baseHash )
+{
+	uint32_t version = JOURNAL_VERSION;
+	memcpy( header, JOURNAL_HEADER, 10 );
+	memcpy( header + 10, &version, sizeof( uint32_t ) );
+	memcpy( header + 14, &baseHash, sizeof( uint64_t ) );
+}
+
+/* the log for the given base, or the new one left by compaction if it didn't get to swap it in */
+static uint8_t *read_log( AcmJournal *self, uint64_t baseHash, size_t *size )
+{
+	uint8_t header[ JOURNAL_HEADER_SIZE ];
+	make_log_header( header, baseHash );
+
+	uint8_t *log = read_file( self->logPath, size, true );
+	if ( log != NULL && *size >= JOURNAL_HEADER_SIZE && memcmp( log, header, JOURNAL_HEADER_SIZE ) == 0 )
+	{
+		return log;
+	}
+
+	size_t   newSize;
+	uint8_t *newLog = read_file( self->newLogPath, &newSize, true );
+	if ( newLog != NULL && newSize >= JOURNAL_HEADER_SIZE && memcmp( newLog, header, JOURNAL_HEADER_SIZE ) == 0 && replace_file( self->newLogPath, self->logPath ) )
+	{
+		ACM_DELETE( log );
+		*size = newSize;
+		return newLog;
+	}
+	ACM_DELETE( newLog );
+
+	if ( log != NULL )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "journal doesn't match its base (%s)", self->logPath );
+		ACM_DELETE( log );
+		return NULL;
+	}
+
+	// there's no log yet, so start one
+	log = ACM_NEW_( uint8_t, JOURNAL_HEADER_SIZE );
+	if ( log == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate journal header" );
+		return NULL;
+	}
+	else if ( !write_file( self->logPath, header, JOURNAL_HEADER_SIZE, NULL, 0 ) )
+	{
+		ACM_DELETE( log );
+		return NULL;
+	}
+
+	memcpy( log, header, JOURNAL_HEADER_SIZE );
+	*size = JOURNAL_HEADER_SIZE;
+	return log;
+}
+
+static bool open_log( AcmJournal *self, uint64_t size )
+{
+	// not appending, as anything after the last commit gets written over
+	self->log = fopen( self->logPath, "r+b" );
+	if ( self->log == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to open journal for writing (%s)", self->logPath );
+		return false;
+	}
+
+	self->logSize = size;
+	return true;
+}
+
+/**
+ * Writes out the new base, and a new log with the given commits, and then
+ * swaps them in. The log's closed in the meantime, as it can't be replaced
+ * while it's open on some platforms.
+ */
+static bool install_base( AcmJournal *self, uint64_t baseHash, uint64_t baseSize, const uint8_t *commits, size_t commitsSize )
+{
+	uint8_t header[ JOURNAL_HEADER_SIZE ];
+	make_log_header( header, baseHash );
+	if ( !write_file( self->newLogPath, header, JOURNAL_HEADER_SIZE, commits, commitsSize ) )
+	{
+		return false;
+	}
+
+	if ( self->log != NULL )
+	{
+		fclose( self->log );
+		self->log = NULL;
+	}
+
+	// the old log no longer matches once the base is swapped in, so it can't be used until the new one is
+	bool isReplaced = replace_file( self->newPath, self->path );
+	if ( isReplaced && !replace_file( self->newLogPath, self->logPath ) )
+	{
+		return false;
+	}
+
+	if ( !open_log( self, isReplaced ? JOURNAL_HEADER_SIZE + commitsSize : self->logSize ) )
+	{
+		return false;
+	}
+
+	if ( isReplaced )
+	{
+		self->baseSize = baseSize;
+	}
+
+	return isReplaced;
+}
+
+/******************************************/
+/** Replay **/
+
+static bool read_u32( const uint8_t **p, const uint8_t *end, uint32_t *v )
+{
+	if ( end - *p < ( ptrdiff_t ) sizeof( uint32_t ) )
+	{
+		return false;
+	}
+
+	memcpy( v, *p, sizeof( uint32_t ) );
+	*p += sizeof( uint32_t );
+	return true;
+}
+
+static bool apply_record( AcmBranch *root, const uint8_t **p, const uint8_t *end )
+{
+	uint32_t depth;
+	if ( !read_u32( p, end, &depth ) )
+	{
+		return false;
+	}
+
+	bool isInsert = ( depth & JOURNAL_RECORD_INSERT ) != 0;
+	depth &= ~JOURNAL_RECORD_INSERT;
+	if ( depth > ACM_BINARY_MAX_DEPTH || ( isInsert && depth == 0 ) )
+	{
+		return false;
+	}
+
+	// find the parent, and where in it the branch goes
+	AcmBranch *parent = NULL;
+	AcmBranch *node   = root;
+	uint32_t   index  = 0;
+	for ( uint32_t i = 0; i < depth; ++i )
+	{
+		if ( node == NULL || !read_u32( p, end, &index ) )
+		{
+			return false;
+		}
+
+		parent = node;
+		node   = acm_get_child_at_( parent, index );
+	}
+
+	uint32_t size;
+	if ( !read_u32( p, end, &size ) || ( size_t ) ( end - *p ) < size )
+	{
+		return false;
+	}
+
+	AcmBranch *branch = acm_load_from_memory( *p, size, NULL, NULL );
+	*p += size;
+	if ( branch == NULL )
+	{
+		return false;
+	}
+
+	if ( isInsert )
+	{
+		if ( ( node == NULL && index != parent->numChildren ) || !acm_insert_branch_( parent, node, branch ) )
+		{
+			acm_branch_destroy( branch );
+			return false;
+		}
+
+		return true;
+	}
+	else if ( node == NULL )
+	{
+		// goes on the end
+		if ( parent == NULL || index != parent->numChildren || acm_is_packed_array_( parent ) )
+		{
+			acm_branch_destroy( branch );
+			return false;
+		}
+
+		node = acm_push_new_branch( parent, NULL, branch->type, branch->childType );
+		if ( node == NULL )
+		{
+			acm_branch_destroy( branch );
+			return false;
+		}
+	}
+
+	acm_replace_branch_( node, branch );
+	return true;
+}
+
+/**
+ * Applies each commit in turn, stopping at the first that's incomplete.
+ * Returns false if a commit can't be applied, as the log doesn't match
+ * the document.
+ */
+static bool replay_log( AcmBranch *root, const uint8_t *log, size_t logSize, size_t *validSize )
+{
+	size_t offset = JOURNAL_HEADER_SIZE;
+	while ( logSize - offset >= JOURNAL_COMMIT_HEADER + JOURNAL_COMMIT_HASH )
+	{
+		uint32_t size, numRecords;
+		memcpy( &size, log + offset, sizeof( uint32_t ) );
+		memcpy( &numRecords, log + offset + 4, sizeof( uint32_t ) );
+		if ( size > logSize - offset - JOURNAL_COMMIT_HEADER - JOURNAL_COMMIT_HASH )
+		{
+			break;
+		}
+
+		uint64_t hash;
+		memcpy( &hash, log + offset + JOURNAL_COMMIT_HEADER + size, sizeof( uint64_t ) );
+		if ( hash != acm_hash_bytes_( ACM_HASH_BASIS, log + offset, JOURNAL_COMMIT_HEADER + size ) )
+		{
+			break;
+		}
+
+		const uint8_t *p   = log + offset + JOURNAL_COMMIT_HEADER;
+		const uint8_t *end = p + size;
+		for ( uint32_t i = 0; i < numRecords; ++i )
+		{
+			if ( !apply_record( root, &p, end ) )
+			{
+				acm_set_error_message_( ND_ERROR_INVALID_DATA, "invalid journal record (commit at offset %zu)", offset );
+				return false;
+			}
+		}
+
+		offset += JOURNAL_COMMIT_HEADER + size + JOURNAL_COMMIT_HASH;
+	}
+
+	*validSize = offset;
+	return true;
+}
+
+/* clears everything that's been flagged, which is only ever below something else that's flagged */
+static void clear_dirty_flags( AcmBranch *self )
+{
+	unsigned int numDirty  = self->numDirtyChildren;
+	self->isDirty          = false;
+	self->isInserted       = false;
+	self->numDirtyChildren = 0;
+	if ( acm_is_packed_array_( self ) )
+	{
+		return;
+	}
+
+	for ( AcmBranch *child = self->children.start; child != NULL && numDirty > 0; child = child->next )
+	{
+		if ( child->isDirty || child->numDirtyChildren > 0 )
+		{
+			clear_dirty_flags( child );
+			numDirty--;
+		}
+	}
+}
+
+/* base and log up to the given size */
+static AcmBranch *load_journaled( const char *path, const uint8_t *base, size_t baseSize, const uint8_t *log, size_t logSize, size_t *validSize )
+{
+	AcmBranch *root = acm_load_from_memory( base, baseSize, NULL, path );
+	if ( root == NULL )
+	{
+		return NULL;
+	}
+	else if ( !replay_log( root, log, logSize, validSize ) )
+	{
+		acm_branch_destroy( root );
+		return NULL;
+	}
+
+	clear_dirty_flags( root );
+	return root;
+}
+
+/******************************************/
+/** Compaction **/
+
+static bool run_compaction( void *user, unsigned int index )
+{
+	( void ) index;
+
+	AcmJournal *self = user;
+
+	size_t   baseSize, logSize, validSize;
+	uint8_t *base = read_file( self->path, &baseSize, false );
+	uint8_t *log  = base != NULL ? read_file( self->logPath, &logSize, false ) : NULL;
+
+	// only fold in what was committed when we started
+	AcmBranch *root = NULL;
+	if ( log != NULL && logSize >= self->foldSize )
+	{
+		root = load_journaled( self->path, base, baseSize, log, self->foldSize, &validSize );
+	}
+	else if ( log != NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "journal is shorter than expected (%s)", self->logPath );
+	}
+
+	ACM_DELETE( base );
+	ACM_DELETE( log );
+
+	bool status = false;
+	if ( root != NULL )
+	{
+		size_t size;
+		void  *buf = acm_write_to_memory( root, ACM_FILE_TYPE_BINARY, ACM_WRITE_FLAG_NONE, &size );
+		if ( buf != NULL )
+		{
+			self->newHash = acm_hash_bytes_( ACM_HASH_BASIS, buf, size );
+			self->newSize = size;
+			status        = write_file( self->newPath, buf, size, NULL, 0 );
+			ACM_DELETE( buf );
+		}
+		acm_branch_destroy( root );
+	}
+
+	if ( !status )
+	{
+		snprintf( self->error, sizeof( self->error ), "%s", acm_get_error_message() );
+	}
+
+	return status;
+}
+
+static bool finish_compaction( AcmJournal *self )
+{
+	bool status      = acm_finish_task_( self->compaction );
+	self->compaction = NULL;
+	if ( !status )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to compact journal (%s)", self->error );
+		return false;
+	}
+
+	// everything committed since it started goes into the new log
+	size_t   logSize;
+	uint8_t *log = read_file( self->logPath, &logSize, false );
+	if ( log == NULL )
+	{
+		return false;
+	}
+	else if ( logSize < self->logSize )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "journal is shorter than expected (%s)", self->logPath );
+		ACM_DELETE( log );
+		return false;
+	}
+
+	status = install_base( self, self->newHash, self->newSize, log + self->foldSize, self->logSize - self->foldSize );
+	ACM_DELETE( log );
+
+	return status;
+}
+
+bool acm_journal_compact( AcmJournal *self )
+{
+	if ( self->compaction != NULL || self->logSize == JOURNAL_HEADER_SIZE )
+	{
+		return true;
+	}
+	else if ( self->log == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "journal isn't open (%s)", self->logPath );
+		return false;
+	}
+
+	self->foldSize   = self->logSize;
+	self->compaction = acm_start_task_( run_compaction, self );
+	return self->compaction != NULL;
+}
+
+/******************************************/
+/** Commits **/
+
+typedef struct AcmJournalChild
+{
+	AcmBranch *branch;
+	uint32_t   index;
+} AcmJournalChild;
+
+static bool write_record( AcmOutput *output, AcmBranch *node, const uint32_t *path, uint32_t depth, bool isInsert )
+{
+	uint32_t flaggedDepth = isInsert ? ( depth | JOURNAL_RECORD_INSERT ) : depth;
+	acm_output_write_( output, &flaggedDepth, sizeof( uint32_t ) );
+	acm_output_write_( output, path, depth * sizeof( uint32_t ) );
+
+	uint64_t sizeOffset = output->total;
+	uint32_t size       = 0;
+	acm_output_write_( output, &size, sizeof( uint32_t ) );
+	if ( !acm_serialize_binary_( output, node, JOURNAL_RECORD_FLAGS ) )
+	{
+		return false;
+	}
+
+	uint64_t recordSize = output->total - sizeOffset - sizeof( uint32_t );
+	if ( recordSize > UINT32_MAX )
+	{
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "journal record is too large (%" PRIu64 " bytes)", recordSize );
+		return false;
+	}
+
+	size = ( uint32_t ) recordSize;
+	return acm_output_patch_( output, sizeOffset, &size, sizeof( uint32_t ) );
+}
+
+/**
+ * Writes a record for each dirty branch, and clears the flags for
+ * everything it passes along the way.
+ */
+static bool write_dirty_branches( AcmOutput *output, AcmBranch *node, uint32_t *path, uint32_t depth, uint32_t *numRecords )
+{
+	if ( node->isDirty )
+	{
+		bool isInsert = node->isInserted;
+		clear_dirty_flags( node );
+		( *numRecords )++;
+		return write_record( output, node, path, depth, isInsert );
+	}
+
+	unsigned int numDirty  = node->numDirtyChildren;
+	node->numDirtyChildren = 0;
+	if ( numDirty == 0 )
+	{
+		return true;
+	}
+	else if ( depth == ACM_BINARY_MAX_DEPTH )
+	{
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "nested too deeply to journal" );
+		return false;
+	}
+
+	AcmJournalChild *dirty = ACM_NEW_( AcmJournalChild, numDirty );
+	if ( dirty == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate dirty branches (%u)", numDirty );
+		return false;
+	}
+
+	/* changes are usually near one end or the other (something added on the end of a large
+	 * array, say), so look from both at once. Those found from the end fill in from the back,
+	 * so they're all in order once found. */
+	unsigned int numFront = 0, numBack = 0;
+	AcmBranch   *front = node->children.start, *back = node->children.end;
+	for ( uint32_t i = 0, j = node->numChildren - 1; numFront + numBack < numDirty && front != NULL && i <= j; ++i, --j )
+	{
+		if ( front->isDirty || front->numDirtyChildren > 0 )
+		{
+			dirty[ numFront ].branch = front;
+			dirty[ numFront ].index  = i;
+			numFront++;
+		}
+		if ( back != front && ( back->isDirty || back->numDirtyChildren > 0 ) && numFront + numBack < numDirty )
+		{
+			numBack++;
+			dirty[ numDirty - numBack ].branch = back;
+			dirty[ numDirty - numBack ].index  = j;
+		}
+
+		front = front->next;
+		back  = back->prev;
+	}
+
+	// close the gap, if fewer were found than expected
+	memmove( &dirty[ numFront ], &dirty[ numDirty - numBack ], sizeof( AcmJournalChild ) * numBack );
+
+	bool status = true;
+	for ( unsigned int i = 0; i < numFront + numBack && status; ++i )
+	{
+		path[ depth ] = dirty[ i ].index;
+		status        = write_dirty_branches( output, dirty[ i ].branch, path, depth + 1, numRecords );
+	}
+
+	ACM_DELETE( dirty );
+
+	return status;
+}
+
+bool acm_journal_commit( AcmJournal *self )
+{
+	if ( self->compaction != NULL && acm_is_task_done_( self->compaction ) && !finish_compaction( self ) )
+	{
+		return false;
+	}
+	else if ( !self->root->isDirty && self->root->numDirtyChildren == 0 )
+	{
+		return true;
+	}
+	else if ( self->log == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "journal isn't open (%s)", self->logPath );
+		return false;
+	}
+
+	AcmOutput output;
+	if ( !acm_output_open_( &output, NULL, NULL ) )
+	{
+		return false;
+	}
+
+	uint32_t header[ 2 ] = { 0, 0 };
+	acm_output_write_( &output, header, sizeof( header ) );
+
+	uint32_t path[ ACM_BINARY_MAX_DEPTH ];
+	bool     status = write_dirty_branches( &output, self->root, path, 0, &header[ 1 ] );
+
+	size_t   size;
+	uint8_t *buf = status ? acm_output_release_( &output, &size ) : NULL;
+	acm_output_close_( &output );
+	if ( buf != NULL && size - sizeof( header ) > UINT32_MAX )
+	{
+		// the size has to fit the commit header, same as each record's
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "journal commit is too large (%zu bytes)", size );
+		ACM_DELETE( buf );
+		status = false;
+	}
+	else if ( buf != NULL )
+	{
+		header[ 0 ] = ( uint32_t ) ( size - sizeof( header ) );
+		memcpy( buf, header, sizeof( header ) );
+
+		uint64_t hash = acm_hash_bytes_( ACM_HASH_BASIS, buf, size );
+
+		// written over whatever's after the last commit, in case the last attempt failed part way
+		status = acm_fseek64( self->log, self->logSize, SEEK_SET ) == 0 &&
+		         fwrite( buf, sizeof( uint8_t ), size, self->log ) == size &&
+		         fwrite( &hash, sizeof( uint64_t ), 1, self->log ) == 1 &&
+		         fflush( self->log ) == 0;
+		if ( status )
+		{
+			self->logSize += size + sizeof( uint64_t );
+		}
+		else
+		{
+			acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to write to journal (%s)", self->logPath );
+		}
+
+		ACM_DELETE( buf );
+	}
+
+	// the flags are gone, so make sure everything's written next time
+	if ( !status )
+	{
+		acm_mark_branch_dirty_( self->root );
+		return false;
+	}
+
+	// fold the log in once it's grown larger than the base
+	if ( self->logSize >= JOURNAL_COMPACT_MIN && self->logSize > self->baseSize )
+	{
+		return acm_journal_compact( self );
+	}
+
+	return true;
+}
+
+/******************************************/
+
+static AcmJournal *new_journal( const char *path )
+{
+	AcmJournal *self = ACM_NEW( AcmJournal );
+	if ( self == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate journal" );
+		return NULL;
+	}
+
+	self->path       = make_path( path, "" );
+	self->logPath    = make_path( path, ".log" );
+	self->newPath    = make_path( path, ".new" );
+	self->newLogPath = make_path( path, ".log.new" );
+	if ( self->path == NULL || self->logPath == NULL || self->newPath == NULL || self->newLogPath == NULL )
+	{
+		acm_journal_close( self );
+		return NULL;
+	}
+
+	return self;
+}
+
+AcmJournal *acm_journal_create( const char *path, AcmBranch *root )
+{
+	AcmJournal *self = new_journal( path );
+	if ( self == NULL )
+	{
+		return NULL;
+	}
+
+	size_t size;
+	void  *buf    = acm_write_to_memory( root, ACM_FILE_TYPE_BINARY, ACM_WRITE_FLAG_NONE, &size );
+	bool   status = buf != NULL && write_file( self->newPath, buf, size, NULL, 0 ) &&
+	              install_base( self, acm_hash_bytes_( ACM_HASH_BASIS, buf, size ), size, NULL, 0 );
+	ACM_DELETE( buf );
+	if ( !status )
+	{
+		acm_journal_close( self );
+		return NULL;
+	}
+
+	self->root = root;
+	clear_dirty_flags( root );
+
+	return self;
+}
+
+AcmJournal *acm_journal_open( const char *path, AcmBranch **root )
+{
+	*root = NULL;
+
+	AcmJournal *self = new_journal( path );
+	if ( self == NULL )
+	{
+		return NULL;
+	}
+
+	size_t   baseSize, logSize, validSize = 0;
+	uint8_t *base = read_file( self->path, &baseSize, false );
+	uint8_t *log  = base != NULL ? read_log( self, acm_hash_bytes_( ACM_HASH_BASIS, base, baseSize ), &logSize ) : NULL;
+	if ( log != NULL )
+	{
+		self->root = load_journaled( self->path, base, baseSize, log, logSize, &validSize );
+	}
+	ACM_DELETE( base );
+
+	// drop anything left over from a commit that was cut short
+	bool status = self->root != NULL;
+	if ( status && validSize < logSize )
+	{
+		status = write_file( self->newLogPath, log, validSize, NULL, 0 ) && replace_file( self->newLogPath, self->logPath );
+	}
+	ACM_DELETE( log );
+
+	if ( !status || !open_log( self, validSize ) )
+	{
+		acm_branch_destroy( self->root );
+		self->root = NULL;
+		acm_journal_close( self );
+		return NULL;
+	}
+
+	self->baseSize = baseSize;
+
+	*root = self->root;
+	return self;
+}
+
+bool acm_journal_close( AcmJournal *self )
+{
+	bool status = true;
+	if ( self->compaction != NULL )
+	{
+		status = finish_compaction( self );
+	}
+
+	if ( self->log != NULL )
+	{
+		fclose( self->log );
+	}
+
+	ACM_DELETE( self->path );
+	ACM_DELETE( self->logPath );
+	ACM_DELETE( self->newPath );
+	ACM_DELETE( self->newLogPath );
+	ACM_DELETE( self );
+
+	return status;
+}
@@ -2,12 +2,18 @@
 // Ape Config Markup
 // Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
 
-//#define ACM_TEST
-
 #include <ctype.h>
 
 #include "acm_private.h"
 
+/* Splits text into tokens as the parser asks for them, so only the few
+ * it's looking at are ever kept. Text comes either from a buffer, or from
+ * a file that's read through a window, which only grows to fit a token
+ * that's longer than it.
+ */
+
+#define LEXER_WINDOW_SIZE 65536
+
 typedef struct AcmLexerReservedWord
 {
 	const char  *string;
@@ -29,6 +35,7 @@ static AcmLexerReservedWord reservedWords[] = {
         {"int32",   ACM_TOKEN_TYPE_TYPENAME     },
         {"int",     ACM_TOKEN_TYPE_TYPENAME     }, // shorthand int32
         {"int64",   ACM_TOKEN_TYPE_TYPENAME     },
+        {"float16", ACM_TOKEN_TYPE_TYPENAME     },
         {"float",   ACM_TOKEN_TYPE_TYPENAME     },
         {"float64", ACM_TOKEN_TYPE_TYPENAME     },
 
@@ -37,404 +44,324 @@ static AcmLexerReservedWord reservedWords[] = {
 };
 static const unsigned int NUM_RESERVED_WORDS = ( sizeof( reservedWords ) / sizeof( *( reservedWords ) ) );
 
-#define NOT_TERMINATING_CHAR( P ) ( ( P ) != '\0' && ( P ) != '\n' && ( P ) != '\r' )
-
-static int get_line_end( const char *p )
+static bool is_space( char c )
 {
-	if ( *p == '\0' ) return 0;
-	if ( *p == '\n' ) return 1;
-	if ( *p == '\r' && *( p + 1 ) == '\n' ) return 2;
-
-	return -1;
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
 }
 
-static bool is_line_end( const char *p )
+/**
+ * Moves whatever's left to the front of the window and reads in more
+ * behind it, growing the window if it's already full. Returns false if
+ * nothing more could be read.
+ */
+static bool fill_window( AcmLexer *self )
 {
-	return get_line_end( p ) != -1;
-}
-
-static bool is_whitespace( const char *p )
-{
-	if ( is_line_end( p ) )
+	if ( self->file == NULL || self->isExhausted )
 	{
 		return false;
 	}
 
-	return isspace( *p ) || *p == '\t';
-}
-
-static void skip_whitespace( const char **p )
-{
-	if ( !is_whitespace( *p ) )
-	{
-		return;
-	}
-
-	do
-	{
-		( *p )++;
-	} while ( is_whitespace( *p ) );
-}
-
-static void skip_line( const char **p )
-{
-	while ( NOT_TERMINATING_CHAR( *( *p ) ) ) ( *p )++;
-	if ( *( *p ) == '\r' ) ( *p )++;
-	if ( *( *p ) == '\n' ) ( *p )++;
-}
-
-static unsigned int get_token_length( const char *p )
-{
-	skip_whitespace( &p );
-
-	const char *s = p;
-	while ( *p != '\0' && *p != ' ' )
+	size_t length = self->bufEnd - self->bufStart;
+	if ( length == self->bufSize )
 	{
-		if ( is_line_end( p ) )
+		char *p = ACM_REALLOC( self->window, char, self->bufSize * 2 );
+		if ( p == NULL )
 		{
-			break;
+			acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate text window (%zu bytes)", self->bufSize * 2 );
+			self->hasFailed   = true;
+			self->isExhausted = true;
+			return false;
 		}
 
-		p++;
+		self->window = p;
+		self->buf    = p;
+		self->bufSize *= 2;
 	}
 
-	return p - s;
-}
-
-static const char *read_token( const char **p, char *dst, size_t size )
-{
-	skip_whitespace( p );
+	memmove( self->window, self->window + self->bufStart, length );
+	self->bufStart = 0;
+	self->bufEnd   = length;
 
-	unsigned int length = get_token_length( ( *p ) );
-	size_t       i;
-	for ( i = 0; i < length; ++i )
+	size_t n = fread( self->window + length, sizeof( char ), self->bufSize - length, self->file );
+	if ( n == 0 )
 	{
-		if ( ( i + 1 ) >= size )
+		if ( ferror( self->file ) )
 		{
-			break;
+			acm_set_error_message_( ND_ERROR_IO_READ, "failed to read text (%s)", self->originPath );
+			self->hasFailed = true;
 		}
-
-		dst[ i ] = ( *p )[ i ];
+		self->isExhausted = true;
+		return false;
 	}
 
-	( *p ) += length;
-
-	dst[ i ] = '\0';
-	return dst;
+	self->bufEnd += n;
+	return true;
 }
 
-static unsigned int get_enclosed_string_length( const char *p )
+/* ensures at least the given number of characters are there, unless the text ends first */
+static bool ensure_text( AcmLexer *self, size_t size )
 {
-	skip_whitespace( &p );
-
-	const char *s          = p;
-	bool        isEnclosed = false;
-	if ( *p == '\"' )
+	while ( self->bufEnd - self->bufStart < size )
 	{
-		p++;
-		isEnclosed = true;
-	}
-
-	while ( NOT_TERMINATING_CHAR( *p ) )
-	{
-		if ( !isEnclosed && ( *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' ) )
-		{
-			break;
-		}
-		if ( isEnclosed && *p == '\"' )
+		if ( !fill_window( self ) )
 		{
-			p++;
-			break;
+			return false;
 		}
-
-		p++;
 	}
 
-	return p - s;
+	return true;
 }
 
-static const char *read_enclosed_string( const char **p, char *dst, size_t size )
+static void step( AcmLexer *self, size_t length )
 {
-	skip_whitespace( p );
-
-	bool isEnclosed = false;
-	if ( *( *p ) == '\"' )
-	{
-		( *p )++;
-		isEnclosed = true;
-	}
+	self->bufStart += length;
+	self->linePos += length;
+}
 
-	size_t i = 0;
-	while ( NOT_TERMINATING_CHAR( *( *p ) ) )
+/**
+ * Skips whitespace and comments, which either run to the end of the line,
+ * or between ;* and *; over any number of lines. Returns false if the text
+ * ends first.
+ */
+static bool skip_to_token( AcmLexer *self )
+{
+	for ( ;; )
 	{
-		if ( !isEnclosed && ( *( *p ) == ' ' || *( *p ) == '\t' || *( *p ) == '\n' || *( *p ) == '\r' ) )
+		if ( !ensure_text( self, 1 ) )
 		{
-			break;
+			return false;
 		}
 
-		if ( isEnclosed && *( *p ) == '\"' )
+		char c = self->buf[ self->bufStart ];
+		if ( c == '\n' )
 		{
-			( *p )++;
-			break;
+			self->bufStart++;
+			self->lineNum++;
+			self->linePos = 1;
+			continue;
 		}
-
-		if ( ( i + 1 ) < size )
+		else if ( is_space( c ) )
 		{
-			dst[ i++ ] = *( *p );
+			step( self, 1 );
+			continue;
+		}
+		else if ( c != ';' )
+		{
+			return true;
 		}
-		( *p )++;
-	}
 
-	dst[ i ] = '\0';
-	return dst;
-}
+		bool isMultiLine = ensure_text( self, 2 ) && self->buf[ self->bufStart + 1 ] == '*';
+		step( self, isMultiLine ? 2 : 1 );
+		for ( ;; )
+		{
+			if ( !ensure_text( self, 1 ) )
+			{
+				return false;
+			}
 
-static unsigned int get_line_length( const char *p )
-{
-	unsigned int length = 0;
-	while ( NOT_TERMINATING_CHAR( *p ) )
-	{
-		length++;
-		p++;
-	}
+			c = self->buf[ self->bufStart ];
+			if ( c == '\n' )
+			{
+				if ( !isMultiLine )
+				{
+					break;
+				}
 
-	return length;
-}
+				self->bufStart++;
+				self->lineNum++;
+				self->linePos = 1;
+				continue;
+			}
+			else if ( isMultiLine && c == '*' && ensure_text( self, 2 ) && self->buf[ self->bufStart + 1 ] == ';' )
+			{
+				step( self, 2 );
+				break;
+			}
 
-static const char *read_line( const char **p, char *dst, size_t size )
-{
-	unsigned int length = get_line_length( *p );
-	size_t       i;
-	for ( i = 0; i < length; ++i )
-	{
-		if ( ( i + 1 ) >= size )
-		{
-			break;
+			step( self, 1 );
 		}
-
-		dst[ i ] = ( *p )[ i ];
 	}
-
-	( *p ) += length + get_line_end( ( *p ) + length );
-
-	dst[ i ] = '\0';
-	return dst;
 }
 
-static AcmTokenType get_token_type_for_symbol( const char *symbol )
+static AcmTokenType get_token_type_for_symbol( const AcmLexer *self, const char *symbol, unsigned int linePos )
 {
-	if ( *symbol == '\0' )
+	if ( isdigit( ( unsigned char ) *symbol ) || *symbol == '-' )
 	{
-		return ACM_TOKEN_TYPE_EOF;
+		AcmTokenType type = ACM_TOKEN_TYPE_INTEGER;
+		for ( const char *c = symbol; *c != '\0'; ++c )
+		{
+			if ( *c != '.' )
+			{
+				continue;
+			}
+			else if ( type == ACM_TOKEN_TYPE_DECIMAL )
+			{
+				Warning( "Unexpected token in num: %u:%u (%s)\n", self->lineNum, linePos, self->originPath );
+				break;
+			}
+
+			type = ACM_TOKEN_TYPE_DECIMAL;
+		}
+
+		return type;
 	}
 
 	for ( unsigned int i = 0; i < NUM_RESERVED_WORDS; ++i )
 	{
-		const char *p = reservedWords[ i ].string;
-		if ( strcmp( p, symbol ) != 0 )
+		if ( strcmp( reservedWords[ i ].string, symbol ) == 0 )
 		{
-			continue;
+			return reservedWords[ i ].type;
 		}
-
-		return reservedWords[ i ].type;
 	}
 
 	return ACM_TOKEN_TYPE_IDENTIFIER;
 }
 
-static void parse_line( const char *p, const char *file, unsigned int lineNum, AcmLexer *lexer )
+/**
+ * Reads the next token onto the end of the queue; either a run of
+ * anything but whitespace, or a string enclosed in quotes, which ends
+ * with the line if it isn't closed. Returns false at the end of the text.
+ */
+static bool read_token( AcmLexer *self )
 {
-	const char *o = p;
-	while ( true )
+	if ( !skip_to_token( self ) )
 	{
-		skip_whitespace( &p );
+		return false;
+	}
 
-		if ( *p == '\0' )
+	bool   isEnclosed = self->buf[ self->bufStart ] == '"';
+	size_t i          = isEnclosed ? 1 : 0;
+	for ( ;; )
+	{
+		if ( self->bufStart + i == self->bufEnd && !fill_window( self ) )
 		{
 			break;
 		}
 
-		if ( *p == ';' )
+		char c = self->buf[ self->bufStart + i ];
+		if ( isEnclosed ? ( c == '"' || c == '\n' || c == '\r' ) : is_space( c ) )
 		{
-			if ( *( p + 1 ) == '*' )
-			{
-				// multi-line comment
-				p += 2;
-				while ( *p != '*' && *( p + 1 ) != ';' )
-				{
-					int l = get_line_end( p );
-					if ( l != -1 )
-					{
-						p += l;
-						continue;
-					}
-
-					p++;
-				}
-				p += 2;
-				continue;
-			}
-
-			// single-line comment
 			break;
 		}
+		i++;
+	}
 
-		AcmTokenType type = ACM_TOKEN_TYPE_INVALID;
-
-		unsigned int linePos = ( p - o ) + 1;
-		unsigned int symbolSize;
-		char        *symbol;
-		if ( *p == '\"' )
-		{
-			symbolSize = get_enclosed_string_length( p ) + 1;
-			symbol     = ACM_NEW_( char, symbolSize );
-			if ( read_enclosed_string( &p, symbol, symbolSize ) == NULL )
-			{
-				Warning( "Failed to parse enclosed string: %u:%u\n", lineNum, linePos );
-				break;
-			}
+	size_t         length = i - ( isEnclosed ? 1 : 0 );
+	AcmLexerToken *token  = ACM_NEW( AcmLexerToken );
+	char          *symbol = token != NULL ? ACM_NEW_( char, length + 1 ) : NULL;
+	if ( symbol == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate token (%zu bytes)", length + 1 );
+		ACM_DELETE( token );
+		self->hasFailed = true;
+		return false;
+	}
 
-			type = ACM_TOKEN_TYPE_STRING;
-		}
-		else
-		{
-			symbolSize = get_token_length( p ) + 1;
-			symbol     = ACM_NEW_( char, symbolSize );
-			if ( read_token( &p, symbol, symbolSize ) == NULL )
-			{
-				Warning( "Failed to parse token for lexer: %u:%u\n", lineNum, linePos );
-				break;
-			}
+	memcpy( symbol, self->buf + self->bufStart + ( isEnclosed ? 1 : 0 ), length );
 
-			if ( isdigit( *symbol ) || *symbol == '-' )
-			{
-				type = ACM_TOKEN_TYPE_INTEGER;
-				for ( unsigned int i = 0; i < symbolSize; ++i )
-				{
-					if ( symbol[ i ] == '.' )
-					{
-						if ( type == ACM_TOKEN_TYPE_DECIMAL )
-						{
-							Warning( "Unexpected token in num: %u:%u\n", lineNum, linePos );
-							break;
-						}
-
-						type = ACM_TOKEN_TYPE_DECIMAL;
-					}
-				}
-			}
-			else
-			{
-				type = get_token_type_for_symbol( symbol );
-			}
-		}
+	token->symbol  = symbol;
+	token->type    = isEnclosed ? ACM_TOKEN_TYPE_STRING : get_token_type_for_symbol( self, symbol, self->linePos );
+	token->path    = self->originPath;
+	token->lineNum = self->lineNum;
+	token->linePos = self->linePos;
 
-		if ( type != ACM_TOKEN_TYPE_INVALID )
-		{
-			AcmLexerToken *token = ACM_NEW( AcmLexerToken );
-			snprintf( token->path, sizeof( token->path ), "%s", file );//TODO: can be simplified!!!
-			token->symbol  = symbol;
-			token->lineNum = lineNum;
-			token->linePos = linePos;
-			token->type    = type;
-
-			if ( lexer->end != NULL )
-			{
-				lexer->end->next = token;
-				token->prev      = lexer->end;
-			}
+	// step over the closing quote, if there is one
+	step( self, i );
+	if ( isEnclosed && ensure_text( self, 1 ) && self->buf[ self->bufStart ] == '"' )
+	{
+		step( self, 1 );
+	}
 
-			lexer->end = token;
-			if ( lexer->start == NULL )
-			{
-				lexer->start = lexer->end;
-			}
-		}
-		else
-		{
-			Warning( "Unexpected character: %u:%u\n", lineNum, linePos );
-		}
+	if ( self->end != NULL )
+	{
+		self->end->next = token;
 	}
+	else
+	{
+		self->start = token;
+	}
+	self->end = token;
+
+	return true;
 }
 
-AcmLexer *acm_lexer_parse_buffer_( AcmLexer *self, const char *buf, const char *file )
+static void open_lexer( AcmLexer *self, const char *path )
 {
-	if ( self == NULL )
-	{
-		self = ACM_NEW( AcmLexer );
-		if ( self == NULL )
-		{
-			return NULL;
-		}
+	memset( self, 0, sizeof( AcmLexer ) );
+	snprintf( self->originPath, sizeof( self->originPath ), "%s", path != NULL ? path : "buffer" );
+	self->lineNum = 1;
+	self->linePos = 1;
+}
 
-		snprintf( self->originPath, sizeof( self->originPath ), "%s", file );
+void acm_lexer_open_buffer_( AcmLexer *self, const char *buf, size_t size, const char *path )
+{
+	open_lexer( self, path );
+	self->buf         = buf;
+	self->bufEnd      = strnlen( buf, size );
+	self->isExhausted = true;
+}
+
+bool acm_lexer_open_file_( AcmLexer *self, FILE *file, const char *path )
+{
+	open_lexer( self, path );
+	self->file   = file;
+	self->window = ACM_NEW_( char, LEXER_WINDOW_SIZE );
+	if ( self->window == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate text window (%u bytes)", LEXER_WINDOW_SIZE );
+		return false;
 	}
 
-#if defined( ACM_TEST )
-	double startTime = PlGetCurrentSeconds();
-#endif
+	self->buf     = self->window;
+	self->bufSize = LEXER_WINDOW_SIZE;
+	return true;
+}
 
-	unsigned int curLineNum = 0;
-	const char  *p          = buf;
-	while ( *p != '\0' )
+const AcmLexerToken *acm_lexer_peek_( AcmLexer *self, unsigned int ahead )
+{
+	AcmLexerToken *token = self->start;
+	for ( unsigned int i = 0;; ++i, token = token->next )
 	{
-		curLineNum++;
-
-		if ( *p == ';' )
+		if ( token == NULL )
 		{
-			if ( *( p + 1 ) == '*' )
+			if ( !read_token( self ) )
 			{
-				// multi-line comment
-				p += 2;
-				while ( *p != '*' && *( p + 1 ) != ';' )
-				{
-					int l = get_line_end( p );
-					if ( l != -1 )
-					{
-						p += l;
-						continue;
-					}
-
-					p++;
-				}
-				p += 2;
-				continue;
+				return NULL;
 			}
-
-			// single-line comment
-			skip_line( &p );
-			continue;
+			token = self->end;
 		}
 
-		// tokenise the line
-		unsigned int bufSize = get_line_length( p ) + 1;
-		if ( bufSize > 1 )
+		if ( i == ahead )
 		{
-			char *line = ACM_NEW_( char, bufSize );
-			read_line( &p, line, bufSize );
-
-			parse_line( line, file, curLineNum, self );
-
-			ACM_DELETE( line );
-		}
-		else
-		{
-			skip_line( &p );
+			return token;
 		}
 	}
+}
+
+void acm_lexer_advance_( AcmLexer *self )
+{
+	AcmLexerToken *token = self->start;
+	if ( token == NULL )
+	{
+		return;
+	}
 
-#if defined( ACM_TEST )
-	// output the result from the lexer
-	printf( "%5s %20s %10s %10s\n", "TYPE", "SYMBOL", "LINE", "LPOS" );
-	const AcmLexerToken *token;
-	PL_ITERATE_LINKED_LIST( token, AcmLexerToken, self->tokens, i )
+	self->start = token->next;
+	if ( self->start == NULL )
 	{
-		printf( "%5d %20s %10u %10u\n", token->type, token->symbol, token->lineNum, token->linePos );
+		self->end = NULL;
 	}
 
-	double endTime = PlGetCurrentSeconds();
-	printf( "Lexer took %lfs for \"%s\"\n", endTime - startTime, file );
-#endif
+	ACM_DELETE( token->symbol );
+	ACM_DELETE( token );
+}
+
+void acm_lexer_close_( AcmLexer *self )
+{
+	while ( self->start != NULL )
+	{
+		acm_lexer_advance_( self );
+	}
 
-	return self;
+	ACM_DELETE( self->window );
 }
@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+#include <inttypes.h>
+
+/* output is gathered into one large buffer and handed over when that fills,
+ * so serialising a tree costs a handful of writes rather than several per node.
+ * without a sink, the buffer just keeps growing and is handed over at the end */
+
+bool acm_output_open_( AcmOutput *self, AcmWriteCallback write, void *user )
+{
+	memset( self, 0, sizeof( AcmOutput ) );
+	self->write     = write;
+	self->user      = user;
+	self->maxLength = ACM_OUTPUT_BUFFER_SIZE;
+	self->buf       = ACM_NEW_( uint8_t, self->maxLength );
+	if ( self->buf == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate output buffer (%zu bytes)", self->maxLength );
+		self->failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+void acm_output_open_fixed_( AcmOutput *self, void *buf, size_t size )
+{
+	memset( self, 0, sizeof( AcmOutput ) );
+	self->buf       = buf;
+	self->maxLength = size;
+	self->isFixed   = true;
+}
+
+static void write_to_sink( AcmOutput *self, const void *buf, size_t size )
+{
+	if ( self->write( buf, size, self->user ) != size )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to write %zu bytes", size );
+		self->failed = true;
+	}
+}
+
+static bool grow_buffer( AcmOutput *self, size_t size )
+{
+	if ( self->isFixed )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "output buffer is too small (%zu bytes)", self->maxLength );
+		self->failed = true;
+		return false;
+	}
+
+	size_t maxLength = self->maxLength;
+	while ( maxLength - self->length < size )
+	{
+		maxLength *= 2;
+	}
+
+	uint8_t *buf = ACM_REALLOC( self->buf, uint8_t, maxLength );
+	if ( buf == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to grow output buffer (%zu bytes)", maxLength );
+		self->failed = true;
+		return false;
+	}
+
+	self->buf       = buf;
+	self->maxLength = maxLength;
+	return true;
+}
+
+void acm_output_write_( AcmOutput *self, const void *buf, size_t size )
+{
+	if ( self->failed || size == 0 )
+	{
+		return;
+	}
+
+	self->total += size;
+
+	if ( self->maxLength - self->length < size )
+	{
+		if ( self->write == NULL )
+		{
+			if ( !grow_buffer( self, size ) )
+			{
+				return;
+			}
+		}
+		else
+		{
+			acm_output_flush_( self );
+
+			// anything as big as the buffer may as well go straight through
+			if ( size >= self->maxLength )
+			{
+				if ( !self->failed )
+				{
+					write_to_sink( self, buf, size );
+				}
+				return;
+			}
+		}
+	}
+
+	memcpy( self->buf + self->length, buf, size );
+	self->length += size;
+}
+
+/**
+ * When everything's kept in memory and the size of what's to come is
+ * known ahead of time, the buffer only has to be allocated the once
+ * (with room for the terminator added on release), and it can be
+ * filled in without going through here. Fixed buffers fail straight
+ * away if there isn't enough room.
+ */
+void *acm_output_claim_( AcmOutput *self, uint64_t size )
+{
+	if ( self->write != NULL || self->failed )
+	{
+		return NULL;
+	}
+
+	if ( size > SIZE_MAX - self->length - 1 )
+	{
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "output is too large (%" PRIu64 " bytes)", size );
+		self->failed = true;
+		return NULL;
+	}
+
+	size_t maxLength = self->length + ( size_t ) size + ( self->isFixed ? 0 : 1 );
+	if ( maxLength > self->maxLength )
+	{
+		if ( self->isFixed )
+		{
+			acm_set_error_message_( ND_ERROR_IO_WRITE, "output buffer is too small (%zu < %zu bytes)", self->maxLength, maxLength );
+			self->failed = true;
+			return NULL;
+		}
+
+		uint8_t *buf = ACM_REALLOC( self->buf, uint8_t, maxLength );
+		if ( buf == NULL )
+		{
+			acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate output buffer (%zu bytes)", maxLength );
+			self->failed = true;
+			return NULL;
+		}
+
+		self->buf       = buf;
+		self->maxLength = maxLength;
+	}
+
+	uint8_t *dst = self->buf + self->length;
+	self->length += ( size_t ) size;
+	self->total += size;
+	return dst;
+}
+
+void acm_output_string_( AcmOutput *self, const char *string )
+{
+	acm_output_write_( self, string, strlen( string ) );
+}
+
+void acm_output_char_( AcmOutput *self, char c )
+{
+	if ( self->length < self->maxLength && !self->failed )
+	{
+		self->buf[ self->length++ ] = ( uint8_t ) c;
+		self->total++;
+		return;
+	}
+
+	acm_output_write_( self, &c, sizeof( char ) );
+}
+
+void acm_output_tabs_( AcmOutput *self, unsigned int depth )
+{
+	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	while ( depth > 0 )
+	{
+		unsigned int n = depth < sizeof( tabs ) - 1 ? depth : sizeof( tabs ) - 1;
+		acm_output_write_( self, tabs, n );
+		depth -= n;
+	}
+}
+
+bool acm_output_patch_( AcmOutput *self, uint64_t offset, const void *buf, size_t size )
+{
+	uint64_t start = self->total - self->length;
+	if ( offset < start || offset + size > self->total )
+	{
+		return false;
+	}
+
+	memcpy( self->buf + ( offset - start ), buf, size );
+	return true;
+}
+
+void acm_output_flush_( AcmOutput *self )
+{
+	if ( self->write == NULL || self->length == 0 || self->failed )
+	{
+		return;
+	}
+
+	write_to_sink( self, self->buf, self->length );
+	self->length = 0;
+}
+
+bool acm_output_close_( AcmOutput *self )
+{
+	acm_output_flush_( self );
+
+	if ( !self->isFixed )
+	{
+		ACM_DELETE( self->buf );
+	}
+	self->buf = NULL;
+
+	return !self->failed;
+}
+
+/**
+ * Hands over whatever was gathered without a sink, null-terminated
+ * (not included in the size), so it can be used as a string if it's text.
+ */
+void *acm_output_release_( AcmOutput *self, size_t *size )
+{
+	if ( self->failed || ( self->length == self->maxLength && !grow_buffer( self, 1 ) ) )
+	{
+		ACM_DELETE( self->buf );
+		self->buf = NULL;
+		return NULL;
+	}
+
+	self->buf[ self->length ] = '\0';
+
+	uint8_t *buf = self->buf;
+	if ( size != NULL )
+	{
+		*size = self->length;
+	}
+
+	self->buf = NULL;
+	return buf;
+}
@@ -4,6 +4,12 @@
 
 #include "acm_private.h"
 
+/* Reads text a token at a time, and either builds a tree from it or hands
+ * each node straight to a push writer. Anything that doesn't make sense is
+ * skipped with a warning either way, so the same text gives the same
+ * document whether it's loaded or transcoded.
+ */
+
 typedef struct VariableProcessor
 {
 	const char     *symbol;
@@ -31,114 +37,209 @@ static VariableProcessor variableProcessors[] = {
 };
 #define NUM_VARIABLE_TYPES ( sizeof( variableProcessors ) / sizeof( *( variableProcessors ) ) )
 
-static AcmBranch *parse_branch_variable( const char *name, const AcmLexerToken *typeToken, const AcmLexerToken *valueToken, AcmBranch *parent, const AcmLexerToken **currentToken )
+typedef struct AcmParser
+{
+	AcmLexer     lexer;
+	AcmWriter   *writer; /* if transcoding, in which case there are no branches */
+	unsigned int depth;
+	bool         hasRoot;
+	bool         hasFailed; /* out of memory, too deep or the writer failed, so there's no point going on */
+} AcmParser;
+
+static const VariableProcessor *find_variable_processor( const char *symbol )
 {
-	AcmBranch *branch = NULL;
-
 	for ( unsigned int i = 0; i < NUM_VARIABLE_TYPES; ++i )
 	{
-		if ( strcmp( typeToken->symbol, variableProcessors[ i ].symbol ) != 0 )
+		if ( strcmp( symbol, variableProcessors[ i ].symbol ) == 0 )
 		{
-			continue;
+			return &variableProcessors[ i ];
 		}
+	}
 
-		bool valid = false;
-		for ( unsigned int j = 0; j < variableProcessors[ i ].numTokenTypes; ++j )
-		{
-			valid = ( valueToken->type == variableProcessors[ i ].acceptedTokenTypes[ j ] );
-			if ( valid )
-			{
-				break;
-			}
-		}
+	return NULL;
+}
 
-		if ( !valid )
-		{
-			Warning( "Unexpected value type for %s (%s): %u:%u (%s)\n",
-			         typeToken->symbol,
-			         valueToken->symbol, valueToken->lineNum, valueToken->linePos, valueToken->path );
-			break;
-		}
+static const AcmLexerToken *peek_token( AcmParser *self, unsigned int ahead )
+{
+	const AcmLexerToken *token = acm_lexer_peek_( &self->lexer, ahead );
+	if ( self->lexer.hasFailed )
+	{
+		self->hasFailed = true;
+	}
+
+	return token;
+}
 
-		branch = acm_push_variable_( parent, name, valueToken->symbol, variableProcessors[ i ].propertyType );
-		break;
+static void next_token( AcmParser *self )
+{
+	acm_lexer_advance_( &self->lexer );
+}
+
+/******************************************/
+/** Output **/
+
+/* returns the new branch, which is always null when writing out */
+static AcmBranch *begin_container( AcmParser *self, AcmBranch *parent, const char *name, AcmPropertyType type, AcmPropertyType childType )
+{
+	// ended either way, so it's counted either way
+	if ( ++self->depth > ACM_BINARY_MAX_DEPTH )
+	{
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "nested too deeply (%s)", self->lexer.originPath );
+		self->hasFailed = true;
+		return NULL;
 	}
 
-	*currentToken = ( *currentToken )->next;
+	AcmBranch *branch = NULL;
+	if ( self->writer != NULL )
+	{
+		bool status     = type == ACM_PROPERTY_TYPE_OBJECT ? acm_writer_begin_object( self->writer, name ) : acm_writer_begin_array( self->writer, name, childType );
+		self->hasFailed = !status;
+	}
+	else
+	{
+		branch          = acm_push_new_branch( parent, name, type, childType );
+		self->hasFailed = branch == NULL;
+	}
+
+	self->hasRoot = self->hasRoot || !self->hasFailed;
 	return branch;
 }
 
-static AcmBranch *parse_branch( const AcmLexerToken *token, AcmBranch *parent, const AcmLexerToken **currentToken );
-static AcmBranch *parse_branch_object( const AcmLexerToken *token, AcmBranch *parent, const AcmLexerToken **currentToken )
+static AcmBranch *end_container( AcmParser *self, AcmBranch *branch, const AcmLexerToken *token )
 {
-	const AcmLexerToken *peekToken;
-	if ( parent == NULL || parent->type != ACM_PROPERTY_TYPE_ARRAY )
+	self->depth--;
+	if ( self->hasFailed )
 	{
-		if ( token->type != ACM_TOKEN_TYPE_IDENTIFIER )
-		{
-			Warning( "Unexpected token type for object: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
-			return NULL;
-		}
+		return branch;
+	}
 
-		peekToken = token->next;
+	if ( peek_token( self, 0 ) == NULL )
+	{
+		Warning( "No closing bracket following object: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
 	}
 	else
 	{
-		peekToken = token;
+		next_token( self );
 	}
 
-	if ( peekToken == NULL || peekToken->type != ACM_TOKEN_TYPE_OPEN_BRACKET )
+	if ( self->writer != NULL && !acm_writer_end( self->writer ) )
 	{
-		Warning( "No opening bracket following object: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
-		return NULL;
+		self->hasFailed = true;
 	}
 
-	AcmBranch *branch = acm_push_object( parent, token->symbol );
+	return branch;
+}
 
-	peekToken = peekToken->next;
-	while ( peekToken != NULL && peekToken->type != ACM_TOKEN_TYPE_CLOSE_BRACKET )
+/**
+ * Adds the value, unless it doesn't convert to the type. Elements of
+ * arrays have no name.
+ */
+static AcmBranch *push_value( AcmParser *self, AcmBranch *parent, const char *name, const VariableProcessor *processor, const AcmLexerToken *valueToken )
+{
+	AcmBranch *branch  = NULL;
+	bool       isValid = true;
+	if ( self->writer != NULL )
+	{
+		isValid = acm_is_valid_value_( processor->propertyType, valueToken->symbol );
+		if ( isValid && !acm_writer_write_value_( self->writer, name, processor->propertyType, valueToken->symbol ) )
+		{
+			self->hasFailed = true;
+		}
+	}
+	else if ( parent != NULL && acm_is_packed_array_( parent ) )
+	{
+		// scalar arrays don't get a branch per element
+		branch  = acm_push_packed_value_( parent, valueToken->symbol ) ? parent : NULL;
+		isValid = branch != NULL;
+	}
+	else
 	{
-		*currentToken = peekToken;
-		parse_branch( *currentToken, branch, currentToken );
-		peekToken = *currentToken;
+		branch  = acm_push_variable_( parent, name, valueToken->symbol, processor->propertyType );
+		isValid = branch != NULL;
 	}
 
-	if ( peekToken == NULL )
+	if ( !isValid )
 	{
-		Warning( "No closing bracket following object: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
+		Warning( "Invalid value for %s (%s): %u:%u (%s)\n",
+		         processor->symbol,
+		         valueToken->symbol, valueToken->lineNum, valueToken->linePos, valueToken->path );
 	}
 
-	*currentToken = ( *currentToken )->next;
+	self->hasRoot = self->hasRoot || isValid;
 	return branch;
 }
 
-static AcmBranch *parse_branch_array( const AcmLexerToken *token, AcmBranch *parent, const AcmLexerToken **currentToken )
+/******************************************/
+/** Grammar **/
+
+/* the caller moves on past the value, whether it's any good or not */
+static AcmBranch *parse_branch_variable( AcmParser *self, AcmBranch *parent, const char *name, const VariableProcessor *processor, const AcmLexerToken *valueToken )
 {
-	if ( token->type != ACM_TOKEN_TYPE_TYPENAME )
+	bool isValid = false;
+	for ( unsigned int j = 0; j < processor->numTokenTypes && !isValid; ++j )
 	{
-		Warning( "Expected typename to follow array (%s): %u:%u (%s)\n", token->symbol, token->lineNum, token->linePos, token->path );
-		return NULL;
+		isValid = ( valueToken->type == processor->acceptedTokenTypes[ j ] );
 	}
 
-	bool isObject = false;
-	if ( strcmp( token->symbol, "object" ) == 0 )
+	if ( !isValid )
 	{
-		isObject = true;
+		Warning( "Unexpected value type for %s (%s): %u:%u (%s)\n",
+		         processor->symbol,
+		         valueToken->symbol, valueToken->lineNum, valueToken->linePos, valueToken->path );
+		return NULL;
 	}
-	else if ( strcmp( token->symbol, "array" ) == 0 )
+
+	return push_value( self, parent, name, processor, valueToken );
+}
+
+static AcmBranch *parse_branch( AcmParser *self, AcmBranch *parent );
+
+/**
+ * Starts on the name, or on the opening bracket for elements of an array,
+ * which is skipped over if it isn't one so there's always some progress.
+ */
+static AcmBranch *parse_branch_object( AcmParser *self, AcmBranch *parent, bool isElement )
+{
+	const AcmLexerToken *token     = peek_token( self, 0 );
+	const AcmLexerToken *peekToken = isElement ? token : peek_token( self, 1 );
+	if ( peekToken == NULL || peekToken->type != ACM_TOKEN_TYPE_OPEN_BRACKET )
 	{
-		Warning( "Invalid typename following array (%s): %u:%u (%s)\n", token->symbol, token->lineNum, token->linePos, token->path );
+		Warning( "No opening bracket following object: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
+		if ( isElement )
+		{
+			next_token( self );
+		}
 		return NULL;
 	}
 
-	const AcmLexerToken *identifierToken = token->next;
+	AcmLexerToken start  = *peekToken;
+	AcmBranch    *branch = begin_container( self, parent, isElement ? NULL : token->symbol, ACM_PROPERTY_TYPE_OBJECT, ACM_PROPERTY_TYPE_INVALID );
+	if ( !isElement )
+	{
+		next_token( self );
+	}
+	next_token( self );
+
+	while ( !self->hasFailed && ( peekToken = peek_token( self, 0 ) ) != NULL && peekToken->type != ACM_TOKEN_TYPE_CLOSE_BRACKET )
+	{
+		parse_branch( self, branch );
+	}
+
+	return end_container( self, branch, &start );
+}
+
+/* starts on the element type, following "array" */
+static AcmBranch *parse_branch_array( AcmParser *self, AcmBranch *parent )
+{
+	const AcmLexerToken *token           = peek_token( self, 0 );
+	const AcmLexerToken *identifierToken = peek_token( self, 1 );
 	if ( identifierToken == NULL || identifierToken->type != ACM_TOKEN_TYPE_IDENTIFIER )
 	{
 		Warning( "Expected identifier to follow typename: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
 		return NULL;
 	}
 
-	const AcmLexerToken *peekToken = identifierToken->next;
+	const AcmLexerToken *peekToken = peek_token( self, 2 );
 	if ( peekToken == NULL || peekToken->type != ACM_TOKEN_TYPE_OPEN_BRACKET )
 	{
 		Warning( "No opening bracket following object: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
@@ -146,136 +247,152 @@ static AcmBranch *parse_branch_array( const AcmLexerToken *token, AcmBranch *par
 	}
 
 	// determine child property type
-	AcmPropertyType childType = ACM_PROPERTY_TYPE_INVALID;
-	if ( strcmp( token->symbol, "object" ) == 0 )
-	{
-		childType = ACM_PROPERTY_TYPE_OBJECT;
-	}
-	else
-	{
-		for ( unsigned int i = 0; i < NUM_VARIABLE_TYPES; ++i )
-		{
-			if ( strcmp( token->symbol, variableProcessors[ i ].symbol ) != 0 )
-			{
-				continue;
-			}
-
-			childType = variableProcessors[ i ].propertyType;
-			break;
-		}
-	}
-	if ( childType == ACM_PROPERTY_TYPE_INVALID )
+	bool                     isObject  = strcmp( token->symbol, "object" ) == 0;
+	const VariableProcessor *processor = isObject ? NULL : find_variable_processor( token->symbol );
+	if ( !isObject && processor == NULL )
 	{
 		Warning( "Unsupported typename following array (%s): %u:%u (%s)\n", token->symbol, token->lineNum, token->linePos, token->path );
 		return NULL;
 	}
 
-	AcmBranch *branch = acm_push_new_branch( parent, identifierToken->symbol, ACM_PROPERTY_TYPE_ARRAY, childType );
+	AcmLexerToken start  = *token;
+	AcmBranch    *branch = begin_container( self, parent, identifierToken->symbol, ACM_PROPERTY_TYPE_ARRAY, isObject ? ACM_PROPERTY_TYPE_OBJECT : processor->propertyType );
+	next_token( self );
+	next_token( self );
+	next_token( self );
 
-	peekToken = peekToken->next;
-	while ( peekToken != NULL && peekToken->type != ACM_TOKEN_TYPE_CLOSE_BRACKET )
+	while ( !self->hasFailed && ( peekToken = peek_token( self, 0 ) ) != NULL && peekToken->type != ACM_TOKEN_TYPE_CLOSE_BRACKET )
 	{
-		*currentToken = peekToken;
 		if ( isObject )
 		{
-			parse_branch_object( *currentToken, branch, currentToken );
+			parse_branch_object( self, branch, true );
 		}
 		else
 		{
-			parse_branch_variable( NULL, token, *currentToken, branch, currentToken );
+			parse_branch_variable( self, branch, NULL, processor, peekToken );
+			next_token( self );
 		}
-		peekToken = *currentToken;
-	}
-
-	if ( peekToken == NULL )
-	{
-		Warning( "No closing bracket following object: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
 	}
 
-	*currentToken = peekToken->next;
-	return branch;
+	return end_container( self, branch, &start );
 }
 
-static AcmBranch *parse_branch( const AcmLexerToken *token, AcmBranch *parent, const AcmLexerToken **currentToken )
+/* always uses up at least the first token */
+static AcmBranch *parse_branch( AcmParser *self, AcmBranch *parent )
 {
-	const AcmLexerToken *peekToken = token->next;
-
+	const AcmLexerToken *token     = peek_token( self, 0 );
+	const AcmLexerToken *peekToken = peek_token( self, 1 );
 	if ( token->type != ACM_TOKEN_TYPE_TYPENAME )
 	{
-		*currentToken = peekToken;
 		Warning( "Unexpected token type (%u): %u:%u (%s)\n", token->type, token->lineNum, token->linePos, token->path );
+		next_token( self );
 		return NULL;
 	}
-
-	if ( peekToken == NULL )
+	else if ( peekToken == NULL )
 	{
-		*currentToken = peekToken;
-		Warning( "Next token missing for branch: %u:%u (%s)\n", peekToken->lineNum, peekToken->linePos, peekToken->path );
+		Warning( "Next token missing for branch: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
+		next_token( self );
 		return NULL;
 	}
 
-	AcmBranch *branch = NULL;
-	if ( peekToken->type == ACM_TOKEN_TYPE_IDENTIFIER )
+	if ( peekToken->type == ACM_TOKEN_TYPE_IDENTIFIER && strcmp( token->symbol, "object" ) == 0 )
+	{
+		next_token( self );
+		return parse_branch_object( self, parent, false );
+	}
+	else if ( peekToken->type == ACM_TOKEN_TYPE_IDENTIFIER )
 	{
-		*currentToken = peekToken;
-		if ( strcmp( token->symbol, "object" ) == 0 )
+		// get the value too
+		const AcmLexerToken     *valueToken = peek_token( self, 2 );
+		const VariableProcessor *processor  = find_variable_processor( token->symbol );
+		AcmBranch               *branch     = NULL;
+		if ( valueToken == NULL )
 		{
-			branch = parse_branch_object( peekToken, parent, currentToken );
+			Warning( "Unexpected end of input for variable: %u:%u (%s)\n", peekToken->lineNum, peekToken->linePos, peekToken->path );
+		}
+		else if ( processor == NULL )
+		{
+			Warning( "Unexpected typename for variable (%s): %u:%u (%s)\n", token->symbol, token->lineNum, token->linePos, token->path );
 		}
 		else
 		{
-			// get the value too
-			const AcmLexerToken *nameToken = *currentToken;
-			*currentToken                  = ( *currentToken )->next;
-			if ( *currentToken == NULL )
-			{
-				Warning( "Unexpected end of input for variable: %u:%u (%s)\n", nameToken->lineNum, nameToken->linePos, nameToken->path );
-				return NULL;
-			}
-
-			branch = parse_branch_variable( nameToken->symbol, token, *currentToken, parent, currentToken );
+			branch = parse_branch_variable( self, parent, peekToken->symbol, processor, valueToken );
 		}
+
+		next_token( self );
+		next_token( self );
+		next_token( self );
+		return branch;
 	}
 	else if ( peekToken->type == ACM_TOKEN_TYPE_TYPENAME && strcmp( peekToken->symbol, "array" ) != 0 )
 	{
-		*currentToken = peekToken;
-		branch        = parse_branch_array( peekToken, parent, currentToken );
-	}
-	else
-	{
-		*currentToken = peekToken;
-		Warning( "Unexpected token (%s): %u:%u (%s)\n", token->symbol, token->lineNum, token->linePos, token->path );
+		next_token( self );
+		return parse_branch_array( self, parent );
 	}
 
-	return branch;
+	Warning( "Unexpected token (%s): %u:%u (%s)\n", token->symbol, token->lineNum, token->linePos, token->path );
+	next_token( self );
+	return NULL;
 }
 
-AcmBranch *acm_parse_buffer( const char *buf, const char *file )
+/**
+ * Everything after the root is ignored. Fails if there's no root that
+ * could be read, or the parser ran out of memory or its writer failed.
+ */
+static AcmBranch *parse_root( AcmParser *self )
 {
-	AcmBranch *root  = NULL;
-	AcmLexer  *lexer = acm_lexer_parse_buffer_( NULL, buf, file );
-	if ( lexer == NULL )
+	const AcmLexerToken *token = peek_token( self, 0 );
+	AcmBranch           *root  = token != NULL ? parse_branch( self, NULL ) : NULL;
+	if ( !self->hasFailed && ( token = peek_token( self, 0 ) ) != NULL )
 	{
-		return NULL;
+		Warning( "Ignoring everything after the root: %u:%u (%s)\n", token->lineNum, token->linePos, token->path );
 	}
 
-	AcmLexerToken *token = lexer->start;
-	if ( token != NULL )
+	if ( self->hasFailed )
 	{
-		root = parse_branch( token, NULL, ( const AcmLexerToken ** ) &token );
-
-		// delete all the tokens
-		token = lexer->start;
-		while ( token != NULL )
-		{
-			AcmLexerToken *nextToken = token->next;
-			ACM_DELETE( token->symbol );
-			ACM_DELETE( token );
-			token = nextToken;
-		}
+		acm_branch_destroy( root );
+		return NULL;
+	}
+	else if ( !self->hasRoot )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "no valid root found in text (%s)", self->lexer.originPath );
+		self->hasFailed = true;
 	}
 
-	ACM_DELETE( lexer );
+	return root;
+}
+
+AcmBranch *acm_parse_buffer_( const char *buf, size_t size, const char *path )
+{
+	AcmParser parser;
+	memset( &parser, 0, sizeof( AcmParser ) );
+	acm_lexer_open_buffer_( &parser.lexer, buf, size, path );
+
+	AcmBranch *root = parse_root( &parser );
+
+	acm_lexer_close_( &parser.lexer );
 
 	return root;
 }
+
+AcmBranch *acm_parse_buffer( const char *buf, const char *file )
+{
+	return acm_parse_buffer_( buf, SIZE_MAX, file );
+}
+
+bool acm_parse_file_to_writer_( FILE *file, const char *path, AcmWriter *writer )
+{
+	AcmParser parser;
+	memset( &parser, 0, sizeof( AcmParser ) );
+	parser.writer = writer;
+	if ( !acm_lexer_open_file_( &parser.lexer, file, path ) )
+	{
+		return false;
+	}
+
+	parse_root( &parser );
+
+	acm_lexer_close_( &parser.lexer );
+
+	return !parser.hasFailed;
+}
@@ -19,39 +19,164 @@
 #	define PATH_MAX 256
 #endif
 
-/* node structure
+/* for files beyond 2GB, where long is only 32-bit */
+#if defined( _WIN32 )
+#	define acm_fseek64( FILE, OFFSET, ORIGIN ) _fseeki64( FILE, ( __int64 ) ( OFFSET ), ORIGIN )
+#	define acm_ftell64( FILE )                 _ftelli64( FILE )
+#else
+#	define acm_fseek64( FILE, OFFSET, ORIGIN ) fseeko( FILE, ( off_t ) ( OFFSET ), ORIGIN )
+#	define acm_ftell64( FILE )                 ftello( FILE )
+#endif
+
+/* binary node structure
+ *  header
+ *      "node.binx\n"
+ *      uint32_t version
+ *      uint32_t flags (v3 onwards)
+ *
  *  string
- *      uint32_t length
+ *      uint16_t length (including null terminator, 0 if empty)
  *      char buffer[ length ]
  *
+ *  with ACM_BINARY_FLAG_VARINTS set, string lengths, numChildren and
+ *  payloadSize are written as unsigned LEB128 rather than at a fixed size,
+ *  and element blocks carry no alignment padding
+ *
+ *  string table (header flags & ACM_BINARY_FLAG_STRING_TABLE)
+ *      uint32_t numStrings
+ *      uint64_t tableSize
+ *      string strings[ numStrings ]
+ *
+ *  with a string table, names are written as a uint32_t reference (index + 1,
+ *  0 for no name), and string values as a reference, followed by the string
+ *  inline if the reference is 0
+ *
  *  string name
- *  uint8_t type
- *  if type == float: float var
- *  if type == integer: uint32_t var
+ *  int8_t type
+ *  if type == array: int8_t childType
  *  if type == string: string var
- *  if type == boolean: uint8_t var
- *  if type == object:
+ *  if type == scalar: native value
+ *  if type == object/array:
  *      uint32_t numChildren
- *      for numChildren
+ *      v3 onwards
+ *          uint8_t containerFlags
+ *          uint64_t payloadSize (size of the children and child table)
+ *      if containerFlags & ACM_BINARY_CONTAINER_PACKED
+ *          uint8_t padding
+ *          uint8_t zero[ padding ] (aligns the block to the size of childType)
+ *          childType values[ numChildren ]
+ *      else if containerFlags & ACM_BINARY_CONTAINER_BITPACKED (integer arrays only)
+ *          uint8_t mode (ACM_BINARY_BITPACK_FOR or ACM_BINARY_BITPACK_DELTA)
+ *          uint8_t bitWidth
+ *          uint64_t first (first element, used by delta)
+ *          uint64_t reference (added to each unpacked value)
+ *          uint8_t bits[ ( count * bitWidth + 7 ) / 8 ] (LSB first, count is numChildren - 1 for delta)
+ *      else if containerFlags & ACM_BINARY_CONTAINER_QUANTIZED (float32/float64 arrays only)
+ *          uint8_t encoding (ACM_BINARY_QUANTIZE_HALF, ACM_BINARY_QUANTIZE_FIXED_8 or ACM_BINARY_QUANTIZE_FIXED_16)
+ *          double minValue (fixed point maps 0 onto this)
+ *          double maxValue (and the largest step onto this)
+ *          uint8_t/uint16_t values[ numChildren ] (unaligned)
+ *      else if containerFlags & ACM_BINARY_CONTAINER_TABLE (arrays of unnamed objects with the same fields)
+ *          uint32_t numFields
+ *          for numFields
+ *              string name
+ *              int8_t type (scalar or string)
+ *          for numChildren
+ *              for numFields
+ *                  scalar: native value, string: string var
+ *      else for numChildren
  *          read node
+ *      if containerFlags & ACM_BINARY_CONTAINER_CHILD_TABLE
+ *          for numChildren (objects sorted by name hash, arrays in order)
+ *              uint32_t nameHash
+ *              uint64_t offset (relative to the first child)
+ *
+ *  compressed (header flags & ACM_BINARY_FLAG_COMPRESSED)
+ *      uint32_t blockSize
+ *      uint32_t numBlocks
+ *      uint64_t rawSize
+ *      blocks, which decompress to a complete uncompressed file (header and all)
+ *      for numBlocks
+ *          uint64_t offset (from the start of the file)
+ *          uint32_t size (stored as is if it matches the uncompressed size)
  *
  */
 
+#define ACM_FORMAT_UTF8_HEADER     "node.utf8"
+#define ACM_FORMAT_BINARY_HEADER   "node.bin\n" // original format w/ no versioning support (defaults to 1)
+#define ACM_FORMAT_BINARY_HEADER_2 "node.binx\n"// new format w/ versioning support
+#define ACM_FORMAT_BINARY_VERSION  3
+
+#define ACM_BINARY_FLAG_VARINTS      ( 1U << 0 ) /* lengths and counts are stored as LEB128 */
+#define ACM_BINARY_FLAG_COMPRESSED   ( 1U << 1 ) /* everything after the header is in compressed blocks */
+#define ACM_BINARY_FLAG_STRING_TABLE ( 1U << 2 ) /* names (and repeated string values) are shared via a table */
+#define ACM_BINARY_FLAG_TABLES       ( 1U << 3 ) /* arrays of objects may be written as tables */
+#define ACM_BINARY_FLAG_QUANTIZED    ( 1U << 4 ) /* float arrays may be stored at reduced precision */
+#define ACM_BINARY_FLAGS_SUPPORTED   ( ACM_BINARY_FLAG_VARINTS | ACM_BINARY_FLAG_COMPRESSED | ACM_BINARY_FLAG_STRING_TABLE | ACM_BINARY_FLAG_TABLES | ACM_BINARY_FLAG_QUANTIZED ) /* header flags this build understands */
+
+#define ACM_BINARY_BLOCK_SIZE  65536 /* uncompressed size of each block */
+#define ACM_BINARY_BLOCK_ENTRY 12    /* uint64_t offset + uint32_t size */
+
+#define ACM_BINARY_CONTAINER_CHILD_TABLE ( 1U << 0 )
+#define ACM_BINARY_CONTAINER_PACKED      ( 1U << 1 ) /* scalar array elements stored as one aligned block */
+#define ACM_BINARY_CONTAINER_BITPACKED   ( 1U << 2 ) /* integer array elements stored as bit-packed offsets */
+#define ACM_BINARY_CONTAINER_TABLE       ( 1U << 3 ) /* objects sharing the same fields stored as a schema and rows */
+#define ACM_BINARY_CONTAINER_QUANTIZED   ( 1U << 4 ) /* float array elements stored at reduced precision */
+#define ACM_BINARY_CHILD_TABLE_MIN       8  /* containers with fewer children are just scanned */
+#define ACM_BINARY_CHILD_TABLE_ENTRY     12 /* uint32_t hash + uint64_t offset */
+#define ACM_BINARY_TABLE_MIN             4  /* fewer rows than this aren't worth a schema */
+
+#define ACM_BINARY_BITPACK_FOR    0  /* offsets from the smallest value */
+#define ACM_BINARY_BITPACK_DELTA  1  /* offsets from the smallest difference between neighbours */
+#define ACM_BINARY_BITPACK_HEADER 18 /* mode, bitWidth, first and reference */
+#define ACM_BINARY_BITPACK_MIN    8  /* smaller arrays aren't worth it */
+
+#define ACM_BINARY_QUANTIZE_HALF     0  /* IEEE half precision */
+#define ACM_BINARY_QUANTIZE_FIXED_8  1  /* 255 steps from the smallest value to the largest */
+#define ACM_BINARY_QUANTIZE_FIXED_16 2  /* 65535 steps from the smallest value to the largest */
+#define ACM_BINARY_QUANTIZE_HEADER   17 /* encoding, minValue and maxValue */
+#define ACM_BINARY_QUANTIZE_MIN      8  /* smaller arrays are kept at full precision */
+
+#define ACM_BINARY_MAX_DEPTH    256         /* deepest nesting of objects/arrays we'll decode */
+#define ACM_BINARY_MAX_ELEMENTS ( 1U << 24 ) /* largest bit-packed array of 0 bit width, as it takes up no space */
+
 #define Message( FORMAT, ... ) printf( FORMAT, ##__VA_ARGS__ )
 #define Warning( FORMAT, ... ) printf( "WARNING: " FORMAT, ##__VA_ARGS__ )
 
 typedef struct AcmString
 {
 	char    *buf;
-	uint16_t bufSize;// including null-terminator
+	uint16_t bufSize;   // including null-terminator
+	bool     isBorrowed;// points into a mapped file, so isn't ours to free
 } AcmString;
 
+/* file mapped into memory, kept around for as long as the document that's using it */
+typedef struct AcmMapping
+{
+	void  *base;
+	size_t size;
+} AcmMapping;
+
+/* native storage used by arrays of scalar types, rather than a branch per element */
+typedef struct AcmArrayBuffer
+{
+	void        *buf;
+	unsigned int numElements;
+	unsigned int maxElements;
+	bool         hasMirror;  /* element branches have been created for iteration */
+	bool         isBorrowed; /* points into a mapped file, copied before any changes */
+} AcmArrayBuffer;
+
 typedef struct AcmBranch
 {
 	AcmString       name;
 	AcmPropertyType type;
 	AcmPropertyType childType; /* used for array types */
 	AcmString       data;
+	AcmArrayBuffer  packed; /* used for arrays of scalar types */
+
+	struct AcmArrayIndex *indexes; /* used for arrays of objects */
+	AcmMapping           *mapping; /* only set on the root of mapped documents */
 
 	AcmBranch *parent;
 	AcmBranch *prev;
@@ -63,12 +188,135 @@ typedef struct AcmBranch
 		AcmBranch *end;
 	} children;
 	unsigned int numChildren;
+
+	bool         isDirty;          /* changed since it was last committed to a journal */
+	bool         isInserted;       /* dirty because it was inserted among its siblings, rather than changed */
+	unsigned int numDirtyChildren; /* children that are dirty, or have something dirty further down */
+
+	bool     hasHash; /* hash is valid, which means it's valid for everything further down too */
+	uint64_t hash;    /* of the whole branch, for diffs */
 } AcmBranch;
 
 char      *acm_preprocess_script_( char *buf, size_t *length, bool isHead );
 AcmBranch *acm_push_new_branch( AcmBranch *parent, const char *name, AcmPropertyType propertyType, AcmPropertyType childType );
 
 AcmBranch *acm_push_variable_( AcmBranch *parent, const char *name, const char *value, AcmPropertyType type );
+void       acm_mark_branch_dirty_( AcmBranch *self );
+void       acm_replace_branch_( AcmBranch *self, AcmBranch *src ); /* takes over everything from src but its place in the tree, then destroys it */
+bool       acm_insert_branch_( AcmBranch *parent, AcmBranch *before, AcmBranch *self ); /* on the end if before is null */
+AcmBranch *acm_get_child_at_( AcmBranch *self, unsigned int index );
+
+#define ACM_HASH_BASIS 14695981039346656037ULL /* to start acm_hash_bytes_ from */
+
+uint32_t    acm_hash_string_( const char *string );                          /* FNV-1a */
+uint64_t    acm_hash_bytes_( uint64_t hash, const void *buf, size_t size ); /* 64-bit FNV-1a, carrying on from hash */
+const char *acm_string_for_property_type_( AcmPropertyType propertyType );
+void        acm_set_error_message_( AcmErrorCode type, const char *msg, ... );
+void        acm_set_error_offset_( uint64_t offset ); /* where in the file the last error was found */
+AcmString  *acm_alloc_var_string_( const char *string, AcmString *dst );
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Output
+
+#define ACM_OUTPUT_BUFFER_SIZE 65536 /* gathered before each write to the sink */
+
+typedef struct AcmOutput
+{
+	AcmWriteCallback write; /* null to keep everything in memory */
+	void            *user;
+	uint8_t         *buf;
+	size_t           length;
+	size_t           maxLength;
+	uint64_t         total; /* number of bytes written so far */
+	bool             isFixed; /* writing into someone else's buffer, which can't grow */
+	bool             failed;
+} AcmOutput;
+
+bool  acm_output_open_( AcmOutput *self, AcmWriteCallback write, void *user );
+void  acm_output_open_fixed_( AcmOutput *self, void *buf, size_t size );
+void *acm_output_claim_( AcmOutput *self, uint64_t size ); /* room to be filled in directly, if there's no sink */
+void  acm_output_write_( AcmOutput *self, const void *buf, size_t size );
+void  acm_output_string_( AcmOutput *self, const char *string );
+void  acm_output_char_( AcmOutput *self, char c );
+void  acm_output_tabs_( AcmOutput *self, unsigned int depth );
+void  acm_output_flush_( AcmOutput *self );
+bool  acm_output_patch_( AcmOutput *self, uint64_t offset, const void *buf, size_t size ); /* false if it's already gone to the sink */
+bool  acm_output_close_( AcmOutput *self ); /* flushes and frees the buffer, unless it's fixed */
+void *acm_output_release_( AcmOutput *self, size_t *size ); /* hands over the buffer, if there's no sink */
+
+void acm_serialize_string_var_( const char *string, AcmOutput *output ); /* quoted if it's empty or has spaces */
+
+bool acm_writer_write_value_( AcmWriter *self, const char *name, AcmPropertyType type, const char *value ); /* value as it's written in text */
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Threads
+
+typedef bool ( *AcmJobFunction )( void *user, unsigned int index );
+
+unsigned int acm_get_num_threads_( void ); /* see acm_set_max_threads */
+bool         acm_run_jobs_( unsigned int numJobs, AcmJobFunction run, AcmJobFunction consume, void *user );
+
+typedef struct AcmTask AcmTask;
+
+AcmTask *acm_start_task_( AcmJobFunction run, void *user ); /* runs run( user, 0 ) on its own thread */
+bool     acm_is_task_done_( AcmTask *self );
+bool     acm_finish_task_( AcmTask *self ); /* waits for it, and returns whatever run did */
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Binary Format
+
+/* entry in the index of a compressed file */
+typedef struct AcmBinaryBlockEntry
+{
+	uint64_t offset;
+	uint32_t size;
+} AcmBinaryBlockEntry;
+
+AcmFileType acm_parse_file_type_( const void *buf, size_t bufSize, uint32_t *version, uint32_t *flags, unsigned int *headerSize );
+AcmBranch  *acm_deserialize_binary_( const void *buf, size_t bufSize, unsigned int headerSize, uint32_t version, uint32_t flags );
+bool        acm_serialize_binary_( AcmOutput *output, AcmBranch *root, unsigned int flags );
+void        acm_release_mapping_( AcmMapping *mapping );
+void       *acm_decompress_binary_( const void *buf, size_t bufSize, unsigned int headerSize, size_t *rawSize );
+
+/* how the elements of a quantized float array map back onto their values */
+typedef struct AcmQuantization
+{
+	uint8_t encoding;
+	double  minValue;
+	double  maxValue;
+} AcmQuantization;
+
+size_t acm_get_quantized_size_( uint8_t encoding ); /* bytes per element */
+void   acm_dequantize_( const AcmQuantization *quantization, AcmPropertyType type, const uint8_t *src, void *dst, unsigned int count );
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Compression
+
+size_t acm_compress_bound_( size_t srcSize );
+size_t acm_compress_block_( const void *src, size_t srcSize, void *dst, size_t dstCapacity ); /* 0 if it doesn't fit */
+bool   acm_decompress_block_( const void *src, size_t srcSize, void *dst, size_t dstSize );
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Array Indexes
+
+void acm_index_detach_( AcmBranch *array );
+void acm_index_branch_added_( AcmBranch *self );
+void acm_index_branch_removed_( AcmBranch *self );
+void acm_index_value_changing_( AcmBranch *self );
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Packed Arrays
+
+size_t   acm_get_type_size_( AcmPropertyType type ); /* native size of scalar types, 0 otherwise */
+bool     acm_is_packed_array_( const AcmBranch *self );
+bool     acm_parse_value_( AcmPropertyType type, const char *string, void *dst ); /* string to native scalar */
+bool     acm_is_valid_value_( AcmPropertyType type, const char *value );         /* converts, or fits, if a string */
+void     acm_format_value_( AcmPropertyType type, const void *src, char *dst, size_t size );
+bool     acm_push_packed_value_( AcmBranch *self, const char *value );
+bool     acm_push_packed_values_( AcmBranch *self, const void *values, unsigned int numValues );
+bool     acm_reserve_packed_values_( AcmBranch *self, unsigned int numValues );
+float    acm_half_to_float_( uint16_t h );
+uint16_t acm_float_to_half_( float f );
 
 /////////////////////////////////////////////////////////////////////////////////////
 // Lexer
@@ -96,19 +344,41 @@ typedef struct AcmLexerToken
 {
 	char        *symbol;
 	AcmTokenType type;
-	char         path[ PATH_MAX ];
+	const char  *path; /* the lexer's originPath */
 	unsigned int lineNum;
 	unsigned int linePos;
 
-	struct AcmLexerToken *prev;
 	struct AcmLexerToken *next;
 } AcmLexerToken;
 
 typedef struct AcmLexer
 {
-	char           originPath[ PATH_MAX ];
-	AcmLexerToken *start;
+	char originPath[ PATH_MAX ];
+
+	FILE       *file;   /* if reading from a file, through the window */
+	char       *window; /* owned, unlike a buffer */
+	const char *buf;
+	size_t      bufSize;
+	size_t      bufStart; /* unread text sits between bufStart and bufEnd */
+	size_t      bufEnd;
+	bool        isExhausted;
+	bool        hasFailed; /* couldn't read or allocate, rather than the text simply ending */
+
+	unsigned int lineNum;
+	unsigned int linePos;
+
+	AcmLexerToken *start; /* the current token, followed by any looked ahead at */
 	AcmLexerToken *end;
 } AcmLexer;
 
-AcmLexer *acm_lexer_parse_buffer_( AcmLexer *self, const char *buf, const char *file );
+void                 acm_lexer_open_buffer_( AcmLexer *self, const char *buf, size_t size, const char *path ); /* up to size or a null, whichever's first */
+bool                 acm_lexer_open_file_( AcmLexer *self, FILE *file, const char *path );
+const AcmLexerToken *acm_lexer_peek_( AcmLexer *self, unsigned int ahead ); /* 0 for the current token, null once the text ends */
+void                 acm_lexer_advance_( AcmLexer *self );                   /* drops the current token */
+void                 acm_lexer_close_( AcmLexer *self );
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Parser
+
+AcmBranch *acm_parse_buffer_( const char *buf, size_t size, const char *path );
+bool       acm_parse_file_to_writer_( FILE *file, const char *path, AcmWriter *writer ); /* from the current position, with no tree in between */
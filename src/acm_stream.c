@@ -0,0 +1,1291 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+
+#if defined( _WIN32 )
+#	include <io.h>
+#	define acm_read_fd( FD, BUF, SIZE )      _read( FD, BUF, ( unsigned int ) ( SIZE ) )
+#	define acm_seek_fd( FD, OFFSET, ORIGIN ) _lseeki64( FD, ( __int64 ) ( OFFSET ), ORIGIN )
+#else
+#	include <unistd.h>
+#	define acm_read_fd( FD, BUF, SIZE )      read( FD, BUF, SIZE )
+#	define acm_seek_fd( FD, OFFSET, ORIGIN ) lseek( FD, ( off_t ) ( OFFSET ), ORIGIN )
+#endif
+
+/* Pull reader for binary files, which only ever holds a window of the
+ * file in memory, along with the string table (if any) and the schema
+ * of the table being read (if any). Compressed files are decompressed
+ * a block at a time, but need to be seekable to get at the block index.
+ */
+
+#define STREAM_BUFFER_SIZE ( ACM_BINARY_BLOCK_SIZE * 2 ) /* has to fit the longest string */
+#define STREAM_HEADER_SIZE 18                            /* longest header, "node.binx\n" + version + flags */
+
+typedef enum AcmBinReaderFrameType
+{
+	ACM_BINREADER_FRAME_NODES,     /* children are nodes */
+	ACM_BINREADER_FRAME_ELEMENTS,  /* scalar array, each element written as a node */
+	ACM_BINREADER_FRAME_PACKED,    /* scalar array, written as a block */
+	ACM_BINREADER_FRAME_BITPACKED, /* integer array, bit-packed */
+	ACM_BINREADER_FRAME_QUANTIZED, /* float array, at reduced precision */
+	ACM_BINREADER_FRAME_TABLE,     /* array of objects, written as rows */
+	ACM_BINREADER_FRAME_ROW,       /* row of a table */
+} AcmBinReaderFrameType;
+
+typedef struct AcmBinReaderFrame
+{
+	AcmBinReaderFrameType type;
+	AcmPropertyType       nodeType; /* object or array */
+	AcmPropertyType       childType;
+	uint32_t              numPending; /* children still to come */
+	uint64_t              end;        /* end of the payload, UINT64_MAX prior to v3 */
+} AcmBinReaderFrame;
+
+struct AcmBinReader
+{
+	FILE *file;
+	int   fd;
+
+	/* unread data sits between bufStart and bufEnd */
+	uint8_t *buf;
+	size_t   bufStart;
+	size_t   bufEnd;
+	uint64_t offset;       /* of buf[ bufStart ], within the (decompressed) file */
+	bool     isExhausted;  /* nothing more to come from the source */
+
+	/* compressed files */
+	AcmBinaryBlockEntry *blocks;
+	uint32_t             numBlocks;
+	uint32_t             blockSize;
+	uint64_t             rawSize;
+	uint32_t             nextBlock;
+	uint8_t             *block;
+	size_t               blockPos;
+	size_t               blockLength;
+	uint8_t             *scratch;
+
+	uint32_t   version;
+	uint32_t   flags;
+	uint8_t   *stringData;
+	AcmString *strings;
+	uint32_t   numStrings;
+
+	/* schema of the table being read */
+	AcmString       *fieldNames;
+	AcmPropertyType *fieldTypes;
+	uint32_t         numFields;
+
+	/* state of the bit-packed array being read */
+	uint8_t  packMode;
+	uint8_t  packWidth;
+	uint64_t packReference;
+	uint64_t packPrevious;
+	uint64_t packBits;
+	uint8_t  packNumBits;
+	bool     packHasFirst; /* the first element of a delta array is stored as is */
+
+	/* quantized array being read */
+	AcmQuantization quantization;
+
+	AcmBinReaderFrame frames[ ACM_BINARY_MAX_DEPTH ];
+	unsigned int      depth;
+	bool              hasStarted;
+	bool              hasFailed;
+
+	/* the current event */
+	const char     *name;
+	AcmPropertyType type;
+	AcmPropertyType childType;
+	uint32_t        numChildren;
+	const char     *value;
+	uint16_t        valueSize;
+	char            nameBuf[ UINT16_MAX + 1 ];
+	char            valueBuf[ UINT16_MAX + 1 ];
+};
+
+static void set_stream_error( AcmBinReader *self, AcmErrorCode type, const char *msg, ... )
+{
+	char    str[ 256 ];
+	va_list args;
+	va_start( args, msg );
+	vsnprintf( str, sizeof( str ), msg, args );
+	va_end( args );
+
+	acm_set_error_message_( type, "%s (offset %" PRIu64 ")", str, self->offset );
+	acm_set_error_offset_( self->offset );
+	self->hasFailed = true;
+}
+
+/******************************************/
+/** Source **/
+
+static size_t read_source( AcmBinReader *self, void *dst, size_t size )
+{
+	if ( self->file != NULL )
+	{
+		return fread( dst, 1, size, self->file );
+	}
+
+	size_t total = 0;
+	while ( total < size )
+	{
+		long r = ( long ) acm_read_fd( self->fd, ( uint8_t * ) dst + total, size - total );
+		if ( r < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		else if ( r <= 0 )
+		{
+			break;
+		}
+
+		total += ( size_t ) r;
+	}
+
+	return total;
+}
+
+static bool seek_source( AcmBinReader *self, uint64_t offset, int origin )
+{
+	if ( self->file != NULL )
+	{
+		return acm_fseek64( self->file, ( int64_t ) offset, origin ) == 0;
+	}
+
+	return acm_seek_fd( self->fd, ( int64_t ) offset, origin ) >= 0;
+}
+
+static int64_t tell_source( AcmBinReader *self )
+{
+	if ( self->file != NULL )
+	{
+		return acm_ftell64( self->file );
+	}
+
+	return acm_seek_fd( self->fd, 0, SEEK_CUR );
+}
+
+static size_t get_block_length( const AcmBinReader *self, uint32_t index )
+{
+	uint64_t start = ( uint64_t ) index * self->blockSize;
+	return ( size_t ) ( ( self->rawSize - start ) < self->blockSize ? ( self->rawSize - start ) : self->blockSize );
+}
+
+static bool next_block( AcmBinReader *self )
+{
+	const AcmBinaryBlockEntry *entry  = &self->blocks[ self->nextBlock ];
+	size_t                     length = get_block_length( self, self->nextBlock );
+
+	// stored blocks are read as they are
+	uint8_t *dst = ( entry->size == length ) ? self->block : self->scratch;
+	if ( !seek_source( self, entry->offset, SEEK_SET ) || read_source( self, dst, entry->size ) != entry->size )
+	{
+		set_stream_error( self, ND_ERROR_IO_READ, "failed to read compressed block (%u)", self->nextBlock );
+		return false;
+	}
+	else if ( dst == self->scratch && !acm_decompress_block_( self->scratch, entry->size, self->block, length ) )
+	{
+		self->hasFailed = true;
+		return false;
+	}
+
+	self->nextBlock++;
+	self->blockPos    = 0;
+	self->blockLength = length;
+	return true;
+}
+
+/* tops up the window from the source, after moving what's left to the front */
+static bool refill( AcmBinReader *self )
+{
+	size_t remaining = self->bufEnd - self->bufStart;
+	memmove( self->buf, self->buf + self->bufStart, remaining );
+	self->bufStart = 0;
+	self->bufEnd   = remaining;
+
+	if ( self->blocks == NULL )
+	{
+		size_t n = read_source( self, self->buf + self->bufEnd, STREAM_BUFFER_SIZE - self->bufEnd );
+		self->bufEnd += n;
+		self->isExhausted = ( n == 0 );
+		return true;
+	}
+
+	while ( self->bufEnd < STREAM_BUFFER_SIZE )
+	{
+		if ( self->blockPos == self->blockLength )
+		{
+			if ( self->nextBlock == self->numBlocks )
+			{
+				self->isExhausted = true;
+				break;
+			}
+			else if ( !next_block( self ) )
+			{
+				return false;
+			}
+		}
+
+		size_t n = self->blockLength - self->blockPos;
+		if ( n > STREAM_BUFFER_SIZE - self->bufEnd )
+		{
+			n = STREAM_BUFFER_SIZE - self->bufEnd;
+		}
+
+		memcpy( self->buf + self->bufEnd, self->block + self->blockPos, n );
+		self->blockPos += n;
+		self->bufEnd += n;
+	}
+
+	return true;
+}
+
+/* makes sure there's at least size bytes in the window, returns false at the end of the data */
+static bool ensure( AcmBinReader *self, size_t size )
+{
+	while ( self->bufEnd - self->bufStart < size )
+	{
+		if ( self->isExhausted || !refill( self ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static const uint8_t *take( AcmBinReader *self, size_t size, const char *what )
+{
+	if ( !ensure( self, size ) )
+	{
+		if ( !self->hasFailed )
+		{
+			set_stream_error( self, ND_ERROR_IO_READ, "unexpected end of data reading %s", what );
+		}
+		return NULL;
+	}
+
+	const uint8_t *p = self->buf + self->bufStart;
+	self->bufStart += size;
+	self->offset += size;
+	return p;
+}
+
+static bool skip( AcmBinReader *self, uint64_t size )
+{
+	while ( size > 0 )
+	{
+		size_t n = ( size < ACM_BINARY_BLOCK_SIZE ) ? ( size_t ) size : ACM_BINARY_BLOCK_SIZE;
+		if ( take( self, n, "payload" ) == NULL )
+		{
+			return false;
+		}
+
+		size -= n;
+	}
+
+	return true;
+}
+
+static bool read_count( AcmBinReader *self, size_t fixedSize, uint64_t *value, const char *what )
+{
+	*value = 0;
+	if ( !( self->flags & ACM_BINARY_FLAG_VARINTS ) )
+	{
+		const uint8_t *p = take( self, fixedSize, what );
+		if ( p == NULL )
+		{
+			return false;
+		}
+
+		memcpy( value, p, fixedSize );
+		return true;
+	}
+
+	for ( unsigned int shift = 0; shift < 64; shift += 7 )
+	{
+		const uint8_t *byte = take( self, sizeof( uint8_t ), what );
+		if ( byte == NULL )
+		{
+			return false;
+		}
+
+		*value |= ( uint64_t ) ( *byte & 0x7F ) << shift;
+		if ( !( *byte & 0x80 ) )
+		{
+			return true;
+		}
+	}
+
+	set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid varint reading %s", what );
+	return false;
+}
+
+/* reads a length prefixed string into dst, which is large enough for any */
+static bool read_inline_string( AcmBinReader *self, char *dst, uint16_t *size, const char *what )
+{
+	uint64_t length;
+	if ( !read_count( self, sizeof( uint16_t ), &length, what ) )
+	{
+		return false;
+	}
+	else if ( length > UINT16_MAX )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid length (%" PRIu64 ") reading %s", length, what );
+		return false;
+	}
+	else if ( length == 0 )
+	{
+		*dst  = '\0';
+		*size = 0;
+		return true;
+	}
+
+	const uint8_t *src = take( self, ( size_t ) length, what );
+	if ( src == NULL )
+	{
+		return false;
+	}
+	else if ( src[ length - 1 ] != '\0' )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "unterminated string reading %s", what );
+		return false;
+	}
+
+	memcpy( dst, src, ( size_t ) length );
+	*size = ( uint16_t ) length;
+	return true;
+}
+
+static const AcmString *get_shared_string( AcmBinReader *self, uint64_t ref )
+{
+	if ( ref == 0 || ref > self->numStrings )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid string reference (%" PRIu64 " of %u)", ref, self->numStrings );
+		return NULL;
+	}
+
+	return &self->strings[ ref - 1 ];
+}
+
+/* names either come from the table or are copied into dst */
+static bool read_name( AcmBinReader *self, char *dst, const char **name )
+{
+	*name = NULL;
+
+	uint64_t ref;
+	if ( self->flags & ACM_BINARY_FLAG_STRING_TABLE )
+	{
+		if ( !read_count( self, sizeof( uint32_t ), &ref, "name" ) )
+		{
+			return false;
+		}
+		else if ( ref == 0 )
+		{
+			return true;
+		}
+
+		const AcmString *string = get_shared_string( self, ref );
+		if ( string == NULL )
+		{
+			return false;
+		}
+
+		*name = string->buf;
+		return true;
+	}
+
+	uint16_t size;
+	if ( !read_inline_string( self, dst, &size, "name" ) )
+	{
+		return false;
+	}
+
+	*name = ( size > 0 ) ? dst : NULL;
+	return true;
+}
+
+static bool read_string_value( AcmBinReader *self )
+{
+	if ( self->flags & ACM_BINARY_FLAG_STRING_TABLE )
+	{
+		uint64_t ref;
+		if ( !read_count( self, sizeof( uint32_t ), &ref, "string" ) )
+		{
+			return false;
+		}
+		else if ( ref > 0 )
+		{
+			const AcmString *string = get_shared_string( self, ref );
+			if ( string == NULL )
+			{
+				return false;
+			}
+
+			self->value     = string->buf;
+			self->valueSize = string->bufSize;
+			return true;
+		}
+	}
+
+	self->value = self->valueBuf;
+	return read_inline_string( self, self->valueBuf, &self->valueSize, "string" );
+}
+
+/* formats a native value the same way a loaded branch would hold it */
+static bool set_scalar_value( AcmBinReader *self, AcmPropertyType type, uint64_t value )
+{
+	if ( type == ACM_PROPERTY_TYPE_BOOL )
+	{
+		value = ( value & 0xFF ) != 0;
+	}
+
+	acm_format_value_( type, &value, self->valueBuf, sizeof( self->valueBuf ) );
+	self->value     = self->valueBuf;
+	self->valueSize = ( uint16_t ) ( strlen( self->valueBuf ) + 1 );
+	return true;
+}
+
+static bool read_scalar_value( AcmBinReader *self, AcmPropertyType type )
+{
+	size_t typeSize = acm_get_type_size_( type );
+	if ( typeSize == 0 )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_TYPE, "unhandled type (%d)", type );
+		return false;
+	}
+
+	const uint8_t *data = take( self, typeSize, "value" );
+	if ( data == NULL )
+	{
+		return false;
+	}
+
+	uint64_t value = 0;
+	memcpy( &value, data, typeSize );
+
+	// slapped on fix for a bug with serialisation in older versions
+	if ( self->version < 2 && ( type == ND_PROPERTY_INT16 || type == ND_PROPERTY_UI16 ) && take( self, sizeof( uint32_t ), "value" ) == NULL )
+	{
+		return false;
+	}
+
+	return set_scalar_value( self, type, value );
+}
+
+static bool is_valid_type( int8_t type )
+{
+	return type > ACM_PROPERTY_TYPE_INVALID && type < ACM_MAX_PROPERTY_TYPES;
+}
+
+static bool is_integer( AcmPropertyType type )
+{
+	return type == ND_PROPERTY_INT8 || type == ND_PROPERTY_INT16 || type == ND_PROPERTY_INT32 || type == ND_PROPERTY_INT64 ||
+	       type == ND_PROPERTY_UI8 || type == ND_PROPERTY_UI16 || type == ND_PROPERTY_UI32 || type == ND_PROPERTY_UI64;
+}
+
+/******************************************/
+/** Header **/
+
+static bool read_string_table( AcmBinReader *self )
+{
+	uint64_t numStrings, tableSize;
+	if ( !read_count( self, sizeof( uint32_t ), &numStrings, "string table" ) ||
+	     !read_count( self, sizeof( uint64_t ), &tableSize, "string table" ) )
+	{
+		return false;
+	}
+	else if ( numStrings > UINT32_MAX || numStrings > tableSize || tableSize > SIZE_MAX - 1 ||
+	          ( self->blocks != NULL && ( self->offset > self->rawSize || tableSize > self->rawSize - self->offset ) ) )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid string table (%" PRIu64 " strings in %" PRIu64 " bytes)", numStrings, tableSize );
+		return false;
+	}
+
+	// the table is needed for as long as the reader is, so it's read in
+	// whole, but the size of an uncompressed source isn't known up front,
+	// so room is only made as the data turns up
+	size_t capacity = 0;
+	for ( uint64_t copied = 0; copied < tableSize; )
+	{
+		size_t         n   = ( tableSize - copied ) < ACM_BINARY_BLOCK_SIZE ? ( size_t ) ( tableSize - copied ) : ACM_BINARY_BLOCK_SIZE;
+		const uint8_t *src = take( self, n, "string table" );
+		if ( src == NULL )
+		{
+			return false;
+		}
+
+		if ( copied + n > capacity )
+		{
+			size_t maxCapacity = ( capacity * 2 > copied + n ) ? capacity * 2 : ( size_t ) ( copied + n );
+			if ( maxCapacity > tableSize )
+			{
+				maxCapacity = ( size_t ) tableSize;
+			}
+
+			uint8_t *data = ACM_REALLOC( self->stringData, uint8_t, maxCapacity );
+			if ( data == NULL )
+			{
+				acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate string table (%" PRIu64 " bytes)", tableSize );
+				self->hasFailed = true;
+				return false;
+			}
+
+			self->stringData = data;
+			capacity         = maxCapacity;
+		}
+
+		memcpy( self->stringData + copied, src, n );
+		copied += n;
+	}
+
+	self->strings = ACM_NEW_( AcmString, ( size_t ) numStrings + 1 );
+	if ( self->strings == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate string table (%" PRIu64 " strings)", numStrings );
+		self->hasFailed = true;
+		return false;
+	}
+
+	const uint8_t *p   = self->stringData;
+	const uint8_t *end = p + tableSize;
+	for ( uint32_t i = 0; i < ( uint32_t ) numStrings; ++i )
+	{
+		uint64_t length = 0;
+		if ( self->flags & ACM_BINARY_FLAG_VARINTS )
+		{
+			unsigned int shift = 0;
+			while ( p < end && shift < 64 )
+			{
+				length |= ( uint64_t ) ( *p & 0x7F ) << shift;
+				shift += 7;
+				if ( !( *p++ & 0x80 ) )
+				{
+					break;
+				}
+			}
+		}
+		else if ( end - p >= ( ptrdiff_t ) sizeof( uint16_t ) )
+		{
+			uint16_t v;
+			memcpy( &v, p, sizeof( uint16_t ) );
+			length = v;
+			p += sizeof( uint16_t );
+		}
+
+		if ( length == 0 || length > UINT16_MAX || length > ( uint64_t ) ( end - p ) || p[ length - 1 ] != '\0' )
+		{
+			set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid string table entry (%u)", i );
+			return false;
+		}
+
+		self->strings[ i ].buf        = ( char * ) p;
+		self->strings[ i ].bufSize    = ( uint16_t ) length;
+		self->strings[ i ].isBorrowed = true;
+		p += length;
+	}
+
+	self->numStrings = ( uint32_t ) numStrings;
+	return true;
+}
+
+/**
+ * Swaps the window over to the decompressed blocks, which
+ * begin with the header of the file as it would otherwise be.
+ */
+static bool open_blocks( AcmBinReader *self )
+{
+	const uint8_t *header = take( self, sizeof( uint32_t ) * 2 + sizeof( uint64_t ), "compressed header" );
+	if ( header == NULL )
+	{
+		return false;
+	}
+
+	memcpy( &self->blockSize, header, sizeof( uint32_t ) );
+	memcpy( &self->numBlocks, header + sizeof( uint32_t ), sizeof( uint32_t ) );
+	memcpy( &self->rawSize, header + sizeof( uint32_t ) * 2, sizeof( uint64_t ) );
+	if ( self->blockSize == 0 || self->blockSize > ACM_BINARY_BLOCK_SIZE * 256 || self->numBlocks == 0 ||
+	     self->numBlocks != ( self->rawSize + self->blockSize - 1 ) / self->blockSize )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid compressed binary node header (%u blocks of %u)", self->numBlocks, self->blockSize );
+		return false;
+	}
+
+	// index sits at the very end of the file, so this is the one thing
+	// that needs the source to be seekable (offsets are from its start)
+	uint64_t indexSize = ( uint64_t ) self->numBlocks * ACM_BINARY_BLOCK_ENTRY;
+	int64_t  size      = seek_source( self, 0, SEEK_END ) ? tell_source( self ) : -1;
+	if ( size < 0 || indexSize > ( uint64_t ) size || !seek_source( self, ( uint64_t ) size - indexSize, SEEK_SET ) )
+	{
+		set_stream_error( self, ND_ERROR_IO_READ, "compressed binary node data needs a seekable source" );
+		return false;
+	}
+
+	self->blocks  = ACM_NEW_( AcmBinaryBlockEntry, self->numBlocks );
+	self->block   = ACM_NEW_( uint8_t, self->blockSize );
+	self->scratch = ACM_NEW_( uint8_t, self->blockSize );
+	if ( self->blocks == NULL || self->block == NULL || self->scratch == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate block index (%u blocks)", self->numBlocks );
+		self->hasFailed = true;
+		return false;
+	}
+
+	for ( uint32_t i = 0; i < self->numBlocks; ++i )
+	{
+		uint8_t entry[ ACM_BINARY_BLOCK_ENTRY ];
+		if ( read_source( self, entry, sizeof( entry ) ) != sizeof( entry ) )
+		{
+			set_stream_error( self, ND_ERROR_IO_READ, "failed to read block index" );
+			return false;
+		}
+
+		memcpy( &self->blocks[ i ].offset, entry, sizeof( uint64_t ) );
+		memcpy( &self->blocks[ i ].size, entry + sizeof( uint64_t ), sizeof( uint32_t ) );
+		if ( self->blocks[ i ].size > self->blockSize || self->blocks[ i ].offset > ( uint64_t ) size - indexSize - self->blocks[ i ].size )
+		{
+			set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid compressed block (%u)", i );
+			return false;
+		}
+	}
+
+	// everything from here comes out of the blocks
+	self->bufStart    = 0;
+	self->bufEnd      = 0;
+	self->offset      = 0;
+	self->isExhausted = false;
+	return true;
+}
+
+static bool read_header( AcmBinReader *self )
+{
+	ensure( self, STREAM_HEADER_SIZE );
+
+	uint32_t     version, flags;
+	unsigned int headerSize;
+	AcmFileType  fileType = acm_parse_file_type_( self->buf + self->bufStart, self->bufEnd - self->bufStart, &version, &flags, &headerSize );
+	if ( fileType != ACM_FILE_TYPE_BINARY )
+	{
+		if ( fileType == ACM_FILE_TYPE_UTF8 )
+		{
+			acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "only binary files can be streamed" );
+		}
+		self->hasFailed = true;
+		return false;
+	}
+
+	take( self, headerSize, "header" );
+
+	if ( flags & ACM_BINARY_FLAG_COMPRESSED )
+	{
+		if ( self->blocks != NULL )
+		{
+			set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid compressed binary node data" );
+			return false;
+		}
+
+		return open_blocks( self ) && read_header( self );
+	}
+
+	self->version = version;
+	self->flags   = flags;
+	return !( flags & ACM_BINARY_FLAG_STRING_TABLE ) || read_string_table( self );
+}
+
+/******************************************/
+/** Events **/
+
+static bool push_frame( AcmBinReader *self, AcmBinReaderFrameType type, AcmPropertyType nodeType, AcmPropertyType childType, uint32_t numPending, uint64_t end )
+{
+	if ( self->depth == ACM_BINARY_MAX_DEPTH )
+	{
+		set_stream_error( self, ND_ERROR_LIMIT_EXCEEDED, "nesting is too deep (%u levels)", self->depth );
+		return false;
+	}
+
+	AcmBinReaderFrame *frame = &self->frames[ self->depth++ ];
+	frame->type              = type;
+	frame->nodeType          = nodeType;
+	frame->childType         = childType;
+	frame->numPending        = numPending;
+	frame->end               = end;
+	return true;
+}
+
+static void free_schema( AcmBinReader *self )
+{
+	if ( self->fieldNames != NULL && !( self->flags & ACM_BINARY_FLAG_STRING_TABLE ) )
+	{
+		for ( uint32_t i = 0; i < self->numFields; ++i )
+		{
+			ACM_DELETE( self->fieldNames[ i ].buf );
+		}
+	}
+
+	ACM_DELETE( self->fieldNames );
+	ACM_DELETE( self->fieldTypes );
+	self->fieldNames = NULL;
+	self->fieldTypes = NULL;
+	self->numFields  = 0;
+}
+
+static bool read_schema( AcmBinReader *self, uint64_t payloadSize )
+{
+	uint64_t numFields;
+	if ( !read_count( self, sizeof( uint32_t ), &numFields, "table schema" ) )
+	{
+		return false;
+	}
+	else if ( numFields == 0 || numFields > payloadSize )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid table schema (%" PRIu64 " fields)", numFields );
+		return false;
+	}
+
+	self->fieldNames = ACM_NEW_( AcmString, ( size_t ) numFields );
+	self->fieldTypes = ACM_NEW_( AcmPropertyType, ( size_t ) numFields );
+	if ( self->fieldNames == NULL || self->fieldTypes == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate table schema (%" PRIu64 " fields)", numFields );
+		self->hasFailed = true;
+		return false;
+	}
+
+	for ( ; self->numFields < numFields; self->numFields++ )
+	{
+		// the name of the table itself is still in nameBuf
+		const char *name;
+		if ( !read_name( self, self->valueBuf, &name ) )
+		{
+			return false;
+		}
+
+		const int8_t *type = ( const int8_t * ) take( self, sizeof( int8_t ), "table field" );
+		if ( type == NULL )
+		{
+			return false;
+		}
+		else if ( name == NULL || !is_valid_type( *type ) || ( *type != ACM_PROPERTY_TYPE_STRING && acm_get_type_size_( ( AcmPropertyType ) *type ) == 0 ) )
+		{
+			set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid table field (%u)", self->numFields );
+			return false;
+		}
+
+		// names outside of the string table only last until the next read
+		AcmString *field = &self->fieldNames[ self->numFields ];
+		if ( self->flags & ACM_BINARY_FLAG_STRING_TABLE )
+		{
+			field->buf = ( char * ) name;
+		}
+		else if ( acm_alloc_var_string_( name, field ) == NULL )
+		{
+			self->hasFailed = true;
+			return false;
+		}
+
+		self->fieldTypes[ self->numFields ] = ( AcmPropertyType ) *type;
+	}
+
+	return true;
+}
+
+static bool read_bitpacked_header( AcmBinReader *self, uint32_t numElements )
+{
+	const uint8_t *header = take( self, ACM_BINARY_BITPACK_HEADER, "bit-packed header" );
+	if ( header == NULL )
+	{
+		return false;
+	}
+
+	uint64_t first;
+	self->packMode  = header[ 0 ];
+	self->packWidth = header[ 1 ];
+	memcpy( &first, header + 2, sizeof( uint64_t ) );
+	memcpy( &self->packReference, header + 2 + sizeof( uint64_t ), sizeof( uint64_t ) );
+	if ( self->packMode > ACM_BINARY_BITPACK_DELTA || self->packWidth > 64 )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid bit-packing (mode %u, %u bits)", self->packMode, self->packWidth );
+		return false;
+	}
+
+	self->packPrevious = first;
+	self->packBits     = 0;
+	self->packNumBits  = 0;
+	self->packHasFirst = ( self->packMode == ACM_BINARY_BITPACK_DELTA && numElements > 0 );
+	return true;
+}
+
+static bool read_bitpacked_value( AcmBinReader *self, uint64_t *value )
+{
+	if ( self->packHasFirst )
+	{
+		self->packHasFirst = false;
+		*value             = self->packPrevious;
+		return true;
+	}
+
+	// pulled in a byte at a time, LSB first
+	uint64_t bits = 0;
+	for ( unsigned int numBits = 0; numBits < self->packWidth; )
+	{
+		if ( self->packNumBits == 0 )
+		{
+			const uint8_t *byte = take( self, sizeof( uint8_t ), "bit-packed data" );
+			if ( byte == NULL )
+			{
+				return false;
+			}
+
+			self->packBits    = *byte;
+			self->packNumBits = 8;
+		}
+
+		unsigned int n = self->packWidth - numBits;
+		if ( n > self->packNumBits )
+		{
+			n = self->packNumBits;
+		}
+
+		bits |= ( self->packBits & ( ( 1U << n ) - 1 ) ) << numBits;
+		self->packBits >>= n;
+		self->packNumBits -= n;
+		numBits += n;
+	}
+
+	*value = bits + self->packReference;
+	if ( self->packMode == ACM_BINARY_BITPACK_DELTA )
+	{
+		self->packPrevious += *value;
+		*value = self->packPrevious;
+	}
+
+	return true;
+}
+
+static bool read_quantized_header( AcmBinReader *self )
+{
+	const uint8_t *header = take( self, ACM_BINARY_QUANTIZE_HEADER, "quantization header" );
+	if ( header == NULL )
+	{
+		return false;
+	}
+
+	self->quantization.encoding = header[ 0 ];
+	memcpy( &self->quantization.minValue, header + 1, sizeof( double ) );
+	memcpy( &self->quantization.maxValue, header + 1 + sizeof( double ), sizeof( double ) );
+	if ( self->quantization.encoding > ACM_BINARY_QUANTIZE_FIXED_16 ||
+	     ( self->quantization.encoding != ACM_BINARY_QUANTIZE_HALF && !( self->quantization.minValue <= self->quantization.maxValue ) ) )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid quantization (%u)", self->quantization.encoding );
+		return false;
+	}
+
+	return true;
+}
+
+/* decoded the same way as a loaded array, so both end up with the same values */
+static bool read_quantized_value( AcmBinReader *self, AcmPropertyType type, uint64_t *value )
+{
+	const uint8_t *data = take( self, acm_get_quantized_size_( self->quantization.encoding ), "quantized value" );
+	if ( data == NULL )
+	{
+		return false;
+	}
+
+	union
+	{
+		float  f32;
+		double f64;
+	} element;
+	acm_dequantize_( &self->quantization, type, data, &element, 1 );
+
+	*value = 0;
+	memcpy( value, &element, acm_get_type_size_( type ) );
+	return true;
+}
+
+/**
+ * Reads the count, flags and payload size of a container, and whatever
+ * precedes its children, then pushes a frame for them.
+ */
+static bool begin_container( AcmBinReader *self )
+{
+	uint64_t numChildren;
+	if ( !read_count( self, sizeof( uint32_t ), &numChildren, "child count" ) )
+	{
+		return false;
+	}
+	else if ( numChildren > UINT32_MAX )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid child count (%" PRIu64 ")", numChildren );
+		return false;
+	}
+
+	uint8_t  containerFlags = 0;
+	uint64_t payloadSize    = UINT64_MAX;
+	uint64_t end            = UINT64_MAX;
+	if ( self->version >= 3 )
+	{
+		// taken before the payload size, as reading that can move the window
+		const uint8_t *flags = take( self, sizeof( uint8_t ), "container flags" );
+		if ( flags == NULL )
+		{
+			return false;
+		}
+
+		containerFlags = *flags;
+		if ( !read_count( self, sizeof( uint64_t ), &payloadSize, "payload size" ) )
+		{
+			return false;
+		}
+
+		end = self->offset + payloadSize;
+
+		// children have to stay within their parent
+		if ( end < self->offset || ( self->depth > 0 && end > self->frames[ self->depth - 1 ].end ) )
+		{
+			set_stream_error( self, ND_ERROR_INVALID_DATA, "invalid payload size (%" PRIu64 ")", payloadSize );
+			return false;
+		}
+	}
+
+	// bit-packed elements can take less than a byte each, everything else takes at least one
+	if ( !( containerFlags & ACM_BINARY_CONTAINER_BITPACKED ) && numChildren > payloadSize )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "too many children (%" PRIu64 ")", numChildren );
+		return false;
+	}
+
+	bool isPacked = self->type == ACM_PROPERTY_TYPE_ARRAY && acm_get_type_size_( self->childType ) > 0;
+	if ( ( containerFlags & ( ACM_BINARY_CONTAINER_BITPACKED | ACM_BINARY_CONTAINER_PACKED | ACM_BINARY_CONTAINER_QUANTIZED ) ) && !isPacked )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_TYPE, "unexpected element block" );
+		return false;
+	}
+
+	AcmBinReaderFrameType type = ACM_BINREADER_FRAME_NODES;
+	if ( containerFlags & ACM_BINARY_CONTAINER_BITPACKED )
+	{
+		if ( !is_integer( self->childType ) )
+		{
+			set_stream_error( self, ND_ERROR_INVALID_TYPE, "unexpected bit-packed elements" );
+			return false;
+		}
+		else if ( !read_bitpacked_header( self, ( uint32_t ) numChildren ) )
+		{
+			return false;
+		}
+
+		type = ACM_BINREADER_FRAME_BITPACKED;
+	}
+	else if ( containerFlags & ACM_BINARY_CONTAINER_QUANTIZED )
+	{
+		if ( self->childType != ACM_PROPERTY_TYPE_FLOAT32 && self->childType != ACM_PROPERTY_TYPE_FLOAT64 )
+		{
+			set_stream_error( self, ND_ERROR_INVALID_TYPE, "unexpected quantized elements" );
+			return false;
+		}
+		else if ( !read_quantized_header( self ) )
+		{
+			return false;
+		}
+
+		type = ACM_BINREADER_FRAME_QUANTIZED;
+	}
+	else if ( containerFlags & ACM_BINARY_CONTAINER_TABLE )
+	{
+		if ( self->type != ACM_PROPERTY_TYPE_ARRAY || self->childType != ACM_PROPERTY_TYPE_OBJECT || self->fieldNames != NULL )
+		{
+			set_stream_error( self, ND_ERROR_INVALID_TYPE, "unexpected table" );
+			return false;
+		}
+		else if ( !read_schema( self, payloadSize ) )
+		{
+			return false;
+		}
+
+		type = ACM_BINREADER_FRAME_TABLE;
+	}
+	else if ( containerFlags & ACM_BINARY_CONTAINER_PACKED )
+	{
+		const uint8_t *padding = take( self, sizeof( uint8_t ), "block padding" );
+		if ( padding == NULL || !skip( self, *padding ) )
+		{
+			return false;
+		}
+
+		type = ACM_BINREADER_FRAME_PACKED;
+	}
+	else if ( isPacked )
+	{
+		type = ACM_BINREADER_FRAME_ELEMENTS;
+	}
+
+	self->numChildren = ( uint32_t ) numChildren;
+	return push_frame( self, type, self->type, self->childType, ( uint32_t ) numChildren, end );
+}
+
+static AcmBinReaderEvent read_node( AcmBinReader *self )
+{
+	if ( !read_name( self, self->nameBuf, &self->name ) )
+	{
+		return ACM_BINREADER_EVENT_ERROR;
+	}
+
+	const int8_t *type = ( const int8_t * ) take( self, sizeof( int8_t ), "type" );
+	if ( type == NULL )
+	{
+		return ACM_BINREADER_EVENT_ERROR;
+	}
+	else if ( !is_valid_type( *type ) )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_TYPE, "invalid property type (%d)", *type );
+		return ACM_BINREADER_EVENT_ERROR;
+	}
+
+	self->type      = ( AcmPropertyType ) *type;
+	self->childType = ACM_PROPERTY_TYPE_INVALID;
+	if ( self->type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		const int8_t *childType = ( const int8_t * ) take( self, sizeof( int8_t ), "child type" );
+		if ( childType == NULL )
+		{
+			return ACM_BINREADER_EVENT_ERROR;
+		}
+		else if ( !is_valid_type( *childType ) )
+		{
+			set_stream_error( self, ND_ERROR_INVALID_TYPE, "invalid child property type (%d)", *childType );
+			return ACM_BINREADER_EVENT_ERROR;
+		}
+
+		self->childType = ( AcmPropertyType ) *childType;
+	}
+
+	if ( self->type == ACM_PROPERTY_TYPE_OBJECT || self->type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		return begin_container( self ) ? ACM_BINREADER_EVENT_BEGIN : ACM_BINREADER_EVENT_ERROR;
+	}
+	else if ( self->type == ACM_PROPERTY_TYPE_STRING )
+	{
+		return read_string_value( self ) ? ACM_BINREADER_EVENT_VALUE : ACM_BINREADER_EVENT_ERROR;
+	}
+
+	return read_scalar_value( self, self->type ) ? ACM_BINREADER_EVENT_VALUE : ACM_BINREADER_EVENT_ERROR;
+}
+
+/* the next element of the current array, or field of the current row */
+static AcmBinReaderEvent read_child( AcmBinReader *self, AcmBinReaderFrame *frame )
+{
+	self->name        = NULL;
+	self->type        = frame->childType;
+	self->childType   = ACM_PROPERTY_TYPE_INVALID;
+	self->numChildren = 0;
+
+	bool status;
+	switch ( frame->type )
+	{
+		default:
+			return read_node( self );
+		case ACM_BINREADER_FRAME_ELEMENTS:
+		{
+			// element names aren't used, but still need to be skipped
+			const char   *name;
+			const int8_t *type = read_name( self, self->nameBuf, &name ) ? ( const int8_t * ) take( self, sizeof( int8_t ), "element type" ) : NULL;
+			if ( type == NULL )
+			{
+				return ACM_BINREADER_EVENT_ERROR;
+			}
+			else if ( *type != frame->childType )
+			{
+				set_stream_error( self, ND_ERROR_INVALID_TYPE, "unexpected element type (%d)", *type );
+				return ACM_BINREADER_EVENT_ERROR;
+			}
+
+			self->name = NULL;
+			status     = read_scalar_value( self, frame->childType );
+			break;
+		}
+		case ACM_BINREADER_FRAME_PACKED:
+			status = read_scalar_value( self, frame->childType );
+			break;
+		case ACM_BINREADER_FRAME_BITPACKED:
+		{
+			uint64_t value;
+			status = read_bitpacked_value( self, &value ) && set_scalar_value( self, frame->childType, value );
+			break;
+		}
+		case ACM_BINREADER_FRAME_QUANTIZED:
+		{
+			uint64_t value;
+			status = read_quantized_value( self, frame->childType, &value ) && set_scalar_value( self, frame->childType, value );
+			break;
+		}
+		case ACM_BINREADER_FRAME_TABLE:
+			self->type        = ACM_PROPERTY_TYPE_OBJECT;
+			self->numChildren = self->numFields;
+			return push_frame( self, ACM_BINREADER_FRAME_ROW, ACM_PROPERTY_TYPE_OBJECT, ACM_PROPERTY_TYPE_INVALID, self->numFields, frame->end ) ? ACM_BINREADER_EVENT_BEGIN : ACM_BINREADER_EVENT_ERROR;
+		case ACM_BINREADER_FRAME_ROW:
+		{
+			uint32_t field = self->numFields - frame->numPending - 1;
+			self->name     = self->fieldNames[ field ].buf;
+			self->type     = self->fieldTypes[ field ];
+			status         = ( self->type == ACM_PROPERTY_TYPE_STRING ) ? read_string_value( self ) : read_scalar_value( self, self->type );
+			break;
+		}
+	}
+
+	return status ? ACM_BINREADER_EVENT_VALUE : ACM_BINREADER_EVENT_ERROR;
+}
+
+/* skips anything left in the payload, such as the child table */
+static bool end_container( AcmBinReader *self )
+{
+	AcmBinReaderFrame *frame = &self->frames[ --self->depth ];
+	if ( frame->type == ACM_BINREADER_FRAME_TABLE )
+	{
+		free_schema( self );
+	}
+
+	self->name        = NULL;
+	self->type        = frame->nodeType;
+	self->childType   = frame->childType;
+	self->numChildren = 0;
+	self->value       = NULL;
+	self->valueSize   = 0;
+
+	if ( frame->end == UINT64_MAX || frame->type == ACM_BINREADER_FRAME_ROW )
+	{
+		return true;
+	}
+	else if ( self->offset > frame->end )
+	{
+		set_stream_error( self, ND_ERROR_INVALID_DATA, "container overran its payload (by %" PRIu64 " bytes)", self->offset - frame->end );
+		return false;
+	}
+
+	return skip( self, frame->end - self->offset );
+}
+
+static AcmBinReader *create_reader( FILE *file, int fd )
+{
+	AcmBinReader *self = ACM_NEW( AcmBinReader );
+	uint8_t      *buf  = ACM_NEW_( uint8_t, STREAM_BUFFER_SIZE );
+	if ( self == NULL || buf == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate binary reader" );
+		ACM_DELETE( self );
+		ACM_DELETE( buf );
+		return NULL;
+	}
+
+	self->file = file;
+	self->fd   = fd;
+	self->buf  = buf;
+	return self;
+}
+
+AcmBinReader *acm_binreader_open_file( FILE *file )
+{
+	if ( file == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "invalid file" );
+		return NULL;
+	}
+
+	return create_reader( file, -1 );
+}
+
+AcmBinReader *acm_binreader_open_fd( int fd )
+{
+	if ( fd < 0 )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "invalid file descriptor" );
+		return NULL;
+	}
+
+	return create_reader( NULL, fd );
+}
+
+void acm_binreader_close( AcmBinReader *self )
+{
+	if ( self == NULL )
+	{
+		return;
+	}
+
+	free_schema( self );
+	ACM_DELETE( self->blocks );
+	ACM_DELETE( self->block );
+	ACM_DELETE( self->scratch );
+	ACM_DELETE( self->stringData );
+	ACM_DELETE( self->strings );
+	ACM_DELETE( self->buf );
+	ACM_DELETE( self );
+}
+
+AcmBinReaderEvent acm_binreader_next( AcmBinReader *self )
+{
+	if ( self->hasFailed )
+	{
+		return ACM_BINREADER_EVENT_ERROR;
+	}
+
+	self->value     = NULL;
+	self->valueSize = 0;
+
+	AcmBinReaderEvent event;
+	if ( !self->hasStarted )
+	{
+		self->hasStarted = true;
+		if ( !read_header( self ) )
+		{
+			self->hasFailed = true;
+			return ACM_BINREADER_EVENT_ERROR;
+		}
+
+		event = read_node( self );
+	}
+	else if ( self->depth == 0 )
+	{
+		return ACM_BINREADER_EVENT_EOF;
+	}
+	else if ( self->frames[ self->depth - 1 ].numPending == 0 )
+	{
+		event = end_container( self ) ? ACM_BINREADER_EVENT_END : ACM_BINREADER_EVENT_ERROR;
+	}
+	else
+	{
+		AcmBinReaderFrame *frame = &self->frames[ self->depth - 1 ];
+		frame->numPending--;
+		event = read_child( self, frame );
+	}
+
+	if ( event == ACM_BINREADER_EVENT_ERROR )
+	{
+		self->hasFailed = true;
+	}
+
+	return event;
+}
+
+const char     *acm_binreader_get_name( const AcmBinReader *self ) { return self->name; }
+AcmPropertyType acm_binreader_get_type( const AcmBinReader *self ) { return self->type; }
+AcmPropertyType acm_binreader_get_child_type( const AcmBinReader *self ) { return self->childType; }
+unsigned int    acm_binreader_get_num_children( const AcmBinReader *self ) { return self->numChildren; }
+unsigned int    acm_binreader_get_depth( const AcmBinReader *self ) { return self->depth; }
+
+const char *acm_binreader_get_value( const AcmBinReader *self, uint16_t *size )
+{
+	if ( size != NULL )
+	{
+		*size = self->valueSize;
+	}
+
+	return self->value;
+}
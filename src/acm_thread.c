@@ -0,0 +1,380 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+#if defined( _WIN32 )
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+typedef HANDLE             AcmThread;
+typedef SRWLOCK            AcmMutex;
+typedef CONDITION_VARIABLE AcmCondition;
+#else
+#	include <pthread.h>
+#	include <unistd.h>
+typedef pthread_t       AcmThread;
+typedef pthread_mutex_t AcmMutex;
+typedef pthread_cond_t  AcmCondition;
+#endif
+
+/* Runs a set of jobs on a pool of threads, handing each back to the
+ * calling thread in order as it's finished. Workers are only allowed
+ * a little ahead of what's been handed back, so the results don't
+ * all pile up if the caller is slower.
+ */
+
+#define JOB_WINDOW_PER_THREAD 4 /* jobs that can be finished but not yet handed back */
+#define MAX_THREADS           64
+
+typedef struct AcmJobQueue
+{
+	AcmMutex     mutex;
+	AcmCondition changed; /* a job was finished, or handed back */
+
+	AcmJobFunction run;
+	void          *user;
+
+	unsigned int numJobs;
+	unsigned int nextJob;
+	unsigned int numConsumed;
+	unsigned int window;
+	bool        *isDone;
+	bool         hasFailed;
+} AcmJobQueue;
+
+static unsigned int maxThreads = 0; /* 0 to use every core */
+
+void acm_set_max_threads( unsigned int numThreads )
+{
+	maxThreads = numThreads;
+}
+
+unsigned int acm_get_num_threads_( void )
+{
+	unsigned int numCores;
+#if defined( _WIN32 )
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	numCores = ( unsigned int ) info.dwNumberOfProcessors;
+#else
+	long n   = sysconf( _SC_NPROCESSORS_ONLN );
+	numCores = n > 0 ? ( unsigned int ) n : 1;
+#endif
+
+	unsigned int numThreads = ( maxThreads > 0 && maxThreads < numCores ) ? maxThreads : numCores;
+	return numThreads < MAX_THREADS ? numThreads : MAX_THREADS;
+}
+
+/******************************************/
+/** Platform **/
+
+#if defined( _WIN32 )
+
+static void lock_queue( AcmJobQueue *self )
+{
+	AcquireSRWLockExclusive( &self->mutex );
+}
+
+static void unlock_queue( AcmJobQueue *self )
+{
+	ReleaseSRWLockExclusive( &self->mutex );
+}
+
+static void wait_for_change( AcmJobQueue *self )
+{
+	SleepConditionVariableSRW( &self->changed, &self->mutex, INFINITE, 0 );
+}
+
+static void signal_change( AcmJobQueue *self )
+{
+	WakeAllConditionVariable( &self->changed );
+}
+
+static bool init_queue( AcmJobQueue *self )
+{
+	InitializeSRWLock( &self->mutex );
+	InitializeConditionVariable( &self->changed );
+	return true;
+}
+
+static void shutdown_queue( AcmJobQueue *self )
+{
+	( void ) self;
+}
+
+static DWORD WINAPI worker_main( LPVOID user );
+static bool start_thread( AcmThread *thread, AcmJobQueue *queue )
+{
+	*thread = CreateThread( NULL, 0, worker_main, queue, 0, NULL );
+	return *thread != NULL;
+}
+
+static void join_thread( AcmThread thread )
+{
+	WaitForSingleObject( thread, INFINITE );
+	CloseHandle( thread );
+}
+
+#else
+
+static void lock_queue( AcmJobQueue *self )
+{
+	pthread_mutex_lock( &self->mutex );
+}
+
+static void unlock_queue( AcmJobQueue *self )
+{
+	pthread_mutex_unlock( &self->mutex );
+}
+
+static void wait_for_change( AcmJobQueue *self )
+{
+	pthread_cond_wait( &self->changed, &self->mutex );
+}
+
+static void signal_change( AcmJobQueue *self )
+{
+	pthread_cond_broadcast( &self->changed );
+}
+
+static bool init_queue( AcmJobQueue *self )
+{
+	if ( pthread_mutex_init( &self->mutex, NULL ) != 0 )
+	{
+		return false;
+	}
+	else if ( pthread_cond_init( &self->changed, NULL ) != 0 )
+	{
+		pthread_mutex_destroy( &self->mutex );
+		return false;
+	}
+
+	return true;
+}
+
+static void shutdown_queue( AcmJobQueue *self )
+{
+	pthread_cond_destroy( &self->changed );
+	pthread_mutex_destroy( &self->mutex );
+}
+
+static void *worker_main( void *user );
+static bool start_thread( AcmThread *thread, AcmJobQueue *queue )
+{
+	return pthread_create( thread, NULL, worker_main, queue ) == 0;
+}
+
+static void join_thread( AcmThread thread )
+{
+	pthread_join( thread, NULL );
+}
+
+#endif
+
+/******************************************/
+/** Workers **/
+
+static void run_jobs( AcmJobQueue *self )
+{
+	lock_queue( self );
+	for ( ;; )
+	{
+		while ( !self->hasFailed && self->nextJob < self->numJobs && self->nextJob >= self->numConsumed + self->window )
+		{
+			wait_for_change( self );
+		}
+
+		if ( self->hasFailed || self->nextJob == self->numJobs )
+		{
+			break;
+		}
+
+		unsigned int job = self->nextJob++;
+		unlock_queue( self );
+
+		bool status = self->run( self->user, job );
+
+		lock_queue( self );
+		self->isDone[ job ] = true;
+		self->hasFailed     = self->hasFailed || !status;
+		signal_change( self );
+	}
+	unlock_queue( self );
+}
+
+#if defined( _WIN32 )
+static DWORD WINAPI worker_main( LPVOID user )
+{
+	run_jobs( user );
+	return 0;
+}
+#else
+static void *worker_main( void *user )
+{
+	run_jobs( user );
+	return NULL;
+}
+#endif
+
+/**
+ * Runs each job, and calls consume for each in order on this thread
+ * once it's done. Stops as soon as anything fails, in which case
+ * some jobs may have been run without being consumed.
+ *
+ * Threads are started per call, so callers only hand over work that's
+ * worth it (see PARALLEL_MIN_NODES), and there's never more than one
+ * per job. If a single thread would do, it's all just run here.
+ */
+bool acm_run_jobs_( unsigned int numJobs, AcmJobFunction run, AcmJobFunction consume, void *user )
+{
+	unsigned int numThreads = acm_get_num_threads_();
+	if ( numThreads > numJobs )
+	{
+		numThreads = numJobs;
+	}
+
+	if ( numThreads <= 1 )
+	{
+		for ( unsigned int i = 0; i < numJobs; ++i )
+		{
+			if ( !run( user, i ) || !consume( user, i ) )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	AcmJobQueue queue;
+	memset( &queue, 0, sizeof( AcmJobQueue ) );
+	queue.run     = run;
+	queue.user    = user;
+	queue.numJobs = numJobs;
+	queue.window  = numThreads * JOB_WINDOW_PER_THREAD;
+	queue.isDone            = ACM_NEW_( bool, numJobs );
+	if ( queue.isDone == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate job queue (%u jobs)", numJobs );
+		return false;
+	}
+	else if ( !init_queue( &queue ) )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "failed to create job queue" );
+		ACM_DELETE( queue.isDone );
+		return false;
+	}
+
+	// if no threads can be started, everything just gets run here
+	AcmThread    threads[ MAX_THREADS ];
+	unsigned int numStarted = 0;
+	while ( numStarted < numThreads && start_thread( &threads[ numStarted ], &queue ) )
+	{
+		numStarted++;
+	}
+
+	bool status = true;
+	for ( unsigned int i = 0; i < numJobs && status; ++i )
+	{
+		if ( numStarted == 0 )
+		{
+			status = run( user, i );
+		}
+		else
+		{
+			lock_queue( &queue );
+			while ( !queue.isDone[ i ] && !queue.hasFailed )
+			{
+				wait_for_change( &queue );
+			}
+			status = queue.isDone[ i ] && !queue.hasFailed;
+			unlock_queue( &queue );
+		}
+
+		status = status && consume( user, i );
+
+		lock_queue( &queue );
+		queue.numConsumed++;
+		queue.hasFailed = queue.hasFailed || !status;
+		signal_change( &queue );
+		unlock_queue( &queue );
+	}
+
+	for ( unsigned int i = 0; i < numStarted; ++i )
+	{
+		join_thread( threads[ i ] );
+	}
+
+	shutdown_queue( &queue );
+	ACM_DELETE( queue.isDone );
+
+	return status;
+}
+
+/******************************************/
+/** Tasks **/
+
+/* a single job, left to run in the background while the caller gets on with something else */
+struct AcmTask
+{
+	AcmJobQueue queue;
+	AcmThread   thread;
+	bool        isStarted;
+	bool        isDone;
+};
+
+AcmTask *acm_start_task_( AcmJobFunction run, void *user )
+{
+	AcmTask *self = ACM_NEW( AcmTask );
+	if ( self == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate task" );
+		return NULL;
+	}
+
+	self->queue.run     = run;
+	self->queue.user    = user;
+	self->queue.numJobs = 1;
+	self->queue.window  = 1;
+	self->queue.isDone  = &self->isDone;
+	if ( !init_queue( &self->queue ) )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "failed to create task" );
+		ACM_DELETE( self );
+		return NULL;
+	}
+
+	// if the thread can't be started, it'll just be run once it's finished
+	self->isStarted = start_thread( &self->thread, &self->queue );
+
+	return self;
+}
+
+bool acm_is_task_done_( AcmTask *self )
+{
+	lock_queue( &self->queue );
+	bool isDone = self->isDone;
+	unlock_queue( &self->queue );
+
+	return isDone || !self->isStarted;
+}
+
+bool acm_finish_task_( AcmTask *self )
+{
+	if ( self->isStarted )
+	{
+		join_thread( self->thread );
+	}
+	else
+	{
+		run_jobs( &self->queue );
+	}
+
+	bool status = self->isDone && !self->queue.hasFailed;
+
+	shutdown_queue( &self->queue );
+	ACM_DELETE( self );
+
+	return status;
+}
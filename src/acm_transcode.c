@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+/* Converts files between formats without building a tree: the source is
+ * read incrementally, and each node is handed to the push writer as soon
+ * as it's been read. Binary files are read with the pull reader, and text
+ * with the same parser as acm_load_file, so it takes the same text.
+ */
+
+static bool transcode_binary( FILE *file, AcmWriter *writer )
+{
+	AcmBinReader *reader = acm_binreader_open_file( file );
+	if ( reader == NULL )
+	{
+		return false;
+	}
+
+	bool status = true;
+	for ( bool isDone = false; !isDone && status; )
+	{
+		switch ( acm_binreader_next( reader ) )
+		{
+			case ACM_BINREADER_EVENT_ERROR:
+				status = false;
+				break;
+			case ACM_BINREADER_EVENT_EOF:
+				isDone = true;
+				break;
+			case ACM_BINREADER_EVENT_BEGIN:
+				if ( acm_binreader_get_type( reader ) == ACM_PROPERTY_TYPE_OBJECT )
+				{
+					status = acm_writer_begin_object( writer, acm_binreader_get_name( reader ) );
+				}
+				else
+				{
+					status = acm_writer_begin_array( writer, acm_binreader_get_name( reader ), acm_binreader_get_child_type( reader ) );
+				}
+				break;
+			case ACM_BINREADER_EVENT_VALUE:
+				status = acm_writer_write_value_( writer, acm_binreader_get_name( reader ), acm_binreader_get_type( reader ), acm_binreader_get_value( reader, NULL ) );
+				break;
+			case ACM_BINREADER_EVENT_END:
+				status = acm_writer_end( writer );
+				break;
+		}
+	}
+
+	acm_binreader_close( reader );
+
+	return status;
+}
+
+bool acm_transcode_file( const char *srcPath, const char *dstPath, AcmFileType dstType )
+{
+	FILE *file = fopen( srcPath, "rb" );
+	if ( file == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_READ, "failed to open path \"%s\"", srcPath );
+		return false;
+	}
+
+	uint8_t      header[ 64 ];
+	size_t       headerSize = fread( header, sizeof( uint8_t ), sizeof( header ), file );
+	uint32_t     version, flags;
+	unsigned int size;
+	AcmFileType  srcType = acm_parse_file_type_( header, headerSize, &version, &flags, &size );
+	// text picks up after the header, as it would if it were loaded
+	if ( srcType == ACM_FILE_TYPE_INVALID || fseek( file, srcType == ACM_FILE_TYPE_UTF8 ? ( long ) size : 0, SEEK_SET ) != 0 )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_DATA, "unrecognised file type (%s)", srcPath );
+		fclose( file );
+		return false;
+	}
+
+	AcmWriter *writer = acm_writer_open_file( dstPath, dstType );
+	if ( writer == NULL )
+	{
+		fclose( file );
+		return false;
+	}
+
+	bool status = srcType == ACM_FILE_TYPE_BINARY ? transcode_binary( file, writer ) : acm_parse_file_to_writer_( file, srcPath, writer );
+	fclose( file );
+
+	// keep hold of the first error, rather than whatever closing says about the incomplete output
+	if ( !status )
+	{
+		char error[ 4096 ];
+		snprintf( error, sizeof( error ), "%s", acm_get_error_message() );
+		AcmErrorCode code = acm_get_error();
+		acm_writer_close( writer );
+		acm_set_error_message_( code, "%s", error );
+		return false;
+	}
+
+	return acm_writer_close( writer );
+}
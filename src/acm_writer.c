@@ -0,0 +1,634 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_private.h"
+
+#include <inttypes.h>
+
+/* Push writer, which writes each node out as it's given rather than
+ * building a tree first, using the same layout as acm_write_file.
+ * Only the containers currently open are kept track of.
+ *
+ * Binary containers are written with their sizes left blank, which are
+ * filled in when they're ended; either in the output buffer, or if that's
+ * already been flushed, by going back in the file. Binary output can't go
+ * to a sink for that reason, and is always written uncompressed and
+ * without child tables, as both need the whole container up front.
+ */
+
+typedef struct AcmWriterFrame
+{
+	AcmPropertyType type;
+	AcmPropertyType childType;
+	uint32_t        numChildren;
+	uint64_t        headerOffset; /* where the number of children goes, followed by the flags and payload size */
+	uint64_t        payloadStart;
+} AcmWriterFrame;
+
+struct AcmWriter
+{
+	AcmFileType    fileType;
+	AcmOutput      output;
+	FILE          *file; /* if writing to a path */
+	AcmWriterFrame frames[ ACM_BINARY_MAX_DEPTH ];
+	unsigned int   depth;
+	bool           hasRoot;
+	bool           hasFailed;
+};
+
+static AcmWriterFrame *get_parent( AcmWriter *self )
+{
+	return self->depth > 0 ? &self->frames[ self->depth - 1 ] : NULL;
+}
+
+static bool is_element( AcmWriter *self )
+{
+	AcmWriterFrame *parent = get_parent( self );
+	return parent != NULL && parent->type == ACM_PROPERTY_TYPE_ARRAY;
+}
+
+static bool has_failed( AcmWriter *self )
+{
+	return self->hasFailed || self->output.failed;
+}
+
+/**
+ * Checks the node can go where it's being written, and counts it
+ * against its parent. Elements of arrays have no name.
+ */
+static bool begin_node( AcmWriter *self, AcmPropertyType type, const char **name )
+{
+	if ( has_failed( self ) )
+	{
+		return false;
+	}
+
+	AcmWriterFrame *parent = get_parent( self );
+	if ( parent == NULL )
+	{
+		if ( self->hasRoot )
+		{
+			acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "root has already been written" );
+			self->hasFailed = true;
+			return false;
+		}
+
+		self->hasRoot = true;
+		return true;
+	}
+
+	if ( parent->type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		if ( type != parent->childType )
+		{
+			acm_set_error_message_( ND_ERROR_INVALID_TYPE, "attempted to add invalid type (%s)", acm_string_for_property_type_( type ) );
+			self->hasFailed = true;
+			return false;
+		}
+
+		*name = NULL;
+	}
+
+	if ( parent->numChildren == UINT32_MAX )
+	{
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "too many children" );
+		self->hasFailed = true;
+		return false;
+	}
+
+	parent->numChildren++;
+	return true;
+}
+
+/******************************************/
+/** Binary **/
+
+static void write_binary_string( AcmWriter *self, const char *string )
+{
+	// empty strings keep their terminator, so they aren't confused with no string at all
+	size_t length = string != NULL ? strlen( string ) + 1 : 0;
+	if ( length > UINT16_MAX )
+	{
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "string is too long (%zu bytes)", length );
+		self->hasFailed = true;
+		return;
+	}
+
+	uint16_t size = ( uint16_t ) length;
+	acm_output_write_( &self->output, &size, sizeof( uint16_t ) );
+	acm_output_write_( &self->output, string, length );
+}
+
+static void write_binary_head( AcmWriter *self, const char *name, AcmPropertyType type )
+{
+	int8_t t = ( int8_t ) type;
+	write_binary_string( self, name );
+	acm_output_write_( &self->output, &t, sizeof( int8_t ) );
+}
+
+static void patch_binary( AcmWriter *self, uint64_t offset, const void *buf, size_t size )
+{
+	if ( acm_output_patch_( &self->output, offset, buf, size ) )
+	{
+		return;
+	}
+
+	// only files can have been flushed, anything else is kept in memory
+	acm_output_flush_( &self->output );
+	if ( self->output.failed ||
+	     acm_fseek64( self->file, offset, SEEK_SET ) != 0 ||
+	     fwrite( buf, sizeof( uint8_t ), size, self->file ) != size ||
+	     acm_fseek64( self->file, 0, SEEK_END ) != 0 )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to fill in %zu bytes at %" PRIu64, size, offset );
+		self->hasFailed = true;
+	}
+}
+
+static void begin_binary_container( AcmWriter *self, const char *name, AcmPropertyType type, AcmPropertyType childType, AcmWriterFrame *frame )
+{
+	write_binary_head( self, name, type );
+	if ( type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		int8_t t = ( int8_t ) childType;
+		acm_output_write_( &self->output, &t, sizeof( int8_t ) );
+	}
+
+	// scalar elements are written as one block, aligned as acm_write_file would
+	size_t  typeSize = type == ACM_PROPERTY_TYPE_ARRAY ? acm_get_type_size_( childType ) : 0;
+	uint8_t flags    = typeSize > 0 ? ACM_BINARY_CONTAINER_PACKED : 0;
+
+	static const uint8_t blank[ sizeof( uint64_t ) ] = { 0 };
+	frame->headerOffset = self->output.total;
+	acm_output_write_( &self->output, blank, sizeof( uint32_t ) );
+	acm_output_write_( &self->output, &flags, sizeof( uint8_t ) );
+	acm_output_write_( &self->output, blank, sizeof( uint64_t ) );
+	frame->payloadStart = self->output.total;
+
+	if ( typeSize > 0 )
+	{
+		uint8_t padding = ( uint8_t ) ( ( typeSize - ( self->output.total + sizeof( uint8_t ) ) % typeSize ) % typeSize );
+		acm_output_write_( &self->output, &padding, sizeof( uint8_t ) );
+		acm_output_write_( &self->output, blank, padding );
+	}
+}
+
+static void end_binary_container( AcmWriter *self, const AcmWriterFrame *frame )
+{
+	uint64_t payloadSize = self->output.total - frame->payloadStart;
+	patch_binary( self, frame->headerOffset, &frame->numChildren, sizeof( uint32_t ) );
+	patch_binary( self, frame->headerOffset + sizeof( uint32_t ) + sizeof( uint8_t ), &payloadSize, sizeof( uint64_t ) );
+}
+
+/******************************************/
+/** Text **/
+
+static void write_text_head( AcmWriter *self, const char *name, AcmPropertyType type, AcmPropertyType childType, bool isElement )
+{
+	acm_output_tabs_( &self->output, self->depth );
+	if ( isElement )
+	{
+		return;
+	}
+
+	acm_output_string_( &self->output, acm_string_for_property_type_( type ) );
+	acm_output_char_( &self->output, ' ' );
+	if ( type == ACM_PROPERTY_TYPE_ARRAY )
+	{
+		acm_output_string_( &self->output, acm_string_for_property_type_( childType ) );
+		acm_output_char_( &self->output, ' ' );
+	}
+
+	acm_serialize_string_var_( name, &self->output );
+}
+
+/******************************************/
+/** Nodes **/
+
+static bool write_scalar( AcmWriter *self, const char *name, AcmPropertyType type, const void *value, const char *text )
+{
+	if ( !begin_node( self, type, &name ) )
+	{
+		return false;
+	}
+
+	bool isElement = is_element( self );
+	if ( self->fileType == ACM_FILE_TYPE_BINARY )
+	{
+		if ( !isElement )
+		{
+			write_binary_head( self, name, type );
+		}
+		acm_output_write_( &self->output, value, acm_get_type_size_( type ) );
+	}
+	else if ( isElement )
+	{
+		char str[ 64 ];
+		acm_format_value_( type, value, str, sizeof( str ) );
+		acm_output_tabs_( &self->output, self->depth );
+		acm_output_string_( &self->output, str );
+		acm_output_write_( &self->output, " \n", 2 );
+	}
+	else
+	{
+		write_text_head( self, name, type, ACM_PROPERTY_TYPE_INVALID, false );
+		acm_serialize_string_var_( text, &self->output );
+		acm_output_char_( &self->output, '\n' );
+	}
+
+	return !has_failed( self );
+}
+
+static bool begin_container( AcmWriter *self, const char *name, AcmPropertyType type, AcmPropertyType childType )
+{
+	if ( type == ACM_PROPERTY_TYPE_ARRAY && ( childType == ACM_PROPERTY_TYPE_INVALID || childType >= ACM_MAX_PROPERTY_TYPES ) )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_TYPE, "invalid array type (%d)", childType );
+		self->hasFailed = true;
+		return false;
+	}
+	else if ( self->depth == ACM_BINARY_MAX_DEPTH )
+	{
+		acm_set_error_message_( ND_ERROR_LIMIT_EXCEEDED, "nested too deeply (%u)", self->depth );
+		self->hasFailed = true;
+		return false;
+	}
+	else if ( !begin_node( self, type, &name ) )
+	{
+		return false;
+	}
+
+	bool            isElement = is_element( self );
+	AcmWriterFrame *frame     = &self->frames[ self->depth ];
+	memset( frame, 0, sizeof( AcmWriterFrame ) );
+	frame->type      = type;
+	frame->childType = childType;
+
+	if ( self->fileType == ACM_FILE_TYPE_BINARY )
+	{
+		begin_binary_container( self, name, type, childType, frame );
+	}
+	else
+	{
+		write_text_head( self, name, type, childType, isElement );
+		if ( isElement )
+		{
+			acm_output_tabs_( &self->output, self->depth );
+		}
+		acm_output_write_( &self->output, "{\n", 2 );
+	}
+
+	self->depth++;
+	return !has_failed( self );
+}
+
+static bool write_array( AcmWriter *self, const char *name, AcmPropertyType type, const void *values, unsigned int numElements )
+{
+	if ( !begin_container( self, name, ACM_PROPERTY_TYPE_ARRAY, type ) )
+	{
+		return false;
+	}
+
+	size_t typeSize = acm_get_type_size_( type );
+	if ( self->fileType == ACM_FILE_TYPE_BINARY )
+	{
+		get_parent( self )->numChildren = numElements;
+		acm_output_write_( &self->output, values, ( size_t ) numElements * typeSize );
+	}
+	else
+	{
+		const uint8_t *p = values;
+		for ( unsigned int i = 0; i < numElements && !has_failed( self ); ++i, p += typeSize )
+		{
+			write_scalar( self, NULL, type, p, NULL );
+		}
+	}
+
+	return acm_writer_end( self );
+}
+
+/******************************************/
+/** Public **/
+
+static size_t write_to_file( const void *buf, size_t size, void *user )
+{
+	return fwrite( buf, sizeof( uint8_t ), size, ( FILE * ) user );
+}
+
+static AcmWriter *create_writer( AcmFileType fileType, AcmWriteCallback write, void *user )
+{
+	AcmWriter *self = ACM_NEW( AcmWriter );
+	if ( self == NULL )
+	{
+		acm_set_error_message_( NL_ERROR_MEM_ALLOC, "failed to allocate writer" );
+		return NULL;
+	}
+
+	self->fileType = fileType;
+	if ( !acm_output_open_( &self->output, write, user ) )
+	{
+		ACM_DELETE( self );
+		return NULL;
+	}
+
+	if ( fileType == ACM_FILE_TYPE_BINARY )
+	{
+		static const uint32_t version = ACM_FORMAT_BINARY_VERSION;
+		static const uint32_t flags   = 0;
+		acm_output_string_( &self->output, ACM_FORMAT_BINARY_HEADER_2 );
+		acm_output_write_( &self->output, &version, sizeof( uint32_t ) );
+		acm_output_write_( &self->output, &flags, sizeof( uint32_t ) );
+	}
+	else
+	{
+		acm_output_string_( &self->output, ACM_FORMAT_UTF8_HEADER "\n; this node file has been auto-generated!\n" );
+	}
+
+	return self;
+}
+
+AcmWriter *acm_writer_open_file( const char *path, AcmFileType fileType )
+{
+	FILE *file = fopen( path, "wb" );
+	if ( file == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to open path \"%s\"", path );
+		return NULL;
+	}
+
+	AcmWriter *self = create_writer( fileType, write_to_file, file );
+	if ( self == NULL )
+	{
+		fclose( file );
+		return NULL;
+	}
+
+	self->file = file;
+	return self;
+}
+
+AcmWriter *acm_writer_open_sink( AcmFileType fileType, AcmWriteCallback write, void *user )
+{
+	if ( fileType == ACM_FILE_TYPE_BINARY )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "binary output needs to go to a file or memory, so container sizes can be filled in" );
+		return NULL;
+	}
+	else if ( write == NULL )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "invalid write callback" );
+		return NULL;
+	}
+
+	return create_writer( fileType, write, user );
+}
+
+AcmWriter *acm_writer_open_memory( AcmFileType fileType )
+{
+	return create_writer( fileType, NULL, NULL );
+}
+
+static bool finish_writer( AcmWriter *self )
+{
+	if ( has_failed( self ) )
+	{
+		return false;
+	}
+	else if ( !self->hasRoot || self->depth > 0 )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "document is incomplete (%u left open)", self->depth );
+		return false;
+	}
+
+	return true;
+}
+
+bool acm_writer_close( AcmWriter *self )
+{
+	bool status = finish_writer( self );
+	status      = acm_output_close_( &self->output ) && status;
+	if ( self->file != NULL && fclose( self->file ) != 0 && status )
+	{
+		acm_set_error_message_( ND_ERROR_IO_WRITE, "failed to close file" );
+		status = false;
+	}
+
+	ACM_DELETE( self );
+	return status;
+}
+
+void *acm_writer_close_memory( AcmWriter *self, size_t *size )
+{
+	void *buf = finish_writer( self ) ? acm_output_release_( &self->output, size ) : NULL;
+	acm_writer_close( self );
+	return buf;
+}
+
+bool acm_writer_begin_object( AcmWriter *self, const char *name )
+{
+	return begin_container( self, name, ACM_PROPERTY_TYPE_OBJECT, ACM_PROPERTY_TYPE_INVALID );
+}
+
+bool acm_writer_begin_array( AcmWriter *self, const char *name, AcmPropertyType childType )
+{
+	return begin_container( self, name, ACM_PROPERTY_TYPE_ARRAY, childType );
+}
+
+bool acm_writer_end( AcmWriter *self )
+{
+	if ( has_failed( self ) )
+	{
+		return false;
+	}
+	else if ( self->depth == 0 )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_ARGUMENT, "no object or array to end" );
+		self->hasFailed = true;
+		return false;
+	}
+
+	const AcmWriterFrame *frame = &self->frames[ --self->depth ];
+	if ( self->fileType == ACM_FILE_TYPE_BINARY )
+	{
+		end_binary_container( self, frame );
+	}
+	else
+	{
+		acm_output_tabs_( &self->output, self->depth );
+		acm_output_write_( &self->output, "}\n", 2 );
+	}
+
+	return !has_failed( self );
+}
+
+bool acm_writer_write_string( AcmWriter *self, const char *name, const char *value )
+{
+	if ( !begin_node( self, ACM_PROPERTY_TYPE_STRING, &name ) )
+	{
+		return false;
+	}
+
+	if ( self->fileType == ACM_FILE_TYPE_BINARY )
+	{
+		write_binary_head( self, name, ACM_PROPERTY_TYPE_STRING );
+		write_binary_string( self, value );
+	}
+	else
+	{
+		write_text_head( self, name, ACM_PROPERTY_TYPE_STRING, ACM_PROPERTY_TYPE_INVALID, is_element( self ) );
+		acm_serialize_string_var_( value, &self->output );
+		acm_output_char_( &self->output, '\n' );
+	}
+
+	return !has_failed( self );
+}
+
+bool acm_writer_write_bool( AcmWriter *self, const char *name, bool var )
+{
+	uint8_t value = var ? 1 : 0;
+	return write_scalar( self, name, ACM_PROPERTY_TYPE_BOOL, &value, var ? "true" : "false" );
+}
+
+bool acm_writer_write_i8( AcmWriter *self, const char *name, int8_t var )
+{
+	char buf[ 8 ];
+	snprintf( buf, sizeof( buf ), "%" PRId8, var );
+	return write_scalar( self, name, ND_PROPERTY_INT8, &var, buf );
+}
+
+bool acm_writer_write_ui8( AcmWriter *self, const char *name, uint8_t var )
+{
+	char buf[ 8 ];
+	snprintf( buf, sizeof( buf ), "%" PRIu8, var );
+	return write_scalar( self, name, ND_PROPERTY_UI8, &var, buf );
+}
+
+bool acm_writer_write_i16( AcmWriter *self, const char *name, int16_t var )
+{
+	char buf[ 32 ];
+	snprintf( buf, sizeof( buf ), "%" PRId16, var );
+	return write_scalar( self, name, ND_PROPERTY_INT16, &var, buf );
+}
+
+bool acm_writer_write_ui16( AcmWriter *self, const char *name, uint16_t var )
+{
+	char buf[ 32 ];
+	snprintf( buf, sizeof( buf ), "%" PRIu16, var );
+	return write_scalar( self, name, ND_PROPERTY_UI16, &var, buf );
+}
+
+bool acm_writer_write_i32( AcmWriter *self, const char *name, int32_t var )
+{
+	char buf[ 32 ];
+	snprintf( buf, sizeof( buf ), "%" PRId32, var );
+	return write_scalar( self, name, ND_PROPERTY_INT32, &var, buf );
+}
+
+bool acm_writer_write_ui32( AcmWriter *self, const char *name, uint32_t var )
+{
+	char buf[ 32 ];
+	snprintf( buf, sizeof( buf ), "%" PRIu32, var );
+	return write_scalar( self, name, ND_PROPERTY_UI32, &var, buf );
+}
+
+#ifdef ACM_SUPPORT_FLT16
+bool acm_writer_write_f16( AcmWriter *self, const char *name, _Float16 var )
+{
+	char buf[ 32 ];
+	uint16_t v;
+	memcpy( &v, &var, sizeof( uint16_t ) );
+	acm_format_value_( ACM_PROPERTY_TYPE_FLOAT16, &v, buf, sizeof( buf ) );
+	return write_scalar( self, name, ACM_PROPERTY_TYPE_FLOAT16, &var, buf );
+}
+#endif
+
+bool acm_writer_write_f32( AcmWriter *self, const char *name, float var )
+{
+	char buf[ 32 ];
+	acm_format_value_( ACM_PROPERTY_TYPE_FLOAT32, &var, buf, sizeof( buf ) );
+	return write_scalar( self, name, ACM_PROPERTY_TYPE_FLOAT32, &var, buf );
+}
+
+bool acm_writer_write_f64( AcmWriter *self, const char *name, double var )
+{
+	char buf[ 32 ];
+	acm_format_value_( ACM_PROPERTY_TYPE_FLOAT64, &var, buf, sizeof( buf ) );
+	return write_scalar( self, name, ACM_PROPERTY_TYPE_FLOAT64, &var, buf );
+}
+
+/**
+ * Writes a string or scalar given as text, as the readers provide them.
+ * Text output keeps the value as it was given, as acm_write_file would.
+ */
+bool acm_writer_write_value_( AcmWriter *self, const char *name, AcmPropertyType type, const char *value )
+{
+	if ( type == ACM_PROPERTY_TYPE_STRING )
+	{
+		return acm_writer_write_string( self, name, value );
+	}
+	else if ( has_failed( self ) )
+	{
+		return false;
+	}
+
+	uint64_t v = 0;
+	if ( acm_get_type_size_( type ) == 0 )
+	{
+		acm_set_error_message_( ND_ERROR_INVALID_TYPE, "invalid %s value (%s)", acm_string_for_property_type_( type ), value != NULL ? value : "null" );
+		self->hasFailed = true;
+		return false;
+	}
+	else if ( !acm_parse_value_( type, value, &v ) )
+	{
+		self->hasFailed = true;
+		return false;
+	}
+
+	return write_scalar( self, name, type, &v, value );
+}
+
+bool acm_writer_write_array_string( AcmWriter *self, const char *name, const char **array, unsigned int numElements )
+{
+	if ( !begin_container( self, name, ACM_PROPERTY_TYPE_ARRAY, ACM_PROPERTY_TYPE_STRING ) )
+	{
+		return false;
+	}
+
+	for ( unsigned int i = 0; i < numElements; ++i )
+	{
+		if ( !acm_writer_write_string( self, NULL, array[ i ] ) )
+		{
+			return false;
+		}
+	}
+
+	return acm_writer_end( self );
+}
+
+bool acm_writer_write_array_i16( AcmWriter *self, const char *name, const int16_t *array, unsigned int numElements )
+{
+	return write_array( self, name, ND_PROPERTY_INT16, array, numElements );
+}
+
+bool acm_writer_write_array_i32( AcmWriter *self, const char *name, const int32_t *array, unsigned int numElements )
+{
+	return write_array( self, name, ND_PROPERTY_INT32, array, numElements );
+}
+
+bool acm_writer_write_array_ui32( AcmWriter *self, const char *name, const uint32_t *array, unsigned int numElements )
+{
+	return write_array( self, name, ND_PROPERTY_UI32, array, numElements );
+}
+
+#ifdef ACM_SUPPORT_FLT16
+bool acm_writer_write_array_f16( AcmWriter *self, const char *name, const _Float16 *array, unsigned int numElements )
+{
+	return write_array( self, name, ACM_PROPERTY_TYPE_FLOAT16, array, numElements );
+}
+#endif
+
+bool acm_writer_write_array_f32( AcmWriter *self, const char *name, const float *array, unsigned int numElements )
+{
+	return write_array( self, name, ACM_PROPERTY_TYPE_FLOAT32, array, numElements );
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acm/acm.h"
+
+/* Bare bones checks for the tests, which are each a program of their own.
+ * A failed check is reported and counted, and the test carries on, so
+ * everything that's wrong shows up in one run.
+ */
+
+static unsigned int acmTestFailures = 0;
+
+#define ACM_CHECK( CONDITION )                                                                \
+	do                                                                                        \
+	{                                                                                         \
+		if ( !( CONDITION ) )                                                                 \
+		{                                                                                     \
+			fprintf( stderr, "%s:%d: check failed: %s (%s)\n", __FILE__, __LINE__, #CONDITION, \
+			         acm_get_error_message() );                                               \
+			acmTestFailures++;                                                                \
+		}                                                                                     \
+	} while ( 0 )
+
+#define ACM_TEST_RESULT() ( acmTestFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE )
+
+/* text form of the tree, for comparing them; free with ACM_DELETE */
+static char *acm_test_dump( AcmBranch *root )
+{
+	size_t size;
+	char  *buf = root != NULL ? acm_write_to_memory( root, ACM_FILE_TYPE_UTF8, ACM_WRITE_FLAG_NONE, &size ) : NULL;
+	char  *str = buf != NULL ? ACM_NEW_( char, size + 1 ) : NULL;
+	if ( str != NULL )
+	{
+		memcpy( str, buf, size );
+	}
+	ACM_DELETE( buf );
+	return str;
+}
+
+static bool acm_test_is_equal( AcmBranch *a, AcmBranch *b )
+{
+	char *x      = acm_test_dump( a );
+	char *y      = acm_test_dump( b );
+	bool  status = x != NULL && y != NULL && strcmp( x, y ) == 0;
+	ACM_DELETE( x );
+	ACM_DELETE( y );
+	return status;
+}
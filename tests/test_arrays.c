@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+
+#include <math.h>
+
+/* scalars and array elements are formatted the same way, and read back exactly */
+static void test_float_format( void )
+{
+	static const float  floats[]  = { 0.1f, 1e-7f, 3.5f, 16777216.0f, -2.5e30f };
+	static const double doubles[] = { 0.1, 1e-300, 1e300, -123456789.125 };
+
+	AcmBranch *root   = acm_push_object( NULL, "project" );
+	AcmBranch *array  = acm_push_array_f32( root, "floats", floats, 5 );
+	AcmBranch *scalar = acm_push_object( root, "scalars" );
+	for ( unsigned int i = 0; i < 5; ++i )
+	{
+		char name[ 16 ];
+		snprintf( name, sizeof( name ), "f%u", i );
+		acm_push_f32( scalar, name, floats[ i ] );
+	}
+	for ( unsigned int i = 0; i < 4; ++i )
+	{
+		char name[ 16 ];
+		snprintf( name, sizeof( name ), "d%u", i );
+		acm_push_f64( scalar, name, doubles[ i ] );
+	}
+
+	unsigned int i = 0;
+	for ( AcmBranch *element = acm_get_first_child( array ); element != NULL; element = acm_get_next_child( element ), ++i )
+	{
+		char name[ 16 ];
+		snprintf( name, sizeof( name ), "f%u", i );
+		ACM_CHECK( strcmp( acm_branch_get_value( element, NULL ), acm_branch_get_value( acm_get_child_by_name( scalar, name ), NULL ) ) == 0 );
+	}
+	ACM_CHECK( i == 5 );
+
+	char      *text = acm_test_dump( root );
+	AcmBranch *copy = text != NULL ? acm_load_from_memory( text, strlen( text ), NULL, NULL ) : NULL;
+	ACM_CHECK( copy != NULL );
+
+	AcmBranch *copyScalar = copy != NULL ? acm_get_child_by_name( copy, "scalars" ) : NULL;
+	ACM_CHECK( copyScalar != NULL );
+	for ( i = 0; i < 5 && copyScalar != NULL; ++i )
+	{
+		char name[ 16 ];
+		snprintf( name, sizeof( name ), "f%u", i );
+		ACM_CHECK( acm_get_f32( copyScalar, name, NAN ) == floats[ i ] );
+	}
+	for ( i = 0; i < 4 && copyScalar != NULL; ++i )
+	{
+		char name[ 16 ];
+		snprintf( name, sizeof( name ), "d%u", i );
+		ACM_CHECK( acm_get_f64( copyScalar, name, NAN ) == doubles[ i ] );
+	}
+
+	ACM_DELETE( text );
+	acm_branch_destroy( copy );
+	acm_branch_destroy( root );
+}
+
+/* the element branches follow the native buffer as it's pushed to and removed from */
+static void test_packed_mirror( void )
+{
+	static const int32_t values[] = { 1, 2, 3, 4 };
+
+	AcmBranch *root  = acm_push_object( NULL, "project" );
+	AcmBranch *array = acm_push_array_i32( root, "values", values, 4 );
+	ACM_CHECK( acm_get_first_child( array ) != NULL );
+
+	acm_push_i32( array, NULL, 5 );
+	acm_branch_destroy( acm_get_first_child( array ) );
+
+	unsigned int   numElements;
+	const int32_t *view = acm_branch_view_i32( array, &numElements );
+	ACM_CHECK( numElements == 4 && acm_get_num_of_children( array ) == 4 );
+
+	unsigned int i = 0;
+	for ( AcmBranch *element = acm_get_first_child( array ); element != NULL && i < numElements; element = acm_get_next_child( element ), ++i )
+	{
+		int32_t v = 0;
+		ACM_CHECK( acm_branch_get_int32( element, &v ) == ND_ERROR_SUCCESS && v == view[ i ] && v == ( int32_t ) i + 2 );
+	}
+	ACM_CHECK( i == 4 );
+
+	acm_branch_destroy( root );
+}
+
+int main( void )
+{
+	test_float_format();
+	test_packed_mirror();
+
+	return ACM_TEST_RESULT();
+}
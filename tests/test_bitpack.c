@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+#include "acm_private.h"
+
+#define MAX_VALUES 1000
+
+static uint64_t next_random( uint64_t *state )
+{
+	// xorshift64
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+/* compact output bit-packs the array, which has to come back exactly as it was; returns the size written */
+static size_t check_round_trip( const uint64_t *values, unsigned int numValues )
+{
+	AcmBranch *root  = acm_push_object( NULL, "project" );
+	AcmBranch *array = acm_push_new_branch( root, "values", ACM_PROPERTY_TYPE_ARRAY, ND_PROPERTY_UI64 );
+	ACM_CHECK( acm_push_packed_values_( array, values, numValues ) );
+
+	size_t     size;
+	void      *buf  = acm_write_to_memory( root, ACM_FILE_TYPE_BINARY, ACM_WRITE_FLAG_COMPACT, &size );
+	AcmBranch *copy = buf != NULL ? acm_load_from_memory( buf, size, NULL, NULL ) : NULL;
+	ACM_CHECK( copy != NULL );
+
+	unsigned int    numElements = 0;
+	const uint64_t *loaded      = copy != NULL ? acm_branch_view_ui64( acm_get_child_by_name( copy, "values" ), &numElements ) : NULL;
+	ACM_CHECK( loaded != NULL && numElements == numValues );
+	ACM_CHECK( loaded != NULL && memcmp( loaded, values, sizeof( uint64_t ) * numValues ) == 0 );
+
+	ACM_DELETE( buf );
+	acm_branch_destroy( copy );
+	acm_branch_destroy( root );
+	return size;
+}
+
+/**
+ * Every width, at lengths either side of the batches they're decoded in,
+ * and of the last few bytes, which are read differently to the rest.
+ */
+static void test_widths( void )
+{
+	static const unsigned int lengths[] = { 8, 9, 15, 63, 64, 65, 255, 256, 257, 300, MAX_VALUES };
+
+	uint64_t  state = 0x9E3779B97F4A7C15ULL;
+	uint64_t *values = ACM_NEW_( uint64_t, MAX_VALUES );
+	ACM_CHECK( values != NULL );
+	for ( unsigned int bitWidth = 0; values != NULL && bitWidth <= 64; ++bitWidth )
+	{
+		uint64_t mask = bitWidth > 0 ? UINT64_MAX >> ( 64 - bitWidth ) : 0;
+		for ( unsigned int i = 0; i < sizeof( lengths ) / sizeof( *lengths ); ++i )
+		{
+			// offsets from an arbitrary base, with the widest one there is
+			uint64_t base = bitWidth < 64 ? next_random( &state ) >> bitWidth : 0;
+			for ( unsigned int j = 0; j < lengths[ i ]; ++j )
+			{
+				values[ j ] = base + ( next_random( &state ) & mask );
+			}
+			values[ lengths[ i ] / 2 ] = base + mask;
+			size_t size                = check_round_trip( values, lengths[ i ] );
+			ACM_CHECK( bitWidth > 32 || size < lengths[ i ] * 5 + 64 );
+
+			// and increasing, so the steps between them are packed
+			uint64_t v = next_random( &state );
+			for ( unsigned int j = 0; j < lengths[ i ]; ++j )
+			{
+				v += 1000 + ( next_random( &state ) & mask & 0xFFFFFFFF );
+				values[ j ] = v;
+			}
+			check_round_trip( values, lengths[ i ] );
+		}
+	}
+
+	ACM_DELETE( values );
+}
+
+int main( void )
+{
+	test_widths();
+
+	return ACM_TEST_RESULT();
+}
@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+
+#define MAX_BRANCHES 4096
+
+static uint64_t state = 0x2545F4914F6CDD1DULL;
+
+static unsigned int next_random( unsigned int range )
+{
+	// xorshift64
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return ( unsigned int ) ( state % range );
+}
+
+static unsigned int collect_branches( AcmBranch *self, AcmBranch **branches, unsigned int numBranches )
+{
+	for ( AcmBranch *child = acm_get_first_child( self ); child != NULL && numBranches < MAX_BRANCHES; child = acm_get_next_child( child ) )
+	{
+		branches[ numBranches++ ] = child;
+		AcmPropertyType type      = acm_branch_get_type( child );
+		if ( type == ACM_PROPERTY_TYPE_OBJECT || type == ACM_PROPERTY_TYPE_ARRAY )
+		{
+			numBranches = collect_branches( child, branches, numBranches );
+		}
+	}
+
+	return numBranches;
+}
+
+/* adds, removes or changes something, somewhere in the tree */
+static void mutate( AcmBranch *root )
+{
+	static AcmBranch *branches[ MAX_BRANCHES ];
+	unsigned int      numBranches = collect_branches( root, branches, 0 );
+	AcmBranch        *branch      = numBranches > 0 ? branches[ next_random( numBranches ) ] : root;
+	AcmBranch        *parent      = acm_get_parent( branch );
+	AcmPropertyType   type        = acm_branch_get_type( branch );
+
+	char value[ 16 ];
+	snprintf( value, sizeof( value ), "%u", next_random( 1000 ) );
+	switch ( next_random( 4 ) )
+	{
+		case 0:
+			if ( parent != NULL && numBranches > 8 )
+			{
+				acm_branch_destroy( branch );
+				break;
+			}
+			// fall through, so the tree can't empty out
+		case 1:
+			if ( type == ACM_PROPERTY_TYPE_OBJECT )
+			{
+				char name[ 16 ];
+				snprintf( name, sizeof( name ), "n%u", next_random( 1000 ) );
+				acm_push_i32( branch, name, ( int32_t ) next_random( 1000 ) );
+			}
+			else if ( type == ACM_PROPERTY_TYPE_ARRAY && acm_get_num_of_children( branch ) > 0 &&
+			          acm_branch_get_type( acm_get_first_child( branch ) ) == ND_PROPERTY_INT32 )
+			{
+				acm_push_i32( branch, NULL, ( int32_t ) next_random( 1000 ) );
+			}
+			else if ( parent != NULL && acm_branch_get_type( parent ) == ACM_PROPERTY_TYPE_ARRAY && type == ACM_PROPERTY_TYPE_OBJECT )
+			{
+				AcmBranch *element = acm_push_object( parent, NULL );
+				acm_push_i32( element, "id", ( int32_t ) next_random( 1000 ) );
+			}
+			break;
+		case 2:
+			if ( type == ND_PROPERTY_INT32 && parent != NULL && acm_branch_get_type( parent ) == ACM_PROPERTY_TYPE_OBJECT )
+			{
+				ACM_CHECK( acm_set_variable( parent, acm_branch_get_name( branch ), value, ND_PROPERTY_INT32, false ) );
+			}
+			break;
+		default:
+			if ( type == ACM_PROPERTY_TYPE_OBJECT )
+			{
+				AcmBranch *items = acm_push_array_object( branch, "items" );
+				AcmBranch *item  = acm_push_object( items, NULL );
+				acm_push_string( item, "name", value, false );
+			}
+			break;
+	}
+}
+
+static AcmBranch *load( const char *text )
+{
+	AcmBranch *root = acm_load_from_memory( text, strlen( text ), NULL, NULL );
+	ACM_CHECK( root != NULL );
+	return root;
+}
+
+/* a diff that doesn't apply leaves the document as it was */
+static void check_rejected( AcmBranch *root, const void *diff, size_t size )
+{
+	char *before = acm_test_dump( root );
+	ACM_CHECK( !acm_diff_apply( root, diff, size ) );
+
+	char *after = acm_test_dump( root );
+	ACM_CHECK( before != NULL && after != NULL && strcmp( before, after ) == 0 );
+	ACM_DELETE( before );
+	ACM_DELETE( after );
+}
+
+/**
+ * One copy is changed a bit at a time, and after each change the other is
+ * diffed against it and has the diff applied, which has to make them equal.
+ * Both keep their hashes between rounds, so only what's changed is visited.
+ */
+static void test_diff_apply( void )
+{
+	static const char *text = "node.utf8\n"
+	                          "object project {\n"
+	                          "\tstring name \"diff\"\n"
+	                          "\tint32 version 1\n"
+	                          "\tarray int32 list { 1 2 3 4 5 }\n"
+	                          "\tobject settings { int32 width 640 int32 height 480 object audio { int32 volume 10 } }\n"
+	                          "\tarray object rows {\n"
+	                          "\t\t{ int32 id 1 string kind \"a\" }\n"
+	                          "\t\t{ int32 id 2 string kind \"b\" }\n"
+	                          "\t\t{ int32 id 3 string kind \"c\" }\n"
+	                          "\t}\n"
+	                          "}\n";
+
+	AcmBranch *from = load( text );
+	AcmBranch *to   = load( text );
+	if ( from == NULL || to == NULL )
+	{
+		return;
+	}
+
+	unsigned int numChanged = 0;
+	for ( unsigned int round = 0; round < 200; ++round )
+	{
+		unsigned int numChanges = 1 + next_random( 4 );
+		for ( unsigned int i = 0; i < numChanges; ++i )
+		{
+			mutate( to );
+		}
+		numChanged += acm_test_is_equal( from, to ) ? 0 : 1;
+
+		size_t size = 0;
+		void  *diff = acm_diff( from, to, &size );
+		ACM_CHECK( diff != NULL );
+		if ( diff == NULL )
+		{
+			break;
+		}
+
+		// a cut short diff, or one for another document, is turned away
+		if ( round % 20 == 0 )
+		{
+			check_rejected( from, diff, size - 1 );
+			if ( !acm_test_is_equal( from, to ) )
+			{
+				check_rejected( to, diff, size );
+			}
+		}
+
+		ACM_CHECK( acm_diff_apply( from, diff, size ) );
+		ACM_CHECK( acm_test_is_equal( from, to ) );
+		ACM_DELETE( diff );
+	}
+
+	// changes often pick a branch they don't apply to, but plenty of rounds still have something to diff
+	ACM_CHECK( numChanged > 80 );
+
+	// nothing left to change
+	size_t size = 0;
+	void  *diff = acm_diff( from, to, &size );
+	ACM_CHECK( diff != NULL && acm_diff_apply( from, diff, size ) );
+	ACM_CHECK( acm_test_is_equal( from, to ) );
+	ACM_DELETE( diff );
+
+	acm_branch_destroy( from );
+	acm_branch_destroy( to );
+}
+
+int main( void )
+{
+	test_diff_apply();
+
+	return ACM_TEST_RESULT();
+}
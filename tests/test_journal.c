@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+
+#define JOURNAL_PATH "test_journal.binj"
+
+static AcmBranch *make_tree( void )
+{
+	AcmBranch *root  = acm_push_object( NULL, "project" );
+	AcmBranch *items = acm_push_array_object( root, "items" );
+	for ( int i = 0; i < 4; ++i )
+	{
+		AcmBranch *item = acm_push_object( items, NULL );
+		acm_push_i32( item, "id", i );
+		acm_push_string( item, "name", "item", false );
+	}
+	acm_push_string( root, "title", "test", false );
+	return root;
+}
+
+/* commit, close and reopen, then check it comes back as the expected tree */
+static void check_reopen( AcmJournal **journal, AcmBranch **root, AcmBranch *expected )
+{
+	ACM_CHECK( acm_journal_commit( *journal ) );
+	ACM_CHECK( acm_journal_close( *journal ) );
+	acm_branch_destroy( *root );
+
+	*root    = NULL;
+	*journal = acm_journal_open( JOURNAL_PATH, root );
+	ACM_CHECK( *journal != NULL );
+	ACM_CHECK( acm_test_is_equal( *root, expected ) );
+}
+
+static void test_commit_reopen( void )
+{
+	AcmBranch  *root    = make_tree();
+	AcmJournal *journal = acm_journal_create( JOURNAL_PATH, root );
+	ACM_CHECK( journal != NULL );
+
+	AcmBranch *expected = make_tree();
+	acm_push_i32( acm_get_child_by_path( expected, "items.1" ), "count", 7 );
+	acm_push_string( expected, "extra", "added", false );
+
+	acm_push_i32( acm_get_child_by_path( root, "items.1" ), "count", 7 );
+	acm_push_string( root, "extra", "added", false );
+	check_reopen( &journal, &root, expected );
+
+	acm_journal_close( journal );
+	acm_branch_destroy( root );
+	acm_branch_destroy( expected );
+}
+
+/* a branch a diff inserts between siblings has to stay an insert in the log,
+ * rather than replacing whatever was at its index before */
+static void test_diff_insert_reopen( void )
+{
+	AcmBranch  *root    = make_tree();
+	AcmJournal *journal = acm_journal_create( JOURNAL_PATH, root );
+	ACM_CHECK( journal != NULL );
+
+	AcmBranch *expected = acm_parse_buffer( "object project {\n"
+	                                        "\tarray object items {\n"
+	                                        "\t\t{ int32 id 0 string name \"item\" }\n"
+	                                        "\t\t{ int32 id 9 string name \"new\" }\n"
+	                                        "\t\t{ int32 id 1 string name \"item\" }\n"
+	                                        "\t\t{ int32 id 2 string name \"item\" }\n"
+	                                        "\t\t{ int32 id 3 string name \"item\" }\n"
+	                                        "\t}\n"
+	                                        "\tstring title \"test\"\n"
+	                                        "}\n",
+	                                        NULL );
+	ACM_CHECK( expected != NULL );
+
+	size_t size;
+	void  *diff = acm_diff( root, expected, &size );
+	ACM_CHECK( diff != NULL );
+	ACM_CHECK( acm_diff_apply( root, diff, size ) );
+	ACM_CHECK( acm_test_is_equal( root, expected ) );
+	ACM_DELETE( diff );
+
+	check_reopen( &journal, &root, expected );
+
+	ACM_CHECK( acm_get_num_of_children( acm_get_child_by_name( root, "items" ) ) == 5 );
+	ACM_CHECK( acm_get_int( acm_get_child_by_path( root, "items.1" ), "id", -1 ) == 9 );
+
+	acm_journal_close( journal );
+	acm_branch_destroy( root );
+	acm_branch_destroy( expected );
+}
+
+int main( void )
+{
+	test_commit_reopen();
+	test_diff_insert_reopen();
+
+	remove( JOURNAL_PATH );
+	return ACM_TEST_RESULT();
+}
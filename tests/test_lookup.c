@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+#include "acm_private.h"
+
+#define NUM_ELEMENTS 6
+
+static uint8_t buf[ 512 ];
+static size_t  bufSize;
+
+static void put( const void *src, size_t size )
+{
+	memcpy( buf + bufSize, src, size );
+	bufSize += size;
+}
+
+static void put_head( const char *name, AcmPropertyType type )
+{
+	// names keep their terminator, and elements have none
+	uint16_t length = ( uint16_t ) ( name != NULL ? strlen( name ) + 1 : 0 );
+	int8_t   t      = ( int8_t ) type;
+	put( &length, sizeof( uint16_t ) );
+	put( name, length );
+	put( &t, sizeof( int8_t ) );
+}
+
+static void put_container( uint32_t numChildren, uint64_t payloadSize )
+{
+	uint8_t flags = 0;
+	put( &numChildren, sizeof( uint32_t ) );
+	put( &flags, sizeof( uint8_t ) );
+	put( &payloadSize, sizeof( uint64_t ) );
+}
+
+/**
+ * Scalar arrays used to be written an element at a time, rather than as a
+ * block, and the name of one of the elements is given, as nothing stops a
+ * writer from doing so.
+ */
+static bool write_unpacked_array( const char *path, int namedElement )
+{
+	size_t elementSize = sizeof( uint16_t ) + sizeof( int8_t ) + sizeof( int32_t );
+	size_t payloadSize = NUM_ELEMENTS * elementSize + ( namedElement >= 0 ? sizeof( "x" ) : 0 );
+
+	uint32_t version = 3, flags = 0;
+	bufSize          = 0;
+	put( ACM_FORMAT_BINARY_HEADER_2, strlen( ACM_FORMAT_BINARY_HEADER_2 ) );
+	put( &version, sizeof( uint32_t ) );
+	put( &flags, sizeof( uint32_t ) );
+
+	put_head( "project", ACM_PROPERTY_TYPE_OBJECT );
+	put_container( 1, 0 );
+	size_t rootPayload = bufSize;
+
+	int8_t childType = ND_PROPERTY_INT32;
+	put_head( "values", ACM_PROPERTY_TYPE_ARRAY );
+	put( &childType, sizeof( int8_t ) );
+	put_container( NUM_ELEMENTS, payloadSize );
+
+	for ( int i = 0; i < NUM_ELEMENTS; ++i )
+	{
+		int32_t value = i * 10;
+		put_head( i == namedElement ? "x" : NULL, ND_PROPERTY_INT32 );
+		put( &value, sizeof( int32_t ) );
+	}
+
+	// the root's payload size goes in once it's known
+	uint64_t rootSize = bufSize - rootPayload;
+	memcpy( buf + rootPayload - sizeof( uint64_t ), &rootSize, sizeof( uint64_t ) );
+
+	FILE *file = fopen( path, "wb" );
+	if ( file == NULL )
+	{
+		return false;
+	}
+
+	bool status = fwrite( buf, sizeof( uint8_t ), bufSize, file ) == bufSize;
+	return fclose( file ) == 0 && status;
+}
+
+/* elements are looked up at a fixed stride when they're all the same size, and walked otherwise */
+static void test_unpacked_elements( void )
+{
+	static const int namedElements[] = { -1, 0, 2 };
+	for ( unsigned int i = 0; i < sizeof( namedElements ) / sizeof( *namedElements ); ++i )
+	{
+		ACM_CHECK( write_unpacked_array( "lookup.bin", namedElements[ i ] ) );
+
+		for ( int j = 0; j < NUM_ELEMENTS; ++j )
+		{
+			char path[ 32 ];
+			snprintf( path, sizeof( path ), "values.%d", j );
+
+			int32_t    value  = -1;
+			AcmBranch *branch = acm_load_file_branch( "lookup.bin", path );
+			ACM_CHECK( branch != NULL );
+			ACM_CHECK( branch != NULL && acm_branch_get_int32( branch, &value ) == ND_ERROR_SUCCESS && value == j * 10 );
+			acm_branch_destroy( branch );
+		}
+	}
+}
+
+int main( void )
+{
+	test_unpacked_elements();
+
+	return ACM_TEST_RESULT();
+}
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+#include "acm_private.h"
+
+#include <math.h>
+
+#define NUM_VALUES 1000
+
+/* writes the array out with the given flags and reads it back, returning the size it took */
+static size_t round_trip( AcmBranch *root, unsigned int flags, AcmBranch **copy )
+{
+	size_t size = 0;
+	void  *buf  = acm_write_to_memory( root, ACM_FILE_TYPE_BINARY, flags, &size );
+	ACM_CHECK( buf != NULL );
+
+	*copy = buf != NULL ? acm_load_from_memory( buf, size, NULL, NULL ) : NULL;
+	ACM_CHECK( *copy != NULL );
+
+	ACM_DELETE( buf );
+	return size;
+}
+
+static double get_max_error( const float *values, AcmBranch *copy )
+{
+	unsigned int numElements = 0;
+	const float *loaded      = acm_branch_view_f32( acm_get_child_by_name( copy, "values" ), &numElements );
+	ACM_CHECK( loaded != NULL && numElements == NUM_VALUES );
+
+	double maxError = 0.0;
+	for ( unsigned int i = 0; loaded != NULL && i < numElements; ++i )
+	{
+		double error = fabs( ( double ) loaded[ i ] - values[ i ] );
+		maxError     = error > maxError ? error : maxError;
+	}
+
+	return maxError;
+}
+
+/* a ramp from 0 to 1 is too coarse in 8 bits for the default tolerance, but not in 16 */
+static void test_tolerance( void )
+{
+	float values[ NUM_VALUES ];
+	for ( unsigned int i = 0; i < NUM_VALUES; ++i )
+	{
+		values[ i ] = ( float ) i / ( NUM_VALUES - 1 );
+	}
+
+	AcmBranch *root = acm_push_object( NULL, "project" );
+	acm_push_array_f32( root, "values", values, NUM_VALUES );
+
+	AcmBranch *copy;
+	size_t     fullSize = round_trip( root, ACM_WRITE_FLAG_NONE, &copy );
+	ACM_CHECK( get_max_error( values, copy ) == 0.0 );
+	acm_branch_destroy( copy );
+
+	size_t size = round_trip( root, ACM_WRITE_FLAG_FIXED_8, &copy );
+	ACM_CHECK( size == fullSize );
+	ACM_CHECK( get_max_error( values, copy ) == 0.0 );
+	acm_branch_destroy( copy );
+
+	size = round_trip( root, ACM_WRITE_FLAG_FIXED_8 | ACM_WRITE_FLAG_FIXED_16, &copy );
+	ACM_CHECK( size < fullSize - NUM_VALUES );
+	ACM_CHECK( get_max_error( values, copy ) <= 0.001 );
+	acm_branch_destroy( copy );
+
+	acm_set_quantization_tolerance( 0.01 );
+	size = round_trip( root, ACM_WRITE_FLAG_FIXED_8, &copy );
+	ACM_CHECK( size < fullSize - NUM_VALUES * 2 );
+	ACM_CHECK( get_max_error( values, copy ) <= 0.01 );
+	acm_branch_destroy( copy );
+	acm_set_quantization_tolerance( 0.001 );
+
+	acm_branch_destroy( root );
+}
+
+/**
+ * Half floats come back exactly as the scalar conversion would give them,
+ * however they were encoded, and anything out of their range is kept.
+ */
+static void test_half_floats( void )
+{
+	float values[ NUM_VALUES ];
+	for ( unsigned int i = 0; i < NUM_VALUES; ++i )
+	{
+		values[ i ] = ( float ) ( ( double ) i * 0.37 - 150.0 ) * ( i % 3 == 0 ? 1e-6f : 1.0f );
+	}
+	values[ 3 ]  = INFINITY;
+	values[ 4 ]  = -INFINITY;
+	values[ 5 ]  = NAN;
+	values[ 6 ]  = 6e-8f;                         // smallest half subnormal
+	values[ 7 ]  = 1.0f + 0x1.0p-11f;              // tie, rounds to even
+	values[ 8 ]  = 65504.0f;
+	values[ 9 ]  = -0.0f;
+	values[ 10 ] = 1.0f + 0x1.0p-11f + 0x1.0p-23f; // just past the tie, rounds up
+
+	AcmBranch *root = acm_push_object( NULL, "project" );
+	acm_push_array_f32( root, "values", values, NUM_VALUES );
+
+	AcmBranch *copy;
+	size_t     fullSize = round_trip( root, ACM_WRITE_FLAG_NONE, &copy );
+	acm_branch_destroy( copy );
+
+	size_t       size        = round_trip( root, ACM_WRITE_FLAG_HALF_FLOAT, &copy );
+	unsigned int numElements = 0;
+	const float *loaded      = acm_branch_view_f32( acm_get_child_by_name( copy, "values" ), &numElements );
+	ACM_CHECK( size < fullSize - NUM_VALUES );
+	ACM_CHECK( loaded != NULL && numElements == NUM_VALUES );
+	for ( unsigned int i = 0; loaded != NULL && i < numElements; ++i )
+	{
+		float    expected = acm_half_to_float_( acm_float_to_half_( values[ i ] ) );
+		uint32_t a, b;
+		memcpy( &a, &loaded[ i ], sizeof( uint32_t ) );
+		memcpy( &b, &expected, sizeof( uint32_t ) );
+		ACM_CHECK( a == b );
+	}
+	acm_branch_destroy( copy );
+
+	// one value past what a half float can hold, so it's all kept as it is
+	values[ 11 ] = 70000.0f;
+	acm_branch_destroy( root );
+	root = acm_push_object( NULL, "project" );
+	acm_push_array_f32( root, "values", values, NUM_VALUES );
+	size = round_trip( root, ACM_WRITE_FLAG_HALF_FLOAT, &copy );
+	ACM_CHECK( size == fullSize );
+	loaded = acm_branch_view_f32( acm_get_child_by_name( copy, "values" ), &numElements );
+	ACM_CHECK( loaded != NULL && memcmp( loaded, values, sizeof( values ) ) == 0 );
+	acm_branch_destroy( copy );
+
+	acm_branch_destroy( root );
+}
+
+int main( void )
+{
+	test_tolerance();
+	test_half_floats();
+
+	return ACM_TEST_RESULT();
+}
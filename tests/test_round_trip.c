@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+
+static const char *document = "node.utf8\n"
+                              "object project {\n"
+                              "\tstring name \"round trip\"\n"
+                              "\tstring empty \"\"\n"
+                              "\tbool enabled true\n"
+                              "\tint8 i8 -128\n"
+                              "\tint16 i16 -32768\n"
+                              "\tint32 i32 -2147483648\n"
+                              "\tint64 i64 -9223372036854775808\n"
+                              "\tuint8 u8 255\n"
+                              "\tuint16 u16 65535\n"
+                              "\tuint32 u32 4294967295\n"
+                              "\tuint64 u64 18446744073709551615\n"
+                              "\tfloat16 f16 -0.5\n"
+                              "\tfloat f32 0.1\n"
+                              "\tfloat64 f64 1e-300\n"
+                              "\tobject nothing {\n"
+                              "\t}\n"
+                              "\tarray int32 none {\n"
+                              "\t}\n"
+                              "\tarray float16 halves { 0.5 1.5 -2 65504 }\n"
+                              "\tarray float floats { 1.5 -0.25 3e30 }\n"
+                              "\tarray bool flags { true false true }\n"
+                              "\tarray string tags { \"a\" \"b\" \"a\" \"\" }\n"
+                              "\tarray object mixed {\n"
+                              "\t\t{ int32 id 1 }\n"
+                              "\t\t{ string id \"two\" object inner { bool deep false } }\n"
+                              "\t}\n"
+                              "}\n";
+
+/* adds what's too big to want to type out; arrays that pack and bit-pack, and rows for a table */
+static void add_large( AcmBranch *root )
+{
+	int32_t values[ 300 ];
+	for ( int i = 0; i < 300; ++i )
+	{
+		values[ i ] = 1000 + i * 3;
+	}
+	acm_push_array_i32( root, "steps", values, 300 );
+
+	AcmBranch *rows = acm_push_array_object( root, "rows" );
+	for ( int i = 0; i < 20; ++i )
+	{
+		AcmBranch *row = acm_push_object( rows, NULL );
+		acm_push_i32( row, "id", i );
+		acm_push_string( row, "kind", i % 2 ? "odd" : "even", false );
+		acm_push_f32( row, "weight", ( float ) i * 0.5f );
+	}
+}
+
+/* the same trees, in whichever order their fields were written */
+static bool is_same( AcmBranch *a, AcmBranch *b )
+{
+	uint64_t x, y;
+	return a != NULL && b != NULL && acm_hash_branch( a, &x ) && acm_hash_branch( b, &y ) && x == y;
+}
+
+/**
+ * Out to binary, back in, out to text and in again, for every mix of
+ * flags. Each step has to keep the tree the same, and writing the last
+ * one out to binary again has to give the same bytes as the first.
+ */
+static void test_flags( void )
+{
+	AcmBranch *root = acm_load_from_memory( document, strlen( document ), NULL, NULL );
+	ACM_CHECK( root != NULL );
+	if ( root == NULL )
+	{
+		return;
+	}
+	add_large( root );
+	ACM_CHECK( acm_get_num_of_children( root ) == 23 );
+
+	static const unsigned int allFlags[] = { ACM_WRITE_FLAG_COMPACT, ACM_WRITE_FLAG_COMPRESS, ACM_WRITE_FLAG_STRING_TABLE,
+	                                         ACM_WRITE_FLAG_TABLES, ACM_WRITE_FLAG_CANONICAL };
+	static const unsigned int numFlags   = sizeof( allFlags ) / sizeof( *allFlags );
+	for ( unsigned int mask = 0; mask < ( 1U << numFlags ); ++mask )
+	{
+		unsigned int flags = 0;
+		for ( unsigned int i = 0; i < numFlags; ++i )
+		{
+			flags |= ( mask & ( 1U << i ) ) ? allFlags[ i ] : 0;
+		}
+
+		size_t     binSize;
+		void      *bin  = acm_write_to_memory( root, ACM_FILE_TYPE_BINARY, flags, &binSize );
+		AcmBranch *copy = bin != NULL ? acm_load_from_memory( bin, binSize, NULL, NULL ) : NULL;
+		ACM_CHECK( is_same( root, copy ) );
+
+		// text takes the flags that apply to it
+		size_t     textSize;
+		void      *text  = copy != NULL ? acm_write_to_memory( copy, ACM_FILE_TYPE_UTF8, flags & ( ACM_WRITE_FLAG_COMPACT | ACM_WRITE_FLAG_CANONICAL ), &textSize ) : NULL;
+		AcmBranch *again = text != NULL ? acm_load_from_memory( text, textSize, NULL, NULL ) : NULL;
+		ACM_CHECK( is_same( root, again ) );
+
+		size_t againSize;
+		void  *againBin = again != NULL ? acm_write_to_memory( again, ACM_FILE_TYPE_BINARY, flags, &againSize ) : NULL;
+		ACM_CHECK( againBin != NULL && againSize == binSize && memcmp( bin, againBin, binSize ) == 0 );
+		if ( !( flags & ACM_WRITE_FLAG_CANONICAL ) )
+		{
+			// and without reordering anything along the way
+			ACM_CHECK( acm_test_is_equal( copy, again ) );
+		}
+
+		ACM_DELETE( againBin );
+		acm_branch_destroy( again );
+		ACM_DELETE( text );
+		acm_branch_destroy( copy );
+		ACM_DELETE( bin );
+
+		// mapped files are read in place, rather than copied out
+		ACM_CHECK( acm_write_file_ex( "round_trip.bin", root, ACM_FILE_TYPE_BINARY, flags ) );
+		AcmBranch *mapped = acm_load_file_mapped( "round_trip.bin", NULL );
+		ACM_CHECK( is_same( root, mapped ) );
+		acm_branch_destroy( mapped );
+	}
+
+	acm_branch_destroy( root );
+}
+
+int main( void )
+{
+	test_flags();
+
+	return ACM_TEST_RESULT();
+}
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+
+/* enough nodes for the text writer to split it between threads */
+static AcmBranch *make_tree( unsigned int numItems )
+{
+	AcmBranch *root  = acm_push_object( NULL, "project" );
+	AcmBranch *items = acm_push_array_object( root, "items" );
+	for ( unsigned int i = 0; i < numItems; ++i )
+	{
+		AcmBranch *item = acm_push_object( items, NULL );
+		acm_push_ui32( item, "id", i );
+		acm_push_string( item, "name", i % 3 ? "some name" : "", false );
+		acm_push_f32( item, "weight", ( float ) i * 0.25f );
+
+		AcmBranch *tags = acm_push_object( item, "tags" );
+		acm_push_bool( tags, "odd", i % 2 );
+	}
+	acm_push_string( root, "title", "threads", false );
+	return root;
+}
+
+static void check_same_output( unsigned int numItems )
+{
+	static const unsigned int threadCounts[] = { 0, 2, 3, 64 };
+
+	AcmBranch *root = make_tree( numItems );
+
+	acm_set_max_threads( 1 );
+	size_t expectedSize;
+	char  *expected = acm_write_to_memory( root, ACM_FILE_TYPE_UTF8, ACM_WRITE_FLAG_NONE, &expectedSize );
+	ACM_CHECK( expected != NULL );
+
+	for ( unsigned int i = 0; i < sizeof( threadCounts ) / sizeof( *threadCounts ); ++i )
+	{
+		acm_set_max_threads( threadCounts[ i ] );
+
+		size_t size;
+		char  *buf = acm_write_to_memory( root, ACM_FILE_TYPE_UTF8, ACM_WRITE_FLAG_NONE, &size );
+		ACM_CHECK( buf != NULL && expected != NULL && size == expectedSize && memcmp( buf, expected, size ) == 0 );
+		ACM_DELETE( buf );
+	}
+
+	// and it reads back as the same tree
+	AcmBranch *copy = expected != NULL ? acm_load_from_memory( expected, expectedSize, NULL, NULL ) : NULL;
+	ACM_CHECK( copy != NULL && acm_test_is_equal( root, copy ) );
+
+	acm_set_max_threads( 0 );
+	ACM_DELETE( expected );
+	acm_branch_destroy( copy );
+	acm_branch_destroy( root );
+}
+
+int main( void )
+{
+	check_same_output( 16 );
+	check_same_output( 12000 ); /* only a handful of runs */
+	check_same_output( 40000 );
+
+	return ACM_TEST_RESULT();
+}
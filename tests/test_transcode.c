@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+
+static bool write_text( const char *path, const char *text )
+{
+	FILE *file = fopen( path, "wb" );
+	if ( file == NULL )
+	{
+		return false;
+	}
+
+	bool status = fputs( "node.utf8\n", file ) >= 0 && fputs( text, file ) >= 0;
+	return fclose( file ) == 0 && status;
+}
+
+/**
+ * Transcoding the text to either format has to give the same tree as
+ * loading it, and so does going back again from the binary.
+ */
+static void check_transcode( const char *text )
+{
+	ACM_CHECK( write_text( "transcode.txt", text ) );
+
+	AcmBranch *root = acm_load_file( "transcode.txt", NULL );
+	ACM_CHECK( root != NULL );
+	if ( root == NULL )
+	{
+		return;
+	}
+
+	ACM_CHECK( acm_transcode_file( "transcode.txt", "transcode.bin", ACM_FILE_TYPE_BINARY ) );
+	ACM_CHECK( acm_transcode_file( "transcode.txt", "transcode.utf8", ACM_FILE_TYPE_UTF8 ) );
+	ACM_CHECK( acm_transcode_file( "transcode.bin", "transcode.back", ACM_FILE_TYPE_UTF8 ) );
+
+	const char *paths[] = { "transcode.bin", "transcode.utf8", "transcode.back" };
+	for ( unsigned int i = 0; i < sizeof( paths ) / sizeof( *paths ); ++i )
+	{
+		AcmBranch *copy = acm_load_file( paths[ i ], NULL );
+		ACM_CHECK( copy != NULL );
+		ACM_CHECK( copy != NULL && acm_test_is_equal( root, copy ) );
+		acm_branch_destroy( copy );
+	}
+
+	acm_branch_destroy( root );
+}
+
+static void test_valid( void )
+{
+	check_transcode( "object project {\n"
+	                 "\tstring name \"test project\"\n"
+	                 "\tbool enabled true\n"
+	                 "\tuint8 small 200\n"
+	                 "\tint64 big -9000000000\n"
+	                 "\tfloat16 half 0.5\n"
+	                 "\tfloat scale 1.25\n"
+	                 "\tfloat64 precise 3.0000001\n"
+	                 "\t; a comment { that shouldn't open anything\n"
+	                 "\t;* and one\n"
+	                 "\t   over a few lines *;\n"
+	                 "\tarray int32 list {\n"
+	                 "\t\t1\t2 3\n"
+	                 "\t\t-4\n"
+	                 "\t}\n"
+	                 "\tarray string names { \"a b\" \"c\" }\n"
+	                 "\tarray object items {\n"
+	                 "\t\t{ int32 id 1 }\n"
+	                 "\t\t{ int32 id 2 object child { string x \"y\" } }\n"
+	                 "\t}\n"
+	                 "}\n" );
+}
+
+/* whatever loading skips with a warning, transcoding has to skip as well */
+static void test_invalid( void )
+{
+	check_transcode( "object project {\n"
+	                 "\tint32 good 1\n"
+	                 "\tint32 bad 1.5\n"
+	                 "\tint8 wide 300\n"
+	                 "\tvector3 unknown 1\n"
+	                 "\tarray int16 list { 1 x 70000 2 }\n"
+	                 "\tarray object items {\n"
+	                 "\t\t{ int32 id 1 }\n"
+	                 "\t\tstray\n"
+	                 "\t\t{ int32 id 2 }\n"
+	                 "\t}\n"
+	                 "\tobject unclosed {\n"
+	                 "\t\tint32 id 3\n" );
+
+	check_transcode( "object project { int32 id 1 } object ignored { int32 id 2 }\n" );
+	check_transcode( "object project { int32 id 1 ;* never closed\n" );
+}
+
+/**
+ * Tokens longer than the transcoder reads at once; the longest string
+ * there's room for is kept, and anything longer is skipped.
+ */
+static void test_long_string( void )
+{
+	static const size_t lengths[] = { UINT16_MAX - 1, UINT16_MAX, 200000 };
+	for ( unsigned int i = 0; i < sizeof( lengths ) / sizeof( *lengths ); ++i )
+	{
+		char *text = ACM_NEW_( char, lengths[ i ] + 64 );
+		ACM_CHECK( text != NULL );
+		if ( text == NULL )
+		{
+			return;
+		}
+
+		size_t n = ( size_t ) sprintf( text, "object project {\n\tint32 id 1\n\tstring long \"" );
+		memset( text + n, 'x', lengths[ i ] );
+		strcpy( text + n + lengths[ i ], "\"\n}\n" );
+
+		AcmBranch *root = acm_parse_buffer( text, NULL );
+		ACM_CHECK( root != NULL );
+		ACM_CHECK( ( acm_get_child_by_name( root, "long" ) != NULL ) == ( lengths[ i ] < UINT16_MAX ) );
+		acm_branch_destroy( root );
+
+		check_transcode( text );
+		ACM_DELETE( text );
+	}
+}
+
+int main( void )
+{
+	test_valid();
+	test_invalid();
+	test_long_string();
+
+	return ACM_TEST_RESULT();
+}
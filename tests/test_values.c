@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+// Ape Config Markup
+// Copyright © 2020-2025 Mark E Sowden <hogsy@oldtimes-software.com>
+
+#include "acm_test.h"
+#include "acm_private.h"
+
+/* text that strtol and friends would take part of, or another reading of */
+static const char *badInts[] = { "12 ", "1.5", "1e3", "0x10", "", "2147483648", "abc" };
+
+static void test_set_variable( void )
+{
+	AcmBranch *root = acm_push_object( NULL, "project" );
+	acm_push_i32( root, "value", 5 );
+
+	for ( unsigned int i = 0; i < sizeof( badInts ) / sizeof( *badInts ); ++i )
+	{
+		ACM_CHECK( !acm_set_variable( root, "value", badInts[ i ], ND_PROPERTY_INT32, false ) );
+		ACM_CHECK( !acm_set_variable( root, "other", badInts[ i ], ND_PROPERTY_INT32, true ) );
+	}
+
+	ACM_CHECK( acm_get_int( root, "value", 0 ) == 5 );
+	ACM_CHECK( acm_get_child_by_name( root, "other" ) == NULL );
+
+	ACM_CHECK( acm_set_variable( root, "value", "-12", ND_PROPERTY_INT32, false ) );
+	ACM_CHECK( acm_get_int( root, "value", 0 ) == -12 );
+
+	acm_branch_destroy( root );
+}
+
+/* whatever the text loader keeps has to come back the same way from binary */
+static void test_parse_round_trip( void )
+{
+	AcmBranch *root = acm_parse_buffer( "object project {\n"
+	                                    "\tint8 small 300\n"
+	                                    "\tint8 fine 12\n"
+	                                    "\tarray int8 list {\n"
+	                                    "\t\t1\n"
+	                                    "\t\t300\n"
+	                                    "\t\t2\n"
+	                                    "\t}\n"
+	                                    "}\n",
+	                                    NULL );
+	ACM_CHECK( root != NULL );
+	ACM_CHECK( acm_get_child_by_name( root, "small" ) == NULL );
+	ACM_CHECK( acm_get_int( root, "fine", 0 ) == 12 );
+	ACM_CHECK( acm_get_num_of_children( acm_get_child_by_name( root, "list" ) ) == 2 );
+
+	size_t     size;
+	void      *buf  = acm_write_to_memory( root, ACM_FILE_TYPE_BINARY, ACM_WRITE_FLAG_NONE, &size );
+	AcmBranch *copy = buf != NULL ? acm_load_from_memory( buf, size, NULL, NULL ) : NULL;
+	ACM_CHECK( copy != NULL );
+	ACM_CHECK( acm_test_is_equal( root, copy ) );
+
+	ACM_DELETE( buf );
+	acm_branch_destroy( copy );
+	acm_branch_destroy( root );
+}
+
+/* a value that can't be converted fails the write, rather than going out as 0 */
+static void test_binary_write_fails( void )
+{
+	AcmBranch *root  = acm_push_object( NULL, "project" );
+	AcmBranch *value = acm_push_i32( root, "value", 123456 );
+	strcpy( value->data.buf, "1.5" );
+
+	size_t size;
+	void  *buf = acm_write_to_memory( root, ACM_FILE_TYPE_BINARY, ACM_WRITE_FLAG_NONE, &size );
+	ACM_CHECK( buf == NULL );
+	ACM_CHECK( acm_get_error() == ND_ERROR_INVALID_DATA );
+
+	ACM_DELETE( buf );
+	acm_branch_destroy( root );
+}
+
+int main( void )
+{
+	test_set_variable();
+	test_parse_round_trip();
+	test_binary_write_fails();
+
+	return ACM_TEST_RESULT();
+}